@@ -0,0 +1,225 @@
+#pragma once
+
+// Dense sampling accuracy-versus-speed profiler for alignment evaluators.
+//
+// An evaluator is anything with an Eigen::Matrix4d evaluate(double u) const member, such as
+// ifcopenshell::geometry::function_item_evaluator. Candidate evaluators are sampled and compared
+// against a reference, either the points of a reference file or a second evaluator built with
+// reference settings. Position error is the distance between the evaluated and reference locations,
+// orientation error is the angle (radians) between the evaluated and reference frames.
+// Results are written as CSV or JSON so evaluator settings can be chosen against an accuracy budget.
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	struct error_statistics
+	{
+		size_t count = 0;
+		double max = 0.0;
+		double rms = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+
+		static error_statistics from(std::vector<double> errors)
+		{
+			error_statistics stats;
+			stats.count = errors.size();
+			if (errors.empty())
+				return stats;
+
+			double sum_sq = 0.0;
+			for (auto e : errors)
+				sum_sq += e * e;
+			stats.rms = sqrt(sum_sq / errors.size());
+
+			std::sort(errors.begin(), errors.end());
+			stats.max = errors.back();
+			stats.p50 = percentile(errors, 0.50);
+			stats.p95 = percentile(errors, 0.95);
+			stats.p99 = percentile(errors, 0.99);
+			return stats;
+		}
+
+		// nearest-rank percentile of sorted values
+		static double percentile(const std::vector<double>& sorted, double p)
+		{
+			if (sorted.empty())
+				return 0.0;
+			auto rank = (size_t)ceil(p * sorted.size());
+			rank = std::clamp(rank, (size_t)1, sorted.size());
+			return sorted[rank - 1];
+		}
+	};
+
+	struct profile_result
+	{
+		std::string name;
+		size_t samples = 0;
+		double samples_per_unit = 0.0; // 0 when sampled at reference file points
+		error_statistics position;
+		error_statistics orientation;
+		double seconds_per_sample = 0.0;
+	};
+
+	// angle between two directions
+	inline double angle_between(const Eigen::Vector3d& a, const Eigen::Vector3d& b)
+	{
+		auto na = a.norm();
+		auto nb = b.norm();
+		if (na == 0.0 || nb == 0.0)
+			return 0.0;
+		return atan2(a.cross(b).norm(), a.dot(b));
+	}
+
+	// angle of the rotation taking frame a onto frame b
+	inline double angle_between(const Eigen::Matrix4d& a, const Eigen::Matrix4d& b)
+	{
+		Eigen::Matrix3d r = a.block<3, 3>(0, 0).transpose() * b.block<3, 3>(0, 0);
+		auto c = std::clamp((r.trace() - 1.0) / 2.0, -1.0, 1.0);
+		return acos(c);
+	}
+
+	namespace detail
+	{
+		// Evaluates all stations in one timed pass so the clock is not read per sample
+		template <typename Evaluator>
+		std::vector<Eigen::Matrix4d> timed_evaluate(const Evaluator& evaluator, const std::vector<double>& stations, double& seconds_per_sample)
+		{
+			std::vector<Eigen::Matrix4d> frames(stations.size());
+			auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < stations.size(); i++)
+			{
+				frames[i] = evaluator.evaluate(stations[i]);
+			}
+			auto end = std::chrono::steady_clock::now();
+			seconds_per_sample = stations.empty() ? 0.0 : std::chrono::duration<double>(end - start).count() / stations.size();
+			return frames;
+		}
+	}
+
+	// Profiles an evaluator against a table of reference points (members s, x, y, z).
+	// Reference positions are in model length units, evaluated frames are divided by length_unit before comparison.
+	// The reference orientation is taken from the chord between neighbouring reference points.
+	// mask selects the coordinates present in the reference file, e.g. (1, 1, 0) for horizontal layouts.
+	template <typename Evaluator, typename ReferencePoint>
+	profile_result profile_against_points(const std::string& name, const Evaluator& evaluator, const std::vector<ReferencePoint>& reference, double length_unit, const Eigen::Vector3d& mask = Eigen::Vector3d::Ones())
+	{
+		profile_result result;
+		result.name = name;
+		result.samples = reference.size();
+
+		std::vector<double> stations;
+		stations.reserve(reference.size());
+		for (const auto& p : reference)
+			stations.push_back(p.s);
+
+		auto frames = detail::timed_evaluate(evaluator, stations, result.seconds_per_sample);
+
+		std::vector<double> position_errors, orientation_errors;
+		position_errors.reserve(reference.size());
+		orientation_errors.reserve(reference.size());
+
+		auto location = [&mask](const ReferencePoint& p) { return Eigen::Vector3d(p.x, p.y, p.z).cwiseProduct(mask); };
+
+		for (size_t i = 0; i < reference.size(); i++)
+		{
+			Eigen::Vector3d evaluated = (frames[i].col(3).head(3) / length_unit).cwiseProduct(mask);
+			position_errors.push_back((evaluated - location(reference[i])).norm());
+
+			if (reference.size() > 1)
+			{
+				auto prev = i == 0 ? 0 : i - 1;
+				auto next = i + 1 == reference.size() ? i : i + 1;
+				Eigen::Vector3d chord = location(reference[next]) - location(reference[prev]);
+				Eigen::Vector3d tangent = frames[i].col(0).head(3).cwiseProduct(mask);
+				orientation_errors.push_back(angle_between(tangent, chord));
+			}
+		}
+
+		result.position = error_statistics::from(std::move(position_errors));
+		result.orientation = error_statistics::from(std::move(orientation_errors));
+		return result;
+	}
+
+	// Profiles a candidate evaluator against a reference evaluator sampled at samples_per_unit over [start, end].
+	// Both ends of the range are always sampled.
+	template <typename Evaluator, typename ReferenceEvaluator>
+	profile_result profile_against_evaluator(const std::string& name, const Evaluator& candidate, const ReferenceEvaluator& reference, double start, double end, double samples_per_unit, double length_unit)
+	{
+		profile_result result;
+		result.name = name;
+		result.samples_per_unit = samples_per_unit;
+
+		auto n = std::max((size_t)2, (size_t)ceil((end - start) * samples_per_unit) + 1);
+		std::vector<double> stations(n);
+		for (size_t i = 0; i < n; i++)
+			stations[i] = start + (end - start) * i / (n - 1);
+		result.samples = n;
+
+		auto frames = detail::timed_evaluate(candidate, stations, result.seconds_per_sample);
+
+		std::vector<double> position_errors, orientation_errors;
+		position_errors.reserve(n);
+		orientation_errors.reserve(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			Eigen::Matrix4d expected = reference.evaluate(stations[i]);
+			position_errors.push_back((frames[i].col(3).head(3) - expected.col(3).head(3)).norm() / length_unit);
+			orientation_errors.push_back(angle_between(frames[i], expected));
+		}
+
+		result.position = error_statistics::from(std::move(position_errors));
+		result.orientation = error_statistics::from(std::move(orientation_errors));
+		return result;
+	}
+
+	inline void write_csv(std::ostream& os, const std::vector<profile_result>& results)
+	{
+		os << "name,samples,samples_per_unit,"
+			"position_max,position_rms,position_p50,position_p95,position_p99,"
+			"orientation_max,orientation_rms,orientation_p50,orientation_p95,orientation_p99,"
+			"seconds_per_sample\n";
+		auto old_precision = os.precision(17);
+		for (const auto& r : results)
+		{
+			os << r.name << "," << r.samples << "," << r.samples_per_unit << ","
+				<< r.position.max << "," << r.position.rms << "," << r.position.p50 << "," << r.position.p95 << "," << r.position.p99 << ","
+				<< r.orientation.max << "," << r.orientation.rms << "," << r.orientation.p50 << "," << r.orientation.p95 << "," << r.orientation.p99 << ","
+				<< r.seconds_per_sample << "\n";
+		}
+		os.precision(old_precision);
+	}
+
+	inline void write_json(std::ostream& os, const std::vector<profile_result>& results)
+	{
+		auto write_stats = [&os](const char* key, const error_statistics& s)
+		{
+			os << "\"" << key << "\": {\"max\": " << s.max << ", \"rms\": " << s.rms
+				<< ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << "}";
+		};
+
+		auto old_precision = os.precision(17);
+		os << "[\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const auto& r = results[i];
+			os << "  {\"name\": \"" << r.name << "\", \"samples\": " << r.samples
+				<< ", \"samples_per_unit\": " << r.samples_per_unit << ", ";
+			write_stats("position", r.position);
+			os << ", ";
+			write_stats("orientation", r.orientation);
+			os << ", \"seconds_per_sample\": " << r.seconds_per_sample << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		os << "]\n";
+		os.precision(old_precision);
+	}
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+// Adaptive polyline tessellation of alignment curves driven by a chord deviation tolerance.
+//
+// The curve is split at the segment boundaries of all its position layers. Within each interval the chord
+// deviation of a chord spanning du stations is at most M2 * du^2 / 8, where M2 bounds |p''(u)|. M2 is derived
+// from the IFC parent curves of the segments covering the interval:
+//
+//   IfcLine                 0
+//   IfcCircle               1 / Radius
+//   IfcClothoid             |t| / A^2 at the end of the interval furthest from the inflection point
+//   other IfcSpiral         sum of the curvature terms |t|^n / |A_n|^(n + 1) of the polynomial spirals, plus
+//                           1 / |A_1| for the sine or cosine of the sine and cosine spirals
+//   IfcPolynomialCurve      bound of |y''| over the interval, for curves with CoefficientsX (0, 1)
+//
+// Horizontal and vertical bounds are added, the vertical one scaled by (1 + g^2)^1.5 for the steepest grade g
+// at the interval ends. Intervals covered by other parent curves have no closed form bound, M2 is then
+// estimated from second differences of the evaluated points with a safety factor. The cant layer of an
+// IfcSegmentedReferenceCurve only rotates the frame and does not contribute.
+//
+// Stations, tolerances and points are in the output unit of the alignment_evaluator, SI units by default.
+
+#include "AlignmentEvaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace IfcOpenShellUnitTests
+{
+	struct polyline
+	{
+		std::vector<double> stations;
+		std::vector<Eigen::Vector3d> points;
+
+		size_t size() const { return points.size(); }
+	};
+
+	class adaptive_tessellator
+	{
+	public:
+		struct interval
+		{
+			double start = 0.0;
+			double end = 0.0;
+			double second_derivative_bound = 0.0; // M2, 1/m
+			bool analytic = true; // false when M2 was estimated from samples
+			size_t chords = 1;
+
+			double step() const { return (end - start) / chords; }
+		};
+
+		// safety factor applied to the sampled estimate of M2 for parent curves without a closed form bound
+		static constexpr double estimate_safety_factor = 1.5;
+		static constexpr int estimate_samples = 32;
+
+		adaptive_tessellator(const alignment_evaluator& evaluator, double tolerance) :
+			evaluator_(evaluator),
+			tolerance_(tolerance)
+		{
+			// the cant layer does not move the axis
+			size_t first_layer = evaluator.curve()->as<Ifc4x3_add2::IfcSegmentedReferenceCurve>() ? 1 : 0;
+			const auto& layers = evaluator.layers();
+			for (size_t i = first_layer; i < layers.size(); i++)
+				position_layers_.push_back(&layers[i]);
+
+			std::set<double> breaks = { evaluator.start(), evaluator.end() };
+			for (auto layer : position_layers_)
+			{
+				for (const auto& r : layer->segments())
+				{
+					if (r.start > evaluator.start() && r.start < evaluator.end())
+						breaks.insert(r.start);
+				}
+			}
+
+			for (auto it = breaks.begin(); std::next(it) != breaks.end(); ++it)
+			{
+				interval i;
+				i.start = *it;
+				i.end = *std::next(it);
+				if (i.end - i.start <= 0.0)
+					continue;
+
+				i.analytic = bound(i.start, i.end, i.second_derivative_bound);
+				if (!i.analytic)
+					i.second_derivative_bound = estimate(i.start, i.end);
+
+				if (i.second_derivative_bound > 0.0)
+				{
+					double max_step = std::sqrt(8.0 * tolerance_ / i.second_derivative_bound);
+					i.chords = std::max((size_t)1, (size_t)std::ceil((i.end - i.start) / max_step));
+				}
+				intervals_.push_back(i);
+			}
+		}
+
+		const std::vector<interval>& intervals() const { return intervals_; }
+		double tolerance() const { return tolerance_; }
+
+		// Smallest station step of any interval, the step a uniform tessellation needs for the same tolerance
+		double min_step() const
+		{
+			double step = evaluator_.end() - evaluator_.start();
+			for (const auto& i : intervals_)
+				step = std::min(step, i.step());
+			return step;
+		}
+
+		polyline tessellate() const
+		{
+			polyline result;
+			for (const auto& i : intervals_)
+			{
+				// the end of an interval is the start of the next one
+				for (size_t k = 0; k < i.chords; k++)
+					add(result, i.start + (i.end - i.start) * k / i.chords);
+			}
+			add(result, evaluator_.end());
+			return result;
+		}
+
+	private:
+		void add(polyline& p, double u) const
+		{
+			p.stations.push_back(u);
+			p.points.push_back(evaluator_.evaluate(u).col(3).head(3));
+		}
+
+		// Sum of the closed form bounds of all position layers over [u0, u1], false if a parent curve has none
+		bool bound(double u0, double u1, double& m2) const
+		{
+			m2 = 0.0;
+			auto length_unit = evaluator_.length_unit();
+			for (size_t l = 0; l < position_layers_.size(); l++)
+			{
+				const auto& layer = *position_layers_[l];
+				if (layer.empty())
+					continue;
+				const auto& r = layer[layer.find(0.5 * (u0 + u1))];
+				auto parent = r.segment->ParentCurve();
+
+				// parent curve parameter at u, in model units
+				double t_start = measure_value(r.segment->SegmentStart());
+				double direction = measure_value(r.segment->SegmentLength()) < 0.0 ? -1.0 : 1.0;
+				auto parameter = [&](double u) { return t_start + direction * (u - r.start) / length_unit; };
+
+				double k = 0.0;
+				if (parent->as<Ifc4x3_add2::IfcLine>())
+				{
+					k = 0.0;
+				}
+				else if (auto circle = parent->as<Ifc4x3_add2::IfcCircle>())
+				{
+					k = 1.0 / (circle->Radius() * length_unit);
+				}
+				else if (auto clothoid = parent->as<Ifc4x3_add2::IfcClothoid>())
+				{
+					double a = clothoid->ClothoidConstant() * length_unit;
+					double t = std::max(std::fabs(parameter(u0)), std::fabs(parameter(u1))) * length_unit;
+					k = t / (a * a);
+				}
+				else if (auto spiral = parent->as<Ifc4x3_add2::IfcSpiral>())
+				{
+					double t = std::max(std::fabs(parameter(u0)), std::fabs(parameter(u1))) * length_unit;
+					if (!spiral_bound(spiral, t, length_unit, k))
+						return false;
+				}
+				else if (auto polynomial = parent->as<Ifc4x3_add2::IfcPolynomialCurve>())
+				{
+					auto cx = polynomial->CoefficientsX();
+					auto cy = polynomial->CoefficientsY();
+					if (!cy || (cx && *cx != std::vector<double>{ 0.0, 1.0 }))
+						return false;
+
+					// |y''| <= sum k (k - 1) |a_k| |x|^(k - 2), model units
+					double x = std::max(std::fabs(parameter(u0)), std::fabs(parameter(u1)));
+					for (size_t n = 2; n < cy->size(); n++)
+						k += n * (n - 1) * std::fabs((*cy)[n]) * std::pow(x, (double)n - 2);
+					k /= length_unit;
+				}
+				else
+				{
+					return false;
+				}
+
+				// the outermost position layer of a gradient curve is the vertical profile, its parameter is the
+				// horizontal distance so the curvature is scaled by the grade
+				bool vertical = l == 0 && position_layers_.size() > 1;
+				if (vertical && k > 0.0)
+				{
+					double g = std::max(grade(u0), grade(u1));
+					k *= std::pow(1.0 + g * g, 1.5);
+				}
+				m2 += k;
+			}
+			return true;
+		}
+
+		// Bound of the curvature of a spiral other than IfcClothoid at parameters up to t, output units. The
+		// polynomial spirals have the curvature terms t^n / A_n^(n + 1) with the sign of A_n, the sine and cosine
+		// spirals add the sine or cosine divided by A_1 to the constant and linear terms.
+		static bool spiral_bound(const Ifc4x3_add2::IfcSpiral* spiral, double t, double length_unit, double& k)
+		{
+			k = 0.0;
+			auto term = [&k, t, length_unit](const boost::optional<double>& a, int n)
+			{
+				if (a && *a != 0.0)
+					k += std::pow(t, n) / std::pow(std::fabs(*a) * length_unit, n + 1);
+			};
+
+			if (auto cosine = spiral->as<Ifc4x3_add2::IfcCosineSpiral>())
+			{
+				term(cosine->CosineTerm(), 0);
+				term(cosine->ConstantTerm(), 0);
+			}
+			else if (auto sine = spiral->as<Ifc4x3_add2::IfcSineSpiral>())
+			{
+				term(sine->SineTerm(), 0);
+				term(sine->LinearTerm(), 1);
+				term(sine->ConstantTerm(), 0);
+			}
+			else if (auto second = spiral->as<Ifc4x3_add2::IfcSecondOrderPolynomialSpiral>())
+			{
+				term(second->QuadraticTerm(), 2);
+				term(second->LinearTerm(), 1);
+				term(second->ConstantTerm(), 0);
+			}
+			else if (auto third = spiral->as<Ifc4x3_add2::IfcThirdOrderPolynomialSpiral>())
+			{
+				term(third->CubicTerm(), 3);
+				term(third->QuadraticTerm(), 2);
+				term(third->LinearTerm(), 1);
+				term(third->ConstantTerm(), 0);
+			}
+			else if (auto seventh = spiral->as<Ifc4x3_add2::IfcSeventhOrderPolynomialSpiral>())
+			{
+				term(seventh->SepticTerm(), 7);
+				term(seventh->SexticTerm(), 6);
+				term(seventh->QuinticTerm(), 5);
+				term(seventh->QuarticTerm(), 4);
+				term(seventh->CubicTerm(), 3);
+				term(seventh->QuadraticTerm(), 2);
+				term(seventh->LinearTerm(), 1);
+				term(seventh->ConstantTerm(), 0);
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		double grade(double u) const
+		{
+			Eigen::Vector3d t = evaluator_.evaluate(u).col(0).head(3);
+			double h = t.head(2).norm();
+			return h > 0.0 ? std::fabs(t(2)) / h : 0.0;
+		}
+
+		// M2 from second differences of evaluated points
+		double estimate(double u0, double u1) const
+		{
+			double h = (u1 - u0) / estimate_samples;
+			double m2 = 0.0;
+			Eigen::Vector3d p0 = evaluator_.evaluate(u0).col(3).head(3);
+			Eigen::Vector3d p1 = evaluator_.evaluate(u0 + h).col(3).head(3);
+			for (int i = 2; i <= estimate_samples; i++)
+			{
+				Eigen::Vector3d p2 = evaluator_.evaluate(u0 + h * i).col(3).head(3);
+				m2 = std::max(m2, (p2 - 2.0 * p1 + p0).norm() / (h * h));
+				p0 = p1;
+				p1 = p2;
+			}
+			return m2 * estimate_safety_factor;
+		}
+
+		const alignment_evaluator& evaluator_;
+		double tolerance_;
+		std::vector<const segment_table*> position_layers_;
+		std::vector<interval> intervals_;
+	};
+
+	// Tessellation with a fixed station step, the last chord may be shorter
+	inline polyline tessellate_uniform(const alignment_evaluator& evaluator, double step)
+	{
+		polyline result;
+		auto n = (size_t)std::ceil((evaluator.end() - evaluator.start()) / step);
+		for (size_t i = 0; i <= n; i++)
+		{
+			double u = std::min(evaluator.start() + step * i, evaluator.end());
+			result.stations.push_back(u);
+			result.points.push_back(evaluator.evaluate(u).col(3).head(3));
+		}
+		return result;
+	}
+
+	// Largest distance between the curve and the chords of p, sampled at the given number of points per chord
+	inline double max_chord_deviation(const alignment_evaluator& evaluator, const polyline& p, int samples_per_chord = 8)
+	{
+		double deviation = 0.0;
+		for (size_t i = 0; i + 1 < p.size(); i++)
+		{
+			Eigen::Vector3d a = p.points[i];
+			Eigen::Vector3d ab = p.points[i + 1] - a;
+			double ab2 = ab.squaredNorm();
+			for (int k = 1; k < samples_per_chord; k++)
+			{
+				double u = p.stations[i] + (p.stations[i + 1] - p.stations[i]) * k / samples_per_chord;
+				Eigen::Vector3d q = evaluator.evaluate(u).col(3).head(3);
+				double t = ab2 > 0.0 ? std::clamp((q - a).dot(ab) / ab2, 0.0, 1.0) : 0.0;
+				deviation = std::max(deviation, (q - (a + t * ab)).norm());
+			}
+		}
+		return deviation;
+	}
+}
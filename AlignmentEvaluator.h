@@ -0,0 +1,211 @@
+#pragma once
+
+// Evaluation of alignment curves through the IfcOpenShell mapping, with instrumentation.
+//
+// alignment_evaluator pairs a function_item_evaluator with the segment tables of the curve it was mapped from.
+// alignment_cache maps each curve of a file once and hands out the cached evaluator on later requests.
+//
+// The mapped function_item is parameterized and evaluated in SI units. An evaluator can instead work in a target
+// output unit, e.g. feet for the FHWA example, so consumers do not divide every result by the length unit. The
+// scale factors are computed once at construction and applied inside evaluate(), distances along, segment tables
+// and frames are all in the output unit. The function_item built by IfcOpenShell stays in SI units, so evaluate()
+// still scales the distance along and the origin of every frame it returns in another unit; the records of a
+// compiled_alignment are fitted in the output unit and evaluate without it.
+//
+// Threads: the curve, function_item tree, segment tables and scale factors of an alignment_evaluator are set at
+// construction and only read afterwards. The function_item_evaluator of IfcOpenShell keeps evaluation state, so an
+// alignment_evaluator is evaluated from one thread. Other threads create an evaluation_cursor each, which shares
+// the read-only data and owns its function_item_evaluator. alignment_cache::get may be called concurrently.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+#include <ifcgeom/function_item_evaluator.h>
+
+#include "AlignmentSegments.h"
+#include "Instrumentation.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace IfcOpenShellUnitTests
+{
+	// Output units of alignment evaluators, the length of one output unit in metres
+	namespace units
+	{
+		constexpr double metre = 1.0;
+		constexpr double millimetre = 0.001;
+		constexpr double foot = 0.3048;
+		constexpr double model = 0.0; // the length unit of the file
+	}
+
+	class alignment_evaluator
+	{
+	public:
+		alignment_evaluator(const ifcopenshell::geometry::Settings& settings, const Ifc4x3_add2::IfcCurve* curve, ifcopenshell::geometry::taxonomy::function_item::ptr fn, double length_unit, double output_unit = units::metre) :
+			settings_(settings),
+			curve_(curve),
+			fn_(fn),
+			output_unit_(output_unit == units::model ? length_unit : output_unit),
+			scale_(1.0 / output_unit_),
+			length_unit_(length_unit * scale_),
+			evaluator_(std::make_unique<ifcopenshell::geometry::function_item_evaluator>(settings, fn)),
+			node_type_(instrumentation::node_type(*fn))
+		{
+			if (auto cc = curve->as<Ifc4x3_add2::IfcCompositeCurve>())
+				layers_ = segment_layers(cc, length_unit_);
+		}
+
+		alignment_evaluator(const alignment_evaluator&) = delete;
+		alignment_evaluator& operator=(const alignment_evaluator&) = delete;
+
+		// Frame at distance along u, output units
+		Eigen::Matrix4d evaluate(double u) const
+		{
+			return evaluate(*evaluator_, u);
+		}
+
+		// Frame at distance along u evaluated with evaluator, which must be created over function()
+		Eigen::Matrix4d evaluate(const ifcopenshell::geometry::function_item_evaluator& evaluator, double u) const
+		{
+			IFCOS_UT_TIMER(timer, node_type_);
+			if (instrumentation::enabled())
+			{
+				// an evaluation counts once for every layer it touches, e.g. a vertical and a horizontal segment for a gradient curve,
+				// and its time for the curve type of each of these segments.
+				// The segments are searched for the detail only, the function searches its own and these are not counted.
+				for (const auto& layer : layers_)
+				{
+					if (!layer.empty())
+					{
+						const auto& curve_type = layer[layer.find(u)].curve_type;
+						IFCOS_UT_COUNT_DETAIL(evaluations, curve_type);
+						IFCOS_UT_TIME_ALSO(timer, curve_type);
+					}
+				}
+			}
+			if (scale_ == 1.0)
+				return evaluator.evaluate(u);
+			Eigen::Matrix4d m = evaluator.evaluate(u * output_unit_);
+			m.col(3).head(3) *= scale_;
+			return m;
+		}
+
+		double start() const { return fn_->start() * scale_; }
+		double end() const { return fn_->end() * scale_; }
+
+		// length of a model unit in output units, the factor for distances read from the file
+		double length_unit() const { return length_unit_; }
+		// length of an output unit in metres
+		double output_unit() const { return output_unit_; }
+
+		const ifcopenshell::geometry::Settings& settings() const { return settings_; }
+		const Ifc4x3_add2::IfcCurve* curve() const { return curve_; }
+		const ifcopenshell::geometry::taxonomy::function_item::ptr& function() const { return fn_; }
+		const ifcopenshell::geometry::function_item_evaluator& evaluator() const { return *evaluator_; }
+
+		// segment tables, outermost layer first, see segment_layers()
+		const std::vector<segment_table>& layers() const { return layers_; }
+
+	private:
+		const ifcopenshell::geometry::Settings& settings_;
+		const Ifc4x3_add2::IfcCurve* curve_;
+		ifcopenshell::geometry::taxonomy::function_item::ptr fn_;
+		double output_unit_;
+		double scale_;
+		double length_unit_;
+		std::unique_ptr<ifcopenshell::geometry::function_item_evaluator> evaluator_;
+		std::vector<segment_table> layers_;
+		std::string node_type_;
+	};
+
+	// Evaluation state for one thread over the shared, read-only data of an alignment_evaluator.
+	// Results are bit-identical to alignment_evaluator::evaluate.
+	class evaluation_cursor
+	{
+	public:
+		explicit evaluation_cursor(const alignment_evaluator& shared) :
+			shared_(&shared),
+			evaluator_(std::make_unique<ifcopenshell::geometry::function_item_evaluator>(shared.settings(), shared.function()))
+		{
+			IFCOS_UT_COUNT_DETAIL(allocations, "evaluation_cursor");
+		}
+
+		evaluation_cursor(evaluation_cursor&&) = default;
+		evaluation_cursor& operator=(evaluation_cursor&&) = default;
+
+		Eigen::Matrix4d evaluate(double u) const { return shared_->evaluate(*evaluator_, u); }
+
+		const alignment_evaluator& shared() const { return *shared_; }
+
+	private:
+		const alignment_evaluator* shared_;
+		std::unique_ptr<ifcopenshell::geometry::function_item_evaluator> evaluator_;
+	};
+
+	class alignment_cache
+	{
+	public:
+		// Evaluators and resolved placements are in output_unit, see units
+		alignment_cache(IfcParse::IfcFile& file, ifcopenshell::geometry::Settings& settings, double output_unit = units::metre) :
+			settings_(settings),
+			mapping_(ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings))
+		{
+			model_unit_ = mapping_->get_length_unit();
+			output_unit_ = output_unit == units::model ? model_unit_ : output_unit;
+			length_unit_ = model_unit_ / output_unit_;
+		}
+
+		alignment_cache(const alignment_cache&) = delete;
+		alignment_cache& operator=(const alignment_cache&) = delete;
+
+		// Evaluator for a curve, mapping the curve on first use. Evaluators are never removed, so the reference stays valid.
+		const alignment_evaluator& get(const Ifc4x3_add2::IfcCurve* curve)
+		{
+			const std::string& type = curve->declaration().name();
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			auto it = cache_.find(curve);
+			if (it != cache_.end())
+			{
+				IFCOS_UT_COUNT_DETAIL(cache_hits, type);
+				return *it->second;
+			}
+			IFCOS_UT_COUNT_DETAIL(cache_misses, type);
+
+			IFCOS_UT_COUNT_DETAIL(mappings, type);
+			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping_->map(curve));
+
+			IFCOS_UT_COUNT_DETAIL(allocations, "alignment_evaluator");
+			auto& evaluator = cache_[curve];
+			evaluator = std::make_unique<alignment_evaluator>(settings_, curve, fn, model_unit_, output_unit_);
+			return *evaluator;
+		}
+
+		// length of a model unit in output units
+		double length_unit() const { return length_unit_; }
+		// length of an output unit in metres
+		double output_unit() const { return output_unit_; }
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return cache_.size();
+		}
+
+		ifcopenshell::geometry::abstract_mapping& mapping() { return *mapping_; }
+		const ifcopenshell::geometry::Settings& settings() const { return settings_; }
+
+	private:
+		ifcopenshell::geometry::Settings& settings_;
+		std::unique_ptr<ifcopenshell::geometry::abstract_mapping> mapping_;
+		double model_unit_;
+		double output_unit_;
+		double length_unit_;
+		mutable std::mutex mutex_;
+		std::map<const Ifc4x3_add2::IfcCurve*, std::unique_ptr<alignment_evaluator>> cache_;
+	};
+}
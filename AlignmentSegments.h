@@ -0,0 +1,116 @@
+#pragma once
+
+// Segment tables for alignment curves.
+//
+// The mapped function_item of an IfcCompositeCurve, IfcGradientCurve or IfcSegmentedReferenceCurve is
+// parameterized by distance along in SI units. A segment_table lists the IfcCurveSegments of one curve with
+// their start distance and length in the same units so a distance along can be located in a segment. The length_unit
+// argument converts model units to the units of the table, metres per model unit for SI units.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	// Returns the numeric value of an IfcCurveMeasureSelect, or 0.0 if it is not set
+	inline double measure_value(const IfcUtil::IfcBaseClass* measure)
+	{
+		if (measure == nullptr)
+			return 0.0;
+		if (auto v = measure->as<Ifc4x3_add2::IfcLengthMeasure>())
+			return *v;
+		if (auto v = measure->as<Ifc4x3_add2::IfcNonNegativeLengthMeasure>())
+			return *v;
+		if (auto v = measure->as<Ifc4x3_add2::IfcPositiveLengthMeasure>())
+			return *v;
+		if (auto v = measure->as<Ifc4x3_add2::IfcParameterValue>())
+			return *v;
+		return 0.0;
+	}
+
+	struct segment_record
+	{
+		double start = 0.0;  // distance along at the start of the segment, model units times length_unit
+		double length = 0.0; // length of the segment, model units times length_unit, always positive
+		std::string curve_type; // entity name of the parent curve, e.g. IfcClothoid
+		const Ifc4x3_add2::IfcCurveSegment* segment = nullptr;
+
+		double end() const { return start + length; }
+	};
+
+	class segment_table
+	{
+	public:
+		segment_table() = default;
+
+		segment_table(const Ifc4x3_add2::IfcCompositeCurve* curve, double length_unit)
+		{
+			double start = 0.0;
+			auto segments = curve->Segments();
+			for (auto& s : *segments)
+			{
+				auto cs = s->as<Ifc4x3_add2::IfcCurveSegment>();
+				if (cs == nullptr)
+					continue;
+
+				segment_record r;
+				r.start = start;
+				r.length = fabs(measure_value(cs->SegmentLength())) * length_unit;
+				r.curve_type = cs->ParentCurve()->declaration().name();
+				r.segment = cs;
+				records_.push_back(r);
+
+				start += r.length;
+			}
+		}
+
+		const std::vector<segment_record>& segments() const { return records_; }
+		size_t size() const { return records_.size(); }
+		bool empty() const { return records_.empty(); }
+		const segment_record& operator[](size_t i) const { return records_[i]; }
+
+		double length() const { return records_.empty() ? 0.0 : records_.back().end(); }
+
+		// Index of the segment containing distance along u. Distances before the first or beyond the last
+		// segment are assigned to the first and last segment. Must not be called on an empty table.
+		size_t find(double u) const
+		{
+			auto it = std::upper_bound(records_.begin(), records_.end(), u, [](double v, const segment_record& r) { return v < r.start; });
+			if (it == records_.begin())
+				return 0;
+			return std::distance(records_.begin(), it) - 1;
+		}
+
+	private:
+		std::vector<segment_record> records_;
+	};
+
+	// Segment tables for all layers of an alignment curve, starting with the curve itself followed by its
+	// base curves, e.g. vertical then horizontal for an IfcGradientCurve and cant, vertical, horizontal for
+	// an IfcSegmentedReferenceCurve.
+	inline std::vector<segment_table> segment_layers(const Ifc4x3_add2::IfcCompositeCurve* curve, double length_unit)
+	{
+		std::vector<segment_table> layers;
+		while (curve)
+		{
+			layers.emplace_back(curve, length_unit);
+
+			const Ifc4x3_add2::IfcBoundedCurve* base = nullptr;
+			if (auto src = curve->as<Ifc4x3_add2::IfcSegmentedReferenceCurve>())
+				base = src->BaseCurve();
+			else if (auto gc = curve->as<Ifc4x3_add2::IfcGradientCurve>())
+				base = gc->BaseCurve();
+
+			curve = base ? base->as<Ifc4x3_add2::IfcCompositeCurve>() : nullptr;
+		}
+		return layers;
+	}
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+// Persistent cache of compiled alignments.
+//
+// Parsing a file is unavoidable, but mapping an alignment and compiling its records evaluates the mapped curve many
+// times per segment, which dominates the startup of long alignments. alignment_store writes the records of a
+// compiled_alignment to one file per alignment in a directory and reads them back from a memory-mapped view of the
+// file, so a later process evaluates without mapping the curve. The records are copied out of the view into the
+// compiled_alignment, which owns them like a compiled one, and the view is closed after loading; evaluation does not
+// read from the mapped file.
+//
+// Files are keyed by a 64 bit FNV-1a hash of the STEP text of the curve and of every instance it references, in
+// id order, together with the length and output units and the compile tolerance. Editing any attribute that
+// contributes to the curve, or the units, gives a different key; unrelated changes to the file do not. A file
+// starts with a header holding the format version, the record sizes and the key, files that do not match are
+// treated as missing. The horizontal, vertical and cant records follow the header in that order.
+//
+// Loaded records are bit-identical to the stored ones, so evaluation gives bit-identical frames. Generic records
+// (segmented reference curves, curves without segment tables and records that failed the compile check) still need
+// the mapped curve: pass its alignment_evaluator to load().
+
+#include "CompiledAlignment.h"
+#include "StepWriter.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	// 64 bit FNV-1a hash
+	class fnv1a
+	{
+	public:
+		void add(const void* data, size_t size)
+		{
+			auto bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash_ ^= bytes[i];
+				hash_ *= 1099511628211ull;
+			}
+		}
+		void add(const std::string& s) { add(s.data(), s.size()); }
+		void add(double v) { add(&v, sizeof(v)); }
+
+		uint64_t value() const { return hash_; }
+
+	private:
+		uint64_t hash_ = 14695981039346656037ull;
+	};
+
+	// Read-only view of a complete file, mapped into memory. Empty if the file cannot be opened or is empty.
+	class mapped_file
+	{
+	public:
+		explicit mapped_file(const std::string& path)
+		{
+			file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file_ == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+				return;
+			mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping_ == nullptr)
+				return;
+			data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+			if (data_)
+				size_ = (size_t)size.QuadPart;
+		}
+
+		~mapped_file()
+		{
+			if (data_)
+				UnmapViewOfFile(data_);
+			if (mapping_)
+				CloseHandle(mapping_);
+			if (file_ != INVALID_HANDLE_VALUE)
+				CloseHandle(file_);
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+		explicit operator bool() const { return data_ != nullptr; }
+
+	private:
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE mapping_ = nullptr;
+		const char* data_ = nullptr;
+		size_t size_ = 0;
+	};
+
+	class alignment_store
+	{
+	public:
+		// to be increased when the records or segment_kind change
+		static constexpr uint32_t format_version = 2;
+
+		explicit alignment_store(const std::string& directory) : directory_(directory)
+		{
+			std::filesystem::create_directories(directory_);
+		}
+
+		// Key of the curve compiled with tolerance, for an alignment_evaluator over model_unit and output_unit (see units)
+		static uint64_t key(IfcParse::IfcFile& file, const Ifc4x3_add2::IfcCurve* curve, double model_unit, double output_unit, double tolerance = 1e-6)
+		{
+			// the factors as computed by alignment_evaluator
+			double output = output_unit == units::model ? model_unit : output_unit;
+			return content_key(file, curve, model_unit * (1.0 / output), output, tolerance);
+		}
+
+		static uint64_t key(IfcParse::IfcFile& file, const alignment_evaluator& evaluator, double tolerance = 1e-6)
+		{
+			return content_key(file, evaluator.curve(), evaluator.length_unit(), evaluator.output_unit(), tolerance);
+		}
+
+		std::string path(uint64_t key) const
+		{
+			std::ostringstream os;
+			os << std::hex;
+			os.width(16);
+			os.fill('0');
+			os << key;
+			return (directory_ / (os.str() + ".alignment")).string();
+		}
+
+		bool contains(uint64_t key) const { return std::filesystem::exists(path(key)); }
+
+		// Writes the records of compiled under key, replacing a stored alignment
+		void save(uint64_t key, const compiled_alignment& compiled) const
+		{
+			header h;
+			h.key = key;
+			h.start = compiled.start();
+			h.end = compiled.end();
+			h.tolerance = compiled.tolerance();
+			h.horizontal = compiled.horizontal().size();
+			h.vertical = compiled.vertical().size();
+			h.cant = compiled.cant().size();
+
+			// written next to the target and renamed, readers never see a partial file
+			std::string target = path(key);
+			std::string temporary = target + ".tmp";
+			{
+				std::ofstream os(temporary, std::ios::binary | std::ios::trunc);
+				os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+				os.write(reinterpret_cast<const char*>(compiled.horizontal().data()), h.horizontal * sizeof(horizontal_record));
+				os.write(reinterpret_cast<const char*>(compiled.vertical().data()), h.vertical * sizeof(vertical_record));
+				os.write(reinterpret_cast<const char*>(compiled.cant().data()), h.cant * sizeof(cant_record));
+				if (!os)
+					throw std::runtime_error("cannot write " + temporary);
+			}
+			std::filesystem::rename(temporary, target);
+		}
+
+		// The alignment stored under key, null if there is none or the file does not match. Generic records are
+		// evaluated by evaluator, which must outlive the result.
+		std::unique_ptr<compiled_alignment> load(uint64_t key, const alignment_evaluator* evaluator = nullptr) const
+		{
+			mapped_file file(path(key));
+			if (!file || file.size() < sizeof(header))
+				return nullptr;
+
+			header h;
+			std::memcpy(&h, file.data(), sizeof(h));
+			if (std::memcmp(h.magic, header().magic, sizeof(h.magic)) != 0 || h.version != format_version ||
+				h.horizontal_size != sizeof(horizontal_record) || h.vertical_size != sizeof(vertical_record) || h.cant_size != sizeof(cant_record) ||
+				h.key != key || file.size() != sizeof(h) + h.horizontal * sizeof(horizontal_record) + h.vertical * sizeof(vertical_record) + h.cant * sizeof(cant_record))
+				return nullptr;
+
+			std::vector<horizontal_record> horizontal(h.horizontal);
+			std::vector<vertical_record> vertical(h.vertical);
+			std::vector<cant_record> cant(h.cant);
+			const char* data = file.data() + sizeof(h);
+			std::memcpy(horizontal.data(), data, h.horizontal * sizeof(horizontal_record));
+			data += h.horizontal * sizeof(horizontal_record);
+			std::memcpy(vertical.data(), data, h.vertical * sizeof(vertical_record));
+			data += h.vertical * sizeof(vertical_record);
+			std::memcpy(cant.data(), data, h.cant * sizeof(cant_record));
+			return std::make_unique<compiled_alignment>(std::move(horizontal), std::move(vertical), h.start, h.end, h.tolerance, evaluator, std::move(cant));
+		}
+
+		// The stored alignment of evaluator, compiled and stored if there is none
+		std::unique_ptr<compiled_alignment> get(IfcParse::IfcFile& file, const alignment_evaluator& evaluator, double tolerance = 1e-6) const
+		{
+			uint64_t k = key(file, evaluator, tolerance);
+			if (auto compiled = load(k, &evaluator))
+				return compiled;
+			auto compiled = std::make_unique<compiled_alignment>(evaluator, tolerance);
+			save(k, *compiled);
+			return compiled;
+		}
+
+	private:
+		static_assert(std::is_trivially_copyable_v<horizontal_record> && std::is_trivially_copyable_v<vertical_record> && std::is_trivially_copyable_v<cant_record>,
+			"records are stored as bytes");
+
+		struct header
+		{
+			char magic[8] = { 'I', 'F', 'C', 'A', 'L', 'I', 'G', 'N' };
+			uint32_t version = format_version;
+			uint32_t horizontal_size = sizeof(horizontal_record);
+			uint32_t vertical_size = sizeof(vertical_record);
+			uint32_t cant_size = sizeof(cant_record);
+			uint64_t key = 0;
+			double start = 0.0;
+			double end = 0.0;
+			double tolerance = 0.0;
+			uint64_t horizontal = 0;
+			uint64_t vertical = 0;
+			uint64_t cant = 0;
+		};
+
+		static uint64_t content_key(IfcParse::IfcFile& file, const Ifc4x3_add2::IfcCurve* curve, double length_unit, double output_unit, double tolerance)
+		{
+			auto instances = file.traverse(const_cast<Ifc4x3_add2::IfcCurve*>(curve));
+			std::vector<const IfcUtil::IfcBaseClass*> sorted(instances->begin(), instances->end());
+			std::sort(sorted.begin(), sorted.end(), [](const IfcUtil::IfcBaseClass* a, const IfcUtil::IfcBaseClass* b) { return a->id() < b->id(); });
+
+			std::ostringstream os;
+			{
+				step_writer writer(os);
+				for (auto inst : sorted)
+					writer.write_entity(inst);
+			}
+
+			fnv1a hash;
+			hash.add(os.str());
+			hash.add(length_unit);
+			hash.add(output_unit);
+			hash.add(tolerance);
+			return hash.value();
+		}
+
+		std::filesystem::path directory_;
+	};
+}
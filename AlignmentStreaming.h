@@ -0,0 +1,630 @@
+#pragma once
+
+// Streaming evaluation of alignment networks that do not fit in memory once mapped.
+//
+// alignment_network_scan reads a STEP file once without parsing attributes. It records the byte range, type name
+// and references of every instance, which is a few tens of bytes per instance, and finds the IfcAlignment
+// instances, the curves of their representations and the IfcLinearPlacements positioned on those curves. extract()
+// reads the instances an alignment needs from disk: its forward closure, the closures of its placements and the
+// closure of the IfcProject for units and contexts. The result is a small STEP file with the original ids.
+//
+// streaming_evaluator runs three overlapping stages: a reader thread extracts alignment k + 1 while a mapping
+// thread parses, maps and evaluates alignment k and the calling thread writes the results of alignment k - 1.
+// Stages hand over through queues of depth items, so at most 2 * depth + 3 alignments are in memory at any time
+// and memory is bounded by the largest alignments rather than by the network. Results are written in file order.
+// An exception in any stage stops the pipeline and is rethrown by run().
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "AlignmentEvaluator.h"
+#include "StepWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	class alignment_network_scan
+	{
+	public:
+		explicit alignment_network_scan(const std::string& path) : path_(path)
+		{
+			std::ifstream is(path, std::ios::binary);
+			if (!is)
+				throw std::runtime_error("cannot open " + path);
+			scan(is);
+			if (instances_.empty())
+				throw std::runtime_error("no instances in " + path);
+
+			header_.resize(instances_.front().offset);
+			is.clear();
+			is.seekg(0);
+			is.read(header_.data(), header_.size());
+
+			index();
+		}
+
+		size_t instances() const { return instances_.size(); }
+		size_t alignments() const { return alignments_.size(); }
+
+		// STEP id of alignment k
+		unsigned alignment_id(size_t k) const { return instances_[alignments_[k]].id; }
+
+		// STEP ids of the IfcLinearPlacements on the curves of alignment k
+		std::vector<unsigned> placement_ids(size_t k) const
+		{
+			std::vector<unsigned> ids;
+			for (auto i : placements_[k])
+				ids.push_back(instances_[i].id);
+			return ids;
+		}
+
+		// STEP file of alignment k with the instances it needs, in file order
+		std::string extract(size_t k) const
+		{
+			std::vector<bool> visited(instances_.size());
+			std::vector<uint32_t> closure;
+			for (auto i : project_)
+			{
+				visited[i] = true;
+				closure.push_back(i);
+			}
+			add_closure(alignments_[k], visited, closure);
+			for (auto i : placements_[k])
+				add_closure(i, visited, closure);
+			std::sort(closure.begin(), closure.end());
+
+			std::ifstream is(path_, std::ios::binary);
+			std::string step = header_;
+			for (size_t first = 0; first < closure.size();)
+			{
+				// instances that follow each other in the file are read at once
+				size_t last = first;
+				while (last + 1 < closure.size() && closure[last + 1] == closure[last] + 1)
+					last++;
+				const auto& a = instances_[closure[first]];
+				const auto& b = instances_[closure[last]];
+				size_t size = step.size();
+				step.resize(size + (b.offset + b.length - a.offset));
+				is.seekg(a.offset);
+				is.read(step.data() + size, b.offset + b.length - a.offset);
+				if (!is)
+					throw std::runtime_error("cannot read " + path_);
+				step += '\n';
+				first = last + 1;
+			}
+			step += "ENDSEC;\nEND-ISO-10303-21;\n";
+			return step;
+		}
+
+		// size of the instance, reference and alignment tables
+		size_t bytes() const
+		{
+			size_t result = instances_.capacity() * sizeof(instance) + (references_.capacity() + reference_begin_.capacity() + by_id_.capacity() + project_.capacity() + alignments_.capacity()) * sizeof(uint32_t);
+			for (const auto& p : placements_)
+				result += p.capacity() * sizeof(uint32_t);
+			return result + header_.size();
+		}
+
+	private:
+		struct instance
+		{
+			uint64_t offset; // of the #
+			uint32_t id;
+			uint32_t length; // up to and including the ;
+			uint32_t type;   // in types_
+		};
+
+		void scan(std::istream& is)
+		{
+			enum class state { outside, id, after_id, type, body };
+			state s = state::outside;
+			bool in_string = false, in_comment = false, in_reference = false;
+			char previous = 0;
+			uint32_t number = 0;
+			uint64_t offset = 0, start = 0;
+			std::string type;
+
+			std::vector<char> buffer(1 << 20);
+			while (is)
+			{
+				is.read(buffer.data(), buffer.size());
+				auto n = is.gcount();
+				for (std::streamsize i = 0; i < n; i++, offset++)
+				{
+					char c = buffer[i];
+					if (in_comment)
+					{
+						if (previous == '*' && c == '/')
+						{
+							in_comment = false;
+							c = 0;
+						}
+						previous = c;
+						continue;
+					}
+					if (in_string)
+					{
+						// a quote in a string is written twice, which leaves and enters the string
+						in_string = c != '\'';
+						previous = c;
+						continue;
+					}
+					if (in_reference)
+					{
+						if (c >= '0' && c <= '9')
+						{
+							number = number * 10 + (c - '0');
+							previous = c;
+							continue;
+						}
+						references_.push_back(number);
+						in_reference = false;
+					}
+					if (c == '\'')
+					{
+						in_string = true;
+						previous = c;
+						continue;
+					}
+					if (previous == '/' && c == '*')
+					{
+						in_comment = true;
+						previous = 0;
+						continue;
+					}
+					previous = c;
+
+					switch (s)
+					{
+					case state::outside:
+						if (c == '#')
+						{
+							s = state::id;
+							number = 0;
+							start = offset;
+						}
+						break;
+					case state::id:
+					case state::after_id:
+						if (s == state::id && c >= '0' && c <= '9')
+							number = number * 10 + (c - '0');
+						else if (c == '=')
+						{
+							s = state::type;
+							type.clear();
+						}
+						else if (std::isspace((unsigned char)c))
+							s = state::after_id;
+						else
+							s = state::outside;
+						break;
+					case state::type:
+						if (std::isalnum((unsigned char)c) || c == '_')
+							type += (char)std::toupper((unsigned char)c);
+						else if (!type.empty() || !std::isspace((unsigned char)c))
+						{
+							instances_.push_back({ start, number, 0, intern(type) });
+							reference_begin_.push_back((uint32_t)references_.size());
+							s = state::body;
+						}
+						break;
+					case state::body:
+						if (c == '#')
+						{
+							in_reference = true;
+							number = 0;
+						}
+						else if (c == ';')
+						{
+							instances_.back().length = (uint32_t)(offset + 1 - instances_.back().offset);
+							s = state::outside;
+						}
+						break;
+					}
+				}
+			}
+			if (s == state::body)
+				throw std::runtime_error("truncated instance #" + std::to_string(instances_.back().id) + " in " + path_);
+			reference_begin_.push_back((uint32_t)references_.size());
+			instances_.shrink_to_fit();
+			references_.shrink_to_fit();
+			reference_begin_.shrink_to_fit();
+		}
+
+		uint32_t intern(const std::string& type)
+		{
+			auto it = types_.find(type);
+			if (it != types_.end())
+				return it->second;
+			return types_[type] = (uint32_t)types_.size();
+		}
+
+		// index of a type name in the file, an index no instance has if the type does not occur
+		uint32_t type(const char* name) const
+		{
+			auto it = types_.find(name);
+			return it != types_.end() ? it->second : (uint32_t)types_.size();
+		}
+
+		bool is(uint32_t i, const char* name) const
+		{
+			return instances_[i].type == type(name);
+		}
+
+		// index of the instance with a STEP id, or instances() if there is none
+		uint32_t find(uint32_t id) const
+		{
+			auto it = std::lower_bound(by_id_.begin(), by_id_.end(), id, [this](uint32_t i, uint32_t id) { return instances_[i].id < id; });
+			return it != by_id_.end() && instances_[*it].id == id ? *it : (uint32_t)instances_.size();
+		}
+
+		template <typename F>
+		void for_each_reference(uint32_t i, F f) const
+		{
+			for (auto r = reference_begin_[i]; r < reference_begin_[i + 1]; r++)
+			{
+				auto j = find(references_[r]);
+				if (j != instances_.size())
+					f(j);
+			}
+		}
+
+		void add_closure(uint32_t root, std::vector<bool>& visited, std::vector<uint32_t>& closure) const
+		{
+			std::vector<uint32_t> stack{ root };
+			while (!stack.empty())
+			{
+				auto i = stack.back();
+				stack.pop_back();
+				if (visited[i])
+					continue;
+				visited[i] = true;
+				closure.push_back(i);
+				for_each_reference(i, [&](uint32_t j) { if (!visited[j]) stack.push_back(j); });
+			}
+		}
+
+		void index()
+		{
+			by_id_.resize(instances_.size());
+			for (uint32_t i = 0; i < by_id_.size(); i++)
+				by_id_[i] = i;
+			std::sort(by_id_.begin(), by_id_.end(), [this](uint32_t a, uint32_t b) { return instances_[a].id < instances_[b].id; });
+
+			const uint32_t project = type("IFCPROJECT"), alignment = type("IFCALIGNMENT"), linear_placement = type("IFCLINEARPLACEMENT");
+			std::vector<bool> visited(instances_.size());
+			for (uint32_t i = 0; i < instances_.size(); i++)
+			{
+				if (instances_[i].type == project)
+					add_closure(i, visited, project_);
+				else if (instances_[i].type == alignment)
+					alignments_.push_back(i);
+			}
+
+			// the representation items of each alignment
+			std::map<uint32_t, size_t> curves;
+			for (size_t k = 0; k < alignments_.size(); k++)
+			{
+				for_each_reference(alignments_[k], [&](uint32_t shape)
+				{
+					if (!is(shape, "IFCPRODUCTDEFINITIONSHAPE"))
+						return;
+					for_each_reference(shape, [&](uint32_t representation)
+					{
+						for_each_reference(representation, [&](uint32_t item)
+						{
+							if (!is(item, "IFCGEOMETRICREPRESENTATIONCONTEXT") && !is(item, "IFCGEOMETRICREPRESENTATIONSUBCONTEXT"))
+								curves.emplace(item, k);
+						});
+					});
+				});
+			}
+
+			// a placement belongs to the alignment of the first curve it reaches
+			placements_.resize(alignments_.size());
+			for (uint32_t i = 0; i < instances_.size(); i++)
+			{
+				if (instances_[i].type != linear_placement)
+					continue;
+				std::vector<uint32_t> stack{ i }, seen;
+				while (!stack.empty())
+				{
+					auto j = stack.back();
+					stack.pop_back();
+					auto it = curves.find(j);
+					if (it != curves.end())
+					{
+						placements_[it->second].push_back(i);
+						break;
+					}
+					if (std::find(seen.begin(), seen.end(), j) != seen.end())
+						continue;
+					seen.push_back(j);
+					for_each_reference(j, [&](uint32_t r) { stack.push_back(r); });
+				}
+			}
+		}
+
+		std::string path_;
+		std::string header_; // up to the first instance of the data section
+		std::vector<instance> instances_; // in file order
+		std::vector<uint32_t> references_; // STEP ids referenced by instance i at reference_begin_[i] to reference_begin_[i + 1]
+		std::vector<uint32_t> reference_begin_;
+		std::vector<uint32_t> by_id_; // instances sorted by STEP id
+		std::map<std::string, uint32_t> types_;
+		std::vector<uint32_t> project_; // closure of the IfcProject
+		std::vector<uint32_t> alignments_;
+		std::vector<std::vector<uint32_t>> placements_; // per alignment
+	};
+
+	// Queue between two pipeline stages. push() blocks while the queue is full, pop() while it is empty.
+	template <typename T>
+	class bounded_queue
+	{
+	public:
+		explicit bounded_queue(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+		// false if the queue was closed
+		bool push(T item)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			not_full_.wait(lock, [&]() { return closed_ || items_.size() < capacity_; });
+			if (closed_)
+				return false;
+			items_.push_back(std::move(item));
+			not_empty_.notify_one();
+			return true;
+		}
+
+		// empty when the queue is closed and drained
+		std::optional<T> pop()
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			not_empty_.wait(lock, [&]() { return closed_ || !items_.empty(); });
+			if (items_.empty())
+				return std::nullopt;
+			T item = std::move(items_.front());
+			items_.pop_front();
+			not_full_.notify_one();
+			return item;
+		}
+
+		void close()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_ = true;
+			not_full_.notify_all();
+			not_empty_.notify_all();
+		}
+
+	private:
+		size_t capacity_;
+		std::deque<T> items_;
+		bool closed_ = false;
+		std::mutex mutex_;
+		std::condition_variable not_full_, not_empty_;
+	};
+
+	// Frames of one alignment, in the output unit of the streaming_evaluator
+	struct alignment_result
+	{
+		size_t index = 0; // in the scan
+		unsigned id = 0;  // STEP id of the IfcAlignment
+		std::string name;
+		std::vector<double> stations;
+		std::vector<Eigen::Matrix4d> frames;
+		std::vector<unsigned> placements; // STEP ids of the IfcLinearPlacements
+		std::vector<Eigen::Matrix4d> placement_frames;
+	};
+
+	class streaming_evaluator
+	{
+	public:
+		using station_function = std::function<std::vector<double>(const alignment_evaluator&)>;
+		using sink = std::function<void(const alignment_result&)>;
+
+		streaming_evaluator(const std::string& path, ifcopenshell::geometry::Settings& settings, double output_unit = units::metre) :
+			scan_(path),
+			settings_(settings),
+			output_unit_(output_unit)
+		{
+		}
+
+		// Stations every step from the start of an alignment, and its end. A step that is not positive and finite throws
+		// std::invalid_argument.
+		static station_function every(double step)
+		{
+			if (!(step > 0.0) || !std::isfinite(step))
+				throw std::invalid_argument("streaming_evaluator::every: the step must be positive and finite");
+			return [step](const alignment_evaluator& evaluator)
+			{
+				std::vector<double> u;
+				for (double s = evaluator.start(); s < evaluator.end(); s = evaluator.start() + step * u.size())
+					u.push_back(s);
+				u.push_back(evaluator.end());
+				return u;
+			};
+		}
+
+		// Evaluates stations and the linear placements of every alignment, passing the results to write in file order
+		void run(const station_function& stations, const sink& write, size_t depth = 1)
+		{
+			bounded_queue<std::pair<size_t, std::string>> texts(depth);
+			bounded_queue<alignment_result> results(depth);
+			std::exception_ptr error;
+			std::mutex error_mutex;
+			auto fail = [&]()
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+				texts.close();
+				results.close();
+			};
+
+			std::thread reader([&]()
+			{
+				try
+				{
+					for (size_t k = 0; k < scan_.alignments(); k++)
+					{
+						if (!texts.push({ k, scan_.extract(k) }))
+							break;
+					}
+				}
+				catch (...)
+				{
+					fail();
+				}
+				texts.close();
+			});
+
+			std::thread mapper([&]()
+			{
+				try
+				{
+					while (auto text = texts.pop())
+					{
+						if (!results.push(evaluate(text->first, text->second, stations)))
+							break;
+					}
+				}
+				catch (...)
+				{
+					fail();
+				}
+				results.close();
+			});
+
+			try
+			{
+				while (auto result = results.pop())
+					write(*result);
+			}
+			catch (...)
+			{
+				fail();
+			}
+			reader.join();
+			mapper.join();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		const alignment_network_scan& scan() const { return scan_; }
+
+		// The representation curve of an alignment with the most layers: segmented reference curve, gradient curve,
+		// horizontal composite curve or any other curve, null if there is none
+		static const Ifc4x3_add2::IfcCurve* alignment_curve(const Ifc4x3_add2::IfcAlignment* alignment)
+		{
+			auto rank = [](const Ifc4x3_add2::IfcCurve* curve)
+			{
+				return curve->as<Ifc4x3_add2::IfcSegmentedReferenceCurve>() ? 3 : curve->as<Ifc4x3_add2::IfcGradientCurve>() ? 2 : curve->as<Ifc4x3_add2::IfcCompositeCurve>() ? 1 : 0;
+			};
+
+			const Ifc4x3_add2::IfcCurve* result = nullptr;
+			if (alignment->Representation() == nullptr)
+				return result;
+			for (auto& representation : *alignment->Representation()->Representations())
+			{
+				for (auto& item : *representation->Items())
+				{
+					auto curve = item->as<Ifc4x3_add2::IfcCurve>();
+					if (curve && (result == nullptr || rank(curve) > rank(result)))
+						result = curve;
+				}
+			}
+			return result;
+		}
+
+	private:
+		alignment_result evaluate(size_t k, std::string& step, const station_function& stations) const
+		{
+			alignment_result result;
+			result.index = k;
+			result.id = scan_.alignment_id(k);
+
+			IfcParse::IfcFile file(step.data(), (int)step.size());
+			if (!file.good())
+				throw std::runtime_error("cannot parse alignment #" + std::to_string(result.id));
+			auto alignment = file.instance_by_id(result.id)->as<Ifc4x3_add2::IfcAlignment>();
+			result.name = alignment->Name().get_value_or("");
+
+			alignment_cache cache(file, settings_, output_unit_);
+			if (auto curve = alignment_curve(alignment))
+			{
+				const auto& evaluator = cache.get(curve);
+				result.stations = stations(evaluator);
+				result.frames.reserve(result.stations.size());
+				for (auto u : result.stations)
+					result.frames.push_back(evaluator.evaluate(u));
+			}
+
+			for (auto id : scan_.placement_ids(k))
+			{
+				auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(cache.mapping().map(file.instance_by_id(id)));
+				Eigen::Matrix4d frame = m->components();
+				frame.col(3).head(3) /= cache.output_unit();
+				result.placements.push_back(id);
+				result.placement_frames.push_back(frame);
+			}
+			return result;
+		}
+
+		alignment_network_scan scan_;
+		ifcopenshell::geometry::Settings& settings_;
+		double output_unit_;
+	};
+
+	// Writes results as CSV, one line per station (alignment id, station, x, y, z) and per placement (alignment id,
+	// #placement id, x, y, z). Reals are written in their shortest round-trip form.
+	class csv_result_writer
+	{
+	public:
+		explicit csv_result_writer(std::ostream& os) : sink_(os) {}
+
+		void operator()(const alignment_result& result)
+		{
+			const std::string alignment = "#" + std::to_string(result.id) + ",";
+			for (size_t i = 0; i < result.stations.size(); i++)
+				write_line(alignment + step::format_real(result.stations[i]), result.frames[i]);
+			for (size_t i = 0; i < result.placements.size(); i++)
+				write_line(alignment + "#" + std::to_string(result.placements[i]), result.placement_frames[i]);
+		}
+
+		void flush() { sink_.flush(); }
+
+	private:
+		void write_line(const std::string& key, const Eigen::Matrix4d& m)
+		{
+			sink_.write(key);
+			for (int i = 0; i < 3; i++)
+			{
+				sink_.put(',');
+				sink_.write(step::format_real(m(i, 3)));
+			}
+			sink_.put('\n');
+		}
+
+		buffered_sink sink_;
+	};
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+// Benchmark runner with stored, machine-normalised baselines.
+//
+// Timings are divided by the time of a fixed calibration workload measured on the same machine, so baselines
+// recorded on one machine can be compared on another. Baselines are stored as "metric,normalised_time" lines.
+//
+// The regression threshold is the ratio current / baseline above which a metric fails. It defaults to 1.5 and can be
+// set with the IFCOS_BENCHMARK_THRESHOLD environment variable. Set IFCOS_BENCHMARK_UPDATE=1 to record the current
+// timings as the new baselines; the baseline file is only written in that mode, so a regression never replaces its
+// baseline. Metrics without a baseline are reported as missing and fail the gate unless the run records baselines.
+// Metric names must not depend on the machine, e.g. on its number of hardware threads, or they are missing elsewhere.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	namespace benchmark
+	{
+		inline std::string environment(const char* name)
+		{
+			char* value = nullptr;
+			size_t len = 0;
+			std::string result;
+			if (_dupenv_s(&value, &len, name) == 0 && value)
+			{
+				result = value;
+				free(value);
+			}
+			return result;
+		}
+
+		// Median wall time in seconds of one call to fn, over the given number of repetitions.
+		// fn is called once before timing to warm up caches.
+		inline double median_seconds(const std::function<void()>& fn, int repetitions = 5)
+		{
+			fn();
+			std::vector<double> times;
+			for (int i = 0; i < repetitions; i++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				fn();
+				auto end = std::chrono::steady_clock::now();
+				times.push_back(std::chrono::duration<double>(end - start).count());
+			}
+			std::sort(times.begin(), times.end());
+			return times[times.size() / 2];
+		}
+
+		// Time of a fixed floating point and memory workload on this machine, used to normalise timings
+		inline double calibration_seconds()
+		{
+			static double seconds = median_seconds([]()
+			{
+				std::vector<double> v(1 << 16);
+				volatile double sink = 0.0;
+				for (int pass = 0; pass < 32; pass++)
+				{
+					for (size_t i = 0; i < v.size(); i++)
+					{
+						v[i] = sin(i * 0.001 + pass) * cos(i * 0.002) + sqrt((double)i + pass);
+					}
+					double sum = 0.0;
+					for (size_t i = 0; i < v.size(); i += 17)
+					{
+						sum += v[(i * 7919) % v.size()];
+					}
+					sink = sink + sum;
+				}
+			}, 7);
+			return seconds;
+		}
+
+		struct result
+		{
+			std::string metric;
+			std::string group; // e.g. the curve type, used to build the comparison table
+			double seconds = 0.0;
+			double normalised = 0.0;
+			double baseline = 0.0; // 0 when no baseline was stored
+			bool regressed = false;
+			bool missing = false;  // no baseline stored and not recording
+
+			double ratio() const { return baseline > 0.0 ? normalised / baseline : 0.0; }
+		};
+
+		class baseline_store
+		{
+		public:
+			// description and column are written to the header of the file
+			explicit baseline_store(const std::string& path, const std::string& description = "Machine-normalised benchmark baselines, see Benchmark.h", const std::string& column = "normalised_time") :
+				path_(path),
+				description_(description),
+				column_(column)
+			{
+				std::ifstream ifile(path_);
+				std::string line;
+				while (std::getline(ifile, line))
+				{
+					if (line.empty() || line[0] == '#')
+						continue;
+					auto comma = line.rfind(',');
+					if (comma == std::string::npos)
+						continue;
+					try
+					{
+						values_[line.substr(0, comma)] = std::stod(line.substr(comma + 1));
+					}
+					catch (const std::exception&)
+					{
+						// skip the header and malformed lines
+					}
+				}
+			}
+
+			bool has(const std::string& metric) const { return values_.find(metric) != values_.end(); }
+			double get(const std::string& metric) const { return values_.at(metric); }
+			void set(const std::string& metric, double normalised) { values_[metric] = normalised; }
+
+			void save() const
+			{
+				std::ofstream ofile(path_);
+				ofile << "# " << description_ << "\n";
+				ofile << "metric," << column_ << "\n";
+				ofile << std::setprecision(9);
+				for (const auto& [metric, value] : values_)
+					ofile << metric << "," << value << "\n";
+			}
+
+		private:
+			std::string path_;
+			std::string description_;
+			std::string column_;
+			std::map<std::string, double> values_;
+		};
+
+		class regression_gate
+		{
+		public:
+			// threshold and update mode from the environment
+			explicit regression_gate(const std::string& baseline_path) :
+				regression_gate(baseline_path, default_threshold(), environment("IFCOS_BENCHMARK_UPDATE") == "1")
+			{
+			}
+
+			regression_gate(const std::string& baseline_path, double threshold, bool update) :
+				store_(baseline_path),
+				threshold_(threshold),
+				update_(update)
+			{
+			}
+
+			static double default_threshold()
+			{
+				auto threshold = environment("IFCOS_BENCHMARK_THRESHOLD");
+				return threshold.empty() ? 1.5 : std::stod(threshold);
+			}
+
+			double threshold() const { return threshold_; }
+
+			// Times fn and compares it against the stored baseline for metric
+			const result& run(const std::string& metric, const std::string& group, const std::function<void()>& fn, int repetitions = 5)
+			{
+				result r;
+				r.metric = metric;
+				r.group = group;
+				r.seconds = median_seconds(fn, repetitions);
+				r.normalised = r.seconds / calibration_seconds();
+
+				if (update_)
+				{
+					store_.set(metric, r.normalised);
+					dirty_ = true;
+				}
+				else if (store_.has(metric))
+				{
+					r.baseline = store_.get(metric);
+					r.regressed = r.ratio() > threshold_;
+				}
+				else
+				{
+					r.missing = true;
+				}
+
+				results_.push_back(r);
+				return results_.back();
+			}
+
+			// Writes the recorded baselines, in update mode only
+			void save()
+			{
+				if (dirty_)
+					store_.save();
+				dirty_ = false;
+			}
+
+			const std::vector<result>& results() const { return results_; }
+
+			bool regressed() const
+			{
+				return std::any_of(results_.begin(), results_.end(), [](const result& r) { return r.regressed; });
+			}
+
+			bool update() const { return update_; }
+
+			// a metric regressed or has no baseline outside update mode
+			bool failed() const { return regressed() || !missing().empty(); }
+
+			// metrics without a baseline
+			std::vector<std::string> missing() const
+			{
+				std::vector<std::string> metrics;
+				for (const auto& r : results_)
+				{
+					if (r.missing)
+						metrics.push_back(r.metric);
+				}
+				return metrics;
+			}
+
+			// Comparison table of all metrics, grouped and summed per group (e.g. per curve type)
+			std::string table() const
+			{
+				std::ostringstream os;
+				os << std::left << std::setw(60) << "metric" << std::right << std::setw(14) << "seconds" << std::setw(14) << "normalised" << std::setw(14) << "baseline" << std::setw(10) << "ratio" << "\n";
+				for (const auto& r : results_)
+				{
+					os << std::left << std::setw(60) << r.metric << std::right << std::setprecision(4)
+						<< std::setw(14) << r.seconds << std::setw(14) << r.normalised;
+					if (r.baseline > 0.0)
+						os << std::setw(14) << r.baseline << std::setw(10) << r.ratio() << (r.regressed ? "  REGRESSED" : "");
+					else
+						os << std::setw(14) << "-" << std::setw(10) << "-" << (r.missing ? "  MISSING" : "  recorded");
+					os << "\n";
+				}
+
+				std::map<std::string, std::pair<double, double>> groups; // normalised, baseline
+				for (const auto& r : results_)
+				{
+					if (r.baseline <= 0.0)
+						continue;
+					auto& g = groups[r.group];
+					g.first += r.normalised;
+					g.second += r.baseline;
+				}
+				if (!groups.empty())
+				{
+					os << "\n" << std::left << std::setw(30) << "group" << std::right << std::setw(14) << "normalised" << std::setw(14) << "baseline" << std::setw(10) << "ratio" << "\n";
+					for (const auto& [group, g] : groups)
+					{
+						os << std::left << std::setw(30) << group << std::right << std::setprecision(4)
+							<< std::setw(14) << g.first << std::setw(14) << g.second << std::setw(10) << g.first / g.second << "\n";
+					}
+				}
+				return os.str();
+			}
+
+		private:
+			baseline_store store_;
+			double threshold_;
+			bool update_;
+			bool dirty_ = false;
+			std::vector<result> results_;
+		};
+	}
+}
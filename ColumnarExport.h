@@ -0,0 +1,387 @@
+#pragma once
+
+// Columnar binary export of evaluated alignment frames.
+//
+// frame_writer samples alignments at given distances along and writes one column of doubles per quantity: station,
+// position, the tangent (x axis), normal (y axis) and binormal (z axis) of the frame, cant and gradient. Cant is
+// the roll of the frame about the tangent in radians, zero for curves without a cant layer, and gradient is the
+// tangent of the slope of the tangent. Rows are grouped into chunks of chunk_rows stations of one alignment, and
+// within a chunk every column is contiguous, so a reader loads the columns it needs without touching the others.
+//
+// The offset of every chunk follows from the number of rows, so the chunks of an alignment are evaluated on
+// several threads, each with its own evaluation_cursor, and written at their offsets with positional writes. The
+// file is the same for any number of threads.
+//
+// Layout: a header, the chunks, and a footer with the alignment and chunk tables. The file ends with the offset of
+// the footer and the magic, so an incomplete file is rejected. Values are in the byte order of the writer.
+
+#include "AlignmentEvaluator.h"
+#include "CompiledAlignment.h"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	enum class frame_column : uint32_t
+	{
+		station,
+		x, y, z,
+		tangent_x, tangent_y, tangent_z,
+		normal_x, normal_y, normal_z,
+		binormal_x, binormal_y, binormal_z,
+		cant,
+		gradient,
+		count
+	};
+
+	inline const char* frame_column_name(frame_column c)
+	{
+		static const char* names[] = { "station", "x", "y", "z", "tangent_x", "tangent_y", "tangent_z", "normal_x", "normal_y", "normal_z",
+			"binormal_x", "binormal_y", "binormal_z", "cant", "gradient" };
+		return names[(size_t)c];
+	}
+
+	constexpr size_t frame_columns = (size_t)frame_column::count;
+
+	namespace columnar
+	{
+		constexpr char magic[8] = { 'I', 'F', 'C', 'F', 'R', 'A', 'M', 'E' };
+		constexpr uint32_t format_version = 1;
+
+		struct header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t columns;
+		};
+
+		struct chunk
+		{
+			uint64_t offset;
+			uint32_t alignment;
+			uint32_t rows;
+		};
+
+		struct alignment
+		{
+			std::string name;
+			double output_unit = 0.0; // length of an output unit in metres
+			uint64_t rows = 0;
+			uint64_t first_chunk = 0;
+			uint64_t chunks = 0;
+		};
+
+		// The columns of a frame at station u, in frame_column order
+		inline void fill(const Eigen::Matrix4d& m, double u, double* row, size_t stride)
+		{
+			row[(size_t)frame_column::station * stride] = u;
+			for (int i = 0; i < 3; i++)
+			{
+				row[((size_t)frame_column::x + i) * stride] = m(i, 3);
+				row[((size_t)frame_column::tangent_x + i) * stride] = m(i, 0);
+				row[((size_t)frame_column::normal_x + i) * stride] = m(i, 1);
+				row[((size_t)frame_column::binormal_x + i) * stride] = m(i, 2);
+			}
+			// without cant the normal is horizontal and the binormal points up
+			row[(size_t)frame_column::cant * stride] = compiled::cant(m);
+			row[(size_t)frame_column::gradient * stride] = compiled::gradient(m);
+		}
+	}
+
+	class frame_writer
+	{
+	public:
+		explicit frame_writer(const std::string& path, size_t chunk_rows = 4096) : path_(path), chunk_rows_(std::max<size_t>(chunk_rows, 1))
+		{
+			file_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file_ == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("cannot create " + path);
+			columnar::header h;
+			std::memcpy(h.magic, columnar::magic, sizeof(h.magic));
+			h.version = columnar::format_version;
+			h.columns = (uint32_t)frame_columns;
+			write(&h, sizeof(h), 0);
+			size_ = sizeof(h);
+		}
+
+		~frame_writer()
+		{
+			try
+			{
+				close();
+			}
+			catch (...)
+			{
+			}
+		}
+
+		frame_writer(const frame_writer&) = delete;
+		frame_writer& operator=(const frame_writer&) = delete;
+
+		// Samples evaluator at the distances along u, on threads threads (0 for one per hardware thread)
+		void add(const std::string& name, const alignment_evaluator& evaluator, const std::vector<double>& u, size_t threads = 0)
+		{
+			if (file_ == INVALID_HANDLE_VALUE)
+				throw std::logic_error("frame_writer is closed");
+
+			columnar::alignment a;
+			a.name = name;
+			a.output_unit = evaluator.output_unit();
+			a.rows = u.size();
+			a.first_chunk = chunks_.size();
+			for (size_t first = 0; first < u.size(); first += chunk_rows_)
+			{
+				uint32_t rows = (uint32_t)std::min(chunk_rows_, u.size() - first);
+				chunks_.push_back({ size_, (uint32_t)alignments_.size(), rows });
+				size_ += rows * frame_columns * sizeof(double);
+			}
+			a.chunks = chunks_.size() - a.first_chunk;
+			alignments_.push_back(a);
+
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			threads = std::min<size_t>(threads, a.chunks);
+
+			std::atomic<size_t> next = 0;
+			std::exception_ptr error;
+			std::mutex error_mutex;
+			auto work = [&]()
+			{
+				try
+				{
+					evaluation_cursor cursor(evaluator);
+					std::vector<double> buffer;
+					for (size_t c = next++; c < a.chunks; c = next++)
+					{
+						const auto& chunk = chunks_[a.first_chunk + c];
+						const double* station = u.data() + c * chunk_rows_;
+						buffer.resize(chunk.rows * frame_columns);
+						for (size_t i = 0; i < chunk.rows; i++)
+							columnar::fill(cursor.evaluate(station[i]), station[i], buffer.data() + i, chunk.rows);
+						write(buffer.data(), buffer.size() * sizeof(double), chunk.offset);
+					}
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+					next = a.chunks;
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (size_t t = 1; t < threads; t++)
+				workers.emplace_back(work);
+			work();
+			for (auto& w : workers)
+				w.join();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		// Writes the footer, after which the file is complete
+		void close()
+		{
+			if (file_ == INVALID_HANDLE_VALUE)
+				return;
+
+			std::string footer;
+			auto put = [&footer](const auto& v) { footer.append(reinterpret_cast<const char*>(&v), sizeof(v)); };
+			put((uint64_t)alignments_.size());
+			for (const auto& a : alignments_)
+			{
+				put((uint32_t)a.name.size());
+				footer += a.name;
+				put(a.output_unit);
+				put(a.rows);
+				put(a.first_chunk);
+				put(a.chunks);
+			}
+			put((uint64_t)chunks_.size());
+			for (const auto& c : chunks_)
+			{
+				put(c.offset);
+				put(c.alignment);
+				put(c.rows);
+			}
+			put(size_);
+			footer.append(columnar::magic, sizeof(columnar::magic));
+
+			HANDLE file = file_;
+			file_ = INVALID_HANDLE_VALUE;
+			try
+			{
+				write(file, footer.data(), footer.size(), size_);
+			}
+			catch (...)
+			{
+				CloseHandle(file);
+				throw;
+			}
+			CloseHandle(file);
+		}
+
+		// bytes of the chunks written so far
+		uint64_t size() const { return size_; }
+
+	private:
+		void write(const void* data, size_t size, uint64_t offset) const
+		{
+			write(file_, data, size, offset);
+		}
+
+		void write(HANDLE file, const void* data, size_t size, uint64_t offset) const
+		{
+			// positional writes on one handle need no lock
+			OVERLAPPED o = {};
+			o.Offset = (DWORD)offset;
+			o.OffsetHigh = (DWORD)(offset >> 32);
+			DWORD written = 0;
+			if (!WriteFile(file, data, (DWORD)size, &written, &o) || written != size)
+				throw std::runtime_error("cannot write " + path_);
+		}
+
+		std::string path_;
+		size_t chunk_rows_;
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		uint64_t size_ = 0;
+		std::vector<columnar::alignment> alignments_;
+		std::vector<columnar::chunk> chunks_;
+	};
+
+	class frame_reader
+	{
+	public:
+		explicit frame_reader(const std::string& path) : is_(path, std::ios::binary)
+		{
+			if (!is_)
+				throw std::runtime_error("cannot open " + path);
+
+			columnar::header h;
+			read(&h, sizeof(h), 0);
+			if (std::memcmp(h.magic, columnar::magic, sizeof(h.magic)) != 0 || h.version != columnar::format_version || h.columns != frame_columns)
+				throw std::runtime_error(path + " is not a frame file of this version");
+
+			is_.seekg(0, std::ios::end);
+			uint64_t size = is_.tellg();
+			char tail[sizeof(uint64_t) + sizeof(columnar::magic)];
+			if (size < sizeof(h) + sizeof(tail))
+				throw std::runtime_error(path + " is incomplete");
+			read(tail, sizeof(tail), size - sizeof(tail));
+			uint64_t footer;
+			std::memcpy(&footer, tail, sizeof(footer));
+			if (std::memcmp(tail + sizeof(footer), columnar::magic, sizeof(columnar::magic)) != 0 || footer < sizeof(h) || footer > size - sizeof(tail))
+				throw std::runtime_error(path + " is incomplete");
+
+			std::string data(size - sizeof(tail) - footer, '\0');
+			read(data.data(), data.size(), footer);
+			size_t position = 0;
+			auto get = [&](auto& v)
+			{
+				if (position + sizeof(v) > data.size())
+					throw std::runtime_error(path + " has a corrupt footer");
+				std::memcpy(&v, data.data() + position, sizeof(v));
+				position += sizeof(v);
+			};
+
+			uint64_t alignments;
+			get(alignments);
+			for (uint64_t i = 0; i < alignments; i++)
+			{
+				columnar::alignment a;
+				uint32_t length;
+				get(length);
+				if (position + length > data.size())
+					throw std::runtime_error(path + " has a corrupt footer");
+				a.name = data.substr(position, length);
+				position += length;
+				get(a.output_unit);
+				get(a.rows);
+				get(a.first_chunk);
+				get(a.chunks);
+				alignments_.push_back(a);
+			}
+			uint64_t chunks;
+			get(chunks);
+			chunks_.resize(chunks);
+			for (auto& c : chunks_)
+			{
+				get(c.offset);
+				get(c.alignment);
+				get(c.rows);
+				if (c.offset + c.rows * frame_columns * sizeof(double) > footer)
+					throw std::runtime_error(path + " has a corrupt chunk table");
+			}
+		}
+
+		const std::vector<columnar::alignment>& alignments() const { return alignments_; }
+		const std::vector<columnar::chunk>& chunks() const { return chunks_; }
+
+		// One column of an alignment, reading only that column of each chunk
+		std::vector<double> column(size_t alignment, frame_column c)
+		{
+			const auto& a = alignments_.at(alignment);
+			std::vector<double> result(a.rows);
+			size_t row = 0;
+			for (uint64_t i = a.first_chunk; i < a.first_chunk + a.chunks; i++)
+			{
+				const auto& chunk = chunks_[i];
+				read(result.data() + row, chunk.rows * sizeof(double), chunk.offset + (uint64_t)c * chunk.rows * sizeof(double));
+				row += chunk.rows;
+			}
+			return result;
+		}
+
+		// The frames of an alignment, rebuilt from the position and axis columns
+		std::vector<Eigen::Matrix4d> frames(size_t alignment)
+		{
+			std::vector<std::vector<double>> columns;
+			for (size_t c = (size_t)frame_column::x; c <= (size_t)frame_column::binormal_z; c++)
+				columns.push_back(column(alignment, (frame_column)c));
+
+			std::vector<Eigen::Matrix4d> result(alignments_.at(alignment).rows, Eigen::Matrix4d::Identity());
+			auto at = [&](frame_column c, size_t i) { return columns[(size_t)c - (size_t)frame_column::x][i]; };
+			for (size_t i = 0; i < result.size(); i++)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					result[i](j, 3) = at((frame_column)((size_t)frame_column::x + j), i);
+					result[i](j, 0) = at((frame_column)((size_t)frame_column::tangent_x + j), i);
+					result[i](j, 1) = at((frame_column)((size_t)frame_column::normal_x + j), i);
+					result[i](j, 2) = at((frame_column)((size_t)frame_column::binormal_x + j), i);
+				}
+			}
+			return result;
+		}
+
+	private:
+		void read(void* data, size_t size, uint64_t offset)
+		{
+			is_.seekg(offset);
+			is_.read(static_cast<char*>(data), size);
+			if (!is_)
+				throw std::runtime_error("cannot read frame file");
+		}
+
+		std::ifstream is_;
+		std::vector<columnar::alignment> alignments_;
+		std::vector<columnar::chunk> chunks_;
+	};
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+// Compact storage of the attributes of numeric entities.
+//
+// Mesh-heavy models are dominated by instances that hold a few numbers each, e.g. IfcIndexedPolygonalFace,
+// IfcCartesianPoint and IfcDirection. An IfcFile keeps every one as an instance object with a generic attribute slot
+// per attribute and a heap block per list. compact_attributes copies the attributes of these instances into two
+// contiguous pools, one of doubles and one of integers, and keeps per instance an entry sorted by id and per
+// attribute a slot of offset, count and type, 28 bytes of bookkeeping for an instance with one attribute against
+// well over a hundred in the file (see MemoryAccounting.h). Lists of lists add the start of every row to a third pool.
+//
+// An instance is stored when all its attributes are numbers, lists of numbers, lists of lists of numbers or unset;
+// instances with strings, booleans or references stay in the file only. Accessors return the values bit-identical to
+// get_attribute_value(), lists as std::span into the pools, valid as long as the store. Empty lists, whose element
+// type the file does not record, read as empty lists of any type and as lists of no rows. Ids that are not stored and
+// rows past the last of a list of lists throw std::out_of_range, accessors of the wrong type std::logic_error. Pools are
+// limited to 2^32 values.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	class compact_attributes
+	{
+	public:
+		compact_attributes() = default;
+
+		explicit compact_attributes(const IfcParse::IfcFile& file)
+		{
+			for (auto it = file.begin(); it != file.end(); ++it)
+				add(it->second);
+
+			std::sort(entries_.begin(), entries_.end(), [](const entry& a, const entry& b) { return a.id < b.id; });
+			entries_.shrink_to_fit();
+			slots_.shrink_to_fit();
+			reals_.shrink_to_fit();
+			integers_.shrink_to_fit();
+			rows_.shrink_to_fit();
+		}
+
+		// Whether all attributes of inst can be stored
+		static bool is_numeric(const IfcUtil::IfcBaseClass* inst)
+		{
+			auto declaration = inst->declaration().as_entity();
+			if (declaration == nullptr)
+				return false;
+			for (size_t i = 0; i < declaration->attribute_count(); i++)
+			{
+				switch (inst->get_attribute_value(i).type())
+				{
+				case IfcUtil::Argument_NULL:
+				case IfcUtil::Argument_DERIVED:
+				case IfcUtil::Argument_INT:
+				case IfcUtil::Argument_DOUBLE:
+				case IfcUtil::Argument_EMPTY_AGGREGATE:
+				case IfcUtil::Argument_AGGREGATE_OF_INT:
+				case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+				case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+				case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+					break;
+				default:
+					return false;
+				}
+			}
+			return true;
+		}
+
+		size_t size() const { return entries_.size(); }
+		bool contains(unsigned id) const { return lookup(id) != nullptr; }
+
+		// Ids of the stored instances, ascending
+		std::vector<unsigned> ids() const
+		{
+			std::vector<unsigned> result;
+			result.reserve(entries_.size());
+			for (const auto& e : entries_)
+				result.push_back(e.id);
+			return result;
+		}
+
+		const IfcParse::entity& declaration(unsigned id) const { return *find(id).declaration; }
+		size_t attribute_count(unsigned id) const { return find(id).declaration->attribute_count(); }
+		IfcUtil::ArgumentType type(unsigned id, size_t attribute) const { return (IfcUtil::ArgumentType)at(id, attribute).type; }
+
+		int integer(unsigned id, size_t attribute) const
+		{
+			return integers_[expect(id, attribute, IfcUtil::Argument_INT).offset];
+		}
+
+		double real(unsigned id, size_t attribute) const
+		{
+			return reals_[expect(id, attribute, IfcUtil::Argument_DOUBLE).offset];
+		}
+
+		// Elements of a list, or of all rows of a list of lists
+		std::span<const int> integers(unsigned id, size_t attribute) const
+		{
+			const auto& s = at(id, attribute);
+			if (s.type == IfcUtil::Argument_EMPTY_AGGREGATE)
+				return {};
+			if (s.type == IfcUtil::Argument_AGGREGATE_OF_INT)
+				return { integers_.data() + s.offset, s.count };
+			expect(s, IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT);
+			return { integers_.data() + rows_[s.offset], rows_[s.offset + s.count] - rows_[s.offset] };
+		}
+
+		std::span<const double> reals(unsigned id, size_t attribute) const
+		{
+			const auto& s = at(id, attribute);
+			if (s.type == IfcUtil::Argument_EMPTY_AGGREGATE)
+				return {};
+			if (s.type == IfcUtil::Argument_AGGREGATE_OF_DOUBLE)
+				return { reals_.data() + s.offset, s.count };
+			expect(s, IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE);
+			return { reals_.data() + rows_[s.offset], rows_[s.offset + s.count] - rows_[s.offset] };
+		}
+
+		// Rows of a list of lists
+		size_t rows(unsigned id, size_t attribute) const
+		{
+			const auto& s = at(id, attribute);
+			if (s.type == IfcUtil::Argument_EMPTY_AGGREGATE)
+				return 0;
+			if (s.type != IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT)
+				expect(s, IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE);
+			return s.count;
+		}
+
+		// One row of a list of lists, rows past the last throw std::out_of_range
+		std::span<const int> integers(unsigned id, size_t attribute, size_t row) const
+		{
+			const auto& s = expect_row(id, attribute, IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT, row);
+			return { integers_.data() + rows_[s.offset + row], rows_[s.offset + row + 1] - rows_[s.offset + row] };
+		}
+
+		std::span<const double> reals(unsigned id, size_t attribute, size_t row) const
+		{
+			const auto& s = expect_row(id, attribute, IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE, row);
+			return { reals_.data() + rows_[s.offset + row], rows_[s.offset + row + 1] - rows_[s.offset + row] };
+		}
+
+		size_t bytes() const
+		{
+			return entries_.capacity() * sizeof(entry) + slots_.capacity() * sizeof(slot) + reals_.capacity() * sizeof(double) +
+				integers_.capacity() * sizeof(int) + rows_.capacity() * sizeof(uint32_t);
+		}
+
+	private:
+		struct slot
+		{
+			uint32_t offset = 0; // into reals_ or integers_, into rows_ for lists of lists
+			uint32_t count = 0;  // elements, rows for lists of lists
+			uint8_t type = IfcUtil::Argument_NULL;
+		};
+
+		struct entry
+		{
+			unsigned id;
+			uint32_t first; // first slot
+			const IfcParse::entity* declaration;
+		};
+
+		void add(const IfcUtil::IfcBaseClass* inst)
+		{
+			if (!is_numeric(inst))
+				return;
+			auto declaration = inst->declaration().as_entity();
+			entries_.push_back({ inst->id(), offset(slots_), declaration });
+			for (size_t i = 0; i < declaration->attribute_count(); i++)
+				slots_.push_back(store(inst->get_attribute_value(i)));
+		}
+
+		slot store(const AttributeValue& value)
+		{
+			slot s;
+			s.type = (uint8_t)value.type();
+			switch (value.type())
+			{
+			case IfcUtil::Argument_INT:
+				s.offset = offset(integers_);
+				s.count = 1;
+				integers_.push_back((int)value);
+				break;
+			case IfcUtil::Argument_DOUBLE:
+				s.offset = offset(reals_);
+				s.count = 1;
+				reals_.push_back((double)value);
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_INT:
+				s = append(integers_, (std::vector<int>)value, s.type);
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+				s = append(reals_, (std::vector<double>)value, s.type);
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+				s = append(integers_, (std::vector<std::vector<int>>)value, s.type);
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+				s = append(reals_, (std::vector<std::vector<double>>)value, s.type);
+				break;
+			default:
+				break;
+			}
+			return s;
+		}
+
+		template <typename T>
+		slot append(std::vector<T>& pool, const std::vector<T>& values, uint8_t type)
+		{
+			slot s{ offset(pool), (uint32_t)values.size(), type };
+			pool.insert(pool.end(), values.begin(), values.end());
+			return s;
+		}
+
+		template <typename T>
+		slot append(std::vector<T>& pool, const std::vector<std::vector<T>>& values, uint8_t type)
+		{
+			slot s{ offset(rows_), (uint32_t)values.size(), type };
+			for (const auto& row : values)
+			{
+				rows_.push_back(offset(pool));
+				pool.insert(pool.end(), row.begin(), row.end());
+			}
+			rows_.push_back(offset(pool));
+			return s;
+		}
+
+		template <typename T>
+		static uint32_t offset(const std::vector<T>& pool)
+		{
+			if (pool.size() > std::numeric_limits<uint32_t>::max())
+				throw std::length_error("compact_attributes: more than 2^32 values");
+			return (uint32_t)pool.size();
+		}
+
+		const entry* lookup(unsigned id) const
+		{
+			auto it = std::lower_bound(entries_.begin(), entries_.end(), id, [](const entry& e, unsigned v) { return e.id < v; });
+			return it != entries_.end() && it->id == id ? &*it : nullptr;
+		}
+
+		const entry& find(unsigned id) const
+		{
+			auto e = lookup(id);
+			if (e == nullptr)
+				throw std::out_of_range("compact_attributes: #" + std::to_string(id) + " is not stored");
+			return *e;
+		}
+
+		const slot& at(unsigned id, size_t attribute) const
+		{
+			const auto& e = find(id);
+			if (attribute >= e.declaration->attribute_count())
+				throw std::out_of_range("compact_attributes: #" + std::to_string(id) + " has no attribute " + std::to_string(attribute));
+			return slots_[e.first + attribute];
+		}
+
+		static const slot& expect(const slot& s, IfcUtil::ArgumentType type)
+		{
+			if (s.type != type)
+				throw std::logic_error("compact_attributes: attribute is not of the requested type");
+			return s;
+		}
+
+		const slot& expect(unsigned id, size_t attribute, IfcUtil::ArgumentType type) const
+		{
+			return expect(at(id, attribute), type);
+		}
+
+		// a list of lists of the type with the row, an empty list has no rows
+		const slot& expect_row(unsigned id, size_t attribute, IfcUtil::ArgumentType type, size_t row) const
+		{
+			const auto& s = at(id, attribute);
+			if (s.type != IfcUtil::Argument_EMPTY_AGGREGATE)
+				expect(s, type);
+			if (s.type == IfcUtil::Argument_EMPTY_AGGREGATE || row >= s.count)
+				throw std::out_of_range("compact_attributes: #" + std::to_string(id) + " has no row " + std::to_string(row) + " in attribute " + std::to_string(attribute));
+			return s;
+		}
+
+		std::vector<entry> entries_; // ascending by id
+		std::vector<slot> slots_;
+		std::vector<double> reals_;
+		std::vector<int> integers_;
+		std::vector<uint32_t> rows_; // row starts of lists of lists, one past the last row included
+	};
+}
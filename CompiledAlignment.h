@@ -0,0 +1,1168 @@
+#pragma once
+
+// Compiled form of a mapped alignment curve.
+//
+// The mapped function_item is a tree of taxonomy nodes held by shared_ptr; evaluating a station walks from the
+// composite to the segment to the parent curve. compiled_alignment flattens the horizontal and vertical layers of
+// an alignment_evaluator into contiguous arrays of tagged records, one per IfcCurveSegment. The start distances of
+// each layer are kept in a separate array for the search.
+//
+// A record holds the start frame of its segment (x, y and heading, or elevation and gradient) and the coefficients
+// of its kind. The parent curve type selects the kind; the frames and coefficients are fitted to the mapped curve so
+// the records follow the conventions of the mapping, e.g. for segment placement and the direction of negative
+// segment lengths. Every record is then checked against the mapped curve at points between the fitted ones. Parent
+// curves without a compiled kind, records that fail the check, segmented reference curves (cant) and curves without
+// segment tables are evaluated through the alignment_evaluator as generic records.
+//
+// The kernels are templates on the segment kind, so every kind has its own code for the position and
+// heading or elevation and gradient. Consecutive records of the same kind form a run. The batch evaluate() splits
+// ascending stations into blocks inside one horizontal and one vertical run and hands each block to a kernel
+// instantiated for that pair of kinds and for curves with or without a vertical layer, picked from a table once per
+// block. Inside a block there is no dispatch on the kind; single stations switch on the kind of their record.
+//
+// derived() returns the gradient, the horizontal and vertical curvature and the cant at a station in one call. For
+// compiled records they follow from the coefficients of the kind: the curvature is the derivative of the turn of
+// the record and the vertical curvature that of the slope angle, no frame is built. The cant layer of an
+// IfcSegmentedReferenceCurve is compiled into cant records for derived() only, frames of these curves remain
+// generic. The sine of the cant is fitted to the forms of the horizontal kinds line, polynomial_spiral,
+// cosine_spiral and sine_spiral, simplest first; cant segments that match none are generic. Generic records give the
+// gradient and cant of the mapped frame and curvatures by central differences of its heading and slope angle.
+//
+// Spirals have no closed form position; it is the integral of the direction of the heading, taken by Gauss-Legendre
+// quadrature over panels of limited turn. By default the 5 point rule on panels of a quarter radian. Compiled with a
+// precision, e.g. the Precision of the Settings, the spirals are evaluated by the rule with the fewest evaluations
+// of the heading whose estimated error stays below the precision, confirmed against the default rule on every
+// spiral record. Records are fitted and checked with the default rule either way.
+//
+// Results are in the output unit of the alignment_evaluator: records are fitted to its frames, so they carry the
+// unit and compiled kinds evaluate without a conversion per station. Compiled data is read-only after construction.
+// Generic records use the alignment_evaluator, other threads pass their own evaluation_cursor. Records loaded from a
+// cache have no alignment_evaluator unless one is passed, generic records then throw std::logic_error.
+
+#include "AlignmentEvaluator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	enum class segment_kind : uint8_t
+	{
+		line,              // horizontal, constant heading
+		arc,               // horizontal, constant curvature
+		clothoid,          // horizontal, curvature linear in the distance along
+		polynomial_spiral, // horizontal, curvature cubic in the distance along (second and third order polynomial spirals)
+		cosine_spiral,     // horizontal, curvature a + b cos(pi du / length)
+		sine_spiral,       // horizontal, curvature a + b du + c sin(2 pi du / length)
+		constant_gradient, // vertical
+		parabolic_arc,     // vertical, gradient linear in the distance along
+		circular_arc,      // vertical, sine of the slope angle linear in the distance along
+		generic,           // evaluated by the alignment_evaluator
+		count
+	};
+
+	inline const char* segment_kind_name(segment_kind k)
+	{
+		static const char* names[] = { "line", "arc", "clothoid", "polynomial_spiral", "cosine_spiral", "sine_spiral", "constant_gradient", "parabolic_arc", "circular_arc", "generic" };
+		return names[(size_t)k];
+	}
+
+	// number of horizontal kinds, line to sine_spiral, and of vertical kinds, constant_gradient to circular_arc
+	constexpr size_t horizontal_kinds = (size_t)segment_kind::constant_gradient;
+	constexpr size_t vertical_kinds = (size_t)segment_kind::generic - (size_t)segment_kind::constant_gradient;
+
+	struct horizontal_record
+	{
+		double start = 0.0;
+		double length = 0.0;
+		double x = 0.0;
+		double y = 0.0;
+		double heading = 0.0;
+		segment_kind kind = segment_kind::generic;
+		union
+		{
+			struct { double curvature; } arc;
+			struct { double curvature, rate; } clothoid; // curvature + rate * du
+			struct { double c[4]; } polynomial;          // c[0] + c[1] du + c[2] du^2 + c[3] du^3
+			struct { double a, b; } cosine;
+			struct { double a, b, c; } sine;
+		};
+
+		horizontal_record() : polynomial{ { 0.0, 0.0, 0.0, 0.0 } } {}
+	};
+
+	struct vertical_record
+	{
+		double start = 0.0;
+		double length = 0.0;
+		double z = 0.0;
+		double gradient = 0.0;
+		segment_kind kind = segment_kind::generic;
+		union
+		{
+			struct { double a; } parabola;         // z + gradient * du + a * du^2
+			struct { double curvature; } circular; // sin(slope angle) = sin(slope angle at start) + curvature * du
+		};
+
+		vertical_record() : parabola{ 0.0 } {}
+	};
+
+	// A segment of the cant layer. The sine of the cant, the rotation of the frame about its tangent, is
+	// line: c0 + c1 du, polynomial_spiral: c0 + c1 du + c2 du^2 + c3 du^3, cosine_spiral: c0 + c1 cos(pi du / length),
+	// sine_spiral: c0 + c1 du + c2 sin(2 pi du / length)
+	struct cant_record
+	{
+		double start = 0.0;
+		double length = 0.0;
+		segment_kind kind = segment_kind::generic;
+		double c[4] = { 0.0, 0.0, 0.0, 0.0 };
+	};
+
+	// Quantities at a station besides the frame, output units
+	struct derived_quantities
+	{
+		double gradient = 0.0;             // dz / du, u the horizontal distance along
+		double horizontal_curvature = 0.0; // d heading / du, positive to the left
+		double vertical_curvature = 0.0;   // d slope angle / d arc length of the profile, positive for sag curves
+		double cant = 0.0;                 // rotation of the frame about its tangent in radians
+	};
+
+	// Records [first, last) of a layer that have the same kind
+	struct segment_run
+	{
+		size_t first = 0;
+		size_t last = 0;
+		segment_kind kind = segment_kind::generic;
+	};
+
+	namespace compiled
+	{
+		constexpr double pi = 3.14159265358979323846;
+
+		// sin(x) / x
+		inline double sinc(double x)
+		{
+			if (std::fabs(x) < 1e-4)
+				return 1.0 - x * x / 6.0;
+			return std::sin(x) / x;
+		}
+
+		// (1 - cos(x)) / x
+		inline double cosc(double x)
+		{
+			if (std::fabs(x) < 1e-4)
+				return x / 2.0 - x * x * x / 24.0;
+			return (1.0 - std::cos(x)) / x;
+		}
+
+		// Gauss-Legendre rules on [-1, 1] of 2 to 5 points, indexed by the number of points
+		constexpr size_t max_points = 5;
+		constexpr std::array<std::array<double, max_points>, max_points + 1> gauss_nodes = { {
+			{}, {},
+			{ -0.5773502691896258, 0.5773502691896258 },
+			{ -0.7745966692414834, 0.0, 0.7745966692414834 },
+			{ -0.8611363115940526, -0.3399810435848563, 0.3399810435848563, 0.8611363115940526 },
+			{ -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640 }
+		} };
+		constexpr std::array<std::array<double, max_points>, max_points + 1> gauss_weights = { {
+			{}, {},
+			{ 1.0, 1.0 },
+			{ 0.5555555555555556, 0.8888888888888889, 0.5555555555555556 },
+			{ 0.3478548451374538, 0.6521451548625461, 0.6521451548625461, 0.3478548451374538 },
+			{ 0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891 }
+		} };
+
+		// error constant of the n point rule for a heading with a constant second derivative, (n!)^3 / ((2n + 1) ((2n)!)^2)
+		constexpr std::array<double, max_points + 1> gauss_errors = { 0.0, 0.0, 2.777777777777778e-3, 5.9523809523809524e-05, 9.448223733938019e-07, 1.1929575421638914e-08 };
+
+		// Rule and maximum change of heading within one panel for the spiral quadrature. The default is the most
+		// precise.
+		struct quadrature
+		{
+			size_t points = max_points;
+			double panel_angle = 0.25;
+		};
+
+		// largest change of heading of a panel for rules selected by precision
+		constexpr double max_panel_angle = 1.0;
+
+		// evaluations of the heading by q over a spiral that turns by at most turn
+		inline size_t quadrature_cost(const quadrature& q, double turn)
+		{
+			return q.points * (1 + (size_t)(turn / q.panel_angle));
+		}
+
+		// Rules for spirals up to length long and turning by up to turn whose estimated error stays below precision, in
+		// output units, cheaper than the default and cheapest first. On a panel of length h turning by phi through a
+		// change of curvature the n point rule integrates the direction of the heading with an error of about
+		// h gauss_errors[n] phi^n. For every rule the panel angle is half the largest that keeps the error over length
+		// ten times below precision, the turn of equal panels differs along a spiral. The estimate takes the change of
+		// curvature within a panel as constant, which it is not for cosine and sine spirals, so the candidates are to be
+		// confirmed against the records.
+		inline std::vector<quadrature> quadratures(double precision, double length, double turn)
+		{
+			std::vector<quadrature> result;
+			const size_t most_precise = quadrature_cost({}, turn);
+			for (size_t n = max_points; n >= 2; n--)
+			{
+				double angle = std::min(max_panel_angle, 0.5 * std::pow(precision / (10.0 * std::max(1.0, length) * gauss_errors[n]), 1.0 / n));
+				if (quadrature_cost({ n, angle }, turn) < most_precise)
+					result.push_back({ n, angle });
+			}
+			std::stable_sort(result.begin(), result.end(), [turn](const quadrature& a, const quadrature& b) { return quadrature_cost(a, turn) < quadrature_cost(b, turn); });
+			return result;
+		}
+
+		// Change of heading from the start of a record of kind K to du, the integral of the curvature
+		template <segment_kind K>
+		inline double turn(const horizontal_record& r, double du)
+		{
+			if constexpr (K == segment_kind::arc)
+				return r.arc.curvature * du;
+			else if constexpr (K == segment_kind::clothoid)
+				return r.clothoid.curvature * du + 0.5 * r.clothoid.rate * du * du;
+			else if constexpr (K == segment_kind::polynomial_spiral)
+			{
+				const auto& c = r.polynomial.c;
+				return du * (c[0] + du * (c[1] / 2.0 + du * (c[2] / 3.0 + du * c[3] / 4.0)));
+			}
+			else if constexpr (K == segment_kind::cosine_spiral)
+				return du * (r.cosine.a + r.cosine.b * sinc(pi * du / r.length));
+			else if constexpr (K == segment_kind::sine_spiral)
+				return du * (r.sine.a + 0.5 * r.sine.b * du + r.sine.c * cosc(2.0 * pi * du / r.length));
+			else
+				return 0.0;
+		}
+
+		// Upper bound of the change of heading from the start of a record of kind K to du, for the number of panels
+		template <segment_kind K>
+		inline double turn_bound(const horizontal_record& r, double du)
+		{
+			du = std::fabs(du);
+			if constexpr (K == segment_kind::clothoid)
+				return du * (std::fabs(r.clothoid.curvature) + 0.5 * std::fabs(r.clothoid.rate) * du);
+			else if constexpr (K == segment_kind::polynomial_spiral)
+			{
+				const auto& c = r.polynomial.c;
+				return du * (std::fabs(c[0]) + du * (std::fabs(c[1]) / 2.0 + du * (std::fabs(c[2]) / 3.0 + du * std::fabs(c[3]) / 4.0)));
+			}
+			else if constexpr (K == segment_kind::cosine_spiral)
+				return du * (std::fabs(r.cosine.a) + std::fabs(r.cosine.b));
+			else if constexpr (K == segment_kind::sine_spiral)
+				return du * (std::fabs(r.sine.a) + 0.5 * std::fabs(r.sine.b) * du + std::fabs(r.sine.c));
+			else
+				return 0.0;
+		}
+
+		// Position and heading at du along a horizontal record of kind K, spirals integrated by q
+		template <segment_kind K>
+		inline void evaluate_horizontal(const horizontal_record& r, double du, double& x, double& y, double& heading, const quadrature& q = {})
+		{
+			if constexpr (K == segment_kind::line)
+			{
+				x = r.x + du * std::cos(r.heading);
+				y = r.y + du * std::sin(r.heading);
+				heading = r.heading;
+			}
+			else if constexpr (K == segment_kind::arc)
+			{
+				// chord of length du * sinc(k du / 2) in the direction of the mean heading
+				double half = 0.5 * r.arc.curvature * du;
+				double chord = du * sinc(half);
+				x = r.x + chord * std::cos(r.heading + half);
+				y = r.y + chord * std::sin(r.heading + half);
+				heading = r.heading + 2.0 * half;
+			}
+			else if constexpr (K == segment_kind::generic || K >= segment_kind::constant_gradient)
+			{
+				x = r.x;
+				y = r.y;
+				heading = r.heading;
+			}
+			else
+			{
+				// spirals, the integral of the direction of the heading over panels of at most q.panel_angle turn
+				int panels = 1 + (int)(turn_bound<K>(r, du) / q.panel_angle);
+				double h = du / panels;
+				double sx = 0.0, sy = 0.0;
+				const auto& nodes = gauss_nodes[q.points];
+				const auto& weights = gauss_weights[q.points];
+				for (int p = 0; p < panels; p++)
+				{
+					double mid = h * (p + 0.5);
+					for (size_t i = 0; i < q.points; i++)
+					{
+						double t = r.heading + turn<K>(r, mid + 0.5 * h * nodes[i]);
+						sx += weights[i] * std::cos(t);
+						sy += weights[i] * std::sin(t);
+					}
+				}
+				IFCOS_UT_COUNT_N(integrator_iterations, (uint64_t)panels * q.points);
+				x = r.x + 0.5 * h * sx;
+				y = r.y + 0.5 * h * sy;
+				heading = r.heading + turn<K>(r, du);
+			}
+		}
+
+		// Elevation and gradient at du along a vertical record of kind K
+		template <segment_kind K>
+		inline void evaluate_vertical(const vertical_record& r, double du, double& z, double& gradient)
+		{
+			if constexpr (K == segment_kind::constant_gradient)
+			{
+				z = r.z + r.gradient * du;
+				gradient = r.gradient;
+			}
+			else if constexpr (K == segment_kind::parabolic_arc)
+			{
+				z = r.z + (r.gradient + r.parabola.a * du) * du;
+				gradient = r.gradient + 2.0 * r.parabola.a * du;
+			}
+			else if constexpr (K == segment_kind::circular_arc)
+			{
+				double c0 = 1.0 / std::sqrt(1.0 + r.gradient * r.gradient);
+				double s0 = r.gradient * c0;
+				double s = s0 + r.circular.curvature * du;
+				double c = std::sqrt(std::max(0.0, 1.0 - s * s));
+				// z difference (cos phi0 - cos phi) / k = (s^2 - s0^2) / (k (c0 + c)) = du (s + s0) / (c0 + c)
+				z = r.z + du * (s + s0) / (c0 + c);
+				gradient = s / c;
+			}
+			else
+			{
+				z = r.z;
+				gradient = r.gradient;
+			}
+		}
+
+		// Curvature at du along a horizontal record of kind K, the derivative of turn<K>
+		template <segment_kind K>
+		inline double curvature(const horizontal_record& r, double du)
+		{
+			if constexpr (K == segment_kind::arc)
+				return r.arc.curvature;
+			else if constexpr (K == segment_kind::clothoid)
+				return r.clothoid.curvature + r.clothoid.rate * du;
+			else if constexpr (K == segment_kind::polynomial_spiral)
+			{
+				const auto& c = r.polynomial.c;
+				return c[0] + du * (c[1] + du * (c[2] + du * c[3]));
+			}
+			else if constexpr (K == segment_kind::cosine_spiral)
+				return r.cosine.a + r.cosine.b * std::cos(pi * du / r.length);
+			else if constexpr (K == segment_kind::sine_spiral)
+				return r.sine.a + r.sine.b * du + r.sine.c * std::sin(2.0 * pi * du / r.length);
+			else
+				return 0.0;
+		}
+
+		// Curvature of the profile of a vertical record of kind K where its gradient is gradient
+		template <segment_kind K>
+		inline double vertical_curvature(const vertical_record& r, double gradient)
+		{
+			if constexpr (K == segment_kind::parabolic_arc)
+				return 2.0 * r.parabola.a / std::pow(1.0 + gradient * gradient, 1.5);
+			else if constexpr (K == segment_kind::circular_arc)
+				return r.circular.curvature;
+			else
+				return 0.0;
+		}
+
+		// Position and heading at du along a horizontal record
+		inline void evaluate(const horizontal_record& r, double du, double& x, double& y, double& heading, const quadrature& q = {})
+		{
+			switch (r.kind)
+			{
+			case segment_kind::line: return evaluate_horizontal<segment_kind::line>(r, du, x, y, heading);
+			case segment_kind::arc: return evaluate_horizontal<segment_kind::arc>(r, du, x, y, heading);
+			case segment_kind::clothoid: return evaluate_horizontal<segment_kind::clothoid>(r, du, x, y, heading, q);
+			case segment_kind::polynomial_spiral: return evaluate_horizontal<segment_kind::polynomial_spiral>(r, du, x, y, heading, q);
+			case segment_kind::cosine_spiral: return evaluate_horizontal<segment_kind::cosine_spiral>(r, du, x, y, heading, q);
+			case segment_kind::sine_spiral: return evaluate_horizontal<segment_kind::sine_spiral>(r, du, x, y, heading, q);
+			default: return evaluate_horizontal<segment_kind::generic>(r, du, x, y, heading);
+			}
+		}
+
+		// Elevation and gradient at du along a vertical record
+		inline void evaluate(const vertical_record& r, double du, double& z, double& gradient)
+		{
+			switch (r.kind)
+			{
+			case segment_kind::constant_gradient: return evaluate_vertical<segment_kind::constant_gradient>(r, du, z, gradient);
+			case segment_kind::parabolic_arc: return evaluate_vertical<segment_kind::parabolic_arc>(r, du, z, gradient);
+			case segment_kind::circular_arc: return evaluate_vertical<segment_kind::circular_arc>(r, du, z, gradient);
+			default: return evaluate_vertical<segment_kind::generic>(r, du, z, gradient);
+			}
+		}
+
+		inline double curvature(const horizontal_record& r, double du)
+		{
+			switch (r.kind)
+			{
+			case segment_kind::arc: return curvature<segment_kind::arc>(r, du);
+			case segment_kind::clothoid: return curvature<segment_kind::clothoid>(r, du);
+			case segment_kind::polynomial_spiral: return curvature<segment_kind::polynomial_spiral>(r, du);
+			case segment_kind::cosine_spiral: return curvature<segment_kind::cosine_spiral>(r, du);
+			case segment_kind::sine_spiral: return curvature<segment_kind::sine_spiral>(r, du);
+			default: return 0.0;
+			}
+		}
+
+		inline double turn_bound(const horizontal_record& r, double du)
+		{
+			switch (r.kind)
+			{
+			case segment_kind::clothoid: return turn_bound<segment_kind::clothoid>(r, du);
+			case segment_kind::polynomial_spiral: return turn_bound<segment_kind::polynomial_spiral>(r, du);
+			case segment_kind::cosine_spiral: return turn_bound<segment_kind::cosine_spiral>(r, du);
+			case segment_kind::sine_spiral: return turn_bound<segment_kind::sine_spiral>(r, du);
+			default: return 0.0;
+			}
+		}
+
+		inline double vertical_curvature(const vertical_record& r, double gradient)
+		{
+			switch (r.kind)
+			{
+			case segment_kind::parabolic_arc: return vertical_curvature<segment_kind::parabolic_arc>(r, gradient);
+			case segment_kind::circular_arc: return vertical_curvature<segment_kind::circular_arc>(r, gradient);
+			default: return 0.0;
+			}
+		}
+
+		// Sine of the cant at du along a cant record
+		inline double cant_sine(const cant_record& r, double du)
+		{
+			switch (r.kind)
+			{
+			case segment_kind::line: return r.c[0] + r.c[1] * du;
+			case segment_kind::polynomial_spiral: return r.c[0] + du * (r.c[1] + du * (r.c[2] + du * r.c[3]));
+			case segment_kind::cosine_spiral: return r.c[0] + r.c[1] * std::cos(pi * du / r.length);
+			case segment_kind::sine_spiral: return r.c[0] + r.c[1] * du + r.c[2] * std::sin(2.0 * pi * du / r.length);
+			default: return 0.0;
+			}
+		}
+
+		inline double cant(const cant_record& r, double du) { return std::asin(std::clamp(cant_sine(r, du), -1.0, 1.0)); }
+
+		// Frame of a horizontal curve, or of a gradient curve with the elevation and gradient of the vertical layer
+		inline Eigen::Matrix4d frame(double x, double y, double heading)
+		{
+			double c = std::cos(heading), s = std::sin(heading);
+			Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+			m(0, 0) = c; m(0, 1) = -s;
+			m(1, 0) = s; m(1, 1) = c;
+			m(0, 3) = x;
+			m(1, 3) = y;
+			return m;
+		}
+
+		inline Eigen::Matrix4d frame(double x, double y, double heading, double z, double gradient)
+		{
+			double c = std::cos(heading), s = std::sin(heading);
+			double norm = std::sqrt(1.0 + gradient * gradient);
+			Eigen::Vector3d tx(c / norm, s / norm, gradient / norm);
+			Eigen::Vector3d ty(-s, c, 0.0);
+			Eigen::Vector3d tz = tx.cross(ty);
+			Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+			m.block<3, 1>(0, 0) = tx;
+			m.block<3, 1>(0, 1) = ty;
+			m.block<3, 1>(0, 2) = tz;
+			m(0, 3) = x;
+			m(1, 3) = y;
+			m(2, 3) = z;
+			return m;
+		}
+
+		inline double heading(const Eigen::Matrix4d& m) { return std::atan2(m(1, 0), m(0, 0)); }
+		inline double gradient(const Eigen::Matrix4d& m) { return m(2, 0) / std::hypot(m(0, 0), m(1, 0)); }
+		inline double cant(const Eigen::Matrix4d& m) { return std::atan2(m(2, 1), m(2, 2)); }
+
+		// difference of two angles in [-pi, pi]
+		inline double angle_difference(double a, double b)
+		{
+			return std::remainder(a - b, 2.0 * pi);
+		}
+	}
+
+	// The Precision setting in output units, the positional error allowed to the integration of spirals
+	inline double integration_precision(const ifcopenshell::geometry::Settings& settings, const alignment_evaluator& evaluator)
+	{
+		return settings.get<ifcopenshell::geometry::settings::Precision>().get() / evaluator.output_unit();
+	}
+
+	class compiled_alignment
+	{
+	public:
+		// tolerance is relative to the segment length, with at least tolerance in output units. precision is the
+		// positional error in output units the spirals may be integrated with, 0 for the most precise quadrature.
+		explicit compiled_alignment(const alignment_evaluator& evaluator, double tolerance = 1e-6, double precision = 0.0) :
+			evaluator_(&evaluator),
+			tolerance_(tolerance),
+			precision_(precision),
+			start_(evaluator.start()),
+			end_(evaluator.end())
+		{
+			const auto& layers = evaluator.layers();
+			const bool reference_curve = evaluator.curve()->as<Ifc4x3_add2::IfcSegmentedReferenceCurve>() != nullptr;
+			const bool gradient = layers.size() == 2 && !reference_curve;
+
+			if (layers.empty() || layers.size() > 2 || reference_curve || layers.back().empty())
+			{
+				// curves without segment tables and segmented reference curves
+				horizontal_record r;
+				r.start = evaluator.start();
+				r.length = evaluator.end() - evaluator.start();
+				horizontal_.push_back(r);
+			}
+			else
+			{
+				if (gradient)
+				{
+					for (const auto& s : layers.front().segments())
+						vertical_.push_back(compile_vertical(s));
+				}
+				for (const auto& s : layers.back().segments())
+					horizontal_.push_back(compile_horizontal(s));
+				if (precision_ > 0.0)
+					quadrature_ = select_quadrature();
+			}
+
+			if (reference_curve && !layers.empty())
+			{
+				for (const auto& s : layers.front().segments())
+					cant_.push_back(compile_cant(s));
+			}
+
+			index();
+		}
+
+		// Spirals integrated at the Precision of settings, see integration_precision()
+		compiled_alignment(const alignment_evaluator& evaluator, const ifcopenshell::geometry::Settings& settings, double tolerance = 1e-6) :
+			compiled_alignment(evaluator, tolerance, integration_precision(settings, evaluator))
+		{
+		}
+
+		// Records compiled earlier, e.g. loaded from an alignment_store. Generic records are evaluated by evaluator,
+		// which may be null if there are none. Spirals use the most precise quadrature.
+		compiled_alignment(std::vector<horizontal_record> horizontal, std::vector<vertical_record> vertical, double start, double end, double tolerance, const alignment_evaluator* evaluator = nullptr,
+			std::vector<cant_record> cant = {}) :
+			evaluator_(evaluator),
+			tolerance_(tolerance),
+			start_(start),
+			end_(end),
+			horizontal_(std::move(horizontal)),
+			vertical_(std::move(vertical)),
+			cant_(std::move(cant))
+		{
+			index();
+		}
+
+		compiled_alignment(const compiled_alignment&) = delete;
+		compiled_alignment& operator=(const compiled_alignment&) = delete;
+
+		// Frame at distance along u, output units
+		Eigen::Matrix4d evaluate(double u) const
+		{
+			return evaluate(u, [this](double v) { return generic(v); });
+		}
+
+		// Frame at distance along u, generic records are evaluated with the cursor of the calling thread
+		Eigen::Matrix4d evaluate(double u, const evaluation_cursor& cursor) const
+		{
+			return evaluate(u, [&cursor](double v) { return cursor.evaluate(v); });
+		}
+
+		// Frames at the stations, bit-identical to evaluate(u) for every station. Ascending stations are evaluated
+		// in blocks by the kernel of the kinds of their runs.
+		std::vector<Eigen::Matrix4d> evaluate(const std::vector<double>& stations) const
+		{
+			std::vector<Eigen::Matrix4d> frames(stations.size());
+			evaluate(stations.data(), stations.size(), frames.data());
+			return frames;
+		}
+
+		std::vector<Eigen::Matrix4d> evaluate(const std::vector<double>& stations, const evaluation_cursor& cursor) const
+		{
+			std::vector<Eigen::Matrix4d> frames(stations.size());
+			evaluate(stations.data(), stations.size(), frames.data(), cursor);
+			return frames;
+		}
+
+		// Frames of n stations written to frames, e.g. one range of a batch split over threads
+		void evaluate(const double* stations, size_t n, Eigen::Matrix4d* frames) const
+		{
+			evaluate_batch(stations, n, frames, [this](double v) { return generic(v); });
+		}
+
+		void evaluate(const double* stations, size_t n, Eigen::Matrix4d* frames, const evaluation_cursor& cursor) const
+		{
+			evaluate_batch(stations, n, frames, [&cursor](double v) { return cursor.evaluate(v); });
+		}
+
+		// Gradient, curvatures and cant at distance along u, output units
+		derived_quantities derived(double u) const
+		{
+			return derived(u, [this](double v) { return generic(v); });
+		}
+
+		derived_quantities derived(double u, const evaluation_cursor& cursor) const
+		{
+			return derived(u, [&cursor](double v) { return cursor.evaluate(v); });
+		}
+
+		std::vector<derived_quantities> derived(const std::vector<double>& stations) const
+		{
+			std::vector<derived_quantities> result(stations.size());
+			for (size_t i = 0; i < stations.size(); i++)
+				result[i] = derived(stations[i]);
+			return result;
+		}
+
+		std::vector<derived_quantities> derived(const std::vector<double>& stations, const evaluation_cursor& cursor) const
+		{
+			std::vector<derived_quantities> result(stations.size());
+			for (size_t i = 0; i < stations.size(); i++)
+				result[i] = derived(stations[i], cursor);
+			return result;
+		}
+
+		const std::vector<horizontal_record>& horizontal() const { return horizontal_; }
+		const std::vector<vertical_record>& vertical() const { return vertical_; }
+		const std::vector<cant_record>& cant() const { return cant_; }
+		const std::vector<segment_run>& horizontal_runs() const { return horizontal_runs_; }
+		const std::vector<segment_run>& vertical_runs() const { return vertical_runs_; }
+		const alignment_evaluator& evaluator() const { return *evaluator_; }
+		bool has_evaluator() const { return evaluator_ != nullptr; }
+
+		double start() const { return start_; }
+		double end() const { return end_; }
+		double tolerance() const { return tolerance_; }
+		double precision() const { return precision_; }
+		const compiled::quadrature& quadrature() const { return quadrature_; }
+
+		// number of records of kind k in both layers
+		size_t count(segment_kind k) const
+		{
+			return std::count_if(horizontal_.begin(), horizontal_.end(), [k](const horizontal_record& r) { return r.kind == k; }) +
+				std::count_if(vertical_.begin(), vertical_.end(), [k](const vertical_record& r) { return r.kind == k; });
+		}
+
+		// true if no station is evaluated through the alignment_evaluator
+		bool fully_compiled() const { return count(segment_kind::generic) == 0; }
+
+		// size of the records, search arrays and runs
+		size_t bytes() const
+		{
+			return horizontal_.size() * (sizeof(horizontal_record) + sizeof(double)) + vertical_.size() * (sizeof(vertical_record) + sizeof(double)) +
+				cant_.size() * (sizeof(cant_record) + sizeof(double)) + (horizontal_runs_.size() + vertical_runs_.size()) * sizeof(segment_run);
+		}
+
+	private:
+		void index()
+		{
+			for (const auto& r : horizontal_)
+				horizontal_starts_.push_back(r.start);
+			for (const auto& r : vertical_)
+				vertical_starts_.push_back(r.start);
+			for (const auto& r : cant_)
+				cant_starts_.push_back(r.start);
+			horizontal_runs_ = runs(horizontal_);
+			vertical_runs_ = runs(vertical_);
+		}
+
+		Eigen::Matrix4d generic(double u) const
+		{
+			if (evaluator_ == nullptr)
+				throw std::logic_error("generic record without alignment_evaluator");
+			return evaluator_->evaluate(u);
+		}
+
+		static size_t find(const std::vector<double>& starts, double u)
+		{
+			IFCOS_UT_COUNT(segment_searches);
+			auto it = std::upper_bound(starts.begin(), starts.end(), u);
+			return it == starts.begin() ? 0 : std::distance(starts.begin(), it) - 1;
+		}
+
+		template <typename Record>
+		static std::vector<segment_run> runs(const std::vector<Record>& records)
+		{
+			std::vector<segment_run> result;
+			for (size_t i = 0; i < records.size(); i++)
+			{
+				if (result.empty() || result.back().kind != records[i].kind)
+					result.push_back({ i, i, records[i].kind });
+				result.back().last = i + 1;
+			}
+			return result;
+		}
+
+		template <typename Fallback>
+		Eigen::Matrix4d evaluate(double u, Fallback fallback) const
+		{
+			const auto& h = horizontal_[find(horizontal_starts_, u)];
+			if (h.kind == segment_kind::generic)
+				return fallback(u);
+
+			double x, y, heading;
+			compiled::evaluate(h, u - h.start, x, y, heading, quadrature_);
+			if (vertical_.empty())
+				return compiled::frame(x, y, heading);
+
+			const auto& v = vertical_[find(vertical_starts_, u)];
+			if (v.kind == segment_kind::generic)
+				return fallback(u);
+
+			double z, gradient;
+			compiled::evaluate(v, u - v.start, z, gradient);
+			return compiled::frame(x, y, heading, z, gradient);
+		}
+
+		template <typename Fallback>
+		derived_quantities derived(double u, Fallback fallback) const
+		{
+			derived_quantities d;
+			const auto& h = horizontal_[find(horizontal_starts_, u)];
+			const vertical_record* v = vertical_.empty() ? nullptr : &vertical_[find(vertical_starts_, u)];
+			if (h.kind == segment_kind::generic || (v && v->kind == segment_kind::generic))
+			{
+				d = differences(u, fallback);
+			}
+			else
+			{
+				d.horizontal_curvature = compiled::curvature(h, u - h.start);
+				if (v)
+				{
+					double z;
+					compiled::evaluate(*v, u - v->start, z, d.gradient);
+					d.vertical_curvature = compiled::vertical_curvature(*v, d.gradient);
+				}
+			}
+
+			if (!cant_.empty())
+			{
+				const auto& c = cant_[find(cant_starts_, u)];
+				if (c.kind != segment_kind::generic)
+					d.cant = compiled::cant(c, u - c.start);
+			}
+			return d;
+		}
+
+		// step of the central differences of generic records, output units
+		static constexpr double difference_step = 1e-3;
+
+		// Gradient and cant of the frame at u, curvatures by central differences of the heading and slope angle,
+		// one-sided at the ends of the curve
+		template <typename Fallback>
+		derived_quantities differences(double u, Fallback fallback) const
+		{
+			derived_quantities d;
+			Eigen::Matrix4d m = fallback(u);
+			d.gradient = compiled::gradient(m);
+			d.cant = compiled::cant(m);
+
+			double a = std::max(start_, u - difference_step), b = std::min(end_, u + difference_step);
+			if (b <= a)
+				return d;
+			Eigen::Matrix4d ma = fallback(a), mb = fallback(b);
+			d.horizontal_curvature = compiled::angle_difference(compiled::heading(mb), compiled::heading(ma)) / (b - a);
+			// d slope angle / d arc length = d slope angle / du * cos(slope angle)
+			d.vertical_curvature = (std::atan(compiled::gradient(mb)) - std::atan(compiled::gradient(ma))) / (b - a) / std::sqrt(1.0 + d.gradient * d.gradient);
+			return d;
+		}
+
+		// Evaluates n ascending stations that lie in one horizontal run of kind H and, with a vertical layer, in one
+		// vertical run of kind V. h and v are the records of the first station.
+		template <bool Gradient, segment_kind H, segment_kind V>
+		static void evaluate_run(const compiled_alignment& a, const double* u, size_t n, size_t h, size_t v, Eigen::Matrix4d* frames)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				while (h + 1 < a.horizontal_starts_.size() && a.horizontal_starts_[h + 1] <= u[i])
+					h++;
+				const auto& hr = a.horizontal_[h];
+				double x, y, heading;
+				compiled::evaluate_horizontal<H>(hr, u[i] - hr.start, x, y, heading, a.quadrature_);
+				if constexpr (Gradient)
+				{
+					while (v + 1 < a.vertical_starts_.size() && a.vertical_starts_[v + 1] <= u[i])
+						v++;
+					const auto& vr = a.vertical_[v];
+					double z, gradient;
+					compiled::evaluate_vertical<V>(vr, u[i] - vr.start, z, gradient);
+					frames[i] = compiled::frame(x, y, heading, z, gradient);
+				}
+				else
+				{
+					frames[i] = compiled::frame(x, y, heading);
+				}
+			}
+		}
+
+		using run_kernel = void (*)(const compiled_alignment&, const double*, size_t, size_t, size_t, Eigen::Matrix4d*);
+
+		// kernels indexed by the horizontal kind
+		template <size_t... I>
+		static constexpr std::array<run_kernel, sizeof...(I)> horizontal_kernels(std::index_sequence<I...>)
+		{
+			return { &evaluate_run<false, (segment_kind)I, segment_kind::constant_gradient>... };
+		}
+
+		// kernels indexed by horizontal kind * vertical_kinds + vertical kind - constant_gradient
+		template <size_t... I>
+		static constexpr std::array<run_kernel, sizeof...(I)> gradient_kernels(std::index_sequence<I...>)
+		{
+			return { &evaluate_run<true, (segment_kind)(I / vertical_kinds), (segment_kind)((size_t)segment_kind::constant_gradient + I % vertical_kinds)>... };
+		}
+
+		template <typename Fallback>
+		void evaluate_batch(const double* stations, size_t count, Eigen::Matrix4d* frames, Fallback fallback) const
+		{
+			static constexpr auto planar = horizontal_kernels(std::make_index_sequence<horizontal_kinds>());
+			static constexpr auto gradient = gradient_kernels(std::make_index_sequence<horizontal_kinds * vertical_kinds>());
+
+			if (!std::is_sorted(stations, stations + count))
+			{
+				for (size_t i = 0; i < count; i++)
+					frames[i] = evaluate(stations[i], fallback);
+				return;
+			}
+
+			const bool vertical = !vertical_.empty();
+			size_t hr = 0, vr = 0;
+			for (size_t i = 0; i < count;)
+			{
+				// runs of the station, and the start of the next run in either layer
+				const double u = stations[i];
+				while (hr + 1 < horizontal_runs_.size() && horizontal_starts_[horizontal_runs_[hr + 1].first] <= u)
+					hr++;
+				double limit = hr + 1 < horizontal_runs_.size() ? horizontal_starts_[horizontal_runs_[hr + 1].first] : std::numeric_limits<double>::infinity();
+				if (vertical)
+				{
+					while (vr + 1 < vertical_runs_.size() && vertical_starts_[vertical_runs_[vr + 1].first] <= u)
+						vr++;
+					if (vr + 1 < vertical_runs_.size())
+						limit = std::min(limit, vertical_starts_[vertical_runs_[vr + 1].first]);
+				}
+
+				size_t n = 0;
+				while (i + n < count && stations[i + n] < limit)
+					n++;
+
+				const auto& h = horizontal_runs_[hr];
+				if (h.kind == segment_kind::generic || (vertical && vertical_runs_[vr].kind == segment_kind::generic))
+				{
+					for (size_t k = i; k < i + n; k++)
+						frames[k] = fallback(stations[k]);
+				}
+				else if (vertical)
+				{
+					const auto& v = vertical_runs_[vr];
+					size_t index = (size_t)h.kind * vertical_kinds + (size_t)v.kind - (size_t)segment_kind::constant_gradient;
+					gradient[index](*this, &stations[i], n, std::max(h.first, find(horizontal_starts_, u)), std::max(v.first, find(vertical_starts_, u)), &frames[i]);
+				}
+				else
+				{
+					planar[(size_t)h.kind](*this, &stations[i], n, std::max(h.first, find(horizontal_starts_, u)), 0, &frames[i]);
+				}
+				i += n;
+			}
+		}
+
+		static constexpr int fit_samples = 8;
+
+		double tolerance(double length) const { return tolerance_ * std::max(1.0, length); }
+
+		static segment_kind horizontal_kind(const std::string& curve_type)
+		{
+			if (curve_type == "IfcLine") return segment_kind::line;
+			if (curve_type == "IfcCircle") return segment_kind::arc;
+			if (curve_type == "IfcClothoid") return segment_kind::clothoid;
+			if (curve_type == "IfcSecondOrderPolynomialSpiral" || curve_type == "IfcThirdOrderPolynomialSpiral") return segment_kind::polynomial_spiral;
+			if (curve_type == "IfcCosineSpiral") return segment_kind::cosine_spiral;
+			if (curve_type == "IfcSineSpiral") return segment_kind::sine_spiral;
+			return segment_kind::generic;
+		}
+
+		static segment_kind vertical_kind(const std::string& curve_type)
+		{
+			if (curve_type == "IfcLine") return segment_kind::constant_gradient;
+			if (curve_type == "IfcPolynomialCurve") return segment_kind::parabolic_arc;
+			if (curve_type == "IfcCircle") return segment_kind::circular_arc;
+			return segment_kind::generic;
+		}
+
+		horizontal_record compile_horizontal(const segment_record& s) const
+		{
+			horizontal_record r;
+			r.start = s.start;
+			r.length = s.length;
+
+			Eigen::Matrix4d m0 = evaluator_->evaluate(s.start);
+			r.x = m0(0, 3);
+			r.y = m0(1, 3);
+			r.heading = compiled::heading(m0);
+
+			auto kind = horizontal_kind(s.curve_type);
+			if (kind == segment_kind::generic || s.length <= 0.0)
+				return r;
+
+			// unwrapped headings at fit_samples points inside the segment
+			double step = s.length / fit_samples;
+			std::array<double, fit_samples> theta;
+			theta[0] = r.heading;
+			for (int i = 1; i < fit_samples; i++)
+				theta[i] = theta[i - 1] + compiled::angle_difference(compiled::heading(evaluator_->evaluate(s.start + step * i)), theta[i - 1]);
+
+			r.kind = kind;
+			if (kind == segment_kind::arc)
+			{
+				r.arc.curvature = (theta[fit_samples - 1] - theta[0]) / (step * (fit_samples - 1));
+			}
+			else if (kind == segment_kind::clothoid)
+			{
+				// heading - heading at start = curvature du + rate du^2 / 2 through du = a and du = b
+				double a = step * fit_samples / 2, b = step * (fit_samples - 1);
+				double da = theta[fit_samples / 2] - theta[0], db = theta[fit_samples - 1] - theta[0];
+				r.clothoid.rate = 2.0 * (db / b - da / a) / (b - a);
+				r.clothoid.curvature = da / a - r.clothoid.rate * a / 2.0;
+			}
+			else
+			{
+				// least squares fit of the heading changes to the turn of the kind, one column per coefficient
+				const double w = compiled::pi / s.length;
+				Eigen::MatrixXd basis(fit_samples - 1, kind == segment_kind::polynomial_spiral ? 4 : kind == segment_kind::cosine_spiral ? 2 : 3);
+				Eigen::VectorXd turn(fit_samples - 1);
+				for (int i = 1; i < fit_samples; i++)
+				{
+					double du = step * i;
+					turn(i - 1) = theta[i] - theta[0];
+					if (kind == segment_kind::polynomial_spiral)
+						basis.row(i - 1) << du, du * du / 2.0, du * du * du / 3.0, du * du * du * du / 4.0;
+					else if (kind == segment_kind::cosine_spiral)
+						basis.row(i - 1) << du, du * compiled::sinc(w * du);
+					else
+						basis.row(i - 1) << du, du * du / 2.0, du * compiled::cosc(2.0 * w * du);
+				}
+				// columns scaled to unit norm, the powers of du differ by orders of magnitude
+				Eigen::VectorXd scale = basis.colwise().norm().transpose();
+				Eigen::VectorXd c = (basis * scale.cwiseInverse().asDiagonal()).colPivHouseholderQr().solve(turn).cwiseQuotient(scale);
+				if (kind == segment_kind::polynomial_spiral)
+					r.polynomial = { { c(0), c(1), c(2), c(3) } };
+				else if (kind == segment_kind::cosine_spiral)
+					r.cosine = { c(0), c(1) };
+				else
+					r.sine = { c(0), c(1), c(2) };
+			}
+
+			if (!check(r, step))
+				r.kind = segment_kind::generic;
+			return r;
+		}
+
+		vertical_record compile_vertical(const segment_record& s) const
+		{
+			vertical_record r;
+			r.start = s.start;
+			r.length = s.length;
+
+			Eigen::Matrix4d m0 = evaluator_->evaluate(s.start);
+			r.z = m0(2, 3);
+			r.gradient = compiled::gradient(m0);
+
+			auto kind = vertical_kind(s.curve_type);
+			if (kind == segment_kind::generic || s.length <= 0.0)
+				return r;
+
+			double b = s.length / fit_samples * (fit_samples - 1);
+			double g1 = compiled::gradient(evaluator_->evaluate(s.start + b));
+
+			r.kind = kind;
+			if (kind == segment_kind::parabolic_arc)
+			{
+				r.parabola.a = (g1 - r.gradient) / (2.0 * b);
+			}
+			else if (kind == segment_kind::circular_arc)
+			{
+				auto sine = [](double g) { return g / std::sqrt(1.0 + g * g); };
+				r.circular.curvature = (sine(g1) - sine(r.gradient)) / b;
+			}
+
+			// elevation and gradient between the fitted points
+			double step = s.length / fit_samples;
+			for (int i = 0; i < fit_samples; i++)
+			{
+				double du = step * (i + 0.5);
+				Eigen::Matrix4d m = evaluator_->evaluate(s.start + du);
+				double z, gradient;
+				compiled::evaluate(r, du, z, gradient);
+				if (std::fabs(z - m(2, 3)) > tolerance(s.length) || std::fabs(gradient - compiled::gradient(m)) > tolerance_)
+				{
+					r.kind = segment_kind::generic;
+					break;
+				}
+			}
+			return r;
+		}
+
+		// the sine of the mapped cant fitted to the forms of the cant kinds, the first that matches between the fitted points
+		cant_record compile_cant(const segment_record& s) const
+		{
+			cant_record r;
+			r.start = s.start;
+			r.length = s.length;
+			if (s.length <= 0.0)
+				return r;
+
+			const double step = s.length / fit_samples;
+			Eigen::VectorXd sine(fit_samples);
+			std::array<double, fit_samples> expected;
+			for (int i = 0; i < fit_samples; i++)
+			{
+				sine(i) = std::sin(compiled::cant(evaluator_->evaluate(s.start + step * i)));
+				expected[i] = compiled::cant(evaluator_->evaluate(s.start + step * (i + 0.5)));
+			}
+
+			const double w = compiled::pi / s.length;
+			for (auto kind : { segment_kind::line, segment_kind::polynomial_spiral, segment_kind::cosine_spiral, segment_kind::sine_spiral })
+			{
+				Eigen::MatrixXd basis(fit_samples, kind == segment_kind::polynomial_spiral ? 4 : kind == segment_kind::sine_spiral ? 3 : 2);
+				for (int i = 0; i < fit_samples; i++)
+				{
+					double du = step * i;
+					if (kind == segment_kind::line)
+						basis.row(i) << 1.0, du;
+					else if (kind == segment_kind::polynomial_spiral)
+						basis.row(i) << 1.0, du, du * du, du * du * du;
+					else if (kind == segment_kind::cosine_spiral)
+						basis.row(i) << 1.0, std::cos(w * du);
+					else
+						basis.row(i) << 1.0, du, std::sin(2.0 * w * du);
+				}
+				Eigen::VectorXd scale = basis.colwise().norm().transpose();
+				Eigen::VectorXd c = (basis * scale.cwiseInverse().asDiagonal()).colPivHouseholderQr().solve(sine).cwiseQuotient(scale);
+
+				r.kind = kind;
+				for (Eigen::Index k = 0; k < 4; k++)
+					r.c[k] = k < c.size() ? c(k) : 0.0;
+
+				bool matches = true;
+				for (int i = 0; i < fit_samples && matches; i++)
+					matches = std::fabs(compiled::cant(r, step * (i + 0.5)) - expected[i]) <= tolerance_;
+				if (matches)
+					return r;
+			}
+
+			r.kind = segment_kind::generic;
+			return r;
+		}
+
+		// compares the complete frames between the fitted points with the mapped curve
+		bool check(const horizontal_record& r, double step) const
+		{
+			for (int i = 0; i < fit_samples; i++)
+			{
+				double u = r.start + step * (i + 0.5);
+				Eigen::Matrix4d expected = evaluator_->evaluate(u);
+
+				double x, y, heading;
+				compiled::evaluate(r, u - r.start, x, y, heading);
+				Eigen::Matrix4d m;
+				if (vertical_.empty())
+				{
+					m = compiled::frame(x, y, heading);
+				}
+				else
+				{
+					const auto& v = vertical_[find_vertical(u)];
+					if (v.kind == segment_kind::generic)
+					{
+						// only the horizontal position and heading can be compared
+						if (std::hypot(x - expected(0, 3), y - expected(1, 3)) > tolerance(r.length) ||
+							std::fabs(compiled::angle_difference(heading, compiled::heading(expected))) > tolerance_)
+							return false;
+						continue;
+					}
+					double z, gradient;
+					compiled::evaluate(v, u - v.start, z, gradient);
+					m = compiled::frame(x, y, heading, z, gradient);
+				}
+
+				if ((m.col(3) - expected.col(3)).norm() > tolerance(r.length) || (m.block<3, 3>(0, 0) - expected.block<3, 3>(0, 0)).norm() > tolerance_)
+					return false;
+			}
+			return true;
+		}
+
+		// The cheapest candidate rule that places the spiral records within precision_ of the most precise rule, at
+		// twice the points of the check and at their ends. The records are compiled and checked with the most precise
+		// rule, so positions stay within the tolerance plus precision_ of the mapped curve.
+		compiled::quadrature select_quadrature() const
+		{
+			double longest = 0.0, turn = 0.0;
+			for (const auto& r : horizontal_)
+			{
+				if (r.kind >= segment_kind::clothoid && r.kind <= segment_kind::sine_spiral)
+				{
+					longest = std::max(longest, std::fabs(r.length));
+					turn = std::max(turn, compiled::turn_bound(r, r.length));
+				}
+			}
+			if (longest == 0.0)
+				return {};
+
+			for (const auto& q : compiled::quadratures(precision_, longest, turn))
+			{
+				bool matches = true;
+				for (size_t k = 0; k < horizontal_.size() && matches; k++)
+				{
+					const auto& r = horizontal_[k];
+					if (r.kind < segment_kind::clothoid || r.kind > segment_kind::sine_spiral)
+						continue;
+					for (int i = 1; i <= 2 * fit_samples && matches; i++)
+					{
+						double du = r.length * i / (2 * fit_samples);
+						double x, y, heading, ex, ey, eheading;
+						compiled::evaluate(r, du, ex, ey, eheading);
+						compiled::evaluate(r, du, x, y, heading, q);
+						matches = std::hypot(x - ex, y - ey) <= precision_;
+					}
+				}
+				if (matches)
+					return q;
+			}
+			return {};
+		}
+
+		// vertical records are compiled before the horizontal ones, the search array is not built yet
+		size_t find_vertical(double u) const
+		{
+			IFCOS_UT_COUNT(segment_searches);
+			auto it = std::upper_bound(vertical_.begin(), vertical_.end(), u, [](double v, const vertical_record& r) { return v < r.start; });
+			return it == vertical_.begin() ? 0 : std::distance(vertical_.begin(), it) - 1;
+		}
+
+		const alignment_evaluator* evaluator_;
+		double tolerance_;
+		double precision_ = 0.0;
+		compiled::quadrature quadrature_;
+		double start_;
+		double end_;
+		std::vector<horizontal_record> horizontal_;
+		std::vector<vertical_record> vertical_;
+		std::vector<cant_record> cant_;
+		std::vector<double> horizontal_starts_;
+		std::vector<double> vertical_starts_;
+		std::vector<double> cant_starts_;
+		std::vector<segment_run> horizontal_runs_;
+		std::vector<segment_run> vertical_runs_;
+	};
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+// Instanced geometry output for products represented by IfcMappedItem.
+//
+// instanced_iterator visits the products of a file that are represented by mapped items. The tessellation of each
+// IfcRepresentationMap is emitted once, the first time it is used, followed by one instance element per product and
+// mapped item carrying only the placement matrix. Linear placements are resolved through linear_placement_resolver,
+// so the basis curve is mapped once for all instances.
+//
+// Tessellation is taken directly from IfcPolygonalFaceSet and IfcTriangulatedFaceSet items. Other representation
+// items need a geometry kernel and are skipped. Coordinates and matrices are in the output unit of the alignment_cache.
+// Given a compact_attributes store of the file, the point lists and face indices it holds are read from its pools
+// instead of the instances.
+
+#include "CompactAttributes.h"
+#include "LinearPlacementResolver.h"
+
+#include <map>
+#include <span>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	struct instanced_mesh
+	{
+		std::vector<double> vertices; // x, y, z
+		std::vector<int> indices;     // triangles, 0-based
+
+		size_t bytes() const { return vertices.size() * sizeof(double) + indices.size() * sizeof(int); }
+		size_t triangle_count() const { return indices.size() / 3; }
+	};
+
+	// Appends a tessellated face set to mesh, transformed by m. Returns false for items that are not tessellated.
+	// Point lists and polygonal faces stored in attributes are read from the store.
+	inline bool append_tessellation(instanced_mesh& mesh, const Ifc4x3_add2::IfcRepresentationItem* item, const Eigen::Matrix4d& m, double length_unit,
+		const compact_attributes* attributes = nullptr)
+	{
+		auto face_set = item->as<Ifc4x3_add2::IfcTessellatedFaceSet>();
+		if (face_set == nullptr)
+			return false;
+
+		auto offset = (int)(mesh.vertices.size() / 3);
+		auto add_point = [&mesh, &m, length_unit](std::span<const double> c)
+		{
+			Eigen::Vector4d p(c[0] * length_unit, c[1] * length_unit, c.size() > 2 ? c[2] * length_unit : 0.0, 1.0);
+			p = m * p;
+			mesh.vertices.insert(mesh.vertices.end(), { p(0), p(1), p(2) });
+		};
+		auto coordinates = face_set->Coordinates();
+		if (attributes != nullptr && attributes->contains(coordinates->id()))
+		{
+			for (size_t row = 0; row < attributes->rows(coordinates->id(), 0); row++)
+				add_point(attributes->reals(coordinates->id(), 0, row));
+		}
+		else
+		{
+			for (const auto& c : coordinates->CoordList())
+				add_point(c);
+		}
+
+		// STEP indices are 1-based and optionally indirect through PnIndex
+		auto add_polygon = [&mesh, offset](std::span<const int> polygon, const std::vector<int>& pn_index)
+		{
+			auto vertex = [&](size_t i) { return offset + (pn_index.empty() ? polygon[i] : pn_index[polygon[i] - 1]) - 1; };
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+			{
+				mesh.indices.insert(mesh.indices.end(), { vertex(0), vertex(i), vertex(i + 1) });
+			}
+		};
+
+		if (auto pfs = face_set->as<Ifc4x3_add2::IfcPolygonalFaceSet>())
+		{
+			auto pn_index = pfs->PnIndex().get_value_or(std::vector<int>());
+			for (auto& face : *pfs->Faces())
+			{
+				// inner loops of IfcIndexedPolygonalFaceWithVoids are not supported by the fan triangulation and are ignored
+				if (attributes != nullptr && attributes->contains(face->id()))
+					add_polygon(attributes->integers(face->id(), 0), pn_index);
+				else
+					add_polygon(face->CoordIndex(), pn_index);
+			}
+		}
+		else if (auto tfs = face_set->as<Ifc4x3_add2::IfcTriangulatedFaceSet>())
+		{
+			auto pn_index = tfs->PnIndex().get_value_or(std::vector<int>());
+			for (const auto& triangle : tfs->CoordIndex())
+			{
+				add_polygon(triangle, pn_index);
+			}
+		}
+		return true;
+	}
+
+	class instanced_iterator
+	{
+	public:
+		enum class element_type { mesh, instance };
+
+		struct element
+		{
+			element_type type = element_type::mesh;
+			const Ifc4x3_add2::IfcRepresentationMap* representation_map = nullptr;
+			const instanced_mesh* mesh = nullptr;                 // set for mesh elements
+			const Ifc4x3_add2::IfcProduct* product = nullptr;    // set for instance elements
+			Eigen::Matrix4d transformation = Eigen::Matrix4d::Identity(); // object placement * mapping target, set for instance elements
+		};
+
+		// attributes, if given, is a compact_attributes store of file that outlives the iterator
+		instanced_iterator(IfcParse::IfcFile& file, ifcopenshell::geometry::Settings& settings, const compact_attributes* attributes = nullptr) :
+			cache_(file, settings),
+			resolver_(cache_),
+			attributes_(attributes)
+		{
+			auto products = file.instances_by_type<Ifc4x3_add2::IfcProduct>();
+			for (auto& product : *products)
+			{
+				auto representation = product->Representation();
+				if (representation == nullptr)
+					continue;
+				for (auto& rep : *representation->Representations())
+				{
+					for (auto& item : *rep->Items())
+					{
+						if (auto mapped_item = item->as<Ifc4x3_add2::IfcMappedItem>())
+							pending_.push_back({ product, mapped_item });
+					}
+				}
+			}
+		}
+
+		instanced_iterator(const instanced_iterator&) = delete;
+		instanced_iterator& operator=(const instanced_iterator&) = delete;
+
+		// Advances to the next element, returns false when all instances have been emitted
+		bool next()
+		{
+			if (next_ >= pending_.size())
+				return false;
+
+			const auto& [product, mapped_item] = pending_[next_];
+			auto representation_map = mapped_item->MappingSource();
+
+			auto it = meshes_.find(representation_map);
+			if (it == meshes_.end())
+			{
+				// first use of this representation map, emit its tessellation before the instance
+				auto& mesh = meshes_[representation_map];
+				auto origin = map_matrix(representation_map->MappingOrigin());
+				for (auto& item : *representation_map->MappedRepresentation()->Items())
+				{
+					append_tessellation(mesh, item, origin, cache_.length_unit(), attributes_);
+				}
+
+				current_ = element();
+				current_.type = element_type::mesh;
+				current_.representation_map = representation_map;
+				current_.mesh = &mesh;
+				return true;
+			}
+
+			current_ = element();
+			current_.type = element_type::instance;
+			current_.representation_map = representation_map;
+			current_.mesh = &it->second;
+			current_.product = product;
+			current_.transformation = placement(product) * map_matrix(mapped_item->MappingTarget());
+			instance_bytes_ += sizeof(Eigen::Matrix4d);
+			duplicated_bytes_ += it->second.bytes();
+			next_++;
+			return true;
+		}
+
+		const element& get() const { return current_; }
+
+		size_t mesh_count() const { return meshes_.size(); }
+
+		// bytes of the emitted meshes plus one matrix per instance
+		size_t instanced_bytes() const
+		{
+			size_t bytes = instance_bytes_;
+			for (const auto& [map, mesh] : meshes_)
+				bytes += mesh.bytes();
+			return bytes;
+		}
+
+		// bytes if every instance carried its own copy of the mesh
+		size_t duplicated_bytes() const { return duplicated_bytes_; }
+
+	private:
+		Eigen::Matrix4d placement(const Ifc4x3_add2::IfcProduct* product)
+		{
+			auto object_placement = product->ObjectPlacement();
+			if (object_placement == nullptr)
+				return Eigen::Matrix4d::Identity();
+			if (auto lp = object_placement->as<Ifc4x3_add2::IfcLinearPlacement>())
+				return resolver_.resolve(lp);
+			return map_matrix(object_placement);
+		}
+
+		Eigen::Matrix4d map_matrix(const IfcUtil::IfcBaseClass* inst)
+		{
+			if (inst == nullptr)
+				return Eigen::Matrix4d::Identity();
+			auto m = ifcopenshell::geometry::taxonomy::dcast<ifcopenshell::geometry::taxonomy::matrix4>(cache_.mapping().map(inst));
+			return m ? m->ccomponents() : Eigen::Matrix4d::Identity();
+		}
+
+		alignment_cache cache_;
+		linear_placement_resolver resolver_;
+		const compact_attributes* attributes_;
+		std::vector<std::pair<const Ifc4x3_add2::IfcProduct*, const Ifc4x3_add2::IfcMappedItem*>> pending_;
+		size_t next_ = 0;
+		std::map<const Ifc4x3_add2::IfcRepresentationMap*, instanced_mesh> meshes_;
+		element current_;
+		size_t instance_bytes_ = 0;
+		size_t duplicated_bytes_ = 0;
+	};
+}
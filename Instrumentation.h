@@ -0,0 +1,239 @@
+#pragma once
+
+// Opt-in instrumentation counters for the alignment evaluation code in this project.
+//
+// Recording is disabled by default and costs one relaxed atomic load per call site while disabled.
+// Define IFCOS_UT_NO_INSTRUMENTATION to compile the recording calls out entirely.
+//
+// Counters have a total and an optional detail key, e.g. evaluations per parent curve type or
+// mappings per entity type. Time is accumulated per evaluated node type: alignment_evaluator records every evaluation
+// under the taxonomy node type of its root function and under the parent curve type of the segment it evaluates in
+// every layer, so like the evaluations of a gradient curve its time counts for a horizontal and a vertical segment.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	namespace instrumentation
+	{
+		enum class counter
+		{
+			evaluations,           // function evaluations, detail is the parent curve type of the segment evaluated
+			segment_searches,      // binary searches of a segment table by station_cursor and compiled_alignment
+			integrator_iterations, // quadrature nodes evaluated by the spiral kernels of compiled_alignment
+			cache_hits,            // detail is the entity type looked up
+			cache_misses,          // detail is the entity type looked up
+			allocations,           // evaluators and other per-curve structures created, detail is the structure type
+			mappings,              // calls into the IfcOpenShell mapping, detail is the entity type mapped
+			count
+		};
+
+		inline const char* counter_name(counter c)
+		{
+			static const char* names[] = { "evaluations", "segment_searches", "integrator_iterations", "cache_hits", "cache_misses", "allocations", "mappings" };
+			return names[(size_t)c];
+		}
+
+		class registry
+		{
+		public:
+			static registry& instance()
+			{
+				static registry r;
+				return r;
+			}
+
+			bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+			void enable(bool b) { enabled_.store(b, std::memory_order_relaxed); }
+
+			void reset()
+			{
+				for (auto& t : totals_)
+					t.store(0, std::memory_order_relaxed);
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (auto& d : details_)
+					d.clear();
+				seconds_.clear();
+			}
+
+			void add(counter c, uint64_t n)
+			{
+				totals_[(size_t)c].fetch_add(n, std::memory_order_relaxed);
+			}
+
+			void add(counter c, const std::string& detail, uint64_t n)
+			{
+				totals_[(size_t)c].fetch_add(n, std::memory_order_relaxed);
+				std::lock_guard<std::mutex> lock(mutex_);
+				details_[(size_t)c][detail] += n;
+			}
+
+			void add_time(const std::string& node_type, double seconds)
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				seconds_[node_type] += seconds;
+			}
+
+			uint64_t value(counter c) const
+			{
+				return totals_[(size_t)c].load(std::memory_order_relaxed);
+			}
+
+			uint64_t value(counter c, const std::string& detail) const
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				auto& m = details_[(size_t)c];
+				auto it = m.find(detail);
+				return it == m.end() ? 0 : it->second;
+			}
+
+			std::map<std::string, uint64_t> details(counter c) const
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				return details_[(size_t)c];
+			}
+
+			double seconds(const std::string& node_type) const
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				auto it = seconds_.find(node_type);
+				return it == seconds_.end() ? 0.0 : it->second;
+			}
+
+			std::string report() const
+			{
+				std::ostringstream os;
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (size_t i = 0; i < (size_t)counter::count; i++)
+				{
+					os << counter_name((counter)i) << ": " << totals_[i].load(std::memory_order_relaxed) << "\n";
+					for (const auto& [detail, n] : details_[i])
+						os << "    " << detail << ": " << n << "\n";
+				}
+				os << "time:\n";
+				for (const auto& [node_type, s] : seconds_)
+					os << "    " << node_type << ": " << s << " s\n";
+				return os.str();
+			}
+
+		private:
+			registry() = default;
+
+			std::atomic<bool> enabled_{ false };
+			std::array<std::atomic<uint64_t>, (size_t)counter::count> totals_{};
+			mutable std::mutex mutex_;
+			std::array<std::map<std::string, uint64_t>, (size_t)counter::count> details_;
+			std::map<std::string, double> seconds_;
+		};
+
+		inline void enable(bool b = true) { registry::instance().enable(b); }
+		inline void disable() { registry::instance().enable(false); }
+		inline bool enabled() { return registry::instance().enabled(); }
+		inline void reset() { registry::instance().reset(); }
+		inline uint64_t value(counter c) { return registry::instance().value(c); }
+		inline uint64_t value(counter c, const std::string& detail) { return registry::instance().value(c, detail); }
+		inline double seconds(const std::string& node_type) { return registry::instance().seconds(node_type); }
+		inline std::string report() { return registry::instance().report(); }
+
+		// Resets the counters and enables recording for the lifetime of the object
+		class enabled_scope
+		{
+		public:
+			enabled_scope()
+			{
+				reset();
+				enable();
+			}
+
+			enabled_scope(const enabled_scope&) = delete;
+			enabled_scope& operator=(const enabled_scope&) = delete;
+
+			~enabled_scope()
+			{
+				disable();
+			}
+		};
+
+		// Unqualified type name of a taxonomy node, e.g. "piecewise_function"
+		template <typename T>
+		std::string node_type(const T& node)
+		{
+			std::string name = typeid(node).name();
+			auto pos = name.rfind("::");
+			if (pos != std::string::npos)
+				name = name.substr(pos + 2);
+			return name;
+		}
+
+		// Accumulates the time between construction and destruction for a node type, and for the node types added with
+		// also(). The clock is only read when instrumentation was enabled at construction.
+		class scoped_timer
+		{
+		public:
+			scoped_timer(const std::string& node_type) : active_(enabled())
+			{
+				if (active_)
+				{
+					node_types_.push_back(node_type);
+					start_ = std::chrono::steady_clock::now();
+				}
+			}
+
+			scoped_timer(const scoped_timer&) = delete;
+			scoped_timer& operator=(const scoped_timer&) = delete;
+
+			void also(const std::string& node_type)
+			{
+				if (active_)
+					node_types_.push_back(node_type);
+			}
+
+			~scoped_timer()
+			{
+				if (active_)
+				{
+					auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+					for (const auto& node_type : node_types_)
+						registry::instance().add_time(node_type, seconds);
+				}
+			}
+
+		private:
+			bool active_;
+			std::vector<std::string> node_types_;
+			std::chrono::steady_clock::time_point start_;
+		};
+	}
+}
+
+#ifdef IFCOS_UT_NO_INSTRUMENTATION
+#define IFCOS_UT_COUNT(c) ((void)0)
+#define IFCOS_UT_COUNT_N(c, n) ((void)0)
+#define IFCOS_UT_COUNT_DETAIL(c, detail) ((void)0)
+#define IFCOS_UT_TIME(node_type) ((void)0)
+#define IFCOS_UT_TIMER(name, node_type) ((void)0)
+#define IFCOS_UT_TIME_ALSO(name, node_type) ((void)0)
+#else
+#define IFCOS_UT_COUNT(c) \
+	do { if (::IfcOpenShellUnitTests::instrumentation::enabled()) ::IfcOpenShellUnitTests::instrumentation::registry::instance().add(::IfcOpenShellUnitTests::instrumentation::counter::c, 1); } while (0)
+#define IFCOS_UT_COUNT_N(c, n) \
+	do { if (::IfcOpenShellUnitTests::instrumentation::enabled()) ::IfcOpenShellUnitTests::instrumentation::registry::instance().add(::IfcOpenShellUnitTests::instrumentation::counter::c, n); } while (0)
+#define IFCOS_UT_COUNT_DETAIL(c, detail) \
+	do { if (::IfcOpenShellUnitTests::instrumentation::enabled()) ::IfcOpenShellUnitTests::instrumentation::registry::instance().add(::IfcOpenShellUnitTests::instrumentation::counter::c, detail, 1); } while (0)
+#define IFCOS_UT_TIME_CONCAT_(a, b) a##b
+#define IFCOS_UT_TIME_CONCAT(a, b) IFCOS_UT_TIME_CONCAT_(a, b)
+#define IFCOS_UT_TIME(node_type) \
+	::IfcOpenShellUnitTests::instrumentation::scoped_timer IFCOS_UT_TIME_CONCAT(ifcos_ut_timer_, __LINE__)(node_type)
+#define IFCOS_UT_TIMER(name, node_type) \
+	::IfcOpenShellUnitTests::instrumentation::scoped_timer name(node_type)
+#define IFCOS_UT_TIME_ALSO(name, node_type) name.also(node_type)
+#endif
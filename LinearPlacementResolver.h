@@ -0,0 +1,86 @@
+#pragma once
+
+// Resolves IfcLinearPlacement to a placement matrix using the cached alignment evaluators of an alignment_cache,
+// so the basis curve of many placements is mapped only once.
+//
+// The frame is evaluated on the basis curve at DistanceAlong and moved by the offsets of the IfcPointByDistanceExpression
+// (longitudinal along the tangent, lateral along the frame y axis and vertical along the frame z axis).
+// When the IfcAxis2PlacementLinear has an Axis or RefDirection these replace the directions of the evaluated frame.
+// resolve() places that frame relative to the PlacementRelTo of the placement, mapped by the mapping of the
+// alignment_cache, relative_frame() leaves it unplaced for callers that resolve the PlacementRelTo themselves.
+// The result is in the output unit of the alignment_cache, with the default of metres it matches mapping->map(placement).
+
+#include "AlignmentEvaluator.h"
+
+namespace IfcOpenShellUnitTests
+{
+	class linear_placement_resolver
+	{
+	public:
+		explicit linear_placement_resolver(alignment_cache& cache) : cache_(cache) {}
+
+		Eigen::Matrix4d resolve(const Ifc4x3_add2::IfcLinearPlacement* placement) const
+		{
+			Eigen::Matrix4d m = relative_frame(placement);
+			if (auto parent = placement->PlacementRelTo())
+			{
+				auto p = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(cache_.mapping().map(parent));
+				Eigen::Matrix4d relative_to = p->components();
+				relative_to.col(3).head(3) /= cache_.output_unit();
+				m = relative_to * m;
+			}
+			return m;
+		}
+
+		// the frame of the placement without its PlacementRelTo
+		Eigen::Matrix4d relative_frame(const Ifc4x3_add2::IfcLinearPlacement* placement) const
+		{
+			auto relative_placement = placement->RelativePlacement()->as<Ifc4x3_add2::IfcAxis2PlacementLinear>();
+			auto pde = relative_placement->Location()->as<Ifc4x3_add2::IfcPointByDistanceExpression>();
+
+			const auto& evaluator = cache_.get(pde->BasisCurve());
+			auto length_unit = cache_.length_unit();
+
+			Eigen::Matrix4d m = evaluator.evaluate(measure_value(pde->DistanceAlong()) * length_unit);
+			apply_offsets(m, pde->OffsetLongitudinal().get_value_or(0.0), pde->OffsetLateral().get_value_or(0.0), pde->OffsetVertical().get_value_or(0.0), length_unit);
+			apply_directions(m, relative_placement->Axis(), relative_placement->RefDirection());
+			return m;
+		}
+
+		// moves the origin of frame m by offsets given in model units
+		static void apply_offsets(Eigen::Matrix4d& m, double longitudinal, double lateral, double vertical, double length_unit)
+		{
+			Eigen::Vector3d offset = m.col(0).head(3) * longitudinal + m.col(1).head(3) * lateral + m.col(2).head(3) * vertical;
+			m.col(3).head(3) += offset * length_unit;
+		}
+
+		// replaces the directions of frame m, following the IfcAxis2Placement3D rules for a missing Axis or RefDirection
+		static void apply_directions(Eigen::Matrix4d& m, const Ifc4x3_add2::IfcDirection* axis, const Ifc4x3_add2::IfcDirection* ref_direction)
+		{
+			if (axis == nullptr && ref_direction == nullptr)
+				return;
+
+			Eigen::Vector3d z = axis ? to_vector(axis) : Eigen::Vector3d(m.col(2).head(3));
+			Eigen::Vector3d x = ref_direction ? to_vector(ref_direction) : Eigen::Vector3d(m.col(0).head(3));
+			z.normalize();
+			x = (x - x.dot(z) * z).normalized();
+			Eigen::Vector3d y = z.cross(x);
+
+			m.col(0).head(3) = x;
+			m.col(1).head(3) = y;
+			m.col(2).head(3) = z;
+		}
+
+	private:
+		static Eigen::Vector3d to_vector(const Ifc4x3_add2::IfcDirection* direction)
+		{
+			auto ratios = direction->DirectionRatios();
+			Eigen::Vector3d v(0, 0, 0);
+			for (size_t i = 0; i < ratios.size() && i < 3; i++)
+				v(i) = ratios[i];
+			return v;
+		}
+
+		alignment_cache& cache_;
+	};
+}
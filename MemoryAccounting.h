@@ -0,0 +1,315 @@
+#pragma once
+
+// Memory footprint of a loaded IfcFile and of mapped alignments.
+//
+// IfcOpenShell does not report its memory use, so account() walks the instances of a file through the public API and
+// adds up what each part of the model needs. The instance objects and their attribute slots are counted per entity
+// type, and strings and aggregates held by the attributes count as attribute storage. Typed values of selects, e.g.
+// IfcLengthMeasure, are instances of their own and count under their type. The entity-by-id and by-type indices add a
+// map node and a pointer per entity. The inverse map adds one entry per distinct (referenced instance, referencing
+// type, attribute) and one id per reference. The sizes of the IfcOpenShell objects behind the public API are
+// modelled by memory_model for a 64-bit build, so the totals are estimates. They are meant for comparing models
+// and catching regressions of the model; the tests require the total to lie between an eighth of the heap growth of
+// loading the file and that growth, and compare the growth itself with a recording.
+//
+// Mapped alignments are measured instead: account_mapping() maps the curve again and takes the growth of the CRT heap
+// as the bytes of the taxonomy tree. Its nodes are counted by type below piecewise functions; other composite nodes
+// such as gradient and cant functions count as one node, their children are in the measured bytes. The bytes are
+// one total for the tree: the heap growth of one mapping cannot be attributed to node types, so only the node counts
+// are broken down by type. The segment tables of the alignment_evaluator and the compiled records of this suite are
+// added from their sizes.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "AlignmentEvaluator.h"
+#include "CompiledAlignment.h"
+#include "Instrumentation.h"
+#include "ProcessMemory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	namespace memory_model
+	{
+		constexpr size_t heap_block = 16;                  // allocator overhead of every heap block
+		constexpr size_t instance = 4 * sizeof(void*);     // instance object: vtable, declaration, file and data pointers
+		constexpr size_t attribute_slot = 40;              // one attribute of the instance data, a variant of scalars, strings and aggregates
+		constexpr size_t string = 32;                      // std::string, strings up to small_string characters are kept inline
+		constexpr size_t small_string = 15;
+		constexpr size_t vector = 3 * sizeof(void*);
+		constexpr size_t aggregate = 48;                   // aggregate_of_instance with its shared_ptr control block
+		constexpr size_t map_node = 4 * sizeof(void*) + 8; // node of a std::map, without key and value
+	}
+
+	struct type_footprint
+	{
+		size_t instances = 0;
+		size_t instance_bytes = 0;  // instance objects and attribute slots
+		size_t attribute_bytes = 0; // strings and aggregates held by the attributes
+		size_t references = 0;      // references to entity instances in the attributes
+
+		size_t total() const { return instance_bytes + attribute_bytes; }
+	};
+
+	struct file_footprint
+	{
+		std::map<std::string, type_footprint> types; // by entity or simple type name
+		size_t instances = 0;                        // entity instances, without typed values
+		size_t instance_bytes = 0;
+		size_t attribute_bytes = 0;
+		size_t inverse_bytes = 0;
+		size_t index_bytes = 0;
+
+		size_t total() const { return instance_bytes + attribute_bytes + inverse_bytes + index_bytes; }
+
+		// totals followed by the types with the largest footprint
+		std::string report(size_t rows = 20) const
+		{
+			std::vector<std::pair<std::string, type_footprint>> sorted(types.begin(), types.end());
+			std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.total() > b.second.total(); });
+
+			std::ostringstream os;
+			os << instances << " instances, " << total() << " bytes: instances " << instance_bytes << ", attributes " << attribute_bytes
+				<< ", inverses " << inverse_bytes << ", indices " << index_bytes << "\n";
+			for (size_t i = 0; i < sorted.size() && i < rows; i++)
+			{
+				const auto& [name, t] = sorted[i];
+				os << "    " << name << ": " << t.instances << " instances, " << t.instance_bytes << " + " << t.attribute_bytes << " bytes\n";
+			}
+			return os.str();
+		}
+	};
+
+	namespace memory_detail
+	{
+		inline size_t string_bytes(const std::string& s)
+		{
+			return s.size() > memory_model::small_string ? s.size() + 1 + memory_model::heap_block : 0;
+		}
+
+		template <typename T>
+		size_t vector_bytes(const std::vector<T>& v)
+		{
+			return v.empty() ? 0 : v.size() * sizeof(T) + memory_model::heap_block;
+		}
+
+		class accountant
+		{
+		public:
+			explicit accountant(file_footprint& result) : result_(result) {}
+
+			void entity(const IfcUtil::IfcBaseClass* inst)
+			{
+				auto declaration = inst->declaration().as_entity();
+				auto& t = result_.types[declaration->name()];
+				t.instances++;
+				t.instance_bytes += instance_bytes(declaration->attribute_count());
+				result_.instances++;
+				result_.index_bytes += memory_model::map_node + sizeof(unsigned) + sizeof(void*) + memory_model::heap_block + sizeof(void*);
+
+				for (size_t i = 0; i < declaration->attribute_count(); i++)
+					attribute(inst->get_attribute_value(i), t, declaration->index_in_schema(), i);
+			}
+
+			void finish()
+			{
+				for (const auto& [name, t] : result_.types)
+				{
+					result_.instance_bytes += t.instance_bytes;
+					result_.attribute_bytes += t.attribute_bytes;
+				}
+				// a vector of referencing ids per key, one id per reference
+				result_.inverse_bytes = inverse_keys_.size() * (memory_model::map_node + 2 * sizeof(uint64_t) + memory_model::vector + 2 * memory_model::heap_block) +
+					references_ * sizeof(int);
+			}
+
+		private:
+			static size_t instance_bytes(size_t attributes)
+			{
+				return memory_model::instance + memory_model::heap_block + attributes * memory_model::attribute_slot + memory_model::heap_block;
+			}
+
+			void reference(const IfcUtil::IfcBaseClass* referenced, type_footprint& t, size_t type, size_t index)
+			{
+				if (!referenced->declaration().as_entity())
+				{
+					// typed value of a select, an instance of its own
+					auto& value = result_.types[referenced->declaration().name()];
+					value.instances++;
+					value.instance_bytes += instance_bytes(1);
+					attribute(referenced->get_attribute_value(0), value, type, index);
+					return;
+				}
+				t.references++;
+				references_++;
+				inverse_keys_.insert(((uint64_t)referenced->id() << 32) | ((uint64_t)(type & 0xffff) << 16) | (index & 0xffff));
+			}
+
+			void attribute(const AttributeValue& value, type_footprint& t, size_t type, size_t index)
+			{
+				switch (value.type())
+				{
+				case IfcUtil::Argument_STRING:
+				case IfcUtil::Argument_ENUMERATION:
+					t.attribute_bytes += string_bytes((std::string)value);
+					break;
+				case IfcUtil::Argument_ENTITY_INSTANCE:
+					reference((IfcUtil::IfcBaseClass*)value, t, type, index);
+					break;
+				case IfcUtil::Argument_AGGREGATE_OF_INT:
+					t.attribute_bytes += vector_bytes((std::vector<int>)value);
+					break;
+				case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+					t.attribute_bytes += vector_bytes((std::vector<double>)value);
+					break;
+				case IfcUtil::Argument_AGGREGATE_OF_STRING:
+				{
+					std::vector<std::string> strings = value;
+					t.attribute_bytes += strings.size() * memory_model::string + memory_model::heap_block;
+					for (const auto& s : strings)
+						t.attribute_bytes += string_bytes(s);
+					break;
+				}
+				case IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE:
+				{
+					aggregate_of_instance::ptr instances = value;
+					t.attribute_bytes += memory_model::aggregate + memory_model::heap_block + instances->size() * sizeof(void*) + memory_model::heap_block;
+					for (auto inst : *instances)
+						reference(inst, t, type, index);
+					break;
+				}
+				case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+				{
+					std::vector<std::vector<int>> lists = value;
+					t.attribute_bytes += lists.size() * memory_model::vector + memory_model::heap_block;
+					for (const auto& l : lists)
+						t.attribute_bytes += vector_bytes(l);
+					break;
+				}
+				case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+				{
+					std::vector<std::vector<double>> lists = value;
+					t.attribute_bytes += lists.size() * memory_model::vector + memory_model::heap_block;
+					for (const auto& l : lists)
+						t.attribute_bytes += vector_bytes(l);
+					break;
+				}
+				default:
+					// null, derived, scalars and empty aggregates live in the slot; other aggregates by their element count
+					if (value.type() >= IfcUtil::Argument_AGGREGATE_OF_BINARY && value.type() < IfcUtil::Argument_UNKNOWN)
+						t.attribute_bytes += value.size() * memory_model::vector + memory_model::heap_block;
+					break;
+				}
+			}
+
+			file_footprint& result_;
+			std::unordered_set<uint64_t> inverse_keys_;
+			size_t references_ = 0;
+		};
+	}
+
+	// Footprint of the instances of file by type, see memory_model
+	inline file_footprint account(const IfcParse::IfcFile& file)
+	{
+		file_footprint result;
+		memory_detail::accountant accountant(result);
+		for (auto it = file.begin(); it != file.end(); ++it)
+		{
+			if (it->second->declaration().as_entity())
+				accountant.entity(it->second);
+		}
+		accountant.finish();
+		return result;
+	}
+
+	struct taxonomy_footprint
+	{
+		std::map<std::string, size_t> nodes; // by node type
+		size_t bytes = 0;                    // heap growth of mapping
+
+		size_t node_count() const
+		{
+			size_t n = 0;
+			for (const auto& [type, count] : nodes)
+				n += count;
+			return n;
+		}
+	};
+
+	inline void count_nodes(const ifcopenshell::geometry::taxonomy::item& node, std::map<std::string, size_t>& nodes)
+	{
+		nodes[instrumentation::node_type(node)]++;
+		if (auto piecewise = dynamic_cast<const ifcopenshell::geometry::taxonomy::piecewise_function*>(&node))
+		{
+			for (const auto& span : piecewise->spans())
+				count_nodes(*span, nodes);
+		}
+	}
+
+	// Maps item again on the calling thread and measures the taxonomy it produces
+	inline taxonomy_footprint account_mapping(ifcopenshell::geometry::abstract_mapping& mapping, const IfcUtil::IfcBaseClass* item)
+	{
+		taxonomy_footprint result;
+		size_t before = heap_bytes_in_use();
+		auto node = mapping.map(item);
+		size_t after = heap_bytes_in_use();
+		result.bytes = after > before ? after - before : 0;
+		if (node)
+			count_nodes(*node, result.nodes);
+		return result;
+	}
+
+	// segment records and their curve type names
+	inline size_t segment_table_bytes(const alignment_evaluator& evaluator)
+	{
+		size_t bytes = evaluator.layers().size() * sizeof(segment_table);
+		for (const auto& layer : evaluator.layers())
+		{
+			bytes += memory_detail::vector_bytes(layer.segments());
+			for (const auto& s : layer.segments())
+				bytes += memory_detail::string_bytes(s.curve_type);
+		}
+		return bytes;
+	}
+
+	struct alignment_footprint
+	{
+		taxonomy_footprint taxonomy;
+		size_t segment_table_bytes = 0;
+		size_t compiled_bytes = 0;
+
+		size_t total() const { return taxonomy.bytes + segment_table_bytes + compiled_bytes; }
+
+		std::string report() const
+		{
+			std::ostringstream os;
+			os << total() << " bytes: taxonomy " << taxonomy.bytes << " in " << taxonomy.node_count() << " nodes, segment tables " << segment_table_bytes
+				<< ", compiled records " << compiled_bytes << "\n";
+			for (const auto& [type, n] : taxonomy.nodes)
+				os << "    " << type << ": " << n << "\n";
+			return os.str();
+		}
+	};
+
+	// Footprint of the curve of evaluator mapped by mapping, and of its compiled records if any
+	inline alignment_footprint account(ifcopenshell::geometry::abstract_mapping& mapping, const alignment_evaluator& evaluator, const compiled_alignment* compiled = nullptr)
+	{
+		alignment_footprint result;
+		result.taxonomy = account_mapping(mapping, evaluator.curve());
+		result.segment_table_bytes = segment_table_bytes(evaluator);
+		if (compiled)
+			result.compiled_bytes = compiled->bytes();
+		return result;
+	}
+}
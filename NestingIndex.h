@@ -0,0 +1,221 @@
+#pragma once
+
+// Index of the IfcRelNests relationships of a file.
+//
+// The layouts of an IfcAlignment and the segments of a layout are nested through IfcRelNests. Walking them through
+// the inverse attributes (IsNestedBy, Nests) looks up the inverses of every instance and allocates an aggregate per
+// call. nesting_index reads all IfcRelNests once, after parsing, and stores the children of every relating object in
+// one contiguous array in compressed sparse row form: the relating objects sorted by id, and per relating object the
+// start of its children in the array. children() returns a std::span into the array without allocating. Objects
+// related by several IfcRelNests get the children of all of them, in the order of the relationships' ids, and every
+// relationship keeps the order of its RelatedObjects.
+//
+// The relationships are read on several threads, each reading a contiguous range of them; the attributes of the file
+// are only read. The children are then placed by a prefix sum over the relationships and copied on the same
+// threads, so the index is the same for any number of threads.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	struct alignment_layouts
+	{
+		const Ifc4x3_add2::IfcAlignmentHorizontal* horizontal = nullptr;
+		const Ifc4x3_add2::IfcAlignmentVertical* vertical = nullptr;
+		const Ifc4x3_add2::IfcAlignmentCant* cant = nullptr;
+	};
+
+	class nesting_index
+	{
+	public:
+		using object = const Ifc4x3_add2::IfcObjectDefinition*;
+
+		nesting_index() = default;
+
+		// threads 0 for one per hardware thread
+		explicit nesting_index(IfcParse::IfcFile& file, size_t threads = 0)
+		{
+			threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+			std::vector<const Ifc4x3_add2::IfcRelNests*> rels;
+			if (auto nests = file.instances_by_type<Ifc4x3_add2::IfcRelNests>())
+			{
+				for (auto& rel : *nests)
+					rels.push_back(rel);
+			}
+			std::sort(rels.begin(), rels.end(), [](auto a, auto b) { return a->id() < b->id(); });
+
+			// relating and related objects of every relationship
+			std::vector<object> relating(rels.size());
+			std::vector<std::vector<object>> related(rels.size());
+			parallel_for(rels.size(), threads, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					relating[i] = rels[i]->RelatingObject();
+					for (auto& child : *rels[i]->RelatedObjects())
+						related[i].push_back(child);
+				}
+			});
+
+			// relating objects by id and the start of the children of every relationship
+			for (size_t i = 0; i < rels.size(); i++)
+			{
+				if (relating[i])
+					parents_.push_back(relating[i]);
+			}
+			std::sort(parents_.begin(), parents_.end(), [](object a, object b) { return a->id() < b->id(); });
+			parents_.erase(std::unique(parents_.begin(), parents_.end()), parents_.end());
+
+			starts_.assign(parents_.size() + 1, 0);
+			std::vector<size_t> row(rels.size());
+			for (size_t i = 0; i < rels.size(); i++)
+			{
+				if (relating[i] == nullptr)
+					continue;
+				row[i] = find(relating[i]->id());
+				starts_[row[i] + 1] += related[i].size();
+			}
+			for (size_t r = 0; r < parents_.size(); r++)
+				starts_[r + 1] += starts_[r];
+			std::vector<size_t> offset(rels.size()), next(starts_.begin(), starts_.end() - 1);
+			for (size_t i = 0; i < rels.size(); i++)
+			{
+				if (relating[i] == nullptr)
+					continue;
+				offset[i] = next[row[i]];
+				next[row[i]] += related[i].size();
+			}
+
+			children_.resize(starts_.back());
+			nested_.resize(starts_.back());
+			parallel_for(rels.size(), threads, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					if (relating[i] == nullptr)
+						continue;
+					std::copy(related[i].begin(), related[i].end(), children_.begin() + offset[i]);
+					for (size_t k = 0; k < related[i].size(); k++)
+						nested_[offset[i] + k] = { related[i][k], relating[i] };
+				}
+			});
+			std::stable_sort(nested_.begin(), nested_.end(), [](const nest& a, const nest& b) { return a.child->id() < b.child->id(); });
+			relationships_ = rels.size();
+		}
+
+		// Objects nested under parent, empty if there are none
+		std::span<const object> children(const Ifc4x3_add2::IfcObjectDefinition* parent) const
+		{
+			return children(parent->id());
+		}
+
+		std::span<const object> children(unsigned id) const
+		{
+			size_t r = find(id);
+			if (r == parents_.size())
+				return {};
+			return { children_.data() + starts_[r], starts_[r + 1] - starts_[r] };
+		}
+
+		// Object that child is nested under, nullptr if none. Objects nested more than once give the first relationship.
+		object parent(const Ifc4x3_add2::IfcObjectDefinition* child) const
+		{
+			auto it = std::lower_bound(nested_.begin(), nested_.end(), child->id(), [](const nest& n, unsigned id) { return n.child->id() < id; });
+			return it != nested_.end() && it->child == child ? it->parent : nullptr;
+		}
+
+		// The horizontal, vertical and cant layouts nested under alignment
+		alignment_layouts layouts(const Ifc4x3_add2::IfcAlignment* alignment) const
+		{
+			alignment_layouts result;
+			for (auto child : children(alignment))
+			{
+				if (auto h = child->as<Ifc4x3_add2::IfcAlignmentHorizontal>())
+					result.horizontal = h;
+				else if (auto v = child->as<Ifc4x3_add2::IfcAlignmentVertical>())
+					result.vertical = v;
+				else if (auto c = child->as<Ifc4x3_add2::IfcAlignmentCant>())
+					result.cant = c;
+			}
+			return result;
+		}
+
+		// IfcAlignmentSegment instances of a layout, in order
+		std::span<const object> segments(const Ifc4x3_add2::IfcLinearElement* layout) const
+		{
+			return layout ? children(layout) : std::span<const object>();
+		}
+
+		size_t parents() const { return parents_.size(); }
+		size_t relationships() const { return relationships_; }
+
+		size_t bytes() const
+		{
+			return parents_.capacity() * sizeof(object) + starts_.capacity() * sizeof(size_t) + children_.capacity() * sizeof(object) +
+				nested_.capacity() * sizeof(nest);
+		}
+
+	private:
+		struct nest
+		{
+			object child;
+			object parent;
+		};
+
+		// Row of the relating object id, parents_.size() if it has no children
+		size_t find(unsigned id) const
+		{
+			auto it = std::lower_bound(parents_.begin(), parents_.end(), id, [](object p, unsigned v) { return p->id() < v; });
+			return it != parents_.end() && (*it)->id() == id ? it - parents_.begin() : parents_.size();
+		}
+
+		// fn(begin, end) over contiguous ranges of n items on up to threads threads, the first exception rethrown
+		static void parallel_for(size_t n, size_t threads, const std::function<void(size_t, size_t)>& fn)
+		{
+			const size_t ranges = std::max((size_t)1, std::min(threads, n));
+			std::exception_ptr error;
+			std::mutex error_mutex;
+			auto work = [&](size_t range)
+			{
+				try
+				{
+					fn(n * range / ranges, n * (range + 1) / ranges);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (size_t range = 1; range < ranges; range++)
+				workers.emplace_back(work, range);
+			work(0);
+			for (auto& w : workers)
+				w.join();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		std::vector<object> parents_;  // relating objects, ascending by id
+		std::vector<size_t> starts_;   // start of the children of every relating object, one past the last included
+		std::vector<object> children_;
+		std::vector<nest> nested_;     // ascending by child id
+		size_t relationships_ = 0;
+	};
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// Evaluation of one batch of stations on several threads.
+//
+// parallel_evaluator splits a batch into contiguous ranges of stations, one per thread. Ascending stations are cut
+// where they cross a segment boundary of any layer of the curve, so a thread evaluates whole segments and walks its
+// records or taxonomy nodes in order. A cut moves from the even split to the nearest boundary within a quarter of a
+// range; where there is none, e.g. on curves with fewer segments than threads, it stays at the even split. Stations
+// that are not sorted are split evenly.
+//
+// Every thread evaluates its range with its own evaluation_cursor, a compiled_alignment through its batch path, and
+// writes the frames in place into the result, which is allocated before the threads start. There are no locks. The
+// frame of a station does not depend on the range it falls in, so results are bit-identical to the serial path for
+// any number of threads. The first exception of a thread is rethrown on the calling thread after all have joined.
+
+#include "AlignmentEvaluator.h"
+#include "CompiledAlignment.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	class parallel_evaluator
+	{
+	public:
+		// threads 0 for one per hardware thread
+		explicit parallel_evaluator(const alignment_evaluator& evaluator, size_t threads = 0) :
+			evaluator_(&evaluator),
+			compiled_(nullptr),
+			threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+		{
+			boundaries(evaluator);
+		}
+
+		explicit parallel_evaluator(const compiled_alignment& compiled, size_t threads = 0) :
+			evaluator_(compiled.has_evaluator() ? &compiled.evaluator() : nullptr),
+			compiled_(&compiled),
+			threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+		{
+			if (evaluator_)
+				boundaries(*evaluator_);
+			else
+			{
+				for (const auto& r : compiled.horizontal())
+					boundaries_.push_back(r.start);
+				for (const auto& r : compiled.vertical())
+					boundaries_.push_back(r.start);
+				std::sort(boundaries_.begin(), boundaries_.end());
+			}
+		}
+
+		std::vector<Eigen::Matrix4d> evaluate(const std::vector<double>& stations) const
+		{
+			std::vector<Eigen::Matrix4d> frames(stations.size());
+			evaluate(stations.data(), stations.size(), frames.data());
+			return frames;
+		}
+
+		// Frames of n stations written to frames
+		void evaluate(const double* stations, size_t n, Eigen::Matrix4d* frames) const
+		{
+			auto cuts = partition(stations, n);
+			std::exception_ptr error;
+			std::mutex error_mutex;
+			auto work = [&](size_t range)
+			{
+				try
+				{
+					evaluate_range(stations + cuts[range], cuts[range + 1] - cuts[range], frames + cuts[range]);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (size_t range = 1; range + 1 < cuts.size(); range++)
+				workers.emplace_back(work, range);
+			if (cuts.size() > 1)
+				work(0);
+			for (auto& w : workers)
+				w.join();
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		// First station of every range followed by n
+		std::vector<size_t> partition(const double* stations, size_t n) const
+		{
+			std::vector<size_t> cuts{ 0 };
+			const size_t ranges = std::min(threads_, n);
+			const bool sorted = std::is_sorted(stations, stations + n);
+			for (size_t t = 1; t < ranges; t++)
+			{
+				size_t cut = n * t / ranges;
+				if (sorted && !boundaries_.empty())
+					cut = boundary_near(stations, n, cut, n / ranges / 4);
+				if (cut > cuts.back() && cut < n)
+					cuts.push_back(cut);
+			}
+			if (n)
+				cuts.push_back(n);
+			return cuts;
+		}
+
+		size_t threads() const { return threads_; }
+
+	private:
+		void boundaries(const alignment_evaluator& evaluator)
+		{
+			for (const auto& layer : evaluator.layers())
+			{
+				for (const auto& s : layer.segments())
+					boundaries_.push_back(s.start);
+			}
+			std::sort(boundaries_.begin(), boundaries_.end());
+			boundaries_.erase(std::unique(boundaries_.begin(), boundaries_.end()), boundaries_.end());
+		}
+
+		// The first station past the segment boundary closest to station cut, if it lies within slack stations
+		size_t boundary_near(const double* stations, size_t n, size_t cut, size_t slack) const
+		{
+			auto station = [&](double b) { return (size_t)(std::lower_bound(stations, stations + n, b) - stations); };
+			auto after = std::lower_bound(boundaries_.begin(), boundaries_.end(), stations[cut]);
+			size_t best = cut, distance = slack + 1;
+			if (after != boundaries_.end())
+			{
+				size_t i = station(*after);
+				if (i >= cut && i - cut < distance)
+					best = i, distance = i - cut;
+			}
+			if (after != boundaries_.begin())
+			{
+				size_t i = station(*(after - 1));
+				if (cut - i < distance)
+					best = i;
+			}
+			return best;
+		}
+
+		void evaluate_range(const double* stations, size_t n, Eigen::Matrix4d* frames) const
+		{
+			if (evaluator_ == nullptr)
+				return compiled_->evaluate(stations, n, frames);
+
+			evaluation_cursor cursor(*evaluator_);
+			if (compiled_)
+				return compiled_->evaluate(stations, n, frames, cursor);
+			for (size_t i = 0; i < n; i++)
+				frames[i] = cursor.evaluate(stations[i]);
+		}
+
+		const alignment_evaluator* evaluator_;
+		const compiled_alignment* compiled_;
+		size_t threads_;
+		std::vector<double> boundaries_; // segment starts of all layers, ascending
+	};
+}
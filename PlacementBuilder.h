@@ -0,0 +1,92 @@
+#pragma once
+
+// Bulk construction of IfcLinearPlacement.
+//
+// linear_placement_builder adds one IfcLinearPlacement with its IfcAxis2PlacementLinear and
+// IfcPointByDistanceExpression per entry of a column of distances, in a single pass. Entities are added
+// leaf first with explicit ids, so the file does not have to traverse the new instance graph and the ids of a
+// batch are contiguous: placement i of a batch uses ids first + 3i (expression), first + 3i + 1 (relative
+// placement) and first + 3i + 2 (linear placement).
+//
+// The entities are individually allocated because the file takes ownership of every instance it holds.
+// Distances and offsets are in model units.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	class linear_placement_builder
+	{
+	public:
+		struct id_range
+		{
+			unsigned first = 0; // id of the first entity of the batch
+			unsigned last = 0;  // id of the last entity of the batch
+
+			size_t size() const { return first == 0 ? 0 : last - first + 1; }
+		};
+
+		explicit linear_placement_builder(IfcParse::IfcFile& file) : file_(file) {}
+
+		// Adds a placement at each distance along basis_curve. The offset columns are either empty, in which case the
+		// offset is omitted, or have one value per distance.
+		std::vector<Ifc4x3_add2::IfcLinearPlacement*> add(Ifc4x3_add2::IfcCurve* basis_curve,
+			const std::vector<double>& distance,
+			const std::vector<double>& lateral = {},
+			const std::vector<double>& vertical = {},
+			const std::vector<double>& longitudinal = {},
+			Ifc4x3_add2::IfcObjectPlacement* relative_to = nullptr)
+		{
+			for (const auto* column : { &lateral, &vertical, &longitudinal })
+			{
+				if (!column->empty() && column->size() != distance.size())
+					throw std::invalid_argument("offset column size does not match the number of distances");
+			}
+
+			auto optional = [](const std::vector<double>& column, size_t i) -> boost::optional<double>
+			{
+				if (column.empty())
+					return boost::none;
+				return column[i];
+			};
+
+			std::vector<Ifc4x3_add2::IfcLinearPlacement*> placements;
+			placements.reserve(distance.size());
+
+			unsigned id = file_.getMaxId() + 1;
+			ids_.first = distance.empty() ? 0 : id;
+			for (size_t i = 0; i < distance.size(); i++)
+			{
+				auto pde = new Ifc4x3_add2::IfcPointByDistanceExpression(
+					new Ifc4x3_add2::IfcLengthMeasure(distance[i]),
+					optional(lateral, i), optional(vertical, i), optional(longitudinal, i),
+					basis_curve);
+				file_.addEntity(pde, id++);
+
+				auto pl = new Ifc4x3_add2::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+				file_.addEntity(pl, id++);
+
+				auto lp = new Ifc4x3_add2::IfcLinearPlacement(relative_to, pl, nullptr);
+				file_.addEntity(lp, id++);
+
+				placements.push_back(lp);
+			}
+			ids_.last = distance.empty() ? 0 : id - 1;
+			return placements;
+		}
+
+		// ids of the last batch
+		const id_range& ids() const { return ids_; }
+
+	private:
+		IfcParse::IfcFile& file_;
+		id_range ids_;
+	};
+}
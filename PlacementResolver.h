@@ -0,0 +1,192 @@
+#pragma once
+
+// Resolves all placements of a file at once into a flat array of matrices.
+//
+// mapping->map(placement) allocates a taxonomy::matrix4 per call and maps the whole IfcLocalPlacement chain above the
+// placement again, so mapping every placement of a model with many nested local placements maps the shared parents and
+// relative placements many times. placement_resolver maps every IfcAxis2Placement2D and IfcAxis2Placement3D of the
+// file once, then resolves the IfcLocalPlacement and IfcLinearPlacement instances in order of their depth in the
+// PlacementRelTo chains, each from the already resolved matrix of its parent. The relative placement of a local placement
+// is one of the resolved matrices, that of a linear placement is resolved by a linear_placement_resolver. Other object
+// placements and placements located by other than an IfcCartesianPoint are mapped by the mapping of the alignment_cache,
+// once each.
+//
+// The directions of an IfcAxis2Placement3D follow the rules for a missing Axis or RefDirection as in
+// linear_placement_resolver. Matrices are in the output unit of the alignment_cache, with the default of metres they
+// match mapping->map(placement). A PlacementRelTo chain that loops throws std::runtime_error, looking up an instance
+// that is not a placement of the file std::out_of_range.
+
+#include "AlignmentEvaluator.h"
+#include "LinearPlacementResolver.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	class placement_resolver
+	{
+	public:
+		placement_resolver(IfcParse::IfcFile& file, alignment_cache& cache) :
+			cache_(cache)
+		{
+			add<Ifc4x3_add2::IfcAxis2Placement2D>(file);
+			add<Ifc4x3_add2::IfcAxis2Placement3D>(file);
+			add<Ifc4x3_add2::IfcObjectPlacement>(file);
+			std::sort(placements_.begin(), placements_.end(), [](auto a, auto b) { return a->id() < b->id(); });
+			placements_.erase(std::unique(placements_.begin(), placements_.end()), placements_.end());
+			matrices_.resize(placements_.size(), Eigen::Matrix4d::Identity());
+
+			// placements without parents, the parent of every local and linear placement and the relative placement of
+			// every local placement, linear placements start from their own frame
+			linear_placement_resolver linear(cache_);
+			std::vector<size_t> placed, parent(placements_.size(), none), relative(placements_.size(), none);
+			for (size_t i = 0; i < placements_.size(); i++)
+			{
+				auto p = placements_[i];
+				if (auto a = p->as<Ifc4x3_add2::IfcAxis2Placement2D>())
+					axis2placement(a, matrices_[i]);
+				else if (auto a = p->as<Ifc4x3_add2::IfcAxis2Placement3D>())
+					axis2placement(a, matrices_[i]);
+				else if (auto lp = p->as<Ifc4x3_add2::IfcLinearPlacement>())
+				{
+					placed.push_back(i);
+					if (lp->PlacementRelTo())
+						parent[i] = find(lp->PlacementRelTo()->id());
+					matrices_[i] = linear.relative_frame(lp);
+				}
+				else if (auto local = p->as<Ifc4x3_add2::IfcLocalPlacement>())
+				{
+					placed.push_back(i);
+					if (local->PlacementRelTo())
+						parent[i] = find(local->PlacementRelTo()->id());
+					relative[i] = find(local->RelativePlacement()->id());
+				}
+				else
+					matrices_[i] = map(p);
+			}
+
+			// local and linear placements by depth, parents first
+			std::vector<size_t> depth(placements_.size(), 0);
+			std::vector<bool> resolved(placements_.size(), true);
+			for (auto i : placed)
+				resolved[i] = false;
+			std::vector<size_t> chain;
+			for (auto i : placed)
+			{
+				for (size_t k = i; !resolved[k]; k = parent[k])
+				{
+					chain.push_back(k);
+					if (chain.size() > placed.size())
+						throw std::runtime_error("placement_resolver: #" + std::to_string(placements_[i]->id()) + " is placed relative to itself");
+					if (parent[k] == none)
+						break;
+				}
+				for (auto k = chain.rbegin(); k != chain.rend(); ++k)
+				{
+					depth[*k] = parent[*k] == none ? 0 : depth[parent[*k]] + 1;
+					resolved[*k] = true;
+				}
+				chain.clear();
+			}
+			std::stable_sort(placed.begin(), placed.end(), [&](size_t a, size_t b) { return depth[a] < depth[b]; });
+
+			for (auto i : placed)
+			{
+				if (relative[i] != none)
+					matrices_[i] = matrices_[relative[i]];
+				if (parent[i] != none)
+					matrices_[i] = matrices_[parent[i]] * matrices_[i];
+			}
+		}
+
+		// Matrix of a placement of the file
+		const Eigen::Matrix4d& matrix(const IfcUtil::IfcBaseClass* placement) const
+		{
+			return matrices_[find(placement->id())];
+		}
+
+		const Eigen::Matrix4d& matrix(unsigned id) const
+		{
+			return matrices_[find(id)];
+		}
+
+		// Resolved placements, ascending by id, and their matrices
+		const std::vector<const IfcUtil::IfcBaseClass*>& placements() const { return placements_; }
+		const std::vector<Eigen::Matrix4d>& matrices() const { return matrices_; }
+		size_t size() const { return placements_.size(); }
+
+	private:
+		static constexpr size_t none = (size_t)-1;
+
+		template <typename T>
+		void add(IfcParse::IfcFile& file)
+		{
+			if (auto instances = file.instances_by_type<T>())
+			{
+				for (auto& inst : *instances)
+					placements_.push_back(inst);
+			}
+		}
+
+		size_t find(unsigned id) const
+		{
+			auto it = std::lower_bound(placements_.begin(), placements_.end(), id, [](const IfcUtil::IfcBaseClass* p, unsigned v) { return p->id() < v; });
+			if (it == placements_.end() || (*it)->id() != id)
+				throw std::out_of_range("placement_resolver: #" + std::to_string(id) + " is not a placement of the file");
+			return it - placements_.begin();
+		}
+
+		// the mapping of the cache, in metres, converted to the output unit
+		Eigen::Matrix4d map(const IfcUtil::IfcBaseClass* placement)
+		{
+			auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(cache_.mapping().map(placement));
+			Eigen::Matrix4d result = m->components();
+			result.col(3).head(3) /= cache_.output_unit();
+			return result;
+		}
+
+		// origin of a placement located by an IfcCartesianPoint, false for other locations
+		bool location(const Ifc4x3_add2::IfcPlacement* placement, Eigen::Matrix4d& m) const
+		{
+			auto point = placement->Location()->as<Ifc4x3_add2::IfcCartesianPoint>();
+			if (point == nullptr)
+				return false;
+			auto coordinates = point->Coordinates();
+			for (size_t i = 0; i < coordinates.size() && i < 3; i++)
+				m(i, 3) = coordinates[i] * cache_.length_unit();
+			return true;
+		}
+
+		void axis2placement(const Ifc4x3_add2::IfcAxis2Placement2D* placement, Eigen::Matrix4d& m)
+		{
+			if (!location(placement, m))
+			{
+				m = map(placement);
+				return;
+			}
+			if (auto ref_direction = placement->RefDirection())
+			{
+				auto ratios = ref_direction->DirectionRatios();
+				Eigen::Vector2d x = Eigen::Vector2d(ratios[0], ratios[1]).normalized();
+				m.block<2, 2>(0, 0) << x(0), -x(1), x(1), x(0);
+			}
+		}
+
+		void axis2placement(const Ifc4x3_add2::IfcAxis2Placement3D* placement, Eigen::Matrix4d& m)
+		{
+			if (!location(placement, m))
+			{
+				m = map(placement);
+				return;
+			}
+			linear_placement_resolver::apply_directions(m, placement->Axis(), placement->RefDirection());
+		}
+
+		alignment_cache& cache_;
+		std::vector<const IfcUtil::IfcBaseClass*> placements_; // ascending by id
+		std::vector<Eigen::Matrix4d> matrices_;
+	};
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+// Distance along IfcPolyline and IfcIndexedPolyCurve basis curves.
+//
+// polyline_index flattens the vertices of a polyline into coordinate arrays with a prefix sum of the leg lengths, so
+// the leg of a distance along is found by binary search and the point is interpolated on that leg. Leg start
+// coordinates, coordinate differences and reciprocal lengths are kept in separate arrays. The batch query for
+// ascending distances follows the legs instead of searching, and interpolates two distances per SSE2 instruction
+// where available; it gives the same bits as the single query.
+//
+// Frames follow the IfcOpenShell mapping of linear placements on polylines: x along the leg, y horizontal and
+// perpendicular to x, z = x cross y. Distances before the start or after the end extrapolate the first or last leg.
+// IfcIndexedPolyCurve segments must be IfcLineIndex, IfcArcIndex throws std::invalid_argument.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IFCOS_UT_SSE2
+#endif
+
+namespace IfcOpenShellUnitTests
+{
+	class polyline_index
+	{
+	public:
+		// vertices in model units, length_unit is the length of a model unit in output units
+		explicit polyline_index(const std::vector<Eigen::Vector3d>& vertices, double length_unit = 1.0)
+		{
+			if (vertices.size() < 2)
+				throw std::invalid_argument("a polyline needs at least two vertices");
+
+			const size_t n = vertices.size() - 1;
+			distance_.reserve(n + 1);
+			for (auto* v : { &x_, &y_, &z_, &dx_, &dy_, &dz_, &inverse_ })
+				v->reserve(n);
+
+			distance_.push_back(0.0);
+			for (size_t i = 0; i < n; i++)
+			{
+				Eigen::Vector3d a = vertices[i] * length_unit;
+				Eigen::Vector3d d = vertices[i + 1] * length_unit - a;
+				double length = d.norm();
+				x_.push_back(a.x());
+				y_.push_back(a.y());
+				z_.push_back(a.z());
+				dx_.push_back(d.x());
+				dy_.push_back(d.y());
+				dz_.push_back(d.z());
+				inverse_.push_back(length > 0.0 ? 1.0 / length : 0.0);
+				distance_.push_back(distance_.back() + length);
+			}
+		}
+
+		// Vertices of an IfcPolyline or IfcIndexedPolyCurve with line segments
+		static polyline_index from_curve(const Ifc4x3_add2::IfcCurve* curve, double length_unit = 1.0)
+		{
+			return polyline_index(vertices(curve), length_unit);
+		}
+
+		static std::vector<Eigen::Vector3d> vertices(const Ifc4x3_add2::IfcCurve* curve)
+		{
+			std::vector<Eigen::Vector3d> result;
+			auto to_vector = [](const std::vector<double>& c)
+			{
+				return Eigen::Vector3d(c.size() > 0 ? c[0] : 0.0, c.size() > 1 ? c[1] : 0.0, c.size() > 2 ? c[2] : 0.0);
+			};
+
+			if (auto polyline = curve->as<Ifc4x3_add2::IfcPolyline>())
+			{
+				for (auto& p : *polyline->Points())
+					result.push_back(to_vector(p->Coordinates()));
+				return result;
+			}
+
+			auto indexed = curve->as<Ifc4x3_add2::IfcIndexedPolyCurve>();
+			if (indexed == nullptr)
+				throw std::invalid_argument("polyline_index requires an IfcPolyline or IfcIndexedPolyCurve");
+
+			std::vector<std::vector<double>> coordinates;
+			if (auto list = indexed->Points()->as<Ifc4x3_add2::IfcCartesianPointList2D>())
+				coordinates = list->CoordList();
+			else if (auto list = indexed->Points()->as<Ifc4x3_add2::IfcCartesianPointList3D>())
+				coordinates = list->CoordList();
+
+			auto segments = indexed->Segments();
+			if (!segments)
+			{
+				for (const auto& c : coordinates)
+					result.push_back(to_vector(c));
+				return result;
+			}
+
+			// consecutive segments share their end and start index, STEP indices are 1-based
+			int last = 0;
+			for (auto& segment : **segments)
+			{
+				auto line = segment->as<Ifc4x3_add2::IfcLineIndex>();
+				if (line == nullptr)
+					throw std::invalid_argument("polyline_index does not support IfcArcIndex segments");
+				std::vector<int> indices = *line;
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					if (i == 0 && indices[i] == last)
+						continue;
+					if (indices[i] < 1 || indices[i] > (int)coordinates.size())
+						throw std::invalid_argument("IfcLineIndex out of range");
+					result.push_back(to_vector(coordinates[indices[i] - 1]));
+				}
+				if (!indices.empty())
+					last = indices.back();
+			}
+			return result;
+		}
+
+		size_t legs() const { return inverse_.size(); }
+		double length() const { return distance_.back(); }
+
+		// distance along at vertex i
+		double distance(size_t i) const { return distance_[i]; }
+
+		// leg of distance along u, the last leg that starts at or before u
+		size_t leg(double u) const
+		{
+			auto first = distance_.begin() + 1;
+			return std::upper_bound(first, distance_.begin() + legs(), u) - first;
+		}
+
+		Eigen::Vector3d point(double u) const
+		{
+			return point(leg(u), u);
+		}
+
+		Eigen::Matrix4d frame(double u) const
+		{
+			size_t i = leg(u);
+			return frame(i, point(i, u));
+		}
+
+		// Points at the distances along u. Ascending distances follow the legs and are interpolated in pairs.
+		void points(const std::vector<double>& u, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z) const
+		{
+			interpolate(u, leg_indices(u), x, y, z);
+		}
+
+		std::vector<Eigen::Matrix4d> frames(const std::vector<double>& u) const
+		{
+			auto legs = leg_indices(u);
+			std::vector<double> x, y, z;
+			interpolate(u, legs, x, y, z);
+			std::vector<Eigen::Matrix4d> result(u.size());
+			for (size_t k = 0; k < u.size(); k++)
+				result[k] = frame(legs[k], Eigen::Vector3d(x[k], y[k], z[k]));
+			return result;
+		}
+
+		// size of the distance and leg arrays
+		size_t bytes() const
+		{
+			return (distance_.size() + 7 * inverse_.size()) * sizeof(double);
+		}
+
+	private:
+		Eigen::Vector3d point(size_t i, double u) const
+		{
+			double t = (u - distance_[i]) * inverse_[i];
+			return Eigen::Vector3d(x_[i] + t * dx_[i], y_[i] + t * dy_[i], z_[i] + t * dz_[i]);
+		}
+
+		void interpolate(const std::vector<double>& u, const std::vector<size_t>& legs, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z) const
+		{
+			x.resize(u.size());
+			y.resize(u.size());
+			z.resize(u.size());
+
+			size_t k = 0;
+#ifdef IFCOS_UT_SSE2
+			for (; k + 2 <= u.size(); k += 2)
+			{
+				size_t a = legs[k], b = legs[k + 1];
+				__m128d t = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&u[k]), _mm_set_pd(distance_[b], distance_[a])), _mm_set_pd(inverse_[b], inverse_[a]));
+				_mm_storeu_pd(&x[k], _mm_add_pd(_mm_set_pd(x_[b], x_[a]), _mm_mul_pd(t, _mm_set_pd(dx_[b], dx_[a]))));
+				_mm_storeu_pd(&y[k], _mm_add_pd(_mm_set_pd(y_[b], y_[a]), _mm_mul_pd(t, _mm_set_pd(dy_[b], dy_[a]))));
+				_mm_storeu_pd(&z[k], _mm_add_pd(_mm_set_pd(z_[b], z_[a]), _mm_mul_pd(t, _mm_set_pd(dz_[b], dz_[a]))));
+			}
+#endif
+			for (; k < u.size(); k++)
+			{
+				Eigen::Vector3d p = point(legs[k], u[k]);
+				x[k] = p.x();
+				y[k] = p.y();
+				z[k] = p.z();
+			}
+		}
+
+		Eigen::Matrix4d frame(size_t i, const Eigen::Vector3d& p) const
+		{
+			Eigen::Vector3d tx = Eigen::Vector3d(dx_[i], dy_[i], dz_[i]) * inverse_[i];
+			double horizontal = std::hypot(dx_[i], dy_[i]);
+			// vertical legs keep y along the model y axis
+			Eigen::Vector3d ty = horizontal > 0.0 ? Eigen::Vector3d(-dy_[i] / horizontal, dx_[i] / horizontal, 0.0) : Eigen::Vector3d::UnitY();
+			Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+			m.block<3, 1>(0, 0) = tx;
+			m.block<3, 1>(0, 1) = ty;
+			m.block<3, 1>(0, 2) = tx.cross(ty);
+			m.block<3, 1>(0, 3) = p;
+			return m;
+		}
+
+		// legs of the distances along u, following the legs while u ascends
+		std::vector<size_t> leg_indices(const std::vector<double>& u) const
+		{
+			std::vector<size_t> result(u.size());
+			size_t i = u.empty() ? 0 : leg(u[0]);
+			for (size_t k = 0; k < u.size(); k++)
+			{
+				if (k && u[k] < u[k - 1])
+					i = leg(u[k]);
+				else if (i + 1 < legs() && distance_[i + 1] <= u[k])
+				{
+					// the next leg, or a search in the remaining legs
+					if (i + 2 >= legs() || distance_[i + 2] > u[k])
+						i++;
+					else
+						i = std::upper_bound(distance_.begin() + i + 2, distance_.begin() + legs(), u[k]) - distance_.begin() - 1;
+				}
+				result[k] = i;
+			}
+			return result;
+		}
+
+		std::vector<double> distance_; // distance along at each vertex
+		std::vector<double> x_, y_, z_; // leg start
+		std::vector<double> dx_, dy_, dz_; // leg end - leg start
+		std::vector<double> inverse_; // 1 / leg length, 0 for legs of zero length
+	};
+}
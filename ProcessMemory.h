@@ -0,0 +1,50 @@
+#pragma once
+
+// Memory use of the test process, for tests that check that memory stays flat or within a budget.
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#include <malloc.h>
+
+#include <cstddef>
+
+namespace IfcOpenShellUnitTests
+{
+	struct process_memory
+	{
+		size_t private_bytes = 0;     // committed memory of the process
+		size_t working_set = 0;       // resident memory
+		size_t peak_working_set = 0;  // largest resident memory since the process started
+	};
+
+	inline process_memory current_process_memory()
+	{
+		PROCESS_MEMORY_COUNTERS_EX counters = {};
+		counters.cb = sizeof(counters);
+		process_memory result;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+		{
+			result.private_bytes = counters.PrivateUsage;
+			result.working_set = counters.WorkingSetSize;
+			result.peak_working_set = counters.PeakWorkingSetSize;
+		}
+		return result;
+	}
+
+	// Bytes in the allocated blocks of the CRT heap. Walks the heap, so it is meant for measuring the allocations of a
+	// step on one thread, e.g. loading a file, as the difference of two calls.
+	inline size_t heap_bytes_in_use()
+	{
+		_HEAPINFO entry = {};
+		size_t bytes = 0;
+		while (_heapwalk(&entry) == _HEAPOK)
+		{
+			if (entry._useflag == _USEDENTRY)
+				bytes += entry._size;
+		}
+		return bytes;
+	}
+}
@@ -10,6 +10,8 @@
 #include <ifcgeom/abstract_mapping.h>
 #include <ifcgeom/function_item_evaluator.h>
 
+#include "RailRoomTestset.h"
+
 #include <fstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -40,26 +42,11 @@ namespace IfcRailRoom
 			ifcopenshell::geometry::function_item_evaluator evaluator(settings,fn);
 
 
-			std::ostringstream os2;
-			os2 << "F:/IFC-Rail-Unit-Test-Reference-Code/alignment_testset/ToolboxProcess-C/CantAlignment/" << curve_type.c_str() << "/" << curve_type.c_str() << test_name << "-2CS.txt";
-			std::ifstream ifile(os2.str().c_str());
-			std::string str;
-			std::getline(ifile, str);
-			std::getline(ifile, str);
-
 			double tol = 0.0001;
-			double s; // so we have the last value after the loop
-			while (ifile)
+			double s = 0.0; // so we have the last value after the loop
+			for (const auto& expected : IfcRailRoom::read_reference(IfcRailRoom::Layout::Cant, curve_type, test_name))
 			{
-				double es, ex, ey, ez;
-				std::string ee;
-				ifile >> es >> ex >> ey >> ez >> ee;
-
-				if (ifile.fail()) break;
-
-				s = std::stod(ee.substr(1, ee.size() - 2));
-
-				//double s = (curve_type == "Cubic") ? ex : es;
+				s = expected.s;
 				auto m = ifcopenshell::geometry::taxonomy::make<ifcopenshell::geometry::taxonomy::matrix4>(evaluator.evaluate(s));
 
 				m->components().col(3).head(3) /= mapping->get_length_unit();
@@ -68,9 +55,9 @@ namespace IfcRailRoom
 				double x = values(0, 3); // row, col
 				double y = values(1, 3);
 				double z = values(2, 3);
-				Assert::AreEqual(ex, x, tol);
-				Assert::AreEqual(ey, y, tol);
-				Assert::AreEqual(ez, z, tol);
+				Assert::AreEqual(expected.x, x, tol);
+				Assert::AreEqual(expected.y, y, tol);
+				Assert::AreEqual(expected.z, z, tol);
 			}
 
 			// validate the ending placement including the vectors
@@ -204,5 +191,11 @@ namespace IfcRailRoom
 			Test("_100.0_300_inf_1_Meter");
 			Test("_100.0_inf_300_1_Meter");
 		}
+
+		// the stations of every reference file as one batch split over threads, bit-identical to the serial frames
+		TEST_METHOD(Parallel)
+		{
+			IfcRailRoom::test_parallel(IfcRailRoom::Layout::Cant);
+		}
 	};
 }
@@ -10,6 +10,9 @@
 #include <ifcgeom/abstract_mapping.h>
 #include <ifcgeom/function_item_evaluator.h>
 
+#include "RailRoomTestset.h"
+#include "StationSampling.h"
+
 #include <fstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -39,30 +42,24 @@ namespace IfcRailRoom
 			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping->map(curve));
 			ifcopenshell::geometry::function_item_evaluator evaluator(settings, fn);
 
-			std::ostringstream os2;
-			os2 << "F:/IFC-Rail-Unit-Test-Reference-Code/alignment_testset/ToolboxProcessed/HorizontalAlignment/" << curve_type.c_str() << "/" << curve_type.c_str() << test_name << ".txt";
-			std::ifstream ifile(os2.str().c_str());
-			std::string str;
-			std::getline(ifile, str);
-			std::getline(ifile, str);
+			// frames in model units are streamed at the stations of the reference file
+			IfcOpenShellUnitTests::alignment_evaluator sampler(settings, curve, fn, mapping->get_length_unit(), IfcOpenShellUnitTests::units::model);
+			auto reference = IfcRailRoom::read_reference(IfcRailRoom::Layout::Horizontal, curve_type, test_name);
+			auto stations = reference | std::views::transform([](const IfcRailRoom::reference_point& p) { return p.s; });
 
 			double tol = 0.001;
-			double s;
-			while (ifile)
+			double s = 0.0;
+			auto expected = reference.begin();
+			for (const auto& sample : IfcOpenShellUnitTests::sample_stations(sampler, stations))
 			{
-				double es, ex, ey;
-				ifile >> es >> ex >> ey;
-
-				s = (curve_type == "Cubic") ? ex : es;
-				auto m = ifcopenshell::geometry::taxonomy::make<ifcopenshell::geometry::taxonomy::matrix4>(evaluator.evaluate(s));
-				m->components().col(3).head(3) /= mapping->get_length_unit();
-				Eigen::Matrix4d values = m->components();
-
-				double x = values(0, 3); // row, col
-				double y = values(1, 3);
-				Assert::AreEqual(ex, x, tol);
-				Assert::AreEqual(ey, y, tol);
+				s = sample.station;
+				double x = sample.frame(0, 3); // row, col
+				double y = sample.frame(1, 3);
+				Assert::AreEqual(expected->x, x, tol);
+				Assert::AreEqual(expected->y, y, tol);
+				++expected;
 			}
+			Assert::IsTrue(expected == reference.end());
 
 
 			// validate the ending placement including the vectors
@@ -202,5 +199,11 @@ namespace IfcRailRoom
 			Test("_100.0_300_inf_1_Meter");
 			Test("_100.0_inf_300_1_Meter");
 		}
+
+		// the stations of every reference file as one batch split over threads, bit-identical to the serial frames
+		TEST_METHOD(Parallel)
+		{
+			IfcRailRoom::test_parallel(IfcRailRoom::Layout::Horizontal);
+		}
 	};
 }
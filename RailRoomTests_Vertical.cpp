@@ -10,6 +10,8 @@
 #include <ifcgeom/abstract_mapping.h>
 #include <ifcgeom/function_item_evaluator.h>
 
+#include "RailRoomTestset.h"
+
 #include <fstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -39,31 +41,21 @@ namespace IfcRailRoom
 			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping->map(curve));
 			ifcopenshell::geometry::function_item_evaluator evaluator(settings,fn);
 
-			std::ostringstream os2;
-			os2 << "F:/IFC-Rail-Unit-Test-Reference-Code/alignment_testset/ToolboxProcessed/VerticalAlignment/" << curve_type.c_str() << "/" << curve_type.c_str() << test_name << ".txt";
-			std::ifstream ifile(os2.str().c_str());
-			std::string str;
-			std::getline(ifile, str);
-			std::getline(ifile, str);
-
 			double tol = 0.0001;
-			double s;
-			while (ifile)
+			double s = 0.0;
+			for (const auto& expected : IfcRailRoom::read_reference(IfcRailRoom::Layout::Vertical, curve_type, test_name))
 			{
-				int i;
-				double ex, ez, es;
-				ifile >> i >> es >> ex >> ez;
-				s = es;
-				auto m = ifcopenshell::geometry::taxonomy::make<ifcopenshell::geometry::taxonomy::matrix4>(evaluator.evaluate(es));
+				s = expected.s;
+				auto m = ifcopenshell::geometry::taxonomy::make<ifcopenshell::geometry::taxonomy::matrix4>(evaluator.evaluate(s));
 				m->components().col(3).head(3) /= mapping->get_length_unit();
 				Eigen::Matrix4d values = m->components();
 
 				double x = values(0, 3); // row, col
 				//double y = values(1, 3);
 				double z = values(2, 3);
-				Assert::AreEqual(es, x, tol);
-				//Assert::AreEqual(ey, y, tol);
-				Assert::AreEqual(ez, z, tol);
+				Assert::AreEqual(expected.x, x, tol);
+				//Assert::AreEqual(expected.y, y, tol);
+				Assert::AreEqual(expected.z, z, tol);
 			}
 
 			// validate the ending placement including the vectors
@@ -136,5 +128,11 @@ namespace IfcRailRoom
 			Test("_100.0_10.0_0.5_1.0_1_Meter");
 			Test("_100.0_10.0_1.0_0.5_1_Meter");
 		}
+
+		// the stations of every reference file as one batch split over threads, bit-identical to the serial frames
+		TEST_METHOD(Parallel)
+		{
+			IfcRailRoom::test_parallel(IfcRailRoom::Layout::Vertical);
+		}
 	};
 }
@@ -0,0 +1,227 @@
+#pragma once
+
+// Access to the IFC-Rail Unit Test Reference Code alignment testset used by the RailRoomTests_*.cpp files.
+// The testset is not part of this repository, see https://github.com/bSI-RailwayRoom/IFC-Rail-Unit-Test-Reference-Code
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include "CppUnitTest.h"
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+#include <ifcgeom/function_item_evaluator.h>
+
+#include "ParallelEvaluation.h"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace IfcRailRoom
+{
+	const std::string testset_root = "F:/IFC-Rail-Unit-Test-Reference-Code/alignment_testset/";
+
+	enum class Layout { Horizontal, Vertical, Cant };
+
+	inline const char* layout_name(Layout layout)
+	{
+		switch (layout)
+		{
+		case Layout::Horizontal: return "Horizontal";
+		case Layout::Vertical: return "Vertical";
+		default: return "Cant";
+		}
+	}
+
+	// curve types with reference results, per layout
+	inline const std::vector<std::string>& curve_types(Layout layout)
+	{
+		static const std::vector<std::string> horizontal{ "Line", "Cubic", "BlossCurve", "CircularArc", "Clothoid", "CosineCurve", "SineCurve", "HelmertCurve", "VienneseBend" };
+		static const std::vector<std::string> vertical{ "ConstantGradient", "ParabolicArc", "CircularArc" };
+		static const std::vector<std::string> cant{ "BlossCurve", "ConstantCant", "CosineCurve", "HelmertCurve", "LinearTransition", "SineCurve", "VienneseBend" };
+		switch (layout)
+		{
+		case Layout::Horizontal: return horizontal;
+		case Layout::Vertical: return vertical;
+		default: return cant;
+		}
+	}
+
+	// test case suffixes, per layout
+	inline const std::vector<std::string>& test_names(Layout layout)
+	{
+		static const std::vector<std::string> horizontal_and_cant{
+			"_100.0_-1000_-300_1_Meter",
+			"_100.0_-300_-1000_1_Meter",
+			"_100.0_-300_-inf_1_Meter",
+			"_100.0_-inf_-300_1_Meter",
+			"_100.0_1000_300_1_Meter",
+			"_100.0_300_1000_1_Meter",
+			"_100.0_300_inf_1_Meter",
+			"_100.0_inf_300_1_Meter"
+		};
+		static const std::vector<std::string> vertical{
+			"_100.0_10.0_-0.5_-1.0_1_Meter",
+			"_100.0_10.0_-0.5_0.0_1_Meter",
+			"_100.0_10.0_-1.0_-0.5_1_Meter",
+			"_100.0_10.0_0.0_-0.5_1_Meter",
+			"_100.0_10.0_0.0_0.5_1_Meter",
+			"_100.0_10.0_0.5_0.0_1_Meter",
+			"_100.0_10.0_0.5_1.0_1_Meter",
+			"_100.0_10.0_1.0_0.5_1_Meter"
+		};
+		return layout == Layout::Vertical ? vertical : horizontal_and_cant;
+	}
+
+	// positional tolerance used by the RailRoomTests_*.cpp files
+	inline double tolerance(Layout layout)
+	{
+		return layout == Layout::Horizontal ? 0.001 : 0.0001;
+	}
+
+	inline std::string ifc_path(Layout layout, const std::string& curve_type, const std::string& test_name)
+	{
+		std::ostringstream os;
+		os << testset_root << "IFC-WithGeneratedGeometry/GENERATED__" << layout_name(layout) << "Alignment_" << curve_type << test_name << ".ifc";
+		return os.str();
+	}
+
+	inline std::string reference_path(Layout layout, const std::string& curve_type, const std::string& test_name)
+	{
+		std::ostringstream os;
+		if (layout == Layout::Cant)
+			os << testset_root << "ToolboxProcess-C/CantAlignment/" << curve_type << "/" << curve_type << test_name << "-2CS.txt";
+		else
+			os << testset_root << "ToolboxProcessed/" << layout_name(layout) << "Alignment/" << curve_type << "/" << curve_type << test_name << ".txt";
+		return os.str();
+	}
+
+	// A point from a reference file.
+	// s is the distance along passed to the evaluator, x, y, z are the expected coordinates.
+	// Coordinates that are not part of the reference file are left at zero.
+	struct reference_point
+	{
+		double s = 0.0;
+		double x = 0.0;
+		double y = 0.0;
+		double z = 0.0;
+	};
+
+	// Reads the points of a reference file, skipping its two header lines
+	inline std::vector<reference_point> read_reference(Layout layout, const std::string& curve_type, const std::string& test_name)
+	{
+		std::vector<reference_point> points;
+
+		std::ifstream ifile(reference_path(layout, curve_type, test_name).c_str());
+		std::string str;
+		std::getline(ifile, str);
+		std::getline(ifile, str);
+
+		while (ifile)
+		{
+			reference_point p;
+			if (layout == Layout::Horizontal)
+			{
+				double es;
+				ifile >> es >> p.x >> p.y;
+				if (ifile.fail()) break;
+				p.s = (curve_type == "Cubic") ? p.x : es;
+			}
+			else if (layout == Layout::Vertical)
+			{
+				int i;
+				ifile >> i >> p.s >> p.x >> p.z;
+				if (ifile.fail()) break;
+				p.x = p.s; // the vertical tests compare x against the distance along
+			}
+			else
+			{
+				double es;
+				std::string ee;
+				ifile >> es >> p.x >> p.y >> p.z >> ee;
+				if (ifile.fail()) break;
+				p.s = std::stod(ee.substr(1, ee.size() - 2));
+			}
+			points.push_back(p);
+		}
+
+		return points;
+	}
+
+	// A testset alignment curve, mapped and ready for evaluation.
+	// The mapping keeps a reference to the settings so test cases are handed out by pointer.
+	struct testcase
+	{
+		testcase(const std::string& path) : file(path) {}
+		testcase(const testcase&) = delete;
+		testcase& operator=(const testcase&) = delete;
+
+		IfcParse::IfcFile file;
+		ifcopenshell::geometry::Settings settings;
+		std::unique_ptr<ifcopenshell::geometry::abstract_mapping> mapping;
+		Ifc4x3_add2::IfcCompositeCurve* curve = nullptr;
+		ifcopenshell::geometry::taxonomy::function_item::ptr fn;
+	};
+
+	inline std::unique_ptr<testcase> load_testcase(Layout layout, const std::string& curve_type, const std::string& test_name)
+	{
+		auto tc = std::make_unique<testcase>(ifc_path(layout, curve_type, test_name));
+
+		aggregate_of_instance::ptr curves;
+		switch (layout)
+		{
+		case Layout::Horizontal: curves = tc->file.instances_by_type<Ifc4x3_add2::IfcCompositeCurve>()->generalize(); break;
+		case Layout::Vertical: curves = tc->file.instances_by_type<Ifc4x3_add2::IfcGradientCurve>()->generalize(); break;
+		default: curves = tc->file.instances_by_type<Ifc4x3_add2::IfcSegmentedReferenceCurve>()->generalize(); break;
+		}
+		if (!curves || curves->size() == 0)
+			return nullptr;
+
+		tc->curve = (*(curves->begin()))->as<Ifc4x3_add2::IfcCompositeCurve>();
+		tc->mapping.reset(ifcopenshell::geometry::impl::mapping_implementations().construct(&tc->file, tc->settings));
+		tc->fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(tc->mapping->map(tc->curve));
+		return tc;
+	}
+
+	// Evaluates the stations of every reference file of a layout as one batch split over threads, asserts the frames are
+	// bit-identical to the serial frames and match the coordinates of the reference file within tolerance(layout)
+	inline void test_parallel(Layout layout)
+	{
+		using Microsoft::VisualStudio::CppUnitTestFramework::Assert;
+
+		for (const auto& type : curve_types(layout))
+		{
+			for (const auto& test_name : test_names(layout))
+			{
+				auto tc = load_testcase(layout, type, test_name);
+				Assert::IsNotNull(tc.get());
+				IfcOpenShellUnitTests::alignment_evaluator evaluator(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit(), IfcOpenShellUnitTests::units::model);
+
+				auto reference = read_reference(layout, type, test_name);
+				std::vector<double> stations;
+				std::vector<Eigen::Matrix4d> frames;
+				for (const auto& p : reference)
+				{
+					stations.push_back(p.s);
+					frames.push_back(evaluator.evaluate(p.s));
+				}
+				for (size_t threads : { 2, 4, 8 })
+					Assert::IsTrue(frames == IfcOpenShellUnitTests::parallel_evaluator(evaluator, threads).evaluate(stations));
+
+				double tol = tolerance(layout);
+				for (size_t i = 0; i < reference.size(); i++)
+				{
+					Assert::AreEqual(reference[i].x, frames[i](0, 3), tol);
+					if (layout != Layout::Vertical)
+						Assert::AreEqual(reference[i].y, frames[i](1, 3), tol);
+					if (layout != Layout::Horizontal)
+						Assert::AreEqual(reference[i].z, frames[i](2, 3), tol);
+				}
+			}
+		}
+	}
+}
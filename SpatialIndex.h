@@ -0,0 +1,262 @@
+#pragma once
+
+// Spatial index over mapped alignment curves for box and radius queries.
+//
+// Every alignment is cut into leaves along the chords of an adaptive_tessellation at the leaf tolerance. The
+// curve between the chord end points deviates from the chord by at most M2 * du^2 / 8 (see AdaptiveTessellation.h),
+// so the box of the chord grown by that deviation contains the curve. The box is conservative where M2 has a closed
+// form. Where it is estimated from samples, for parent curves such as IfcPolynomialCurve with other CoefficientsX or
+// B-splines, the curve may leave the box between the samples; such leaves are marked as not conservative. For
+// horizontal alignments of lines, circles and spirals the distance along is the arc length, so the curve also lies
+// in the ellipsoid with the chord end points as foci and the leaf length as major axis, and the box is clipped to
+// the box of that ellipsoid.
+//
+// Leaves are kept in alignment and station order and a bounding volume hierarchy is built over consecutive
+// leaves, which are spatially close along an alignment. Query results are station ranges, merged per
+// horizontal IfcCurveSegment, in the output unit of the evaluators.
+
+#include "AdaptiveTessellation.h"
+
+#include <limits>
+
+namespace IfcOpenShellUnitTests
+{
+	struct bounding_box
+	{
+		Eigen::Vector3d min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+		Eigen::Vector3d max = Eigen::Vector3d::Constant(-std::numeric_limits<double>::infinity());
+
+		bounding_box() = default;
+		bounding_box(const Eigen::Vector3d& a, const Eigen::Vector3d& b) : min(a.cwiseMin(b)), max(a.cwiseMax(b)) {}
+
+		bool empty() const { return (min.array() > max.array()).any(); }
+
+		void extend(const bounding_box& b)
+		{
+			min = min.cwiseMin(b.min);
+			max = max.cwiseMax(b.max);
+		}
+
+		void grow(double d)
+		{
+			min.array() -= d;
+			max.array() += d;
+		}
+
+		bool contains(const Eigen::Vector3d& p) const { return (p.array() >= min.array()).all() && (p.array() <= max.array()).all(); }
+		bool intersects(const bounding_box& b) const { return (min.array() <= b.max.array()).all() && (b.min.array() <= max.array()).all(); }
+
+		double squared_distance(const Eigen::Vector3d& p) const
+		{
+			Eigen::Vector3d d = (min - p).cwiseMax(p - max).cwiseMax(Eigen::Vector3d::Zero());
+			return d.squaredNorm();
+		}
+	};
+
+	class spatial_index
+	{
+	public:
+		static constexpr size_t no_segment = std::numeric_limits<size_t>::max();
+
+		struct leaf
+		{
+			size_t alignment = 0;
+			size_t segment = no_segment; // index in the horizontal segment table of the alignment
+			double start = 0.0;
+			double end = 0.0;
+			bounding_box box;
+			bool conservative = true; // false when the box is grown by an estimated M2
+		};
+
+		struct hit
+		{
+			size_t alignment = 0;
+			size_t segment = no_segment;
+			double start = 0.0;
+			double end = 0.0;
+		};
+
+		explicit spatial_index(double leaf_tolerance = 1.0) : leaf_tolerance_(leaf_tolerance) {}
+
+		// Adds the leaves of an alignment, returns its index. The index must be rebuilt before querying.
+		size_t add(const alignment_evaluator& evaluator)
+		{
+			size_t alignment = alignments_++;
+			const segment_table* horizontal = evaluator.layers().empty() ? nullptr : &evaluator.layers().back();
+			bool arc_length = parameterized_by_arc_length(evaluator);
+
+			adaptive_tessellator tessellator(evaluator, leaf_tolerance_);
+			auto line = tessellator.tessellate();
+			size_t interval = 0;
+			for (size_t i = 0; i + 1 < line.size(); i++)
+			{
+				leaf l;
+				l.alignment = alignment;
+				l.start = line.stations[i];
+				l.end = line.stations[i + 1];
+				if (horizontal && !horizontal->empty())
+					l.segment = horizontal->find(0.5 * (l.start + l.end));
+
+				while (interval + 1 < tessellator.intervals().size() && tessellator.intervals()[interval].end <= l.start)
+					interval++;
+				const auto& bound = tessellator.intervals()[interval];
+				l.box = chord_box(line.points[i], line.points[i + 1], l.end - l.start, bound.second_derivative_bound, arc_length);
+				l.conservative = bound.analytic;
+				leaves_.push_back(l);
+			}
+			nodes_.clear();
+			return alignment;
+		}
+
+		void build()
+		{
+			nodes_.clear();
+			if (!leaves_.empty())
+				build(0, leaves_.size());
+		}
+
+		std::vector<hit> query(const bounding_box& box) const
+		{
+			return query_nodes([&box](const bounding_box& b) { return b.intersects(box); });
+		}
+
+		std::vector<hit> query(const Eigen::Vector3d& center, double radius) const
+		{
+			double r2 = radius * radius;
+			return query_nodes([&center, r2](const bounding_box& b) { return b.squared_distance(center) <= r2; });
+		}
+
+		const std::vector<leaf>& leaves() const { return leaves_; }
+		size_t alignment_count() const { return alignments_; }
+		double leaf_tolerance() const { return leaf_tolerance_; }
+
+		bounding_box bounds() const { return nodes_.empty() ? bounding_box() : nodes_.front().box; }
+
+	private:
+		struct node
+		{
+			bounding_box box;
+			size_t first = 0; // first leaf
+			size_t count = 0; // number of leaves
+			size_t right = 0; // index of the right child, the left child follows its parent; 0 for a leaf node
+		};
+
+		static constexpr size_t leaves_per_node = 4;
+
+		// true for a horizontal alignment whose parent curves are all lines, circles or spirals
+		static bool parameterized_by_arc_length(const alignment_evaluator& evaluator)
+		{
+			if (evaluator.layers().size() != 1 || evaluator.curve()->as<Ifc4x3_add2::IfcGradientCurve>())
+				return false;
+			for (const auto& r : evaluator.layers().front().segments())
+			{
+				auto parent = r.segment->ParentCurve();
+				if (!parent->as<Ifc4x3_add2::IfcLine>() && !parent->as<Ifc4x3_add2::IfcCircle>() && !parent->as<Ifc4x3_add2::IfcSpiral>())
+					return false;
+			}
+			return true;
+		}
+
+		static bounding_box chord_box(const Eigen::Vector3d& p0, const Eigen::Vector3d& p1, double length, double m2, bool arc_length)
+		{
+			bounding_box box(p0, p1);
+			box.grow(m2 * length * length / 8.0);
+
+			if (arc_length)
+			{
+				// box of the ellipsoid with foci p0, p1 and major axis length
+				double a = 0.5 * length;
+				Eigen::Vector3d d = p1 - p0;
+				double c = 0.5 * d.norm();
+				double b2 = std::max(0.0, a * a - c * c);
+				Eigen::Vector3d u = c > 0.0 ? Eigen::Vector3d(d / (2.0 * c)) : Eigen::Vector3d::UnitX();
+				Eigen::Vector3d center = 0.5 * (p0 + p1);
+				Eigen::Vector3d extent;
+				for (int i = 0; i < 3; i++)
+					extent(i) = std::sqrt(a * a * u(i) * u(i) + b2 * (1.0 - u(i) * u(i)));
+				box.min = box.min.cwiseMax(center - extent);
+				box.max = box.max.cwiseMin(center + extent);
+			}
+			return box;
+		}
+
+		size_t build(size_t first, size_t count)
+		{
+			size_t index = nodes_.size();
+			nodes_.emplace_back();
+			nodes_[index].first = first;
+			nodes_[index].count = count;
+
+			bounding_box box;
+			if (count <= leaves_per_node)
+			{
+				for (size_t i = first; i < first + count; i++)
+					box.extend(leaves_[i].box);
+			}
+			else
+			{
+				size_t half = count / 2;
+				build(first, half);
+				size_t right = build(first + half, count - half);
+				box = nodes_[index + 1].box;
+				box.extend(nodes_[right].box);
+				nodes_[index].right = right;
+			}
+			nodes_[index].box = box;
+			return index;
+		}
+
+		template <typename F>
+		std::vector<hit> query_nodes(F overlaps) const
+		{
+			std::vector<hit> hits;
+			if (nodes_.empty())
+				return hits;
+
+			size_t stack[64];
+			size_t top = 0;
+			stack[top++] = 0;
+			while (top)
+			{
+				const auto& n = nodes_[stack[--top]];
+				if (!overlaps(n.box))
+					continue;
+				if (n.right == 0)
+				{
+					for (size_t i = n.first; i < n.first + n.count; i++)
+					{
+						if (overlaps(leaves_[i].box))
+							add_hit(hits, leaves_[i]);
+					}
+				}
+				else
+				{
+					// right first so leaves are visited in station order
+					stack[top++] = n.right;
+					stack[top++] = &n - nodes_.data() + 1;
+				}
+			}
+			return hits;
+		}
+
+		// merges consecutive leaves of the same segment into one station range
+		static void add_hit(std::vector<hit>& hits, const leaf& l)
+		{
+			if (!hits.empty())
+			{
+				auto& last = hits.back();
+				if (last.alignment == l.alignment && last.segment == l.segment && last.end == l.start)
+				{
+					last.end = l.end;
+					return;
+				}
+			}
+			hits.push_back({ l.alignment, l.segment, l.start, l.end });
+		}
+
+		double leaf_tolerance_;
+		size_t alignments_ = 0;
+		std::vector<leaf> leaves_;
+		std::vector<node> nodes_;
+	};
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+// Lazy sampling of alignment curves.
+//
+// The sample functions are coroutines that yield one station_sample at a time, at fixed steps, at the segment
+// breakpoints of all layers, or at a sequence of stations given by the caller. Nothing is evaluated before the
+// consumer asks for the next sample and no vector of samples is built, so a consumer can stop early or process
+// samples as they come:
+//
+//     for (const auto& sample : sample_fixed_step(evaluator, 1.0))
+//         consume(sample.station, sample.frame);
+//
+// A station_cursor follows the stations and keeps the current segment of every layer, reported with every sample.
+// Moving forward advances the segment indices, only a move backwards searches the segment tables. The frames are
+// evaluated by the alignment_evaluator, which locates every station in the mapped function_item itself; the cursor
+// saves the search of the segment tables, not of the mapping. Frames are in the output unit of the evaluator.
+//
+// sample_fixed_step throws std::invalid_argument for a step that is not positive and finite, when it is called.
+//
+// The generators refer to the evaluator, which must outlive them. A station sequence is stored in the coroutine, pass
+// a view such as std::span or std::views::transform to avoid a copy.
+
+#include "AlignmentEvaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+
+namespace IfcOpenShellUnitTests
+{
+	// Move-only input range over the values yielded by a coroutine
+	template <typename T>
+	class generator
+	{
+	public:
+		struct promise_type
+		{
+			const T* value = nullptr;
+			std::exception_ptr exception;
+
+			generator get_return_object() { return generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() { exception = std::current_exception(); }
+
+			// the yielded temporary lives until the coroutine is resumed
+			std::suspend_always yield_value(const T& v) noexcept
+			{
+				value = std::addressof(v);
+				return {};
+			}
+		};
+
+		using handle = std::coroutine_handle<promise_type>;
+
+		class iterator
+		{
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using difference_type = std::ptrdiff_t;
+			using value_type = T;
+
+			iterator() = default;
+			explicit iterator(handle h) : h_(h) {}
+
+			const T& operator*() const { return *h_.promise().value; }
+			const T* operator->() const { return h_.promise().value; }
+
+			iterator& operator++()
+			{
+				resume(h_);
+				return *this;
+			}
+			void operator++(int) { ++*this; }
+
+			bool operator==(std::default_sentinel_t) const { return !h_ || h_.done(); }
+
+		private:
+			handle h_;
+		};
+
+		generator(generator&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+		generator& operator=(generator&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (h_)
+					h_.destroy();
+				h_ = std::exchange(other.h_, {});
+			}
+			return *this;
+		}
+		generator(const generator&) = delete;
+		generator& operator=(const generator&) = delete;
+
+		~generator()
+		{
+			if (h_)
+				h_.destroy();
+		}
+
+		// runs the coroutine to the first value, must be called once
+		iterator begin()
+		{
+			if (h_)
+				resume(h_);
+			return iterator(h_);
+		}
+		std::default_sentinel_t end() const { return {}; }
+
+	private:
+		explicit generator(handle h) : h_(h) {}
+
+		static void resume(handle h)
+		{
+			h.resume();
+			if (h.promise().exception)
+				std::rethrow_exception(h.promise().exception);
+		}
+
+		handle h_;
+	};
+
+	struct station_sample
+	{
+		double station = 0.0;
+		Eigen::Matrix4d frame;
+		size_t segment = 0; // index of the segment in the outermost layer, 0 for curves without segment tables
+	};
+
+	class station_cursor
+	{
+	public:
+		explicit station_cursor(const alignment_evaluator& evaluator) : evaluator_(evaluator), segments_(evaluator.layers().size(), 0) {}
+
+		// Moves to station u, updating the current segment of every layer
+		void seek(double u)
+		{
+			const auto& layers = evaluator_.layers();
+			for (size_t l = 0; l < layers.size(); l++)
+			{
+				const auto& layer = layers[l];
+				if (layer.empty())
+					continue;
+				auto& i = segments_[l];
+				if (u < layer[i].start)
+				{
+					IFCOS_UT_COUNT(segment_searches);
+					i = layer.find(u);
+					continue;
+				}
+				while (i + 1 < layer.size() && layer[i + 1].start <= u)
+					i++;
+			}
+		}
+
+		station_sample sample(double u)
+		{
+			seek(u);
+			return { u, evaluator_.evaluate(u), segments_.empty() ? 0 : segments_.front() };
+		}
+
+		// current segment in layer, see segment_layers()
+		size_t segment(size_t layer) const { return segments_[layer]; }
+
+	private:
+		const alignment_evaluator& evaluator_;
+		std::vector<size_t> segments_;
+	};
+
+	namespace sampling_detail
+	{
+		inline generator<station_sample> fixed_step(const alignment_evaluator& evaluator, double step)
+		{
+			station_cursor cursor(evaluator);
+			const double start = evaluator.start(), end = evaluator.end();
+			for (size_t i = 0;; i++)
+			{
+				// multiples of step do not accumulate rounding errors
+				double u = start + step * i;
+				if (u >= end)
+					break;
+				co_yield cursor.sample(u);
+			}
+			co_yield cursor.sample(end);
+		}
+	}
+
+	// Samples at start, start + step, start + 2 step, ... and at the end of the curve. The step is checked here, the
+	// body of a coroutine only runs when the first sample is requested.
+	inline generator<station_sample> sample_fixed_step(const alignment_evaluator& evaluator, double step)
+	{
+		if (!(step > 0.0) || !std::isfinite(step))
+			throw std::invalid_argument("sample_fixed_step: the step must be positive and finite");
+		return sampling_detail::fixed_step(evaluator, step);
+	}
+
+	// Samples at the start of the curve, at every segment start of every layer inside the curve and at the end
+	inline generator<station_sample> sample_breakpoints(const alignment_evaluator& evaluator)
+	{
+		station_cursor cursor(evaluator);
+		const double start = evaluator.start(), end = evaluator.end();
+		const auto& layers = evaluator.layers();
+
+		co_yield cursor.sample(start);
+
+		// merges the segment starts of the layers
+		std::vector<size_t> next(layers.size(), 0);
+		double last = start;
+		for (;;)
+		{
+			double u = std::numeric_limits<double>::infinity();
+			for (size_t l = 0; l < layers.size(); l++)
+			{
+				while (next[l] < layers[l].size() && layers[l][next[l]].start <= last)
+					next[l]++;
+				if (next[l] < layers[l].size())
+					u = std::min(u, layers[l][next[l]].start);
+			}
+			if (!(u < end))
+				break;
+			co_yield cursor.sample(u);
+			last = u;
+		}
+
+		if (end > start)
+			co_yield cursor.sample(end);
+	}
+
+	// Samples at the stations of a range of doubles, in the order given. The segments of ascending stations are followed
+	// without searching.
+	template <std::ranges::input_range Range>
+	generator<station_sample> sample_stations(const alignment_evaluator& evaluator, Range stations)
+	{
+		station_cursor cursor(evaluator);
+		for (double u : stations)
+			co_yield cursor.sample(u);
+	}
+}
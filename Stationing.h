@@ -0,0 +1,271 @@
+#pragma once
+
+// Conversion between station and distance along an alignment.
+//
+// Stationing is defined by IfcReferent instances nested under the IfcAlignment. Each referent is positioned by an
+// IfcLinearPlacement at a distance along the alignment and carries Pset_Stationing with the Station from which
+// stationing continues, optionally the IncomingStation of a station equation and HasIncreasingStation.
+// Between two referents the station changes by the distance travelled, so station(d) = Station + (d - distance)
+// for the last referent before d. Stations before the first referent are extrapolated from the first referent.
+//
+// A station equation that jumps back produces stations that occur more than once. distance() then returns the
+// smallest distance along with the given station. Stations in the gap of a forward equation do not exist and
+// throw std::out_of_range.
+//
+// Both lookups are binary searches. Stations and distances are in model units.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include "AlignmentSegments.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	struct station_equation
+	{
+		double distance = 0.0; // distance along of the referent
+		double station = 0.0;  // station from the referent onwards
+		double incoming_station = std::numeric_limits<double>::quiet_NaN(); // station before the referent, NaN if not given
+		bool increasing = true;
+		const Ifc4x3_add2::IfcReferent* referent = nullptr;
+	};
+
+	class stationing_index
+	{
+	public:
+		stationing_index() = default;
+
+		explicit stationing_index(std::vector<station_equation> equations) : equations_(std::move(equations))
+		{
+			std::stable_sort(equations_.begin(), equations_.end(), [](const station_equation& a, const station_equation& b) { return a.distance < b.distance; });
+			distances_.reserve(equations_.size());
+			for (const auto& e : equations_)
+				distances_.push_back(e.distance);
+
+			// station ranges of the regions between referents, sorted by their lowest station
+			const double infinity = std::numeric_limits<double>::infinity();
+			for (size_t i = 0; i < equations_.size(); i++)
+			{
+				double d0 = i == 0 ? -infinity : equations_[i].distance;
+				double d1 = i + 1 < equations_.size() ? equations_[i + 1].distance : infinity;
+				if (d1 <= d0)
+					continue; // superseded by a referent at the same distance
+				double s0 = station_in(i, d0);
+				double s1 = station_in(i, d1);
+				ranges_.push_back({ std::min(s0, s1), std::max(s0, s1), i });
+			}
+			std::sort(ranges_.begin(), ranges_.end(), [](const range& a, const range& b) { return a.low < b.low; });
+
+			prefix_high_.reserve(ranges_.size());
+			double high = -infinity;
+			for (const auto& r : ranges_)
+			{
+				high = std::max(high, r.high);
+				prefix_high_.push_back(high);
+			}
+		}
+
+		bool empty() const { return equations_.empty(); }
+		size_t size() const { return equations_.size(); }
+		const std::vector<station_equation>& equations() const { return equations_; }
+
+		// Station at distance along d. Without referents stations equal distances.
+		double station(double d) const
+		{
+			if (equations_.empty())
+				return d;
+			return station_in(region(d), d);
+		}
+
+		// Smallest distance along with station s
+		double distance(double s) const
+		{
+			if (equations_.empty())
+				return s;
+
+			// candidate ranges start at or below s, scan back until no earlier range can reach s
+			auto it = std::upper_bound(ranges_.begin(), ranges_.end(), s, [](double v, const range& r) { return v < r.low; });
+			double best = std::numeric_limits<double>::infinity();
+			for (size_t j = std::distance(ranges_.begin(), it); j-- > 0 && prefix_high_[j] >= s;)
+			{
+				const auto& r = ranges_[j];
+				if (s > r.high)
+					continue;
+				const auto& e = equations_[r.equation];
+				double d = e.distance + (e.increasing ? s - e.station : e.station - s);
+				best = std::min(best, d);
+			}
+			if (best == std::numeric_limits<double>::infinity())
+				throw std::out_of_range("station is not on the alignment");
+			return best;
+		}
+
+		// Batch conversions. Sorted input is converted with a forward scan instead of a search per value.
+		std::vector<double> stations(const std::vector<double>& distances) const
+		{
+			std::vector<double> result;
+			result.reserve(distances.size());
+			if (equations_.empty() || !std::is_sorted(distances.begin(), distances.end()))
+			{
+				for (auto d : distances)
+					result.push_back(station(d));
+				return result;
+			}
+
+			size_t i = region(distances.empty() ? 0.0 : distances.front());
+			for (auto d : distances)
+			{
+				while (i + 1 < distances_.size() && distances_[i + 1] <= d)
+					i++;
+				result.push_back(station_in(i, d));
+			}
+			return result;
+		}
+
+		std::vector<double> distances(const std::vector<double>& stations) const
+		{
+			std::vector<double> result;
+			result.reserve(stations.size());
+			for (auto s : stations)
+				result.push_back(distance(s));
+			return result;
+		}
+
+	private:
+		struct range
+		{
+			double low;
+			double high;
+			size_t equation;
+		};
+
+		// index of the last referent at or before d, the first referent for distances before it
+		size_t region(double d) const
+		{
+			auto it = std::upper_bound(distances_.begin(), distances_.end(), d);
+			return it == distances_.begin() ? 0 : std::distance(distances_.begin(), it) - 1;
+		}
+
+		double station_in(size_t i, double d) const
+		{
+			const auto& e = equations_[i];
+			return e.increasing ? e.station + (d - e.distance) : e.station - (d - e.distance);
+		}
+
+		std::vector<station_equation> equations_;
+		std::vector<double> distances_;
+		std::vector<range> ranges_;
+		std::vector<double> prefix_high_;
+	};
+
+	// Stationing indices of all alignments of a file, built in one pass over the nesting and property relationships
+	class stationing_service
+	{
+	public:
+		explicit stationing_service(IfcParse::IfcFile& file)
+		{
+			// Pset_Stationing per referent
+			std::map<const Ifc4x3_add2::IfcObjectDefinition*, const Ifc4x3_add2::IfcPropertySet*> psets;
+			auto rels = file.instances_by_type<Ifc4x3_add2::IfcRelDefinesByProperties>();
+			if (rels)
+			{
+				for (auto& rel : *rels)
+				{
+					auto pset = rel->RelatingPropertyDefinition()->as<Ifc4x3_add2::IfcPropertySet>();
+					if (pset == nullptr || pset->Name().get_value_or("") != "Pset_Stationing")
+						continue;
+					for (auto& object : *rel->RelatedObjects())
+						psets[object] = pset;
+				}
+			}
+
+			std::map<const Ifc4x3_add2::IfcAlignment*, std::vector<station_equation>> equations;
+			auto nests = file.instances_by_type<Ifc4x3_add2::IfcRelNests>();
+			if (nests)
+			{
+				for (auto& rel : *nests)
+				{
+					auto alignment = rel->RelatingObject()->as<Ifc4x3_add2::IfcAlignment>();
+					if (alignment == nullptr)
+						continue;
+					for (auto& object : *rel->RelatedObjects())
+					{
+						auto referent = object->as<Ifc4x3_add2::IfcReferent>();
+						if (referent == nullptr)
+							continue;
+						auto pset = psets.find(referent);
+						if (pset == psets.end())
+							continue;
+
+						station_equation e;
+						if (!read(referent, pset->second, e))
+							continue;
+						equations[alignment].push_back(e);
+					}
+				}
+			}
+
+			for (auto& [alignment, e] : equations)
+				indices_.emplace(alignment, stationing_index(std::move(e)));
+		}
+
+		// Stationing of an alignment, an empty index (stations equal distances) for alignments without referents
+		const stationing_index& get(const Ifc4x3_add2::IfcAlignment* alignment) const
+		{
+			static const stationing_index none;
+			auto it = indices_.find(alignment);
+			return it == indices_.end() ? none : it->second;
+		}
+
+		size_t size() const { return indices_.size(); }
+
+	private:
+		static bool read(const Ifc4x3_add2::IfcReferent* referent, const Ifc4x3_add2::IfcPropertySet* pset, station_equation& e)
+		{
+			auto placement = referent->ObjectPlacement() ? referent->ObjectPlacement()->as<Ifc4x3_add2::IfcLinearPlacement>() : nullptr;
+			if (placement == nullptr)
+				return false;
+			auto pde = placement->RelativePlacement()->as<Ifc4x3_add2::IfcAxis2PlacementLinear>()->Location()->as<Ifc4x3_add2::IfcPointByDistanceExpression>();
+			if (pde == nullptr)
+				return false;
+
+			e.referent = referent;
+			e.distance = measure_value(pde->DistanceAlong());
+
+			bool has_station = false;
+			for (auto& property : *pset->HasProperties())
+			{
+				auto value = property->as<Ifc4x3_add2::IfcPropertySingleValue>();
+				if (value == nullptr || value->NominalValue() == nullptr)
+					continue;
+				const auto& name = value->Name();
+				if (name == "Station")
+				{
+					e.station = measure_value(value->NominalValue());
+					has_station = true;
+				}
+				else if (name == "IncomingStation")
+				{
+					e.incoming_station = measure_value(value->NominalValue());
+				}
+				else if (name == "HasIncreasingStation")
+				{
+					if (auto b = value->NominalValue()->as<Ifc4x3_add2::IfcBoolean>())
+						e.increasing = *b;
+				}
+			}
+			return has_station;
+		}
+
+		std::map<const Ifc4x3_add2::IfcAlignment*, stationing_index> indices_;
+	};
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+// Streaming STEP physical file writer.
+//
+// step_writer serialises the instances of an IfcFile entity by entity into a fixed size buffer that is flushed
+// to an output stream whenever it fills up, so memory use does not grow with the size of the model. Reals are
+// written with the shortest representation that parses back to the same double, so a written model re-parses
+// to bit-identical values.
+//
+// Attributes are read through get_attribute_value(). Binary attributes, aggregates of empty aggregates and
+// aggregates of aggregates of instances are not supported and throw std::runtime_error.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+
+#include <cctype>
+#include <charconv>
+#include <ctime>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	// Fixed size character buffer in front of an output stream
+	class buffered_sink
+	{
+	public:
+		explicit buffered_sink(std::ostream& os, size_t capacity = 1 << 16) : os_(os), buffer_(capacity) {}
+		~buffered_sink() { flush(); }
+
+		buffered_sink(const buffered_sink&) = delete;
+		buffered_sink& operator=(const buffered_sink&) = delete;
+
+		void put(char c)
+		{
+			if (size_ == buffer_.size())
+				flush();
+			buffer_[size_++] = c;
+		}
+
+		void write(std::string_view s)
+		{
+			if (s.size() > buffer_.size() - size_)
+			{
+				flush();
+				if (s.size() > buffer_.size())
+				{
+					os_.write(s.data(), s.size());
+					written_ += s.size();
+					return;
+				}
+			}
+			std::copy(s.begin(), s.end(), buffer_.begin() + size_);
+			size_ += s.size();
+		}
+
+		void flush()
+		{
+			if (size_ == 0)
+				return;
+			os_.write(buffer_.data(), size_);
+			written_ += size_;
+			size_ = 0;
+		}
+
+		size_t capacity() const { return buffer_.size(); }
+
+		// bytes passed to the stream so far
+		size_t written() const { return written_; }
+
+	private:
+		std::ostream& os_;
+		std::vector<char> buffer_;
+		size_t size_ = 0;
+		size_t written_ = 0;
+	};
+
+	namespace step
+	{
+		// Shortest round-trip representation of v as a STEP real, e.g. 1., 0.5, 1.E-05
+		inline std::string format_real(double v)
+		{
+			char buffer[32];
+			auto result = std::to_chars(buffer, buffer + sizeof(buffer), v);
+			if (result.ec != std::errc())
+				throw std::runtime_error("cannot format real");
+
+			std::string s(buffer, result.ptr);
+			if (s.find_first_of("in") != std::string::npos)
+				throw std::runtime_error("non-finite real cannot be written to STEP");
+
+			// STEP requires a decimal point in the mantissa and an upper case exponent
+			auto e = s.find('e');
+			auto mantissa_end = e == std::string::npos ? s.size() : e;
+			if (s.find('.') == std::string::npos)
+				s.insert(mantissa_end, 1, '.');
+			if (e != std::string::npos)
+				s[s.find('e')] = 'E';
+			return s;
+		}
+
+		// STEP string literal of UTF-8 text, including the quotes. Characters outside printable ASCII are
+		// written as \X2\ encoded UTF-16 code units.
+		inline std::string format_string(const std::string& utf8)
+		{
+			static const char* hex = "0123456789ABCDEF";
+
+			std::string s = "'";
+			std::vector<unsigned> extended; // UTF-16 code units waiting to be written in one \X2\ block
+			auto flush_extended = [&]()
+			{
+				if (extended.empty())
+					return;
+				s += "\\X2\\";
+				for (auto u : extended)
+				{
+					for (int shift = 12; shift >= 0; shift -= 4)
+						s += hex[(u >> shift) & 0xF];
+				}
+				s += "\\X0\\";
+				extended.clear();
+			};
+
+			for (size_t i = 0; i < utf8.size();)
+			{
+				unsigned char c = utf8[i];
+				unsigned code_point = c;
+				size_t n = 1;
+				if (c >= 0xF0) { code_point = c & 0x07; n = 4; }
+				else if (c >= 0xE0) { code_point = c & 0x0F; n = 3; }
+				else if (c >= 0xC0) { code_point = c & 0x1F; n = 2; }
+				for (size_t k = 1; k < n && i + k < utf8.size(); k++)
+					code_point = (code_point << 6) | (utf8[i + k] & 0x3F);
+				i += n;
+
+				if (code_point >= 0x20 && code_point < 0x7F)
+				{
+					flush_extended();
+					s += (char)code_point;
+					if (code_point == '\'' || code_point == '\\')
+						s += (char)code_point;
+				}
+				else if (code_point >= 0x10000)
+				{
+					code_point -= 0x10000;
+					extended.push_back(0xD800 + (code_point >> 10));
+					extended.push_back(0xDC00 + (code_point & 0x3FF));
+				}
+				else
+				{
+					extended.push_back(code_point);
+				}
+			}
+			flush_extended();
+			s += "'";
+			return s;
+		}
+
+		inline std::string upper(const std::string& name)
+		{
+			std::string s = name;
+			for (auto& c : s)
+				c = (char)std::toupper((unsigned char)c);
+			return s;
+		}
+	}
+
+	class step_writer
+	{
+	public:
+		explicit step_writer(std::ostream& os, size_t buffer_capacity = 1 << 16) : sink_(os, buffer_capacity) {}
+
+		// Writes the complete file
+		void write(const IfcParse::IfcFile& file, const std::string& name = "")
+		{
+			write_header(file, name);
+			for (auto it = file.begin(); it != file.end(); ++it)
+				write_entity(it->second);
+			write_footer();
+		}
+
+		void write_header(const IfcParse::IfcFile& file, const std::string& name)
+		{
+			char timestamp[32] = "";
+			std::time_t now = std::time(nullptr);
+			std::tm tm;
+			if (gmtime_s(&tm, &now) == 0)
+				std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+			sink_.write("ISO-10303-21;\nHEADER;\nFILE_DESCRIPTION(('ViewDefinition [CoordinationView]'),'2;1');\nFILE_NAME(");
+			sink_.write(step::format_string(name));
+			sink_.put(',');
+			sink_.write(step::format_string(timestamp));
+			sink_.write(",(''),(''),'IfcOpenShellUnitTests','IfcOpenShellUnitTests','');\nFILE_SCHEMA(('");
+			sink_.write(step::upper(file.schema()->name()));
+			sink_.write("'));\nENDSEC;\nDATA;\n");
+		}
+
+		void write_entity(const IfcUtil::IfcBaseClass* inst)
+		{
+			auto entity = inst->declaration().as_entity();
+			if (entity == nullptr)
+				return; // simple type instances are written inline where they are used
+
+			sink_.put('#');
+			write_integer(inst->id());
+			sink_.put('=');
+			sink_.write(step::upper(entity->name()));
+			sink_.put('(');
+			auto derived = entity->derived();
+			for (size_t i = 0; i < entity->attribute_count(); i++)
+			{
+				if (i)
+					sink_.put(',');
+				if (i < derived.size() && derived[i])
+					sink_.put('*');
+				else
+					write_attribute(inst->get_attribute_value(i));
+			}
+			sink_.write(");\n");
+		}
+
+		void write_footer()
+		{
+			sink_.write("ENDSEC;\nEND-ISO-10303-21;\n");
+			sink_.flush();
+		}
+
+		const buffered_sink& sink() const { return sink_; }
+
+	private:
+		void write_integer(long long v)
+		{
+			char buffer[24];
+			auto result = std::to_chars(buffer, buffer + sizeof(buffer), v);
+			sink_.write(std::string_view(buffer, result.ptr - buffer));
+		}
+
+		void write_real(double v)
+		{
+			sink_.write(step::format_real(v));
+		}
+
+		void write_reference(const IfcUtil::IfcBaseClass* inst)
+		{
+			if (inst->declaration().as_entity())
+			{
+				sink_.put('#');
+				write_integer(inst->id());
+				return;
+			}
+			// typed value of a select, e.g. IFCLENGTHMEASURE(425.)
+			sink_.write(step::upper(inst->declaration().name()));
+			sink_.put('(');
+			write_attribute(inst->get_attribute_value(0));
+			sink_.put(')');
+		}
+
+		template <typename T, typename F>
+		void write_list(const T& values, F write_value)
+		{
+			sink_.put('(');
+			bool first = true;
+			for (const auto& v : values)
+			{
+				if (!first)
+					sink_.put(',');
+				first = false;
+				write_value(v);
+			}
+			sink_.put(')');
+		}
+
+		void write_attribute(const AttributeValue& value)
+		{
+			switch (value.type())
+			{
+			case IfcUtil::Argument_NULL:
+				sink_.put('$');
+				break;
+			case IfcUtil::Argument_DERIVED:
+				sink_.put('*');
+				break;
+			case IfcUtil::Argument_INT:
+				write_integer((int)value);
+				break;
+			case IfcUtil::Argument_BOOL:
+				sink_.write((bool)value ? ".T." : ".F.");
+				break;
+			case IfcUtil::Argument_LOGICAL:
+			{
+				boost::logic::tribool v = value;
+				sink_.write(boost::logic::indeterminate(v) ? ".U." : (v ? ".T." : ".F."));
+				break;
+			}
+			case IfcUtil::Argument_DOUBLE:
+				write_real((double)value);
+				break;
+			case IfcUtil::Argument_STRING:
+				sink_.write(step::format_string((std::string)value));
+				break;
+			case IfcUtil::Argument_ENUMERATION:
+				sink_.put('.');
+				sink_.write((std::string)value);
+				sink_.put('.');
+				break;
+			case IfcUtil::Argument_ENTITY_INSTANCE:
+				write_reference((IfcUtil::IfcBaseClass*)value);
+				break;
+			case IfcUtil::Argument_EMPTY_AGGREGATE:
+				sink_.write("()");
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_INT:
+				write_list((std::vector<int>)value, [this](int v) { write_integer(v); });
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+				write_list((std::vector<double>)value, [this](double v) { write_real(v); });
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_STRING:
+				write_list((std::vector<std::string>)value, [this](const std::string& v) { sink_.write(step::format_string(v)); });
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE:
+			{
+				aggregate_of_instance::ptr instances = value;
+				write_list(*instances, [this](const IfcUtil::IfcBaseClass* v) { write_reference(v); });
+				break;
+			}
+			case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+				write_list((std::vector<std::vector<int>>)value, [this](const std::vector<int>& l)
+				{
+					write_list(l, [this](int v) { write_integer(v); });
+				});
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+				write_list((std::vector<std::vector<double>>)value, [this](const std::vector<double>& l)
+				{
+					write_list(l, [this](double v) { write_real(v); });
+				});
+				break;
+			default:
+				throw std::runtime_error("attribute type not supported by step_writer");
+			}
+		}
+
+		buffered_sink sink_;
+	};
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Synthetic models used by the tests and benchmarks: instances are added to a file through its entity constructors so
+// the tests do not depend on the fixtures or the testset for model sizes that only need to be large.
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcFile.h>
+#include <ifcparse/IfcGlobalId.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace IfcOpenShellUnitTests
+{
+	// Test model: n alignments with a horizontal layout of horizontal_segments lines, a vertical layout of
+	// vertical_segments constant gradients and, if cant_segments is not zero, a cant layout of constant cant, all nested
+	// as in the fixtures. Segments share their design parameters.
+	inline void add_nested_alignments(IfcParse::IfcFile& file, size_t n, size_t horizontal_segments, size_t vertical_segments, size_t cant_segments = 0)
+	{
+		using namespace Ifc4x3_add2;
+		auto origin = new IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 });
+		auto line = new IfcAlignmentHorizontalSegment(boost::none, boost::none, origin, 0.0, 0.0, 0.0, 100.0, boost::none,
+			IfcAlignmentHorizontalSegmentTypeEnum::IfcAlignmentHorizontalSegmentType_LINE);
+		auto gradient = new IfcAlignmentVerticalSegment(boost::none, boost::none, 0.0, 100.0, 0.0, 0.01, 0.01, boost::none,
+			IfcAlignmentVerticalSegmentTypeEnum::IfcAlignmentVerticalSegmentType_CONSTANTGRADIENT);
+		auto constant_cant = new IfcAlignmentCantSegment(boost::none, boost::none, 0.0, 100.0, 0.0, boost::none, 0.1, boost::none,
+			IfcAlignmentCantSegmentTypeEnum::IfcAlignmentCantSegmentType_CONSTANTCANT);
+
+		auto nest = [&](IfcObjectDefinition* parent, aggregate_of<IfcObjectDefinition>::ptr objects)
+		{
+			file.addEntity(new IfcRelNests(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, parent, objects));
+		};
+		auto layout = [&](IfcLinearElement* element, IfcAlignmentParameterSegment* design, size_t segments)
+		{
+			aggregate_of<IfcObjectDefinition>::ptr objects(new aggregate_of<IfcObjectDefinition>());
+			for (size_t i = 0; i < segments; i++)
+				objects->push(new IfcAlignmentSegment(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, boost::none, nullptr, nullptr, design));
+			nest(element, objects);
+			return element;
+		};
+
+		for (size_t i = 0; i < n; i++)
+		{
+			aggregate_of<IfcObjectDefinition>::ptr layouts(new aggregate_of<IfcObjectDefinition>());
+			layouts->push(layout(new IfcAlignmentHorizontal(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, boost::none, nullptr, nullptr), line, horizontal_segments));
+			layouts->push(layout(new IfcAlignmentVertical(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, boost::none, nullptr, nullptr), gradient, vertical_segments));
+			if (cant_segments)
+				layouts->push(layout(new IfcAlignmentCant(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, boost::none, nullptr, nullptr, 1.435), constant_cant, cant_segments));
+			nest(new IfcAlignment(IfcParse::IfcGlobalId(), nullptr, std::string("Alignment " + std::to_string(i)), boost::none, boost::none, nullptr, nullptr, boost::none), layouts);
+		}
+	}
+
+	// Test model: n IfcLocalPlacement instances in chains of depth placements, each relative to the previous one of its
+	// chain by its own IfcAxis2Placement3D, translated and turned about z
+	inline void add_local_placements(IfcParse::IfcFile& file, size_t n, size_t depth)
+	{
+		using namespace Ifc4x3_add2;
+		auto z = new IfcDirection(std::vector<double>{ 0.0, 0.0, 1.0 });
+		IfcObjectPlacement* parent = nullptr;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (i % depth == 0)
+				parent = nullptr;
+			double angle = 0.001 * i;
+			auto origin = new IfcCartesianPoint(std::vector<double>{ 10.0 + i % 7, 0.5 * (i % depth), 0.1 });
+			auto x = new IfcDirection(std::vector<double>{ std::cos(angle), std::sin(angle), 0.0 });
+			auto placement = new IfcLocalPlacement(parent, new IfcAxis2Placement3D(origin, z, x));
+			file.addEntity(placement);
+			parent = placement;
+		}
+	}
+}
@@ -0,0 +1,196 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+#include <ifcgeom/function_item_evaluator.h>
+
+#include "RailRoomTestset.h"
+#include "AccuracyProfiler.h"
+#include "CompiledAlignment.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace IfcOpenShellUnitTests;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcRailRoom
+{
+	// Samples every alignment in the testset and reports accuracy against the reference files
+	// and against a reference evaluator at a user chosen density. The reference evaluator is the
+	// function_item_evaluator, the candidate a compiled_alignment with its spirals integrated at the
+	// Precision of the candidate settings.
+	//
+	// The sampling density is read from the IFCOS_PROFILE_SAMPLES_PER_UNIT environment variable (default 10 samples per model length unit).
+	// Results are written to AccuracyProfile_<Layout>.csv and AccuracyProfile_<Layout>.json in the working directory.
+	TEST_CLASS(AccuracyProfiler)
+	{
+	public:
+		// Settings used for the candidate evaluator, by default the tolerance of the RailRoomTests_*.cpp files.
+		// Change these to compare evaluator settings against the accuracy budget.
+		std::function<void(Layout, ifcopenshell::geometry::Settings&)> configure_candidate = [](Layout layout, ifcopenshell::geometry::Settings& settings)
+		{
+			settings.get<ifcopenshell::geometry::settings::Precision>().value = tolerance(layout);
+		};
+
+		static double samples_per_unit()
+		{
+			char* value = nullptr;
+			size_t len = 0;
+			double density = 10.0;
+			if (_dupenv_s(&value, &len, "IFCOS_PROFILE_SAMPLES_PER_UNIT") == 0 && value)
+			{
+				density = atof(value);
+				free(value);
+			}
+			return density > 0.0 ? density : 10.0;
+		}
+
+		static Eigen::Vector3d mask(Layout layout)
+		{
+			switch (layout)
+			{
+			case Layout::Horizontal: return Eigen::Vector3d(1, 1, 0);
+			case Layout::Vertical: return Eigen::Vector3d(1, 0, 1);
+			default: return Eigen::Vector3d(1, 1, 1);
+			}
+		}
+
+		void Profile(Layout layout)
+		{
+			std::vector<profile_result> results;
+			auto density = samples_per_unit();
+
+			for (const auto& curve_type : curve_types(layout))
+			{
+				for (const auto& test_name : test_names(layout))
+				{
+					auto tc = load_testcase(layout, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+
+					auto length_unit = tc->mapping->get_length_unit();
+
+					ifcopenshell::geometry::function_item_evaluator reference(tc->settings, tc->fn);
+
+					ifcopenshell::geometry::Settings candidate_settings;
+					configure_candidate(layout, candidate_settings);
+					alignment_evaluator tree(tc->settings, tc->curve, tc->fn, length_unit);
+					compiled_alignment candidate(tree, candidate_settings);
+
+					auto name = curve_type + test_name;
+
+					// accuracy against the reference file, at the tolerance used by the RailRoomTests_*.cpp files
+					auto points = read_reference(layout, curve_type, test_name);
+					auto r1 = profile_against_points(name + " (reference file)", reference, points, length_unit, mask(layout));
+					Assert::AreEqual(0.0, r1.position.max, tolerance(layout), std::wstring(name.begin(), name.end()).c_str());
+					results.push_back(r1);
+
+					// accuracy of the candidate against the reference evaluator, at the requested density
+					// the evaluators are parameterized in SI units, the density is given per model length unit
+					auto r2 = profile_against_evaluator(name + " (candidate settings)", candidate, reference, tc->fn->start(), tc->fn->end(), density / length_unit, length_unit);
+					Assert::AreEqual(0.0, r2.position.max, tolerance(layout), std::wstring(name.begin(), name.end()).c_str());
+					results.push_back(r2);
+				}
+			}
+
+			std::string base = std::string("AccuracyProfile_") + layout_name(layout);
+			std::ofstream csv(base + ".csv");
+			write_csv(csv, results);
+			std::ofstream json(base + ".json");
+			write_json(json, results);
+
+			std::ostringstream os;
+			write_csv(os, results);
+			Logger::WriteMessage(os.str().c_str());
+		}
+
+		TEST_METHOD(Horizontal)
+		{
+			Profile(Layout::Horizontal);
+		}
+
+		TEST_METHOD(Vertical)
+		{
+			Profile(Layout::Vertical);
+		}
+
+		TEST_METHOD(Cant)
+		{
+			Profile(Layout::Cant);
+		}
+	};
+}
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(ErrorStatistics)
+	{
+	public:
+		TEST_METHOD(Percentiles)
+		{
+			std::vector<double> errors;
+			for (int i = 1; i <= 100; i++)
+				errors.push_back(i * 0.001);
+
+			auto stats = error_statistics::from(errors);
+			Assert::AreEqual((size_t)100, stats.count);
+			Assert::AreEqual(0.100, stats.max, 1e-12);
+			Assert::AreEqual(0.050, stats.p50, 1e-12);
+			Assert::AreEqual(0.095, stats.p95, 1e-12);
+			Assert::AreEqual(0.099, stats.p99, 1e-12);
+			Assert::AreEqual(sqrt(338350.0 / 100.0) * 0.001, stats.rms, 1e-12);
+		}
+
+		TEST_METHOD(FHWA_Alignment)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			Assert::AreEqual(1u, curves->size());
+			auto gradient_curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping->map(gradient_curve));
+			ifcopenshell::geometry::function_item_evaluator evaluator(settings, fn);
+
+			// From Table 3.2, distance along is measured from the start of the alignment (S + 1200)
+			std::vector<IfcRailRoom::reference_point> points;
+			std::vector<std::pair<double, double>> table{
+				{   0.0, 121.00 }, { 160.0, 123.58 }, { 320.0, 125.72 }, { 480.0, 127.42 },
+				{ 640.0, 128.68 }, { 800.0, 129.50 }, { 960.0, 129.88 }, {1120.0, 129.82 },
+				{1280.0, 129.32 }, {1440.0, 128.38 }, {1600.0, 127.00 }
+			};
+			auto length_unit = mapping->get_length_unit();
+			for (const auto& [s, elev] : table)
+			{
+				IfcRailRoom::reference_point p;
+				p.s = (s + 1200.0) * length_unit;
+				p.z = elev;
+				points.push_back(p);
+			}
+
+			auto result = profile_against_points("FHWA Table 3.2", evaluator, points, length_unit, Eigen::Vector3d(0, 0, 1));
+			Assert::AreEqual(points.size(), result.samples);
+			Assert::AreEqual(0.0, result.position.max, 0.01);
+			Assert::IsTrue(result.seconds_per_sample > 0.0);
+
+			// a compiled_alignment with its spirals integrated at the precision of the layout, against the reference evaluator
+			ifcopenshell::geometry::Settings candidate_settings;
+			candidate_settings.get<ifcopenshell::geometry::settings::Precision>().value = 0.001;
+			alignment_evaluator tree(settings, gradient_curve, fn, length_unit);
+			compiled_alignment candidate(tree, candidate_settings);
+			auto dense = profile_against_evaluator("FHWA dense", candidate, evaluator, fn->start(), fn->end(), 1.0 / length_unit, length_unit);
+			Assert::IsTrue(dense.samples > points.size());
+			Assert::AreEqual(0.0, dense.position.max, 0.01);
+		}
+	};
+}
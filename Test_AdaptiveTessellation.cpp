@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "RailRoomTestset.h"
+#include "AdaptiveTessellation.h"
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace IfcOpenShellUnitTests;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	// Adaptive tessellation stays within the chord tolerance and needs fewer vertices than a uniform
+	// tessellation with the same maximum error, i.e. with the smallest adaptive step.
+	TEST_CLASS(AdaptiveTessellation)
+	{
+	public:
+		struct comparison
+		{
+			std::string name;
+			size_t adaptive_vertices = 0;
+			size_t uniform_vertices = 0;
+			double adaptive_deviation = 0.0;
+			double uniform_deviation = 0.0;
+			double adaptive_seconds = 0.0;
+			double uniform_seconds = 0.0;
+		};
+
+		static comparison compare(const std::string& name, const alignment_evaluator& evaluator, double tolerance)
+		{
+			comparison c;
+			c.name = name;
+
+			auto t0 = std::chrono::steady_clock::now();
+			adaptive_tessellator tessellator(evaluator, tolerance);
+			auto adaptive = tessellator.tessellate();
+			auto t1 = std::chrono::steady_clock::now();
+			auto uniform = tessellate_uniform(evaluator, tessellator.min_step());
+			auto t2 = std::chrono::steady_clock::now();
+
+			c.adaptive_vertices = adaptive.size();
+			c.uniform_vertices = uniform.size();
+			c.adaptive_deviation = max_chord_deviation(evaluator, adaptive);
+			c.uniform_deviation = max_chord_deviation(evaluator, uniform);
+			c.adaptive_seconds = std::chrono::duration<double>(t1 - t0).count();
+			c.uniform_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+			Assert::AreEqual(evaluator.start(), adaptive.stations.front());
+			Assert::AreEqual(evaluator.end(), adaptive.stations.back());
+			Assert::IsTrue(std::is_sorted(adaptive.stations.begin(), adaptive.stations.end()));
+
+			std::wostringstream os;
+			os << name.c_str() << L" deviates " << c.adaptive_deviation << L" from the curve";
+			Assert::IsTrue(c.adaptive_deviation <= tolerance, os.str().c_str());
+			Assert::IsTrue(c.adaptive_vertices <= c.uniform_vertices);
+			return c;
+		}
+
+		static void report(const std::vector<comparison>& comparisons)
+		{
+			std::ostringstream os;
+			os << std::left << std::setw(50) << "curve" << std::right << std::setw(10) << "adaptive" << std::setw(10) << "uniform"
+				<< std::setw(14) << "adaptive err" << std::setw(14) << "uniform err" << std::setw(14) << "adaptive s" << std::setw(14) << "uniform s" << "\n";
+			for (const auto& c : comparisons)
+			{
+				os << std::left << std::setw(50) << c.name << std::right << std::setw(10) << c.adaptive_vertices << std::setw(10) << c.uniform_vertices
+					<< std::setprecision(4) << std::setw(14) << c.adaptive_deviation << std::setw(14) << c.uniform_deviation
+					<< std::setw(14) << c.adaptive_seconds << std::setw(14) << c.uniform_seconds << "\n";
+			}
+			Logger::WriteMessage(os.str().c_str());
+		}
+
+		TEST_METHOD(FHWA_Horizontal)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto curves = file.instances_by_type<Schema::IfcCompositeCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcCompositeCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			std::vector<comparison> comparisons;
+			for (double tolerance : { 0.01, 0.001 })
+			{
+				adaptive_tessellator tessellator(evaluator, tolerance);
+				Assert::IsTrue(tessellator.intervals().size() <= evaluator.layers().front().size());
+				for (const auto& i : tessellator.intervals())
+				{
+					Assert::IsTrue(i.analytic);
+					// tangents need a single chord
+					const auto& r = evaluator.layers().front()[evaluator.layers().front().find(0.5 * (i.start + i.end))];
+					if (r.curve_type == "IfcLine")
+						Assert::AreEqual((size_t)1, i.chords);
+				}
+
+				comparisons.push_back(compare("FHWA IfcCompositeCurve " + std::to_string(tolerance), evaluator, tolerance));
+				Assert::IsTrue(comparisons.back().adaptive_vertices < comparisons.back().uniform_vertices);
+			}
+			report(comparisons);
+		}
+
+		TEST_METHOD(FHWA_Gradient)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			adaptive_tessellator tessellator(evaluator, 0.001);
+			for (const auto& i : tessellator.intervals())
+				Assert::IsTrue(i.analytic);
+
+			report({ compare("FHWA IfcGradientCurve", evaluator, 0.001) });
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curves = file.instances_by_type<Schema::IfcSegmentedReferenceCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			adaptive_tessellator tessellator(evaluator, 0.001);
+			for (const auto& i : tessellator.intervals())
+				Assert::IsTrue(i.analytic);
+
+			report({ compare("ACCA IfcSegmentedReferenceCurve", evaluator, 0.001) });
+		}
+
+		void RailRoom(IfcRailRoom::Layout layout)
+		{
+			std::vector<comparison> comparisons;
+			for (const auto& curve_type : IfcRailRoom::curve_types(layout))
+			{
+				for (const auto& test_name : IfcRailRoom::test_names(layout))
+				{
+					auto tc = IfcRailRoom::load_testcase(layout, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+
+					alignment_evaluator evaluator(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit());
+					comparisons.push_back(compare(std::string(IfcRailRoom::layout_name(layout)) + "/" + curve_type + "/" + test_name, evaluator, 0.001));
+				}
+			}
+			report(comparisons);
+		}
+
+		TEST_METHOD(RailRoom_Horizontal)
+		{
+			RailRoom(IfcRailRoom::Layout::Horizontal);
+		}
+
+		TEST_METHOD(RailRoom_Vertical)
+		{
+			RailRoom(IfcRailRoom::Layout::Vertical);
+		}
+	};
+}
@@ -0,0 +1,241 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "AlignmentStore.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(AlignmentStore)
+	{
+	public:
+		// an empty store in the temporary directory
+		static std::string store_directory(const char* name)
+		{
+			auto path = std::filesystem::temp_directory_path() / "IfcOpenShellUnitTests" / name;
+			std::filesystem::remove_all(path);
+			return path.string();
+		}
+
+		static std::vector<double> stations(double start, double end, size_t n)
+		{
+			std::vector<double> u;
+			for (size_t i = 0; i < n; i++)
+				u.push_back(start + (end - start) * i / (n - 1));
+			return u;
+		}
+
+		// frames of a freshly compiled alignment against the stored one, single and batch
+		static void compare(const compiled_alignment& fresh, const compiled_alignment& stored)
+		{
+			Assert::AreEqual(fresh.start(), stored.start());
+			Assert::AreEqual(fresh.end(), stored.end());
+			Assert::AreEqual(fresh.horizontal().size(), stored.horizontal().size());
+			Assert::AreEqual(fresh.vertical().size(), stored.vertical().size());
+			Assert::AreEqual(fresh.cant().size(), stored.cant().size());
+			Assert::AreEqual(0, std::memcmp(fresh.horizontal().data(), stored.horizontal().data(), fresh.horizontal().size() * sizeof(horizontal_record)));
+			Assert::AreEqual(0, std::memcmp(fresh.vertical().data(), stored.vertical().data(), fresh.vertical().size() * sizeof(vertical_record)));
+			Assert::AreEqual(0, std::memcmp(fresh.cant().data(), stored.cant().data(), fresh.cant().size() * sizeof(cant_record)));
+
+			auto u = stations(fresh.start(), fresh.end(), 5000);
+			auto batch = stored.evaluate(u);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < u.size(); i++)
+				mismatches += (fresh.evaluate(u[i]) != stored.evaluate(u[i])) + (fresh.evaluate(u[i]) != batch[i]);
+			Assert::AreEqual((size_t)0, mismatches);
+		}
+
+		// a second process run: the file is parsed again and the alignment is loaded without mapping the curve
+		TEST_METHOD(FHWA_BitIdentical)
+		{
+			alignment_store store(store_directory("FHWA_BitIdentical"));
+			uint64_t key;
+			std::unique_ptr<compiled_alignment> fresh;
+			{
+				IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+				auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+				ifcopenshell::geometry::Settings settings;
+				alignment_cache cache(file, settings, units::model);
+				const auto& evaluator = cache.get(gradient_curve);
+
+				key = alignment_store::key(file, evaluator);
+				Assert::IsFalse(store.contains(key));
+				auto compiled = store.get(file, evaluator);
+				Assert::IsTrue(store.contains(key));
+
+				// the records do not refer to the evaluator, so they outlive it
+				fresh = std::make_unique<compiled_alignment>(std::vector<horizontal_record>(compiled->horizontal()), std::vector<vertical_record>(compiled->vertical()),
+					compiled->start(), compiled->end(), compiled->tolerance());
+				Assert::IsTrue(compiled->fully_compiled());
+			}
+
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = std::unique_ptr<ifcopenshell::geometry::abstract_mapping>(ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings));
+			Assert::AreEqual(key, alignment_store::key(file, gradient_curve, mapping->get_length_unit(), units::model));
+
+			auto stored = store.load(key);
+			Assert::IsNotNull(stored.get());
+			Assert::IsFalse(stored->has_evaluator());
+			compare(*fresh, *stored);
+
+			// and against a fresh mapping in this run
+			alignment_cache cache(file, settings, units::model);
+			compiled_alignment mapped(cache.get(gradient_curve));
+			compare(mapped, *stored);
+
+			// PVC of vertical curve 1, Table 3.2
+			Assert::AreEqual(121.00, stored->evaluate(1200.0)(2, 3), 0.01);
+		}
+
+		// the segmented reference curve is generic and needs the mapped curve, its cant records are stored
+		TEST_METHOD(ACCA_Generic)
+		{
+			alignment_store store(store_directory("ACCA_Generic"));
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			bool cant = false;
+			for (auto& c : *file.instances_by_type<Schema::IfcCompositeCurve>())
+			{
+				const auto& evaluator = cache.get(c->as<Schema::IfcCurve>());
+				auto saved = store.get(file, evaluator);
+				auto key = alignment_store::key(file, evaluator);
+
+				auto stored = store.load(key, &evaluator);
+				Assert::IsNotNull(stored.get());
+				compare(*saved, *stored);
+
+				// the cant of the segmented reference curve comes from its stored records
+				compiled_alignment fresh(evaluator);
+				if (c->as<Schema::IfcSegmentedReferenceCurve>())
+				{
+					Assert::IsFalse(stored->cant().empty());
+					cant = true;
+				}
+				auto u = stations(fresh.start(), fresh.end(), 500);
+				auto expected = fresh.derived(u), loaded = stored->derived(u);
+				for (size_t i = 0; i < u.size(); i++)
+				{
+					Assert::AreEqual(expected[i].cant, loaded[i].cant);
+					Assert::AreEqual(expected[i].gradient, loaded[i].gradient);
+					Assert::AreEqual(expected[i].horizontal_curvature, loaded[i].horizontal_curvature);
+					Assert::AreEqual(expected[i].vertical_curvature, loaded[i].vertical_curvature);
+				}
+
+				if (!saved->fully_compiled())
+				{
+					auto detached = store.load(key);
+					Assert::ExpectException<std::logic_error>([&]() { detached->evaluate(detached->start()); });
+				}
+			}
+			Assert::IsTrue(cant);
+		}
+
+		TEST_METHOD(Keys)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = std::unique_ptr<ifcopenshell::geometry::abstract_mapping>(ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings));
+			const double foot = mapping->get_length_unit();
+
+			auto key = alignment_store::key(file, gradient_curve, foot, units::model);
+			Assert::AreEqual(key, alignment_store::key(file, gradient_curve, foot, units::model));
+			Assert::AreNotEqual(key, alignment_store::key(file, horizontal, foot, units::model));
+			Assert::AreNotEqual(key, alignment_store::key(file, gradient_curve, foot, units::metre));
+			Assert::AreNotEqual(key, alignment_store::key(file, gradient_curve, foot, units::model, 1e-7));
+
+			// an unrelated instance keeps the key, a changed segment placement changes it
+			file.addEntity(new Schema::IfcCartesianPoint(std::vector<double>{ 1.0, 2.0, 3.0 }));
+			Assert::AreEqual(key, alignment_store::key(file, gradient_curve, foot, units::model));
+
+			auto segment = (*horizontal->Segments()->begin())->as<Schema::IfcCurveSegment>();
+			auto location = segment->Placement()->as<Schema::IfcAxis2Placement2D>()->Location()->as<Schema::IfcCartesianPoint>();
+			auto coordinates = location->Coordinates();
+			coordinates[0] += 0.001;
+			location->setCoordinates(coordinates);
+			Assert::AreNotEqual(key, alignment_store::key(file, gradient_curve, foot, units::model));
+		}
+
+		// truncated and foreign files are treated as missing
+		TEST_METHOD(InvalidFiles)
+		{
+			alignment_store store(store_directory("InvalidFiles"));
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(gradient_curve);
+			auto key = alignment_store::key(file, evaluator);
+			store.get(file, evaluator);
+			Assert::IsNotNull(store.load(key).get());
+
+			// a valid file stored under another key
+			std::filesystem::copy_file(store.path(key), store.path(key + 1));
+			Assert::IsNull(store.load(key + 1).get());
+
+			auto size = std::filesystem::file_size(store.path(key));
+			std::filesystem::resize_file(store.path(key), size - 1);
+			Assert::IsNull(store.load(key).get());
+
+			{
+				std::ofstream os(store.path(key), std::ios::binary | std::ios::trunc);
+				os << "ISO-10303-21;";
+			}
+			Assert::IsNull(store.load(key).get());
+
+			// get replaces the invalid file
+			store.get(file, evaluator);
+			Assert::IsNotNull(store.load(key).get());
+		}
+
+		TEST_METHOD(ColdWarmStart)
+		{
+			alignment_store store(store_directory("ColdWarmStart"));
+			using clock = std::chrono::steady_clock;
+			const std::string path = "../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc";
+
+			// parse, map and compile
+			auto t0 = clock::now();
+			IfcParse::IfcFile cold_file(path);
+			auto cold_curve = (*(cold_file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(cold_file, settings, units::model);
+			auto cold = store.get(cold_file, cache.get(cold_curve));
+			auto t1 = clock::now();
+
+			// parse, hash and load
+			IfcParse::IfcFile warm_file(path);
+			auto warm_curve = (*(warm_file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			auto mapping = std::unique_ptr<ifcopenshell::geometry::abstract_mapping>(ifcopenshell::geometry::impl::mapping_implementations().construct(&warm_file, settings));
+			auto warm = store.load(alignment_store::key(warm_file, warm_curve, mapping->get_length_unit(), units::model));
+			auto t2 = clock::now();
+
+			Assert::IsNotNull(warm.get());
+			compare(*cold, *warm);
+
+			std::ostringstream os;
+			os << "cold start " << std::chrono::duration<double>(t1 - t0).count() << " s, warm start " << std::chrono::duration<double>(t2 - t1).count() << " s\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
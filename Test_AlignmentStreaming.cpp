@@ -0,0 +1,345 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "AlignmentStreaming.h"
+#include "ProcessMemory.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(AlignmentStreaming)
+	{
+	public:
+		static std::string network_path(const char* name)
+		{
+			auto directory = std::filesystem::temp_directory_path() / "IfcOpenShellUnitTests";
+			std::filesystem::create_directories(directory);
+			return (directory / (std::string(name) + ".ifc")).string();
+		}
+
+		// A network of n alignments of segments alternating 450 m lines and 50 m arcs with a linear placement every
+		// kilometre. The file is written instance by instance, so the generator does not hold the network in memory.
+		// Model units are metres.
+		static void write_network(const std::string& path, size_t n, size_t segments)
+		{
+			const double line_length = 450.0, arc_length = 50.0, radius = 1000.0;
+
+			std::ofstream os(path, std::ios::binary);
+			unsigned id = 0;
+			auto instance = [&](const std::string& text)
+			{
+				os << '#' << ++id << '=' << text << ";\n";
+				return id;
+			};
+			auto ref = [](unsigned i) { return "#" + std::to_string(i); };
+			auto real = [](double v) { return step::format_real(v); };
+			auto guid = [](size_t i)
+			{
+				std::string s = std::to_string(i);
+				return "'" + std::string(22 - s.size(), '0') + s + "'";
+			};
+
+			os << "ISO-10303-21;\nHEADER;\nFILE_DESCRIPTION(('ViewDefinition [Alignment]'),'2;1');\n"
+				"FILE_NAME('network.ifc','2024-01-01T00:00:00',(''),(''),'','','');\nFILE_SCHEMA(('IFC4X3_ADD2'));\nENDSEC;\nDATA;\n";
+			auto origin = instance("IFCCARTESIANPOINT((0.,0.,0.))");
+			auto world = instance("IFCAXIS2PLACEMENT3D(" + ref(origin) + ",$,$)");
+			auto context = instance("IFCGEOMETRICREPRESENTATIONCONTEXT($,'Model',3,1.E-05," + ref(world) + ",$)");
+			auto metre = instance("IFCSIUNIT(*,.LENGTHUNIT.,$,.METRE.)");
+			auto units = instance("IFCUNITASSIGNMENT((" + ref(metre) + "))");
+			instance("IFCPROJECT(" + guid(0) + ",$,'Network',$,$,$,$,(" + ref(context) + ")," + ref(units) + ")");
+
+			for (size_t k = 0; k < n; k++)
+			{
+				auto start = instance("IFCCARTESIANPOINT((0.,0.))");
+				auto east = instance("IFCDIRECTION((1.,0.))");
+				auto vector = instance("IFCVECTOR(" + ref(east) + ",1.)");
+				auto line = instance("IFCLINE(" + ref(start) + "," + ref(vector) + ")");
+				auto centre = instance("IFCAXIS2PLACEMENT2D(" + ref(start) + "," + ref(east) + ")");
+				auto circle = instance("IFCCIRCLE(" + ref(centre) + "," + real(radius) + ")");
+
+				double x = 0.0, y = 1000.0 * k, theta = 0.0, length = 0.0;
+				std::string list;
+				for (size_t i = 0; i < segments; i++)
+				{
+					auto location = instance("IFCCARTESIANPOINT((" + real(x) + "," + real(y) + "))");
+					auto direction = instance("IFCDIRECTION((" + real(cos(theta)) + "," + real(sin(theta)) + "))");
+					auto placement = instance("IFCAXIS2PLACEMENT2D(" + ref(location) + "," + ref(direction) + ")");
+					if (i % 2 == 0)
+					{
+						list += (i ? ",": "") + ref(instance("IFCCURVESEGMENT(.CONTSAMEGRADIENT.," + ref(placement) + ",IFCLENGTHMEASURE(0.),IFCLENGTHMEASURE(" + real(line_length) + ")," + ref(line) + ")"));
+						x += line_length * cos(theta);
+						y += line_length * sin(theta);
+						length += line_length;
+					}
+					else
+					{
+						// alternating left and right turns, a positive length turns left
+						double sign = (i / 2) % 2 ? -1.0 : 1.0;
+						list += "," + ref(instance("IFCCURVESEGMENT(.CONTSAMEGRADIENT.," + ref(placement) + ",IFCLENGTHMEASURE(0.),IFCLENGTHMEASURE(" + real(sign * arc_length) + ")," + ref(circle) + ")"));
+						double cx = x - sign * radius * sin(theta);
+						double cy = y + sign * radius * cos(theta);
+						theta += sign * arc_length / radius;
+						x = cx + sign * radius * sin(theta);
+						y = cy - sign * radius * cos(theta);
+						length += arc_length;
+					}
+				}
+
+				auto curve = instance("IFCCOMPOSITECURVE((" + list + "),.F.)");
+				auto representation = instance("IFCSHAPEREPRESENTATION(" + ref(context) + ",'Axis','Curve2D',(" + ref(curve) + "))");
+				auto shape = instance("IFCPRODUCTDEFINITIONSHAPE($,$,(" + ref(representation) + "))");
+				instance("IFCALIGNMENT(" + guid(k + 1) + ",$,'Alignment " + std::to_string(k) + "',$,$,$," + ref(shape) + ",$)");
+
+				for (double d = 0.0; d < length; d += 1000.0)
+				{
+					auto pde = instance("IFCPOINTBYDISTANCEEXPRESSION(IFCLENGTHMEASURE(" + real(d) + "),$,$,$," + ref(curve) + ")");
+					auto linear = instance("IFCAXIS2PLACEMENTLINEAR(" + ref(pde) + ",$,$)");
+					instance("IFCLINEARPLACEMENT($," + ref(linear) + ",$)");
+				}
+			}
+			os << "ENDSEC;\nEND-ISO-10303-21;\n";
+		}
+
+		// Growth of the working set over its lifetime, sampled every millisecond. The peak working set of the process
+		// includes earlier tests, so it is not used.
+		class working_set_sampler
+		{
+		public:
+			working_set_sampler() :
+				baseline_(current_process_memory().working_set),
+				peak_(baseline_),
+				thread_([this]()
+				{
+					while (!stop_)
+					{
+						peak_ = std::max(peak_.load(), current_process_memory().working_set);
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+				})
+			{
+			}
+
+			~working_set_sampler() { stop(); }
+
+			size_t stop()
+			{
+				if (thread_.joinable())
+				{
+					stop_ = true;
+					thread_.join();
+					peak_ = std::max(peak_.load(), current_process_memory().working_set);
+				}
+				return peak_ > baseline_ ? peak_ - baseline_ : 0;
+			}
+
+		private:
+			size_t baseline_;
+			std::atomic<size_t> peak_;
+			std::atomic<bool> stop_ = false;
+			std::thread thread_;
+		};
+
+		TEST_METHOD(Scan)
+		{
+			auto path = network_path("Scan");
+			write_network(path, 5, 20);
+
+			alignment_network_scan scan(path);
+			Assert::AreEqual((size_t)5, scan.alignments());
+
+			// 5 km alignments
+			for (size_t k = 0; k < scan.alignments(); k++)
+				Assert::AreEqual((size_t)5, scan.placement_ids(k).size());
+
+			auto step = scan.extract(2);
+			IfcParse::IfcFile file(step.data(), (int)step.size());
+			Assert::IsTrue(file.good());
+			Assert::AreEqual((unsigned)1, file.instances_by_type<Schema::IfcAlignment>()->size());
+			Assert::AreEqual((unsigned)1, file.instances_by_type<Schema::IfcCompositeCurve>()->size());
+			Assert::AreEqual((unsigned)1, file.instances_by_type<Schema::IfcProject>()->size());
+			Assert::AreEqual((unsigned)5, file.instances_by_type<Schema::IfcLinearPlacement>()->size());
+
+			// with the ids of the network file
+			auto alignment = file.instance_by_id(scan.alignment_id(2))->as<Schema::IfcAlignment>();
+			Assert::IsNotNull(alignment);
+			Assert::AreEqual(std::string("Alignment 2"), *alignment->Name());
+			for (auto id : scan.placement_ids(2))
+				Assert::IsNotNull(file.instance_by_id(id)->as<Schema::IfcLinearPlacement>());
+		}
+
+		// references in strings and comments are not references
+		TEST_METHOD(ScanStringsAndComments)
+		{
+			auto path = network_path("ScanStringsAndComments");
+			{
+				std::ofstream os(path, std::ios::binary);
+				os << "ISO-10303-21;\nHEADER;\nFILE_DESCRIPTION(('#1=X;'),'2;1');\nFILE_NAME('','',(''),(''),'','','');\nFILE_SCHEMA(('IFC4X3_ADD2'));\nENDSEC;\nDATA;\n"
+					"#1=IFCCARTESIANPOINT((0.,0.,0.));\n"
+					"/* #2=IFCCARTESIANPOINT((1.,0.,0.)); */\n"
+					"#3 = IFCAXIS2PLACEMENT3D(#1,$,$);\n"
+					"#4=IFCALIGNMENT('0000000000000000000001',$,'it''s #3; a test',$,$,$,$,$);\n"
+					"ENDSEC;\nEND-ISO-10303-21;\n";
+			}
+
+			alignment_network_scan scan(path);
+			Assert::AreEqual((size_t)3, scan.instances());
+			Assert::AreEqual((size_t)1, scan.alignments());
+			Assert::AreEqual((unsigned)4, scan.alignment_id(0));
+
+			auto step = scan.extract(0);
+			Assert::AreEqual(std::string::npos, step.find("#3 ="));
+			Assert::AreNotEqual(std::string::npos, step.find("'it''s #3; a test'"));
+		}
+
+		// streaming results are bit-identical to mapping the whole file
+		TEST_METHOD(MatchesInMemory)
+		{
+			auto path = network_path("MatchesInMemory");
+			write_network(path, 5, 40);
+
+			ifcopenshell::geometry::Settings settings;
+			streaming_evaluator streaming(path, settings);
+			std::vector<alignment_result> results;
+			std::ostringstream csv;
+			csv_result_writer writer(csv);
+			streaming.run(streaming_evaluator::every(100.0), [&](const alignment_result& result)
+			{
+				results.push_back(result);
+				writer(result);
+			});
+			writer.flush();
+			Assert::AreEqual((size_t)5, results.size());
+
+			IfcParse::IfcFile file(path);
+			alignment_cache cache(file, settings);
+			size_t lines = 0;
+			for (size_t k = 0; k < results.size(); k++)
+			{
+				const auto& result = results[k];
+				Assert::AreEqual(k, result.index);
+				Assert::AreEqual(std::string("Alignment ") + std::to_string(k), result.name);
+
+				auto alignment = file.instance_by_id(result.id)->as<Schema::IfcAlignment>();
+				const auto& evaluator = cache.get(streaming_evaluator::alignment_curve(alignment));
+				Assert::IsTrue(streaming_evaluator::every(100.0)(evaluator) == result.stations);
+				for (size_t i = 0; i < result.stations.size(); i++)
+					Assert::IsTrue(evaluator.evaluate(result.stations[i]) == result.frames[i]);
+
+				Assert::AreEqual((size_t)10, result.placements.size());
+				for (size_t i = 0; i < result.placements.size(); i++)
+				{
+					auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(cache.mapping().map(file.instance_by_id(result.placements[i])));
+					Eigen::Matrix4d expected = m->components();
+					expected.col(3).head(3) /= cache.output_unit();
+					Assert::IsTrue(expected == result.placement_frames[i]);
+				}
+				lines += result.stations.size() + result.placements.size();
+			}
+
+			std::string text = csv.str();
+			Assert::AreEqual(lines, (size_t)std::count(text.begin(), text.end(), '\n'));
+		}
+
+		TEST_METHOD(ErrorStopsPipeline)
+		{
+			auto path = network_path("ErrorStopsPipeline");
+			write_network(path, 10, 4);
+
+			ifcopenshell::geometry::Settings settings;
+			streaming_evaluator streaming(path, settings);
+			size_t written = 0;
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				streaming.run(streaming_evaluator::every(100.0), [&](const alignment_result&)
+				{
+					if (++written == 2)
+						throw std::runtime_error("disk full");
+				});
+			});
+			Assert::AreEqual((size_t)2, written);
+		}
+
+		TEST_METHOD(InvalidStep)
+		{
+			for (double step : { 0.0, -100.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() })
+				Assert::ExpectException<std::invalid_argument>([&]() { streaming_evaluator::every(step); });
+		}
+
+		// the working set of streaming stays a fraction of mapping the network in memory
+		TEST_METHOD(PeakMemory)
+		{
+			auto path = network_path("PeakMemory");
+			write_network(path, 200, 500);
+
+			ifcopenshell::geometry::Settings settings;
+			size_t alignments = 0, frames = 0;
+			size_t streaming_growth, scan_bytes;
+			auto t0 = std::chrono::steady_clock::now();
+			{
+				working_set_sampler sampler;
+				streaming_evaluator streaming(path, settings);
+				scan_bytes = streaming.scan().bytes();
+				streaming.run(streaming_evaluator::every(100.0), [&](const alignment_result& result)
+				{
+					alignments++;
+					frames += result.frames.size() + result.placement_frames.size();
+				});
+				streaming_growth = sampler.stop();
+			}
+			auto t1 = std::chrono::steady_clock::now();
+			Assert::AreEqual((size_t)200, alignments);
+
+			// measured second, memory the streaming run returned to the heap is reused and makes this growth smaller
+			size_t in_memory_growth, in_memory_frames = 0;
+			{
+				working_set_sampler sampler;
+				IfcParse::IfcFile file(path);
+				alignment_cache cache(file, settings);
+				for (auto& alignment : *file.instances_by_type<Schema::IfcAlignment>())
+				{
+					const auto& evaluator = cache.get(streaming_evaluator::alignment_curve(alignment));
+					for (auto u : streaming_evaluator::every(100.0)(evaluator))
+					{
+						evaluator.evaluate(u);
+						in_memory_frames++;
+					}
+				}
+				for (auto& placement : *file.instances_by_type<Schema::IfcLinearPlacement>())
+				{
+					cache.mapping().map(placement);
+					in_memory_frames++;
+				}
+				in_memory_growth = sampler.stop();
+			}
+			auto t2 = std::chrono::steady_clock::now();
+			Assert::AreEqual(in_memory_frames, frames);
+
+			std::ostringstream os;
+			os << std::filesystem::file_size(path) << " byte network, scan tables " << scan_bytes << " bytes\n"
+				<< "streaming: working set grew by " << streaming_growth << " bytes in " << std::chrono::duration<double>(t1 - t0).count() << " s\n"
+				<< "in memory: working set grew by " << in_memory_growth << " bytes in " << std::chrono::duration<double>(t2 - t1).count() << " s\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			Assert::IsTrue(streaming_growth < in_memory_growth / 4);
+		}
+	};
+}
@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "ColumnarExport.h"
+#include "RailRoomTestset.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(ColumnarExport)
+	{
+	public:
+		static std::string export_path(const std::string& name)
+		{
+			auto directory = std::filesystem::temp_directory_path() / "IfcOpenShellUnitTests";
+			std::filesystem::create_directories(directory);
+			return (directory / (name + ".frames")).string();
+		}
+
+		static std::string contents(const std::string& path)
+		{
+			std::ifstream is(path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+		}
+
+		static std::vector<double> stations(const alignment_evaluator& evaluator, double step)
+		{
+			std::vector<double> u;
+			for (double s = evaluator.start(); s < evaluator.end(); s = evaluator.start() + step * u.size())
+				u.push_back(s);
+			u.push_back(evaluator.end());
+			return u;
+		}
+
+		// the columns of alignment k against the evaluator, bit for bit
+		static void check(frame_reader& reader, size_t k, const alignment_evaluator& evaluator, const std::vector<double>& u)
+		{
+			Assert::AreEqual((uint64_t)u.size(), reader.alignments()[k].rows);
+			Assert::AreEqual(evaluator.output_unit(), reader.alignments()[k].output_unit);
+			Assert::IsTrue(u == reader.column(k, frame_column::station));
+
+			auto frames = reader.frames(k);
+			auto cant = reader.column(k, frame_column::cant);
+			auto gradient = reader.column(k, frame_column::gradient);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < u.size(); i++)
+			{
+				Eigen::Matrix4d m = evaluator.evaluate(u[i]);
+				mismatches += (m != frames[i]);
+				mismatches += cant[i] != compiled::cant(m);
+				mismatches += gradient[i] != compiled::gradient(m);
+			}
+			Assert::AreEqual((size_t)0, mismatches);
+		}
+
+		TEST_METHOD(FHWA_RoundTrip)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& plan = cache.get(horizontal);
+			const auto& profile = cache.get(gradient_curve);
+			auto u_plan = stations(plan, 10.0);
+			auto u_profile = stations(profile, 1.0);
+
+			// and the PVC of vertical curve 1
+			auto pvc = std::lower_bound(u_profile.begin(), u_profile.end(), 1200.0) - u_profile.begin();
+			if (u_profile[pvc] != 1200.0)
+				u_profile.insert(u_profile.begin() + pvc, 1200.0);
+
+			// chunks that do not divide the stations, on one and on several threads
+			std::vector<std::string> paths;
+			for (size_t threads : { 1, 4 })
+			{
+				paths.push_back(export_path("FHWA_RoundTrip_" + std::to_string(threads)));
+				frame_writer writer(paths.back(), 1000);
+				writer.add("horizontal", plan, u_plan, threads);
+				writer.add("gradient", profile, u_profile, threads);
+			}
+			Assert::IsTrue(contents(paths[0]) == contents(paths[1]));
+
+			frame_reader reader(paths[0]);
+			Assert::AreEqual((size_t)2, reader.alignments().size());
+			Assert::AreEqual(std::string("gradient"), reader.alignments()[1].name);
+			Assert::AreEqual((uint64_t)(u_profile.size() + 999) / 1000, reader.alignments()[1].chunks);
+			check(reader, 0, plan, u_plan);
+			check(reader, 1, profile, u_profile);
+
+			// PVC of vertical curve 1, Table 3.2
+			Assert::AreEqual(121.00, reader.column(1, frame_column::z)[pvc], 0.01);
+		}
+
+		TEST_METHOD(IncompleteFile)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+
+			auto path = export_path("IncompleteFile");
+			{
+				frame_writer writer(path);
+				writer.add("gradient", evaluator, stations(evaluator, 10.0));
+			}
+			frame_reader(path).column(0, frame_column::x);
+
+			std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+			Assert::ExpectException<std::runtime_error>([&]() { frame_reader reader(path); });
+
+			// without close() there is no footer
+			{
+				frame_writer writer(path);
+				writer.add("gradient", evaluator, stations(evaluator, 10.0));
+				Assert::ExpectException<std::runtime_error>([&]() { frame_reader reader(path); });
+			}
+		}
+
+		// Every testcase of the layout as one alignment of a file, at the stations of its reference file
+		static void RailRoom(IfcRailRoom::Layout layout)
+		{
+			const double tol = IfcRailRoom::tolerance(layout);
+			auto path = export_path(std::string("RailRoom_") + IfcRailRoom::layout_name(layout));
+
+			std::vector<std::unique_ptr<IfcRailRoom::testcase>> testcases;
+			std::vector<std::unique_ptr<alignment_evaluator>> evaluators;
+			std::vector<std::vector<IfcRailRoom::reference_point>> references;
+			std::vector<std::vector<double>> u;
+			{
+				frame_writer writer(path, 256);
+				for (const auto& curve_type : IfcRailRoom::curve_types(layout))
+				{
+					for (const auto& test_name : IfcRailRoom::test_names(layout))
+					{
+						auto tc = IfcRailRoom::load_testcase(layout, curve_type, test_name);
+						Assert::IsNotNull(tc.get());
+						evaluators.push_back(std::make_unique<alignment_evaluator>(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit(), units::model));
+						testcases.push_back(std::move(tc));
+
+						references.push_back(IfcRailRoom::read_reference(layout, curve_type, test_name));
+						u.emplace_back();
+						for (const auto& p : references.back())
+							u.back().push_back(p.s);
+						writer.add(curve_type + test_name, *evaluators.back(), u.back());
+					}
+				}
+			}
+
+			frame_reader reader(path);
+			Assert::AreEqual(evaluators.size(), reader.alignments().size());
+			double largest_cant = 0.0;
+			for (size_t k = 0; k < evaluators.size(); k++)
+			{
+				check(reader, k, *evaluators[k], u[k]);
+
+				auto x = reader.column(k, frame_column::x);
+				auto y = reader.column(k, frame_column::y);
+				auto z = reader.column(k, frame_column::z);
+				for (size_t i = 0; i < references[k].size(); i++)
+				{
+					const auto& p = references[k][i];
+					Assert::AreEqual(p.x, x[i], tol);
+					if (layout != IfcRailRoom::Layout::Vertical)
+						Assert::AreEqual(p.y, y[i], tol);
+					if (layout != IfcRailRoom::Layout::Horizontal)
+						Assert::AreEqual(p.z, z[i], tol);
+				}
+
+				for (auto c : reader.column(k, frame_column::cant))
+					largest_cant = std::max(largest_cant, std::abs(c));
+			}
+
+			// only the cant layouts roll the frame
+			if (layout == IfcRailRoom::Layout::Cant)
+				Assert::IsTrue(largest_cant > 1e-3);
+			else
+				Assert::AreEqual(0.0, largest_cant, 1e-9);
+		}
+
+		TEST_METHOD(RailRoom_Horizontal)
+		{
+			RailRoom(IfcRailRoom::Layout::Horizontal);
+		}
+
+		TEST_METHOD(RailRoom_Vertical)
+		{
+			RailRoom(IfcRailRoom::Layout::Vertical);
+		}
+
+		TEST_METHOD(RailRoom_Cant)
+		{
+			RailRoom(IfcRailRoom::Layout::Cant);
+		}
+	};
+}
@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include "CompactAttributes.h"
+#include "MemoryAccounting.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(CompactAttributes)
+	{
+	public:
+		template <typename T>
+		static bool equal(std::span<const T> a, const std::vector<T>& b)
+		{
+			return std::equal(a.begin(), a.end(), b.begin(), b.end());
+		}
+
+		// every attribute of every stored instance against get_attribute_value(), and every numeric instance stored
+		static void check_parity(IfcParse::IfcFile& file, const compact_attributes& store)
+		{
+			size_t numeric = 0, mismatches = 0;
+			for (auto it = file.begin(); it != file.end(); ++it)
+			{
+				if (!compact_attributes::is_numeric(it->second))
+				{
+					Assert::IsFalse(store.contains(it->second->id()));
+					continue;
+				}
+				numeric++;
+			}
+			Assert::AreEqual(numeric, store.size());
+
+			for (auto id : store.ids())
+			{
+				auto inst = file.instance_by_id(id);
+				Assert::IsTrue(&store.declaration(id) == inst->declaration().as_entity());
+				for (size_t i = 0; i < store.attribute_count(id); i++)
+				{
+					auto value = inst->get_attribute_value(i);
+					Assert::AreEqual((int)value.type(), (int)store.type(id, i));
+					switch (value.type())
+					{
+					case IfcUtil::Argument_INT:
+						mismatches += store.integer(id, i) != (int)value;
+						break;
+					case IfcUtil::Argument_DOUBLE:
+						mismatches += store.real(id, i) != (double)value;
+						break;
+					case IfcUtil::Argument_AGGREGATE_OF_INT:
+						mismatches += !equal(store.integers(id, i), (std::vector<int>)value);
+						break;
+					case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+						mismatches += !equal(store.reals(id, i), (std::vector<double>)value);
+						break;
+					case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+					{
+						std::vector<std::vector<int>> rows = value;
+						mismatches += store.rows(id, i) != rows.size();
+						for (size_t r = 0; r < rows.size(); r++)
+							mismatches += !equal(store.integers(id, i, r), rows[r]);
+						break;
+					}
+					case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+					{
+						std::vector<std::vector<double>> rows = value;
+						mismatches += store.rows(id, i) != rows.size();
+						for (size_t r = 0; r < rows.size(); r++)
+							mismatches += !equal(store.reals(id, i, r), rows[r]);
+						break;
+					}
+					case IfcUtil::Argument_EMPTY_AGGREGATE:
+						mismatches += !store.integers(id, i).empty() || !store.reals(id, i).empty() || store.rows(id, i) != 0;
+						break;
+					default:
+						break;
+					}
+				}
+			}
+			Assert::AreEqual((size_t)0, mismatches);
+		}
+
+		// memory of the store against the modelled footprint of the same types in the file, and load time
+		static void check_footprint(const std::string& path)
+		{
+			auto t0 = std::chrono::steady_clock::now();
+			size_t before = heap_bytes_in_use();
+			auto file = std::make_unique<IfcParse::IfcFile>(path);
+			auto t1 = std::chrono::steady_clock::now();
+			size_t loaded = heap_bytes_in_use();
+			compact_attributes store(*file);
+			auto t2 = std::chrono::steady_clock::now();
+			size_t built = heap_bytes_in_use() - loaded;
+			loaded -= before;
+
+			std::set<std::string> types;
+			for (auto id : store.ids())
+				types.insert(store.declaration(id).name());
+			auto footprint = account(*file);
+			size_t instances = 0, file_bytes = 0;
+			for (const auto& name : types)
+			{
+				const auto& t = footprint.types.at(name);
+				instances += t.instances;
+				file_bytes += t.total();
+			}
+			// and their share of the indices
+			file_bytes += footprint.index_bytes * instances / footprint.instances;
+
+			std::ostringstream os;
+			os << path << ": " << store.size() << " of " << footprint.instances << " instances stored in " << store.bytes() << " bytes ("
+				<< built << " measured) against " << file_bytes << " modelled in the file; load " << loaded << " bytes in "
+				<< std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, build "
+				<< std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			Assert::IsTrue(store.bytes() * 3 < file_bytes);
+			Assert::IsTrue(built <= 2 * store.bytes() + 4096);
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			for (auto path : { "../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc", "../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc" })
+			{
+				IfcParse::IfcFile file(path);
+				compact_attributes store(file);
+				check_parity(file, store);
+				Assert::AreEqual((size_t)2420, (size_t)file.instances_by_type<Schema::IfcIndexedPolygonalFace>()->size());
+
+				// faces, points and directions
+				for (auto type : { "IfcIndexedPolygonalFace", "IfcCartesianPoint", "IfcDirection", "IfcCartesianPointList3D" })
+				{
+					auto instances = file.instances_by_type(type);
+					for (auto inst : *instances)
+						Assert::IsTrue(store.contains(inst->id()));
+				}
+				check_footprint(path);
+			}
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			compact_attributes store(file);
+			check_parity(file, store);
+
+			auto point = *file.instances_by_type<Schema::IfcCartesianPoint>()->begin();
+			auto coordinates = store.reals(point->id(), 0);
+			Assert::IsTrue(equal(coordinates, point->as<Schema::IfcCartesianPoint>()->Coordinates()));
+		}
+
+		TEST_METHOD(Errors)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto list = new Schema::IfcCartesianPointList3D(std::vector<std::vector<double>>{ { 0.0, 0.0, 0.0 }, { 1.0, 0.0, 0.0 } }, boost::none);
+			file.addEntity(list);
+			compact_attributes store(file);
+
+			auto point = (*file.instances_by_type<Schema::IfcCartesianPoint>()->begin())->id();
+			auto curve = (*file.instances_by_type<Schema::IfcGradientCurve>()->begin())->id();
+			Assert::IsFalse(store.contains(curve));
+			Assert::ExpectException<std::out_of_range>([&]() { store.reals(curve, 0); });
+			Assert::ExpectException<std::out_of_range>([&]() { store.reals(point, 1); });
+			Assert::ExpectException<std::logic_error>([&]() { store.integers(point, 0); });
+			Assert::ExpectException<std::logic_error>([&]() { store.real(point, 0); });
+			Assert::ExpectException<std::logic_error>([&]() { store.rows(point, 0); });
+
+			Assert::AreEqual((size_t)2, store.rows(list->id(), 0));
+			Assert::AreEqual(1.0, store.reals(list->id(), 0, 1)[0]);
+			Assert::ExpectException<std::out_of_range>([&]() { store.reals(list->id(), 0, 2); });
+			Assert::ExpectException<std::logic_error>([&]() { store.integers(list->id(), 0, 0); });
+		}
+
+		// "()" in a file has no element type, it reads as an empty list of any type
+		TEST_METHOD(EmptyLists)
+		{
+			auto path = (std::filesystem::temp_directory_path() / "IfcOpenShellUnitTests_CompactAttributes.ifc").string();
+			{
+				IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+				file.addEntity(new Schema::IfcCartesianPointList3D(std::vector<std::vector<double>>(), boost::none));
+				file.addEntity(new Schema::IfcIndexedPolygonalFace(std::vector<int>()));
+				std::ofstream os(path, std::ios::binary | std::ios::trunc);
+				os << file;
+			}
+
+			IfcParse::IfcFile file(path);
+			compact_attributes store(file);
+			check_parity(file, store);
+
+			auto points = (*file.instances_by_type<Schema::IfcCartesianPointList3D>()->begin())->id();
+			auto face = (*file.instances_by_type<Schema::IfcIndexedPolygonalFace>()->begin())->id();
+			for (auto id : { points, face })
+			{
+				Assert::AreEqual((int)IfcUtil::Argument_EMPTY_AGGREGATE, (int)store.type(id, 0));
+				Assert::IsTrue(store.reals(id, 0).empty());
+				Assert::IsTrue(store.integers(id, 0).empty());
+				Assert::AreEqual((size_t)0, store.rows(id, 0));
+				Assert::ExpectException<std::out_of_range>([&]() { store.reals(id, 0, 0); });
+			}
+			std::filesystem::remove(path);
+		}
+	};
+}
@@ -0,0 +1,550 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "CompiledAlignment.h"
+#include "RailRoomTestset.h"
+
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(CompiledAlignment)
+	{
+	public:
+		// compiled frames against the mapped curve, generic records must be bit-identical
+		static void compare(const compiled_alignment& compiled, size_t n, double tolerance)
+		{
+			const auto& evaluator = compiled.evaluator();
+			for (size_t i = 0; i < n; i++)
+			{
+				double u = evaluator.start() + (evaluator.end() - evaluator.start()) * i / (n - 1);
+				Eigen::Matrix4d expected = evaluator.evaluate(u);
+				Eigen::Matrix4d m = compiled.evaluate(u);
+				Assert::AreEqual(0.0, (m.col(3) - expected.col(3)).norm(), tolerance);
+				Assert::AreEqual(0.0, (m.block<3, 3>(0, 0) - expected.block<3, 3>(0, 0)).norm(), 1e-6);
+			}
+		}
+
+		static std::string summary(const compiled_alignment& compiled)
+		{
+			std::ostringstream os;
+			os << compiled.evaluator().curve()->declaration().name() << ": " << compiled.horizontal().size() << " horizontal, "
+				<< compiled.vertical().size() << " vertical records, " << compiled.bytes() << " bytes;";
+			for (size_t k = 0; k < (size_t)segment_kind::count; k++)
+			{
+				if (auto n = compiled.count((segment_kind)k))
+					os << " " << segment_kind_name((segment_kind)k) << " " << n;
+			}
+			if (!compiled.cant().empty())
+			{
+				os << "; cant";
+				for (const auto& r : compiled.cant())
+					os << " " << segment_kind_name(r.kind);
+			}
+			os << "\n";
+			return os.str();
+		}
+
+		// batch evaluation in station order and in random order is bit-identical to single stations
+		static void compare_batch(const compiled_alignment& compiled, size_t n)
+		{
+			const auto& evaluator = compiled.evaluator();
+			std::vector<double> u;
+			for (size_t i = 0; i < n; i++)
+				u.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / (n - 1));
+			std::vector<double> shuffled = u;
+			std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(39));
+
+			for (const auto& stations : { u, shuffled })
+			{
+				auto frames = compiled.evaluate(stations);
+				Assert::AreEqual(stations.size(), frames.size());
+				size_t mismatches = 0;
+				for (size_t i = 0; i < stations.size(); i++)
+					mismatches += frames[i] != compiled.evaluate(stations[i]);
+				Assert::AreEqual((size_t)0, mismatches);
+			}
+		}
+
+		// Derived quantities against the frames at n stations: gradient and cant of the mapped frame, curvatures
+		// against central differences of the compiled heading and slope angle away from segment boundaries. The batch
+		// is bit-identical to single stations.
+		static void check_derived(const compiled_alignment& compiled, size_t n)
+		{
+			const auto& evaluator = compiled.evaluator();
+			std::vector<double> boundaries;
+			for (const auto& layer : evaluator.layers())
+			{
+				for (const auto& s : layer.segments())
+				{
+					boundaries.push_back(s.start);
+					boundaries.push_back(s.end());
+				}
+			}
+
+			const double h = 0.01;
+			auto slope = [&](double u) { return std::atan(compiled::gradient(compiled.evaluate(u))); };
+			std::vector<double> u;
+			for (size_t i = 0; i < n; i++)
+			{
+				double v = evaluator.start() + (evaluator.end() - evaluator.start()) * (i + 0.5) / n;
+				if (std::none_of(boundaries.begin(), boundaries.end(), [&](double b) { return std::fabs(v - b) < 2.0 * h; }))
+					u.push_back(v);
+			}
+
+			auto batch = compiled.derived(u);
+			for (size_t i = 0; i < u.size(); i++)
+			{
+				auto d = compiled.derived(u[i]);
+				Eigen::Matrix4d m = evaluator.evaluate(u[i]);
+				Assert::AreEqual(compiled::gradient(m), d.gradient, 1e-9);
+				Assert::AreEqual(compiled::cant(m), d.cant, 1e-5);
+
+				double turn = compiled::angle_difference(compiled::heading(compiled.evaluate(u[i] + h)), compiled::heading(compiled.evaluate(u[i] - h)));
+				Assert::AreEqual(turn / (2.0 * h), d.horizontal_curvature, 1e-7);
+				Assert::AreEqual((slope(u[i] + h) - slope(u[i] - h)) / (2.0 * h) / std::sqrt(1.0 + d.gradient * d.gradient), d.vertical_curvature, 1e-7);
+
+				Assert::IsTrue(batch[i].gradient == d.gradient && batch[i].horizontal_curvature == d.horizontal_curvature &&
+					batch[i].vertical_curvature == d.vertical_curvature && batch[i].cant == d.cant);
+			}
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+
+			// lines and circular arcs, constant gradients and parabolic vertical curves
+			compiled_alignment h(cache.get(horizontal));
+			Assert::IsTrue(h.fully_compiled());
+			Assert::IsTrue(h.count(segment_kind::arc) > 0);
+			compare(h, 5000, 1e-6);
+
+			compiled_alignment g(cache.get(gradient_curve));
+			Logger::WriteMessage(summary(g).c_str());
+			Assert::IsTrue(g.fully_compiled());
+			Assert::IsTrue(g.count(segment_kind::parabolic_arc) > 0);
+			compare(g, 5000, 1e-6);
+			compare_batch(h, 5000);
+			compare_batch(g, 5000);
+
+			// Bridge 1, Table 6.2 and Table 6.5, feet
+			std::vector<std::tuple<double, double, double, double>> expected_values{
+				{ 11070, 1398.00, 1918.20, 118.73 },
+				{ 11200, 1507.10, 1847.51, 121.00 },
+				{ 11330, 1616.21, 1776.82, 123.13 },
+				{ 11460, 1725.31, 1706.14, 124.97 },
+				{ 11590, 1834.41, 1635.45, 126.52 },
+				{ 11720, 1943.51, 1564.76, 127.78 },
+				{ 11850, 2052.62, 1494.08, 128.74 }
+			};
+			for (const auto& [station, x, y, elev] : expected_values)
+			{
+				auto m = g.evaluate(station - 10000.0);
+				Assert::AreEqual(x, m(0, 3), 0.01);
+				Assert::AreEqual(y, m(1, 3), 0.01);
+				Assert::AreEqual(elev, m(2, 3), 0.01);
+			}
+		}
+
+		// gradient and curvature of the FHWA curves without the frame
+		TEST_METHOD(FHWA_Derived)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			compiled_alignment h(cache.get(horizontal));
+			compiled_alignment g(cache.get(gradient_curve));
+			check_derived(h, 5000);
+			check_derived(g, 5000);
+
+			// vertical curve 1, Table 3.2, grades change by -0.0275 over 1600 ft
+			const std::vector<double> grades{ 0.01750, 0.01475, 0.01200, 0.00925, 0.00650, 0.00375, 0.00100, -0.00175, -0.00450, -0.00725, -0.01000 };
+			for (size_t i = 0; i < grades.size(); i++)
+			{
+				auto d = g.derived(1200.0 + i * 160.0);
+				Assert::AreEqual(grades[i], d.gradient, 1e-5);
+				Assert::AreEqual(0.0, d.cant);
+				// the PVC and PVT may fall into the neighbouring constant gradients
+				if (i > 0 && i + 1 < grades.size())
+					Assert::AreEqual(-0.0275 / 1600.0 / std::pow(1.0 + d.gradient * d.gradient, 1.5), d.vertical_curvature, 1e-9);
+			}
+
+			// Bridge 1, Table 6.5
+			const std::vector<std::pair<double, double>> slopes{ { 11070, 0.0175 }, { 11200, 0.0175 }, { 11330, 0.0153 }, { 11460, 0.0130 }, { 11590, 0.0108 }, { 11720, 0.0086 }, { 11850, 0.0063 } };
+			for (const auto& [station, slope] : slopes)
+				Assert::AreEqual(slope, g.derived(station - 10000.0).gradient, 0.0001);
+
+			// lines have no curvature, arcs the curvature of their record
+			for (const auto& r : h.horizontal())
+			{
+				auto d = h.derived(r.start + r.length / 2);
+				Assert::AreEqual(r.kind == segment_kind::arc ? r.arc.curvature : 0.0, d.horizontal_curvature);
+				Assert::AreEqual(0.0, d.vertical_curvature);
+			}
+		}
+
+		// the horizontal and gradient curves of ACCA compile, the segmented reference curve with cant is generic
+		TEST_METHOD(ACCA)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			size_t clothoids = 0;
+			for (auto& c : *file.instances_by_type<Schema::IfcCompositeCurve>())
+			{
+				compiled_alignment compiled(cache.get(c->as<Schema::IfcCurve>()));
+				Logger::WriteMessage(summary(compiled).c_str());
+				compare(compiled, 2000, 1e-6);
+				compare_batch(compiled, 2000);
+				check_derived(compiled, 2000);
+				clothoids += compiled.count(segment_kind::clothoid);
+
+				if (c->as<Schema::IfcSegmentedReferenceCurve>())
+				{
+					Assert::AreEqual((size_t)1, compiled.horizontal().size());
+					Assert::AreEqual((size_t)1, compiled.count(segment_kind::generic));
+				}
+			}
+			Assert::IsTrue(clothoids > 0);
+		}
+
+		// another thread evaluates with its own cursor, generic records included
+		TEST_METHOD(Cursor)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+			compiled_alignment compiled(evaluator);
+
+			std::vector<double> u;
+			std::vector<Eigen::Matrix4d> expected;
+			for (int i = 0; i < 500; i++)
+			{
+				u.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / 499);
+				expected.push_back(compiled.evaluate(u.back()));
+			}
+
+			size_t mismatches = 0;
+			std::thread worker([&]()
+			{
+				evaluation_cursor cursor(evaluator);
+				for (size_t i = 0; i < u.size(); i++)
+					mismatches += compiled.evaluate(u[i], cursor) != expected[i];
+			});
+			worker.join();
+			Assert::AreEqual((size_t)0, mismatches);
+		}
+
+		TEST_METHOD(Kernels)
+		{
+			// a quarter circle of radius 100 starting at the origin heading east, turning left
+			horizontal_record arc;
+			arc.kind = segment_kind::arc;
+			arc.length = 50.0 * 3.14159265358979323846;
+			arc.arc.curvature = 0.01;
+			double x, y, heading;
+			compiled::evaluate(arc, arc.length, x, y, heading);
+			Assert::AreEqual(100.0, x, 1e-9);
+			Assert::AreEqual(100.0, y, 1e-9);
+			Assert::AreEqual(3.14159265358979323846 / 2, heading, 1e-12);
+
+			// a clothoid with zero rate is the arc
+			horizontal_record clothoid;
+			clothoid.kind = segment_kind::clothoid;
+			clothoid.clothoid.curvature = 0.01;
+			clothoid.clothoid.rate = 0.0;
+			double cx, cy, ch;
+			compiled::evaluate(clothoid, arc.length, cx, cy, ch);
+			Assert::AreEqual(x, cx, 1e-9);
+			Assert::AreEqual(y, cy, 1e-9);
+
+			// clothoid with A = 273.86 over 150 m (ACCA) against the Fresnel series x = s - s^5 / (40 A^4), y = s^3 / (6 A^2) - s^7 / (336 A^6)
+			const double A = 273.861278752584, s = 150.0;
+			clothoid.clothoid.curvature = 0.0;
+			clothoid.clothoid.rate = 1.0 / (A * A);
+			compiled::evaluate(clothoid, s, cx, cy, ch);
+			Assert::AreEqual(s - std::pow(s, 5) / (40 * std::pow(A, 4)) + std::pow(s, 9) / (3456 * std::pow(A, 8)), cx, 1e-9);
+			Assert::AreEqual(std::pow(s, 3) / (6 * A * A) - std::pow(s, 7) / (336 * std::pow(A, 6)) + std::pow(s, 11) / (42240 * std::pow(A, 10)), cy, 1e-9);
+			Assert::AreEqual(s * s / (2 * A * A), ch, 1e-15);
+
+			// vertical circular arc of radius 1000 from a 2% gradient, sag curve
+			vertical_record circular;
+			circular.kind = segment_kind::circular_arc;
+			circular.gradient = 0.02;
+			circular.circular.curvature = 0.001;
+			double z, g;
+			compiled::evaluate(circular, 40.0, z, g);
+			double phi0 = std::atan(0.02);
+			double phi = std::asin(std::sin(phi0) + 0.04);
+			Assert::AreEqual((std::cos(phi0) - std::cos(phi)) / 0.001, z, 1e-9);
+			Assert::AreEqual(std::tan(phi), g, 1e-12);
+
+			// parabola
+			vertical_record parabola;
+			parabola.kind = segment_kind::parabolic_arc;
+			parabola.z = 121.0;
+			parabola.gradient = 0.0175;
+			parabola.parabola.a = -0.0275 / (2 * 1600.0);
+			compiled::evaluate(parabola, 800.0, z, g);
+			Assert::AreEqual(129.50, z, 0.01); // Table 3.2
+			Assert::AreEqual(0.00375, g, 1e-9);
+		}
+
+		// the spiral kernels reduce to the arc and the clothoid
+		TEST_METHOD(SpiralKernels)
+		{
+			horizontal_record clothoid;
+			clothoid.kind = segment_kind::clothoid;
+			clothoid.length = 100.0;
+			clothoid.heading = 0.3;
+			clothoid.clothoid.curvature = 1.0 / 1000.0;
+			clothoid.clothoid.rate = (1.0 / 300.0 - 1.0 / 1000.0) / 100.0;
+
+			horizontal_record polynomial = clothoid;
+			polynomial.kind = segment_kind::polynomial_spiral;
+			polynomial.polynomial = { { clothoid.clothoid.curvature, clothoid.clothoid.rate, 0.0, 0.0 } };
+
+			horizontal_record sine = clothoid;
+			sine.kind = segment_kind::sine_spiral;
+			sine.sine = { clothoid.clothoid.curvature, clothoid.clothoid.rate, 0.0 };
+
+			horizontal_record arc = clothoid;
+			arc.kind = segment_kind::arc;
+			arc.arc.curvature = 1.0 / 300.0;
+
+			horizontal_record cosine = clothoid;
+			cosine.kind = segment_kind::cosine_spiral;
+			cosine.cosine = { 1.0 / 300.0, 0.0 };
+
+			for (double du : { 0.0, 12.5, 50.0, 100.0 })
+			{
+				double x, y, heading, ex, ey, eheading;
+				compiled::evaluate(clothoid, du, ex, ey, eheading);
+				for (const auto& r : { polynomial, sine })
+				{
+					compiled::evaluate(r, du, x, y, heading);
+					Assert::AreEqual(ex, x, 1e-12);
+					Assert::AreEqual(ey, y, 1e-12);
+					Assert::AreEqual(eheading, heading, 1e-15);
+				}
+
+				// the arc uses the chord, the cosine spiral the quadrature
+				compiled::evaluate(arc, du, ex, ey, eheading);
+				compiled::evaluate(cosine, du, x, y, heading);
+				Assert::AreEqual(ex, x, 1e-9);
+				Assert::AreEqual(ey, y, 1e-9);
+				Assert::AreEqual(eheading, heading, 1e-15);
+			}
+
+			// a cosine spiral from straight to R 300 turns by the mean curvature times the length
+			cosine.cosine = { 0.5 / 300.0, -0.5 / 300.0 };
+			double x, y, heading;
+			compiled::evaluate(cosine, 100.0, x, y, heading);
+			Assert::AreEqual(0.3 + 100.0 * 0.5 / 300.0, heading, 1e-15);
+		}
+
+		// the n point rules integrate polynomials up to degree 2n - 1, cheaper rules stay within the precision
+		TEST_METHOD(Quadrature)
+		{
+			for (size_t n = 2; n <= compiled::max_points; n++)
+			{
+				for (size_t k = 0; k < 2 * n; k++)
+				{
+					double sum = 0.0;
+					for (size_t i = 0; i < n; i++)
+						sum += compiled::gauss_weights[n][i] * std::pow(compiled::gauss_nodes[n][i], (double)k);
+					Assert::AreEqual(k % 2 ? 0.0 : 2.0 / (k + 1), sum, 1e-14);
+				}
+			}
+
+			// the ACCA clothoid turns by 0.15 over 150 m, one panel for any rule
+			horizontal_record clothoid;
+			clothoid.kind = segment_kind::clothoid;
+			clothoid.length = 150.0;
+			clothoid.clothoid.rate = 1.0 / (273.861278752584 * 273.861278752584);
+			const double turn = compiled::turn_bound(clothoid, clothoid.length);
+			for (double precision : { 1e-3, 1e-4 })
+			{
+				auto candidates = compiled::quadratures(precision, clothoid.length, turn);
+				Assert::IsFalse(candidates.empty());
+				Assert::IsTrue(compiled::quadrature_cost(candidates.front(), turn) < compiled::quadrature_cost({}, turn));
+				for (const auto& q : candidates)
+				{
+					for (double du : { 12.5, 75.0, 150.0 })
+					{
+						double x, y, heading, ex, ey, eheading;
+						compiled::evaluate(clothoid, du, ex, ey, eheading);
+						compiled::evaluate(clothoid, du, x, y, heading, q);
+						Assert::AreEqual(0.0, std::hypot(x - ex, y - ey), precision);
+						Assert::AreEqual(eheading, heading);
+					}
+				}
+			}
+			Assert::IsTrue(compiled::quadratures(1e-3, 100.0, 0.0).front().points < compiled::max_points);
+		}
+
+		// the curvature is the derivative of the turn, the cant follows its sine
+		TEST_METHOD(DerivedKernels)
+		{
+			horizontal_record clothoid;
+			clothoid.kind = segment_kind::clothoid;
+			clothoid.length = 100.0;
+			clothoid.clothoid.curvature = 1.0 / 1000.0;
+			clothoid.clothoid.rate = (1.0 / 300.0 - 1.0 / 1000.0) / 100.0;
+
+			horizontal_record polynomial = clothoid;
+			polynomial.kind = segment_kind::polynomial_spiral;
+			polynomial.polynomial = { { 1.0 / 1000.0, 2e-5, -3e-7, 4e-9 } };
+
+			horizontal_record cosine = clothoid;
+			cosine.kind = segment_kind::cosine_spiral;
+			cosine.cosine = { 0.5 / 300.0, -0.5 / 300.0 };
+
+			horizontal_record sine = clothoid;
+			sine.kind = segment_kind::sine_spiral;
+			sine.sine = { 1.0 / 1000.0, 3e-5, -2e-3 };
+
+			const double h = 1e-3;
+			for (double du : { 1.0, 12.5, 50.0, 99.0 })
+			{
+				Assert::AreEqual((compiled::turn<segment_kind::clothoid>(clothoid, du + h) - compiled::turn<segment_kind::clothoid>(clothoid, du - h)) / (2 * h), compiled::curvature(clothoid, du), 1e-10);
+				Assert::AreEqual((compiled::turn<segment_kind::polynomial_spiral>(polynomial, du + h) - compiled::turn<segment_kind::polynomial_spiral>(polynomial, du - h)) / (2 * h), compiled::curvature(polynomial, du), 1e-10);
+				Assert::AreEqual((compiled::turn<segment_kind::cosine_spiral>(cosine, du + h) - compiled::turn<segment_kind::cosine_spiral>(cosine, du - h)) / (2 * h), compiled::curvature(cosine, du), 1e-10);
+				Assert::AreEqual((compiled::turn<segment_kind::sine_spiral>(sine, du + h) - compiled::turn<segment_kind::sine_spiral>(sine, du - h)) / (2 * h), compiled::curvature(sine, du), 1e-10);
+			}
+			Assert::AreEqual(0.0, compiled::curvature(cosine, 0.0), 1e-15);
+			Assert::AreEqual(1.0 / 300.0, compiled::curvature(cosine, 100.0), 1e-15);
+
+			// a circular vertical curve has the curvature of its record, a parabola 2 a at zero gradient
+			vertical_record circular;
+			circular.kind = segment_kind::circular_arc;
+			circular.circular.curvature = 0.001;
+			Assert::AreEqual(0.001, compiled::vertical_curvature(circular, 0.04));
+			vertical_record parabola;
+			parabola.kind = segment_kind::parabolic_arc;
+			parabola.parabola.a = -0.0275 / (2 * 1600.0);
+			Assert::AreEqual(-0.0275 / 1600.0, compiled::vertical_curvature(parabola, 0.0), 1e-18);
+
+			// a cosine transition from 0 to 150 mm of cant over a rail head distance of 1.5 m
+			cant_record cant;
+			cant.kind = segment_kind::cosine_spiral;
+			cant.length = 60.0;
+			cant.c[0] = 0.05;
+			cant.c[1] = -0.05;
+			Assert::AreEqual(0.0, compiled::cant(cant, 0.0), 1e-15);
+			Assert::AreEqual(std::asin(0.05), compiled::cant(cant, 30.0), 1e-15);
+			Assert::AreEqual(std::asin(0.1), compiled::cant(cant, 60.0), 1e-15);
+		}
+
+		// Every RailRoom testcase of the layout evaluated in one batch at the stations of its reference file
+		static void RailRoom(IfcRailRoom::Layout layout)
+		{
+			const double tol = IfcRailRoom::tolerance(layout);
+			ifcopenshell::geometry::Settings settings;
+			settings.get<ifcopenshell::geometry::settings::Precision>().value = tol;
+			size_t spirals = 0, cheaper = 0;
+			std::ostringstream os;
+			for (const auto& curve_type : IfcRailRoom::curve_types(layout))
+			{
+				for (const auto& test_name : IfcRailRoom::test_names(layout))
+				{
+					auto tc = IfcRailRoom::load_testcase(layout, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+					alignment_evaluator evaluator(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit(), units::model);
+					compiled_alignment compiled(evaluator);
+					os << curve_type << test_name << " " << summary(compiled);
+
+					auto reference = IfcRailRoom::read_reference(layout, curve_type, test_name);
+					Assert::IsFalse(reference.empty());
+					std::vector<double> stations;
+					for (const auto& p : reference)
+						stations.push_back(p.s);
+
+					auto frames = compiled.evaluate(stations);
+					for (size_t i = 0; i < reference.size(); i++)
+					{
+						const auto& p = reference[i];
+						const auto& m = frames[i];
+						Assert::AreEqual(p.x, m(0, 3), tol);
+						if (layout != IfcRailRoom::Layout::Vertical)
+							Assert::AreEqual(p.y, m(1, 3), tol);
+						if (layout != IfcRailRoom::Layout::Horizontal)
+							Assert::AreEqual(p.z, m(2, 3), tol);
+						Assert::IsTrue(m == compiled.evaluate(stations[i]));
+					}
+
+					compare(compiled, 1000, 1e-6 * std::max(1.0, evaluator.end() - evaluator.start()));
+					check_derived(compiled, 1000);
+
+					// the cant at the stations of the reference file is the rotation of the reference frame
+					auto derived = compiled.derived(stations);
+					for (size_t i = 0; i < stations.size(); i++)
+						Assert::AreEqual(compiled::cant(evaluator.evaluate(stations[i])), derived[i].cant, 1e-5);
+					if (layout == IfcRailRoom::Layout::Cant)
+						Assert::AreEqual(evaluator.layers().front().size(), compiled.cant().size());
+					else
+						Assert::IsTrue(compiled.cant().empty());
+
+					// spirals integrated at the Precision of the settings, within it of the most precise quadrature
+					compiled_alignment precise(evaluator, settings);
+					Assert::AreEqual(tol, precise.precision(), 1e-15);
+					Assert::AreEqual(compiled.count(segment_kind::generic), precise.count(segment_kind::generic));
+					auto precise_frames = precise.evaluate(stations);
+					for (size_t i = 0; i < reference.size(); i++)
+					{
+						Assert::AreEqual(0.0, (precise_frames[i].col(3) - frames[i].col(3)).norm(), tol);
+						Assert::IsTrue(precise_frames[i].block<3, 3>(0, 0) == frames[i].block<3, 3>(0, 0));
+					}
+					spirals += precise.count(segment_kind::clothoid) + precise.count(segment_kind::polynomial_spiral) +
+						precise.count(segment_kind::cosine_spiral) + precise.count(segment_kind::sine_spiral);
+					cheaper += precise.quadrature().points < compiled.quadrature().points || precise.quadrature().panel_angle > compiled.quadrature().panel_angle;
+					os << "  " << precise.quadrature().points << " point rule, panels of " << precise.quadrature().panel_angle << " rad at precision " << tol << "\n";
+				}
+			}
+			Logger::WriteMessage(os.str().c_str());
+			if (spirals)
+				Assert::IsTrue(cheaper > 0);
+		}
+
+		TEST_METHOD(RailRoom_Horizontal)
+		{
+			RailRoom(IfcRailRoom::Layout::Horizontal);
+		}
+
+		TEST_METHOD(RailRoom_Vertical)
+		{
+			RailRoom(IfcRailRoom::Layout::Vertical);
+		}
+
+		TEST_METHOD(RailRoom_Cant)
+		{
+			RailRoom(IfcRailRoom::Layout::Cant);
+		}
+	};
+}
@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "AlignmentEvaluator.h"
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	// Many threads evaluating the same alignments through per-thread evaluation_cursors.
+	// The results must be bit-identical to a serial evaluation.
+	TEST_CLASS(ConcurrentEvaluation)
+	{
+	public:
+		static std::vector<double> stations(const alignment_evaluator& evaluator, size_t n)
+		{
+			std::vector<double> u;
+			for (size_t i = 0; i < n; i++)
+				u.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / (n - 1));
+			return u;
+		}
+
+		static std::vector<Eigen::Matrix4d> serial(const alignment_evaluator& evaluator, const std::vector<double>& u)
+		{
+			std::vector<Eigen::Matrix4d> frames;
+			for (auto v : u)
+				frames.push_back(evaluator.evaluate(v));
+			return frames;
+		}
+
+		// Every thread evaluates every station, starting at a different offset so threads touch different segments
+		// at the same time. Returns the number of mismatches with the serial frames.
+		static size_t concurrent(const alignment_evaluator& evaluator, const std::vector<double>& u, const std::vector<Eigen::Matrix4d>& expected, size_t threads)
+		{
+			std::atomic<size_t> mismatches{ 0 };
+			std::vector<std::thread> workers;
+			for (size_t t = 0; t < threads; t++)
+			{
+				workers.emplace_back([&, t]()
+				{
+					evaluation_cursor cursor(evaluator);
+					size_t offset = t * u.size() / threads;
+					for (size_t k = 0; k < u.size(); k++)
+					{
+						size_t i = (offset + k) % u.size();
+						Eigen::Matrix4d m = cursor.evaluate(u[i]);
+						if (m != expected[i])
+							mismatches++;
+					}
+				});
+			}
+			for (auto& w : workers)
+				w.join();
+			return mismatches;
+		}
+
+		TEST_METHOD(FHWA_GradientCurve)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+
+			auto u = stations(evaluator, 2000);
+			auto expected = serial(evaluator, u);
+			for (size_t threads : { 2, 8, 64 })
+				Assert::AreEqual((size_t)0, concurrent(evaluator, u, expected, threads));
+		}
+
+		TEST_METHOD(ACCA_SegmentedReferenceCurve)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			auto u = stations(evaluator, 2000);
+			auto expected = serial(evaluator, u);
+			for (size_t threads : { 2, 8, 64 })
+				Assert::AreEqual((size_t)0, concurrent(evaluator, u, expected, threads));
+		}
+
+		// Concurrent first requests of the same curves map each curve once and hand out the same evaluator
+		TEST_METHOD(ConcurrentCacheRequests)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			std::vector<const Schema::IfcCurve*> curves;
+			for (auto& c : *file.instances_by_type<Schema::IfcCompositeCurve>())
+				curves.push_back(c->as<Schema::IfcCurve>());
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			const size_t threads = 32;
+			std::vector<std::vector<const alignment_evaluator*>> seen(threads);
+			std::vector<std::thread> workers;
+			for (size_t t = 0; t < threads; t++)
+			{
+				workers.emplace_back([&, t]()
+				{
+					for (size_t k = 0; k < curves.size(); k++)
+					{
+						auto curve = curves[(t + k) % curves.size()];
+						seen[t].push_back(&cache.get(curve));
+					}
+				});
+			}
+			for (auto& w : workers)
+				w.join();
+
+			Assert::AreEqual(curves.size(), cache.size());
+			for (size_t t = 0; t < threads; t++)
+			{
+				for (size_t k = 0; k < curves.size(); k++)
+					Assert::IsTrue(seen[t][k] == &cache.get(curves[(t + k) % curves.size()]));
+			}
+		}
+
+		// A fixed number of evaluations split over 1 to 64 threads, each with its own cursor
+		TEST_METHOD(Scaling)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			auto u = stations(evaluator, 1 << 16);
+			auto expected = serial(evaluator, u);
+
+			std::ostringstream os;
+			os << std::thread::hardware_concurrency() << " hardware threads, " << u.size() << " evaluations\n";
+			double single = 0.0;
+			for (size_t threads = 1; threads <= 64; threads *= 2)
+			{
+				std::atomic<size_t> mismatches{ 0 };
+				auto t0 = std::chrono::steady_clock::now();
+				std::vector<std::thread> workers;
+				for (size_t t = 0; t < threads; t++)
+				{
+					workers.emplace_back([&, t]()
+					{
+						evaluation_cursor cursor(evaluator);
+						for (size_t i = t; i < u.size(); i += threads)
+						{
+							if (cursor.evaluate(u[i]) != expected[i])
+								mismatches++;
+						}
+					});
+				}
+				for (auto& w : workers)
+					w.join();
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+				Assert::AreEqual((size_t)0, mismatches.load());
+				if (threads == 1)
+					single = seconds;
+				os << threads << " threads: " << seconds << " s, speedup " << single / seconds << "\n";
+			}
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
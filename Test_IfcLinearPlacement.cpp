@@ -9,6 +9,11 @@
 #include <ifcgeom/abstract_mapping.h>
 #include <boost/math/constants/constants.hpp>
 
+#include "PolylineIndex.h"
+
+#include <algorithm>
+#include <random>
+
 const double PI = boost::math::constants::pi<double>();
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -66,21 +71,9 @@ namespace IfcOpenShellUnitTests
 			bool bMultipleSegments = true;
 		};
 
-		void Test2D(const Options& options)
+		// IfcPolyline or IfcIndexedPolyCurve through 2D or 3D points
+		static Schema::IfcCurve* make_curve(const Options& options, const std::vector<std::vector<double>>& curve_points)
 		{
-			IfcHierarchyHelper<Schema> file;
-			setup_project(file);
-
-			ifcopenshell::geometry::Settings settings;
-			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
-
-			std::vector<std::vector<double>> curve_points;
-			curve_points.push_back(std::vector<double>{0, 0});
-			curve_points.push_back(std::vector<double>{10, 0});
-			curve_points.push_back(std::vector<double>{20, 10});
-			curve_points.push_back(std::vector<double>{30, 10});
-
-			Schema::IfcCurve* curve;
 			if (options.curve == Curve::IfcPolyLine)
 			{
 				typename aggregate_of<typename Schema::IfcCartesianPoint>::ptr points(new aggregate_of<typename Schema::IfcCartesianPoint>());
@@ -88,11 +81,15 @@ namespace IfcOpenShellUnitTests
 				{
 					points->push(new Schema::IfcCartesianPoint(curve_point));
 				}
-				curve = new Schema::IfcPolyline(points);
+				return new Schema::IfcPolyline(points);
 			}
 			else
 			{
-				auto points = new Schema::IfcCartesianPointList2D(curve_points, boost::none);
+				Schema::IfcCartesianPointList* points;
+				if (curve_points.front().size() == 2)
+					points = new Schema::IfcCartesianPointList2D(curve_points, boost::none);
+				else
+					points = new Schema::IfcCartesianPointList3D(curve_points, boost::none);
 				if (options.bUseSegments)
 				{
 					// note: STEP uses a 1-based index
@@ -116,13 +113,47 @@ namespace IfcOpenShellUnitTests
 						}
 						segments->push(new Schema::IfcLineIndex(indicies));
 					}
-					curve = new Schema::IfcIndexedPolyCurve(points, segments, boost::none);
+					return new Schema::IfcIndexedPolyCurve(points, segments, boost::none);
 				}
 				else
 				{
-					curve = new Schema::IfcIndexedPolyCurve(points, boost::none, boost::none);
+					return new Schema::IfcIndexedPolyCurve(points, boost::none, boost::none);
+				}
+			}
+		}
+
+		// the polyline index gives the frames of the mapping
+		static void check_index(const Schema::IfcCurve* curve, const std::vector<double>& dist, const std::vector<Eigen::Matrix4d>& expected_values)
+		{
+			auto index = polyline_index::from_curve(curve);
+			for (size_t k = 0; k < dist.size(); k++)
+			{
+				Eigen::Matrix4d values = index.frame(dist[k]);
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(expected_values[k](row, col), values(row, col), 0.001);
+					}
 				}
 			}
+		}
+
+		void Test2D(const Options& options)
+		{
+			IfcHierarchyHelper<Schema> file;
+			setup_project(file);
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+
+			std::vector<std::vector<double>> curve_points;
+			curve_points.push_back(std::vector<double>{0, 0});
+			curve_points.push_back(std::vector<double>{10, 0});
+			curve_points.push_back(std::vector<double>{20, 10});
+			curve_points.push_back(std::vector<double>{30, 10});
+
+			auto curve = make_curve(options, curve_points);
 
 			// distances along polyline for testing
 			std::vector<double> dist{ 5.0, // mid-point first leg
@@ -169,6 +200,8 @@ namespace IfcOpenShellUnitTests
 			expected_values.emplace_back(e2);
 			expected_values.emplace_back(e3);
 
+			check_index(curve, dist, expected_values);
+
 			// test mapping of placements
 			int i = 0;
 			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
@@ -207,49 +240,7 @@ namespace IfcOpenShellUnitTests
 			curve_points.push_back(std::vector<double>{20, 10, -10});
 			curve_points.push_back(std::vector<double>{30, 10, 0});
 
-			Schema::IfcCurve* curve;
-			if (options.curve == Curve::IfcPolyLine)
-			{
-				typename aggregate_of<typename Schema::IfcCartesianPoint>::ptr points(new aggregate_of<typename Schema::IfcCartesianPoint>());
-				for (auto& curve_point : curve_points)
-				{
-					points->push(new Schema::IfcCartesianPoint(curve_point));
-				}
-				curve = new Schema::IfcPolyline(points);
-			}
-			else
-			{
-				auto points = new Schema::IfcCartesianPointList3D(curve_points, boost::none);
-				if (options.bUseSegments)
-				{
-					// note: STEP uses a 1-based index
-					typename aggregate_of<typename Schema::IfcSegmentIndexSelect>::ptr segments(new aggregate_of<typename Schema::IfcSegmentIndexSelect>());
-					if (options.bMultipleSegments)
-					{
-						int npoints = curve_points.size();
-						for (int i = 0; i < npoints - 1; i++)
-						{
-							std::vector<int> indicies{ i + 1,i + 2 };
-							segments->push(new Schema::IfcLineIndex(indicies));
-						}
-					}
-					else
-					{
-						std::vector<int> indicies;
-						int npoints = curve_points.size();
-						for (int i = 0; i < npoints; i++)
-						{
-							indicies.push_back(i + 1);
-						}
-						segments->push(new Schema::IfcLineIndex(indicies));
-					}
-					curve = new Schema::IfcIndexedPolyCurve(points, segments, boost::none);
-				}
-				else
-				{
-					curve = new Schema::IfcIndexedPolyCurve(points, boost::none, boost::none);
-				}
-			}
+			auto curve = make_curve(options, curve_points);
 
 			// distances along polyline for testing
 			std::vector<double> dist{ 5.0, // point in first leg
@@ -294,6 +285,8 @@ namespace IfcOpenShellUnitTests
 			expected_values.emplace_back(e2);
 			expected_values.emplace_back(e3);
 
+			check_index(curve, dist, expected_values);
+
 			// test mapping of placements
 			int i = 0;
 			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
@@ -365,6 +358,128 @@ namespace IfcOpenShellUnitTests
 			Test3D(options);
 		}
 
+		// A survey polyline of n vertices 0.5 to 1.5 apart, meandering in plan and, for 3D, in elevation
+		static std::vector<std::vector<double>> survey_points(size_t n, bool three_d)
+		{
+			std::mt19937 generator(41);
+			std::uniform_real_distribution<double> spacing(0.5, 1.5);
+			std::vector<std::vector<double>> points;
+			points.reserve(n);
+			double x = 0.0;
+			for (size_t i = 0; i < n; i++)
+			{
+				if (three_d)
+					points.push_back({ x, 50.0 * sin(x / 5000.0), 10.0 * sin(x / 20000.0) });
+				else
+					points.push_back({ x, 50.0 * sin(x / 5000.0) });
+				x += spacing(generator);
+			}
+			return points;
+		}
+
+		void TestMillionVertices(const Options& options, bool three_d)
+		{
+			IfcHierarchyHelper<Schema> file;
+			setup_project(file);
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+
+			auto curve_points = survey_points(1000000, three_d);
+			auto curve = make_curve(options, curve_points);
+
+			auto index = polyline_index::from_curve(curve);
+			Assert::AreEqual(curve_points.size() - 1, index.legs());
+
+			// mid-points of legs spread over the curve
+			std::vector<double> dist;
+			for (size_t k = 0; k < 10; k++)
+			{
+				size_t leg = (index.legs() - 1) * k / 9;
+				dist.push_back((index.distance(leg) + index.distance(leg + 1)) / 2.0);
+			}
+
+			for (auto& d : dist)
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(
+					new Schema::IfcLengthMeasure(d),
+					boost::none, boost::none, boost::none,
+					curve);
+
+				auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+				file.addEntity(lp);
+			}
+
+			// the index against the mapping of placements
+			int i = 0;
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			for (auto& placement : *placements)
+			{
+				auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placement));
+				m->components().col(3).head(3) /= mapping->get_length_unit();
+
+				Eigen::Matrix4d values = m->components();
+				Eigen::Matrix4d expected = index.frame(dist[i++]);
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(expected(row, col), values(row, col), col == 3 ? 0.001 : 0.000001);
+					}
+				}
+			}
+
+			// batches give the same bits as single queries, sorted and in random order
+			std::mt19937 generator(42);
+			std::uniform_real_distribution<double> along(-10.0, index.length() + 10.0);
+			std::vector<double> u(100000);
+			for (auto& v : u)
+				v = along(generator);
+			std::sort(u.begin(), u.end());
+
+			for (int pass = 0; pass < 2; pass++)
+			{
+				auto frames = index.frames(u);
+				std::vector<double> x, y, z;
+				index.points(u, x, y, z);
+				size_t mismatches = 0;
+				for (size_t k = 0; k < u.size(); k++)
+				{
+					Eigen::Vector3d p = index.point(u[k]);
+					mismatches += (frames[k] != index.frame(u[k])) + (p.x() != x[k]) + (p.y() != y[k]) + (p.z() != z[k]);
+				}
+				Assert::AreEqual((size_t)0, mismatches);
+				std::shuffle(u.begin(), u.end(), generator);
+			}
+		}
+
+		TEST_METHOD(BasisCurve_IfcPolyline_MillionVertices)
+		{
+			Options options;
+			options.curve = Curve::IfcPolyLine;
+			TestMillionVertices(options, false);
+			TestMillionVertices(options, true);
+		}
+
+		TEST_METHOD(BasisCurve_IfcIndexedPolyCurve_MillionVertices)
+		{
+			Options options;
+			options.curve = Curve::IfcIndexedPolyCurve;
+			for (bool three_d : { false, true })
+			{
+				options.bUseSegments = false;
+				TestMillionVertices(options, three_d);
+
+				options.bUseSegments = true;
+				options.bMultipleSegments = true;
+				TestMillionVertices(options, three_d);
+
+				options.bMultipleSegments = false;
+				TestMillionVertices(options, three_d);
+			}
+		}
+
 		TEST_METHOD(BasisCurve_IfcOffsetCurveByDistances)
 		{
 			IfcHierarchyHelper<Schema> file;
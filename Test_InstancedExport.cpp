@@ -0,0 +1,178 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "InstancedExport.h"
+
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(InstancedExport)
+	{
+	public:
+
+		// Both sleepers map representation map #52 (three IfcPolygonalFaceSet, 5556 points, 2420 triangles).
+		// The instance matrices are the linear placements of ACCA_Sleepers::LinearPlacement1 and LinearPlacement2,
+		// the mapping targets are identity.
+		static void check_sleepers(const char* path)
+		{
+			IfcParse::IfcFile file(path);
+
+			ifcopenshell::geometry::Settings settings;
+			instanced_iterator it(file, settings);
+
+			std::vector<instanced_iterator::element> meshes, instances;
+			while (it.next())
+			{
+				const auto& e = it.get();
+				if (e.type == instanced_iterator::element_type::mesh)
+				{
+					// a mesh is emitted before any instance that uses it
+					Assert::IsTrue(std::none_of(instances.begin(), instances.end(), [&e](const auto& i) { return i.representation_map == e.representation_map; }));
+					meshes.push_back(e);
+				}
+				else
+				{
+					instances.push_back(e);
+				}
+			}
+
+			Assert::AreEqual((size_t)1, meshes.size());
+			Assert::AreEqual((size_t)1, it.mesh_count());
+			Assert::AreEqual((size_t)2, instances.size());
+
+			const auto& mesh = *meshes.front().mesh;
+			Assert::AreEqual((size_t)5556 * 3, mesh.vertices.size());
+			Assert::AreEqual((size_t)2420, mesh.triangle_count());
+			Assert::IsTrue(std::all_of(mesh.indices.begin(), mesh.indices.end(), [&mesh](int i) { return i >= 0 && i < (int)mesh.vertices.size() / 3; }));
+
+			for (const auto& instance : instances)
+			{
+				Assert::IsTrue(instance.mesh == meshes.front().mesh);
+				Assert::AreEqual(std::string("Sleeper_0") + (&instance == &instances.front() ? "1" : "2"), instance.product->Name().get());
+				Assert::AreEqual(1.0, instance.transformation.determinant(), 0.00001);
+			}
+
+			const auto& m1 = instances[0].transformation;
+			Assert::AreEqual(0.99999879246069978, m1(0, 0), 0.0001);
+			Assert::AreEqual(-0.0013642520620536322, m1(1, 0), 0.0001);
+			Assert::AreEqual(0.00074424018529778728, m1(2, 0), 0.0001);
+			Assert::AreEqual(-0.0011076434592169500, m1(0, 2), 0.0001);
+			Assert::AreEqual(-0.28978206702852100, m1(1, 2), 0.0001);
+			Assert::AreEqual(0.95709201582431203, m1(2, 2), 0.0001);
+			Assert::AreEqual(424.99995652662165, m1(0, 3), 0.001);
+			Assert::AreEqual(-0.034722183303109985, m1(1, 3), 0.001);
+			Assert::AreEqual(0.25000003129438408, m1(2, 3), 0.001);
+
+			const auto& m2 = instances[1].transformation;
+			Assert::AreEqual(0.99999850931045120, m2(0, 0), 0.0001);
+			Assert::AreEqual(-0.0015740827616835551, m2(1, 0), 0.0001);
+			Assert::AreEqual(0.00070967621825949664, m2(2, 0), 0.0001);
+			Assert::AreEqual(-0.0011505876482260603, m2(0, 2), 0.0001);
+			Assert::AreEqual(-0.30101714069267704, m2(1, 2), 0.0001);
+			Assert::AreEqual(0.95361803525167710, m2(2, 2), 0.0001);
+			Assert::AreEqual(425.99994710799535, m2(0, 3), 0.001);
+			Assert::AreEqual(-0.039057725772016598, m2(1, 3), 0.001);
+			Assert::AreEqual(0.26000003254615944, m2(2, 3), 0.001);
+
+			// one mesh and two matrices instead of two meshes
+			Assert::AreEqual(2 * mesh.bytes(), it.duplicated_bytes());
+			Assert::AreEqual(mesh.bytes() + 2 * sizeof(Eigen::Matrix4d), it.instanced_bytes());
+
+			std::ostringstream os;
+			os << path << ": " << instances.size() << " instances of " << it.mesh_count() << " meshes, "
+				<< it.instanced_bytes() << " bytes instanced, " << it.duplicated_bytes() << " bytes duplicated, "
+				<< it.duplicated_bytes() - it.instanced_bytes() << " bytes saved\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+
+		TEST_METHOD(ACCA_Explicit)
+		{
+			check_sleepers("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+		}
+
+		TEST_METHOD(ACCA_Implicit)
+		{
+			check_sleepers("../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc");
+		}
+
+		// the tessellation read from a compact_attributes store is the one read from the instances
+		TEST_METHOD(ACCA_CompactAttributes)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			compact_attributes store(file);
+			for (auto& face_set : *file.instances_by_type<Schema::IfcPolygonalFaceSet>())
+			{
+				Assert::IsTrue(store.contains(face_set->Coordinates()->id()));
+				Assert::IsTrue(store.contains((*face_set->Faces()->begin())->id()));
+			}
+
+			ifcopenshell::geometry::Settings settings;
+			instanced_iterator from_file(file, settings), from_store(file, settings, &store);
+			size_t meshes = 0;
+			while (from_file.next())
+			{
+				Assert::IsTrue(from_store.next());
+				const auto& a = from_file.get();
+				const auto& b = from_store.get();
+				Assert::IsTrue(a.type == b.type);
+				Assert::IsTrue(a.representation_map == b.representation_map);
+				Assert::IsTrue(a.mesh->vertices == b.mesh->vertices);
+				Assert::IsTrue(a.mesh->indices == b.mesh->indices);
+				meshes += a.type == instanced_iterator::element_type::mesh;
+			}
+			Assert::IsFalse(from_store.next());
+			Assert::AreEqual((size_t)1, meshes);
+		}
+
+		TEST_METHOD(ACCA_ManySleepers)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc");
+
+			// a sleeper every 0.6 m, all mapping the representation of the first sleeper
+			auto sleepers = file.instances_by_type<Schema::IfcTrackElement>();
+			auto first = (*(sleepers->begin()))->as<Schema::IfcTrackElement>();
+			auto pde = first->ObjectPlacement()->as<Schema::IfcLinearPlacement>()->RelativePlacement()->as<Schema::IfcAxis2PlacementLinear>()->Location()->as<Schema::IfcPointByDistanceExpression>();
+			auto representation = first->Representation();
+
+			const size_t n = 500;
+			for (size_t i = 2; i < n; i++)
+			{
+				auto location = new Schema::IfcPointByDistanceExpression(new Schema::IfcLengthMeasure(400.0 + 0.6 * i), 0.0, boost::none, 0.0, pde->BasisCurve());
+				auto placement = new Schema::IfcLinearPlacement(nullptr, new Schema::IfcAxis2PlacementLinear(location, nullptr, nullptr), nullptr);
+				auto sleeper = new Schema::IfcTrackElement(IfcParse::IfcGlobalId(), nullptr, std::string("Sleeper"), boost::none, boost::none, placement, representation, boost::none, Schema::IfcTrackElementTypeEnum::IfcTrackElementType_SLEEPER);
+				file.addEntity(sleeper);
+			}
+
+			ifcopenshell::geometry::Settings settings;
+			instanced_iterator it(file, settings);
+
+			size_t meshes = 0, instances = 0;
+			while (it.next())
+			{
+				if (it.get().type == instanced_iterator::element_type::mesh)
+					meshes++;
+				else
+					instances++;
+			}
+			Assert::AreEqual((size_t)1, meshes);
+			Assert::AreEqual(n, instances);
+			Assert::IsTrue(it.duplicated_bytes() > 100 * it.instanced_bytes());
+
+			std::ostringstream os;
+			os << instances << " instances: " << it.instanced_bytes() << " bytes instanced, " << it.duplicated_bytes() << " bytes duplicated\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "CompiledAlignment.h"
+#include "LinearPlacementResolver.h"
+#include "StationSampling.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(Instrumentation)
+	{
+	public:
+
+		// Adds placements along the basis curve of the first linear placement in the file, so the file has n placements in total
+		static void add_placements(IfcParse::IfcFile& file, size_t n)
+		{
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			auto first = (*(placements->begin()))->as<Schema::IfcLinearPlacement>();
+			auto curve = first->RelativePlacement()->as<Schema::IfcAxis2PlacementLinear>()->Location()->as<Schema::IfcPointByDistanceExpression>()->BasisCurve();
+
+			for (size_t i = placements->size(); i < n; i++)
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(
+					new Schema::IfcLengthMeasure(400.0 + 0.5 * i),
+					0.0, boost::none, 0.0,
+					curve);
+
+				auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+				file.addEntity(lp);
+			}
+		}
+
+		TEST_METHOD(ACCA_OneBasisCurveMapping)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			add_placements(file, 1000);
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			linear_placement_resolver resolver(cache);
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			Assert::AreEqual(1000u, placements->size());
+
+			std::vector<Eigen::Matrix4d> resolved;
+			{
+				instrumentation::enabled_scope scope;
+				for (auto& placement : *placements)
+				{
+					resolved.push_back(resolver.resolve(placement->as<Schema::IfcLinearPlacement>()));
+				}
+
+				Assert::AreEqual((uint64_t)1, instrumentation::value(instrumentation::counter::mappings));
+				Assert::AreEqual((uint64_t)1, instrumentation::value(instrumentation::counter::mappings, "IfcSegmentedReferenceCurve"));
+				Assert::AreEqual((uint64_t)1, instrumentation::value(instrumentation::counter::cache_misses));
+				Assert::AreEqual((uint64_t)999, instrumentation::value(instrumentation::counter::cache_hits));
+				Assert::AreEqual((uint64_t)1, instrumentation::value(instrumentation::counter::allocations, "alignment_evaluator"));
+
+				// cant, vertical and horizontal layers are evaluated for every placement, the function searches its segments itself
+				Assert::AreEqual((uint64_t)0, instrumentation::value(instrumentation::counter::segment_searches));
+				Assert::AreEqual((uint64_t)3000, instrumentation::value(instrumentation::counter::evaluations));
+
+				Logger::WriteMessage(instrumentation::report().c_str());
+			}
+
+			// first placement, see ACCA_Sleepers::LinearPlacement1
+			const auto& m = resolved.front();
+			Assert::AreEqual(1.0, m.determinant(), 0.00001);
+			Assert::AreEqual(0.99999879246069978, m(0, 0), 0.0001);
+			Assert::AreEqual(-0.28978206702852100, m(1, 2), 0.0001);
+			Assert::AreEqual(424.99995652662165, m(0, 3), 0.001);
+			Assert::AreEqual(-0.034722183303109985, m(1, 3), 0.001);
+			Assert::AreEqual(0.25000003129438408, m(2, 3), 0.001);
+
+			// the resolver matches the mapping
+			auto& mapping = cache.mapping();
+			int i = 0;
+			for (auto& placement : *placements)
+			{
+				auto expected = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping.map(placement))->ccomponents();
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(expected(row, col), resolved[i](row, col), 0.000001);
+					}
+				}
+				i++;
+			}
+		}
+
+		TEST_METHOD(Disabled)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc");
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			linear_placement_resolver resolver(cache);
+
+			instrumentation::reset();
+			Assert::IsFalse(instrumentation::enabled());
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			for (auto& placement : *placements)
+			{
+				resolver.resolve(placement->as<Schema::IfcLinearPlacement>());
+			}
+
+			for (size_t c = 0; c < (size_t)instrumentation::counter::count; c++)
+			{
+				Assert::AreEqual((uint64_t)0, instrumentation::value((instrumentation::counter)c));
+			}
+		}
+
+		TEST_METHOD(FHWA_EvaluationsPerCurveType)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			Assert::AreEqual(1u, curves->size());
+			auto gradient_curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			instrumentation::enabled_scope scope;
+
+			const auto& evaluator = cache.get(gradient_curve);
+			Assert::AreEqual((size_t)2, evaluator.layers().size()); // vertical, horizontal
+
+			uint64_t n = 0;
+			for (double u = evaluator.start(); u <= evaluator.end(); u += 100.0 * cache.length_unit())
+			{
+				evaluator.evaluate(u);
+				n++;
+			}
+
+			Assert::AreEqual(2 * n, instrumentation::value(instrumentation::counter::evaluations));
+			Assert::AreEqual((uint64_t)0, instrumentation::value(instrumentation::counter::segment_searches));
+
+			uint64_t sum = 0;
+			for (const auto& [curve_type, count] : instrumentation::registry::instance().details(instrumentation::counter::evaluations))
+			{
+				sum += count;
+			}
+			Assert::AreEqual(2 * n, sum);
+			Assert::IsTrue(instrumentation::value(instrumentation::counter::evaluations, "IfcCircle") > 0);
+			Assert::IsTrue(instrumentation::value(instrumentation::counter::evaluations, "IfcPolynomialCurve") > 0);
+			Assert::IsTrue(instrumentation::seconds(instrumentation::node_type(*evaluator.function())) > 0.0);
+			Assert::IsTrue(instrumentation::seconds("IfcCircle") > 0.0);
+			Assert::IsTrue(instrumentation::seconds("IfcPolynomialCurve") > 0.0);
+			Assert::IsTrue(instrumentation::seconds("IfcCircle") < instrumentation::seconds(instrumentation::node_type(*evaluator.function())));
+
+			Logger::WriteMessage(instrumentation::report().c_str());
+		}
+
+		// one search per compiled evaluation of a horizontal curve, the quadrature nodes of the clothoids, and a search per
+		// layer when a station_cursor moves back
+		TEST_METHOD(ACCA_CompiledSearchesAndNodes)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			size_t curves = 0;
+			for (auto& c : *file.instances_by_type<Schema::IfcCompositeCurve>())
+			{
+				const auto& evaluator = cache.get(c->as<Schema::IfcCurve>());
+				compiled_alignment compiled(evaluator);
+				if (!compiled.vertical().empty() || !compiled.fully_compiled() || compiled.count(segment_kind::clothoid) == 0)
+					continue;
+				curves++;
+
+				const int n = 1000;
+				uint64_t nodes = 0;
+				{
+					instrumentation::enabled_scope scope;
+					for (int i = 0; i < n; i++)
+					{
+						double u = compiled.start() + (compiled.end() - compiled.start()) * i / (n - 1);
+						compiled.evaluate(u);
+
+						auto it = std::upper_bound(compiled.horizontal().begin(), compiled.horizontal().end(), u, [](double v, const horizontal_record& r) { return v < r.start; });
+						const auto& r = it == compiled.horizontal().begin() ? *it : *(it - 1);
+						if (r.kind == segment_kind::clothoid)
+							nodes += (1 + (int)(compiled::turn_bound<segment_kind::clothoid>(r, u - r.start) / compiled.quadrature().panel_angle)) * compiled.quadrature().points;
+					}
+				}
+				Assert::AreEqual((uint64_t)n, instrumentation::value(instrumentation::counter::segment_searches));
+				Assert::IsTrue(nodes > 0);
+				Assert::AreEqual(nodes, instrumentation::value(instrumentation::counter::integrator_iterations));
+
+				uint64_t layers = 0;
+				for (const auto& layer : evaluator.layers())
+					layers += layer.size() > 1;
+				station_cursor cursor(evaluator);
+				cursor.seek(evaluator.end());
+				{
+					instrumentation::enabled_scope scope;
+					cursor.seek(evaluator.start());
+				}
+				Assert::AreEqual(layers, instrumentation::value(instrumentation::counter::segment_searches));
+			}
+			Assert::IsTrue(curves > 0);
+		}
+
+		TEST_METHOD(FHWA_ResolverMatchesMapping)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcCompositeCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcCompositeCurve>();
+
+			// Example 5.3 and 5.8 style placements, with lateral offsets
+			for (auto offset : { -20.0, -10.0, 0.0, 10.0, 20.0 })
+			{
+				for (auto dist : { 1000.0, 3000.0, 4500.0 })
+				{
+					auto pde = new Schema::IfcPointByDistanceExpression(
+						new Schema::IfcLengthMeasure(dist),
+						offset, boost::none, boost::none,
+						curve);
+
+					auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+					auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+					file.addEntity(lp);
+				}
+			}
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			linear_placement_resolver resolver(cache);
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			for (auto& placement : *placements)
+			{
+				auto expected = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(cache.mapping().map(placement))->ccomponents();
+				auto m = resolver.resolve(placement->as<Schema::IfcLinearPlacement>());
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(expected(row, col), m(row, col), 0.000001);
+					}
+				}
+			}
+			Assert::AreEqual((size_t)1, cache.size());
+		}
+	};
+}
@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "CompiledAlignment.h"
+#include "LinearPlacementResolver.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	// Evaluators with a target output unit, checked against the FHWA tables without scaling the results
+	TEST_CLASS(LengthUnits)
+	{
+	public:
+		// Station, X, Y, Elev of Bridge 1 from Table 6.2 and Table 6.5, feet
+		static std::vector<std::tuple<double, double, double, double>> bridge1()
+		{
+			return {
+				{ 11070, 1398.00, 1918.20, 118.73 }, // Abut 1
+				{ 11200, 1507.10, 1847.51, 121.00 }, // Pier 2
+				{ 11330, 1616.21, 1776.82, 123.13 }, // Pier 3
+				{ 11460, 1725.31, 1706.14, 124.97 }, // Pier 4
+				{ 11590, 1834.41, 1635.45, 126.52 }, // Pier 5
+				{ 11720, 1943.51, 1564.76, 127.78 }, // Pier 6
+				{ 11850, 2052.62, 1494.08, 128.74 }  // Abut 7
+			};
+		}
+
+		// adds the Bridge 1 placements to the file, distance along in feet
+		static std::vector<const Schema::IfcLinearPlacement*> add_bridge1(IfcParse::IfcFile& file, Schema::IfcGradientCurve* gradient_curve)
+		{
+			std::vector<const Schema::IfcLinearPlacement*> placements;
+			for (const auto& ev : bridge1())
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(new Schema::IfcLengthMeasure(std::get<0>(ev) - 10000.0), boost::none, boost::none, boost::none, gradient_curve);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr), nullptr);
+				file.addEntity(lp);
+				placements.push_back(lp);
+			}
+			return placements;
+		}
+
+		TEST_METHOD(FHWA_Feet)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			auto placements = add_bridge1(file, gradient_curve);
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			Assert::AreEqual(units::foot, cache.output_unit(), 1e-12);
+			Assert::AreEqual(1.0, cache.length_unit());
+
+			// Bridge 1, Table 6.2 and Table 6.5
+			linear_placement_resolver resolver(cache);
+			auto expected_values = bridge1();
+			for (size_t i = 0; i < placements.size(); i++)
+			{
+				auto m = resolver.resolve(placements[i]);
+				Assert::AreEqual(1.0, m.determinant(), 1e-7);
+				Assert::AreEqual(std::get<1>(expected_values[i]), m(0, 3), 0.01);
+				Assert::AreEqual(std::get<2>(expected_values[i]), m(1, 3), 0.01);
+				Assert::AreEqual(std::get<3>(expected_values[i]), m(2, 3), 0.01);
+			}
+
+			// vertical curve 1 from Table 3.2, distances along in feet
+			const auto& evaluator = cache.get(gradient_curve);
+			Assert::AreEqual(0.0, evaluator.start(), 1e-9);
+			std::vector<std::pair<double, double>> elevations{
+				{   0.0, 121.00 }, { 160.0, 123.58 }, { 320.0, 125.72 }, { 480.0, 127.42 },
+				{ 640.0, 128.68 }, { 800.0, 129.50 }, { 960.0, 129.88 }, { 1120.0, 129.82 },
+				{ 1280.0, 129.32 }, { 1440.0, 128.38 }, { 1600.0, 127.00 }
+			};
+			for (const auto& [s, elev] : elevations)
+				Assert::AreEqual(elev, evaluator.evaluate(1200.0 + s)(2, 3), 0.01);
+
+			// the PVC of vertical curve 1 is at 1200 ft
+			const auto& vertical = evaluator.layers().front();
+			Assert::AreEqual(1200.0, vertical[vertical.find(1300.0)].start, 1e-6);
+		}
+
+		TEST_METHOD(FHWA_Metres)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			auto placements = add_bridge1(file, gradient_curve);
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::metre);
+			Assert::AreEqual(units::metre, cache.output_unit());
+			Assert::AreEqual(units::foot, cache.length_unit(), 1e-12);
+
+			linear_placement_resolver resolver(cache);
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto expected_values = bridge1();
+			for (size_t i = 0; i < placements.size(); i++)
+			{
+				auto m = resolver.resolve(placements[i]);
+				Assert::AreEqual(std::get<1>(expected_values[i]) * units::foot, m(0, 3), 0.01 * units::foot);
+				Assert::AreEqual(std::get<2>(expected_values[i]) * units::foot, m(1, 3), 0.01 * units::foot);
+				Assert::AreEqual(std::get<3>(expected_values[i]) * units::foot, m(2, 3), 0.01 * units::foot);
+
+				// metres are the units of the mapping, so the result is unchanged
+				auto e = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placements[i]))->ccomponents();
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(e(row, col), m(row, col), 1e-9);
+					}
+				}
+			}
+
+			const auto& evaluator = cache.get(gradient_curve);
+			Assert::AreEqual(129.88 * units::foot, evaluator.evaluate((1200.0 + 960.0) * units::foot)(2, 3), 0.01 * units::foot);
+		}
+
+		// the same curve evaluated in feet and in metres
+		TEST_METHOD(FHWA_Consistency)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache feet(file, settings, units::foot);
+			alignment_cache metres(file, settings);
+
+			const auto& f = feet.get(gradient_curve);
+			const auto& m = metres.get(gradient_curve);
+			Assert::AreEqual(m.end(), f.end() * units::foot, 1e-9);
+			Assert::AreEqual(m.layers().size(), f.layers().size());
+			for (size_t l = 0; l < m.layers().size(); l++)
+			{
+				for (size_t i = 0; i < m.layers()[l].size(); i++)
+					Assert::AreEqual(m.layers()[l][i].start, f.layers()[l][i].start * units::foot, 1e-9);
+			}
+
+			for (double u = f.start(); u <= f.end(); u += 10.0)
+			{
+				Eigen::Matrix4d a = f.evaluate(u);
+				Eigen::Matrix4d b = m.evaluate(u * units::foot);
+				Assert::AreEqual(0.0, (a.block<3, 3>(0, 0) - b.block<3, 3>(0, 0)).norm(), 1e-12);
+				Assert::AreEqual(0.0, (Eigen::Vector3d(a.col(3).head(3) * units::foot) - Eigen::Vector3d(b.col(3).head(3))).norm(), 1e-9);
+			}
+		}
+
+		// records compiled in feet carry the scale, their frames need no conversion and do not pass through the evaluator
+		TEST_METHOD(FHWA_CompiledFeet)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache feet(file, settings, units::foot);
+			alignment_cache metres(file, settings);
+			compiled_alignment f(feet.get(gradient_curve));
+			compiled_alignment m(metres.get(gradient_curve));
+			Assert::IsTrue(f.fully_compiled());
+			Assert::AreEqual(m.horizontal().size(), f.horizontal().size());
+			for (size_t i = 0; i < m.horizontal().size(); i++)
+				Assert::AreEqual(m.horizontal()[i].start, f.horizontal()[i].start * units::foot, 1e-9);
+
+			std::vector<double> stations;
+			for (const auto& ev : bridge1())
+				stations.push_back(std::get<0>(ev) - 10000.0);
+			std::vector<Eigen::Matrix4d> frames(stations.size());
+			{
+				instrumentation::enabled_scope scope;
+				f.evaluate(stations.data(), stations.size(), frames.data());
+				Assert::AreEqual((uint64_t)0, instrumentation::value(instrumentation::counter::evaluations));
+			}
+
+			auto expected = bridge1();
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				Assert::AreEqual(std::get<1>(expected[i]), frames[i](0, 3), 0.01);
+				Assert::AreEqual(std::get<2>(expected[i]), frames[i](1, 3), 0.01);
+				Assert::AreEqual(std::get<3>(expected[i]), frames[i](2, 3), 0.01);
+				Eigen::Matrix4d b = m.evaluate(stations[i] * units::foot);
+				Assert::AreEqual(0.0, (Eigen::Vector3d(frames[i].col(3).head(3) * units::foot) - Eigen::Vector3d(b.col(3).head(3))).norm(), 1e-6);
+			}
+		}
+
+		// a file in metres is evaluated unchanged in model units
+		TEST_METHOD(ACCA_Model)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache model(file, settings, units::model);
+			alignment_cache metres(file, settings);
+			Assert::AreEqual(1.0, model.output_unit());
+
+			linear_placement_resolver a(model), b(metres);
+			for (auto& placement : *file.instances_by_type<Schema::IfcLinearPlacement>())
+			{
+				auto lp = placement->as<Schema::IfcLinearPlacement>();
+				Eigen::Matrix4d ma = a.resolve(lp);
+				Eigen::Matrix4d mb = b.resolve(lp);
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(mb(row, col), ma(row, col));
+					}
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,178 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "Benchmark.h"
+#include "MemoryAccounting.h"
+
+#include <memory>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(MemoryAccounting)
+	{
+	public:
+		// Budgets of the model of MemoryAccounting.h, a quarter above its totals of 127 KB for FHWA and 1.34 MB for ACCA.
+		// They catch changes of the model and of the fixtures, not of the memory use of IfcOpenShell. Raise a budget
+		// deliberately, with the change that needs it, not to make a test pass.
+		static constexpr size_t fhwa_accounted_budget = 160 << 10;
+		static constexpr size_t acca_accounted_budget = 1680 << 10;
+		static constexpr size_t alignment_budget = 1 << 20;
+
+		// The heap growth of loading a fixture is the measurement that catches IfcOpenShell using more memory. It is
+		// recorded in loaded_path with IFCOS_BENCHMARK_UPDATE=1, like the benchmark baselines, and a load may grow the
+		// heap by at most loaded_margin times its recording. Without a recording the test fails.
+		static constexpr const char* loaded_path = "../../Files/memory_baselines.csv";
+		static constexpr double loaded_margin = 1.05;
+
+		// Sanity check of the model: it leaves out the parser's buffers and caches, so the accounted total is at most
+		// the heap growth of loading the file and at least this fraction of it
+		static constexpr size_t accounted_factor = 8;
+
+		static void check_loaded(const std::string& metric, size_t loaded)
+		{
+			benchmark::baseline_store store(loaded_path, "Heap growth of loading the fixtures, see Test_MemoryAccounting.cpp", "bytes");
+			if (benchmark::environment("IFCOS_BENCHMARK_UPDATE") == "1")
+			{
+				store.set(metric, (double)loaded);
+				store.save();
+				return;
+			}
+
+			std::wostringstream os;
+			os << metric.c_str();
+			if (!store.has(metric))
+			{
+				os << L" has no recorded heap growth in " << loaded_path << L", record it with IFCOS_BENCHMARK_UPDATE=1";
+				Assert::Fail(os.str().c_str());
+			}
+			os << L" grew the heap by " << loaded << L" bytes, recorded " << store.get(metric);
+			Assert::IsTrue(loaded <= store.get(metric) * loaded_margin, os.str().c_str());
+		}
+
+		// Loads path and checks the accounted breakdown against itself, the heap growth and the budgets
+		static file_footprint check_file(const std::string& path, const std::string& metric, size_t accounted_budget)
+		{
+			// a first load, so that the schema and other one-off allocations are not measured
+			{ IfcParse::IfcFile warm_up(path); }
+
+			size_t before = heap_bytes_in_use();
+			auto file = std::make_unique<IfcParse::IfcFile>(path);
+			size_t loaded = heap_bytes_in_use() - before;
+			Assert::IsTrue(file->good());
+
+			auto footprint = account(*file);
+			std::ostringstream os;
+			os << path << ": " << loaded << " bytes loaded, " << footprint.report(10);
+			Logger::WriteMessage(os.str().c_str());
+
+			size_t instances = 0, instance_bytes = 0, attribute_bytes = 0;
+			for (auto it = file->begin(); it != file->end(); ++it)
+				instances += it->second->declaration().as_entity() != nullptr;
+			for (const auto& [name, t] : footprint.types)
+			{
+				Assert::IsTrue(t.instances > 0);
+				instance_bytes += t.instance_bytes;
+				attribute_bytes += t.attribute_bytes;
+			}
+			Assert::AreEqual(instances, footprint.instances);
+			Assert::AreEqual(footprint.instance_bytes, instance_bytes);
+			Assert::AreEqual(footprint.attribute_bytes, attribute_bytes);
+			Assert::IsTrue(footprint.types.count("IfcCurveSegment") == 1);
+			Assert::IsTrue(footprint.inverse_bytes > 0);
+			Assert::IsTrue(footprint.index_bytes > 0);
+
+			Assert::IsTrue(footprint.total() <= loaded);
+			Assert::IsTrue(footprint.total() * accounted_factor >= loaded);
+			Assert::IsTrue(footprint.total() <= accounted_budget);
+			check_loaded(metric, loaded);
+			return footprint;
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			auto footprint = check_file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc", "FHWA/loaded", fhwa_accounted_budget);
+			Assert::AreEqual((size_t)276, footprint.instances);
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			auto footprint = check_file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc", "ACCA/loaded", acca_accounted_budget);
+			Assert::AreEqual((size_t)2749, footprint.instances);
+		}
+
+		// the model, exactly, for a few instances
+		TEST_METHOD(Model)
+		{
+			IfcHierarchyHelper<Schema> file;
+			aggregate_of<Schema::IfcCartesianPoint>::ptr points(new aggregate_of<Schema::IfcCartesianPoint>());
+			for (double x : { 0.0, 1.0, 2.0 })
+				points->push(new Schema::IfcCartesianPoint(std::vector<double>{ x, 0.0, 0.0 }));
+			file.addEntity(new Schema::IfcPolyline(points));
+
+			auto footprint = account(file);
+			Assert::AreEqual((size_t)4, footprint.instances);
+
+			const auto& point = footprint.types.at("IfcCartesianPoint");
+			Assert::AreEqual((size_t)3, point.instances);
+			Assert::AreEqual(3 * (memory_model::instance + memory_model::attribute_slot + 2 * memory_model::heap_block), point.instance_bytes);
+			Assert::AreEqual(3 * (3 * sizeof(double) + memory_model::heap_block), point.attribute_bytes);
+			Assert::AreEqual((size_t)0, point.references);
+
+			const auto& polyline = footprint.types.at("IfcPolyline");
+			Assert::AreEqual((size_t)3, polyline.references);
+			Assert::AreEqual(memory_model::aggregate + 3 * sizeof(void*) + 2 * memory_model::heap_block, polyline.attribute_bytes);
+
+			// one inverse entry per point
+			Assert::AreEqual(3 * (memory_model::map_node + 2 * sizeof(uint64_t) + memory_model::vector + 2 * memory_model::heap_block) + 3 * sizeof(int), footprint.inverse_bytes);
+		}
+
+		static alignment_footprint check_alignment(IfcParse::IfcFile& file, const Schema::IfcCurve* curve, double output_unit)
+		{
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, output_unit);
+			const auto& evaluator = cache.get(curve);
+			compiled_alignment compiled(evaluator);
+
+			// a mapping of its own, so that nothing is mapped yet
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto footprint = account(*mapping, evaluator, &compiled);
+			Logger::WriteMessage((curve->declaration().name() + ": " + footprint.report()).c_str());
+
+			size_t segments = 0;
+			for (const auto& layer : evaluator.layers())
+				segments += layer.size();
+			Assert::IsTrue(footprint.taxonomy.node_count() > 0);
+			Assert::IsTrue(footprint.taxonomy.bytes > 0);
+			Assert::IsTrue(footprint.segment_table_bytes >= segments * sizeof(segment_record));
+			Assert::AreEqual(compiled.bytes(), footprint.compiled_bytes);
+			Assert::IsTrue(footprint.total() <= alignment_budget);
+			return footprint;
+		}
+
+		TEST_METHOD(FHWA_Alignment)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			check_alignment(file, gradient_curve, units::model);
+		}
+
+		TEST_METHOD(ACCA_Alignment)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+			check_alignment(file, curve, units::metre);
+		}
+	};
+}
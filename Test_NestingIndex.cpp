@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+
+#include "NestingIndex.h"
+#include "TestModels.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(NestingIndex)
+	{
+	public:
+		// children and parent of every object of the file against the inverse attributes, on 1 to 8 threads
+		static void check_inverses(IfcParse::IfcFile& file)
+		{
+			std::vector<nesting_index> indices;
+			for (size_t threads : { 1, 2, 8 })
+				indices.emplace_back(file, threads);
+
+			size_t mismatches = 0;
+			for (auto& object : *file.instances_by_type<Schema::IfcObjectDefinition>())
+			{
+				auto rels = object->IsNestedBy();
+				std::vector<const Schema::IfcRelNests*> sorted(rels->begin(), rels->end());
+				std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->id() < b->id(); });
+				std::vector<nesting_index::object> expected;
+				for (auto rel : sorted)
+				{
+					for (auto& child : *rel->RelatedObjects())
+						expected.push_back(child);
+				}
+
+				auto nests = object->Nests();
+				nesting_index::object parent = nests->size() ? (*nests->begin())->RelatingObject() : nullptr;
+				for (const auto& index : indices)
+				{
+					auto children = index.children(object);
+					mismatches += !std::equal(children.begin(), children.end(), expected.begin(), expected.end());
+					mismatches += index.parent(object) != parent;
+				}
+			}
+			Assert::AreEqual((size_t)0, mismatches);
+			Assert::AreEqual((size_t)file.instances_by_type<Schema::IfcRelNests>()->size(), indices.front().relationships());
+		}
+
+		// segments of layout, checking that they are nested under it and carry design parameters of type Design
+		template <typename Design>
+		static size_t count_segments(const nesting_index& index, const Schema::IfcLinearElement* layout)
+		{
+			size_t n = 0;
+			for (auto segment : index.segments(layout))
+			{
+				auto s = segment->as<Schema::IfcAlignmentSegment>();
+				Assert::IsNotNull(s);
+				Assert::IsNotNull(s->DesignParameters()->as<Design>());
+				Assert::IsTrue(index.parent(segment) == layout);
+				n++;
+			}
+			return n;
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			check_inverses(file);
+
+			nesting_index index(file);
+			auto alignment = (*(file.instances_by_type<Schema::IfcAlignment>()->begin()))->as<Schema::IfcAlignment>();
+			auto layouts = index.layouts(alignment);
+			Assert::IsNotNull(layouts.horizontal);
+			Assert::IsNotNull(layouts.vertical);
+			Assert::IsNull(layouts.cant);
+			Assert::AreEqual(31, (int)layouts.horizontal->id());
+			Assert::AreEqual(117, (int)layouts.vertical->id());
+			Assert::AreEqual((size_t)8, count_segments<Schema::IfcAlignmentHorizontalSegment>(index, layouts.horizontal));
+			Assert::AreEqual(file.instances_by_type<Schema::IfcAlignmentVerticalSegment>()->size(), count_segments<Schema::IfcAlignmentVerticalSegment>(index, layouts.vertical));
+			Assert::IsTrue(index.parent(alignment) == nullptr);
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			for (auto path : { "../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc", "../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc" })
+			{
+				IfcParse::IfcFile file(path);
+				check_inverses(file);
+
+				nesting_index index(file);
+				auto alignment = (*(file.instances_by_type<Schema::IfcAlignment>()->begin()))->as<Schema::IfcAlignment>();
+				auto layouts = index.layouts(alignment);
+				Assert::AreEqual((size_t)3, count_segments<Schema::IfcAlignmentHorizontalSegment>(index, layouts.horizontal));
+				Assert::AreEqual((size_t)1, count_segments<Schema::IfcAlignmentVerticalSegment>(index, layouts.vertical));
+				Assert::AreEqual((size_t)4, count_segments<Schema::IfcAlignmentCantSegment>(index, layouts.cant));
+				Assert::AreEqual((size_t)4, index.parents());
+			}
+		}
+
+		TEST_METHOD(Synthetic)
+		{
+			IfcHierarchyHelper<Schema> file;
+			add_nested_alignments(file, 100, 5, 3, 2);
+			check_inverses(file);
+
+			nesting_index index(file, 4);
+			Assert::AreEqual((size_t)400, index.relationships());
+			for (auto& alignment : *file.instances_by_type<Schema::IfcAlignment>())
+			{
+				auto layouts = index.layouts(alignment);
+				Assert::AreEqual((size_t)5, count_segments<Schema::IfcAlignmentHorizontalSegment>(index, layouts.horizontal));
+				Assert::AreEqual((size_t)3, count_segments<Schema::IfcAlignmentVerticalSegment>(index, layouts.vertical));
+				Assert::AreEqual((size_t)2, count_segments<Schema::IfcAlignmentCantSegment>(index, layouts.cant));
+			}
+
+			// objects without children
+			auto segment = index.segments(index.layouts(*file.instances_by_type<Schema::IfcAlignment>()->begin()).horizontal)[0];
+			Assert::IsTrue(index.children(segment).empty());
+			Assert::IsTrue(index.segments(nullptr).empty());
+			Assert::IsTrue(nesting_index().children(1).empty());
+		}
+	};
+}
@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "ParallelEvaluation.h"
+
+#include <random>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	// One batch of stations split over threads, bit-identical to the serial path for any number of threads
+	TEST_CLASS(ParallelEvaluation)
+	{
+	public:
+		static std::vector<double> stations(const alignment_evaluator& evaluator, size_t n)
+		{
+			std::vector<double> u;
+			for (size_t i = 0; i < n; i++)
+				u.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / (n - 1));
+			return u;
+		}
+
+		static size_t mismatches(const std::vector<Eigen::Matrix4d>& frames, const std::vector<Eigen::Matrix4d>& expected)
+		{
+			Assert::AreEqual(expected.size(), frames.size());
+			size_t n = 0;
+			for (size_t i = 0; i < frames.size(); i++)
+				n += frames[i] != expected[i];
+			return n;
+		}
+
+		// the tree walk and the compiled records, in station order and shuffled, on 1 to 64 threads
+		static void check(const alignment_evaluator& evaluator, size_t n)
+		{
+			compiled_alignment compiled(evaluator);
+			auto u = stations(evaluator, n);
+			std::vector<double> shuffled = u;
+			std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(45));
+
+			for (const auto& batch : { u, shuffled })
+			{
+				std::vector<Eigen::Matrix4d> expected;
+				for (auto v : batch)
+					expected.push_back(evaluator.evaluate(v));
+				auto expected_compiled = compiled.evaluate(batch);
+
+				for (size_t threads : { 1, 2, 3, 8, 64 })
+				{
+					Assert::AreEqual((size_t)0, mismatches(parallel_evaluator(evaluator, threads).evaluate(batch), expected));
+					Assert::AreEqual((size_t)0, mismatches(parallel_evaluator(compiled, threads).evaluate(batch), expected_compiled));
+				}
+			}
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			check(cache.get(horizontal), 5000);
+			check(cache.get(gradient_curve), 5000);
+		}
+
+		// generic records evaluated through a cursor per thread
+		TEST_METHOD(ACCA_SegmentedReferenceCurve)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			check(cache.get(curve), 2000);
+		}
+
+		// ascending stations are cut at segment boundaries, or at the even split where no boundary is near
+		TEST_METHOD(Partition)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+			std::vector<double> boundaries;
+			for (const auto& layer : evaluator.layers())
+			{
+				for (const auto& s : layer.segments())
+					boundaries.push_back(s.start);
+			}
+
+			auto u = stations(evaluator, 100000);
+			std::ostringstream os;
+			for (size_t threads : { 2, 4, 8 })
+			{
+				auto cuts = parallel_evaluator(evaluator, threads).partition(u.data(), u.size());
+				Assert::AreEqual((size_t)0, cuts.front());
+				Assert::AreEqual(u.size(), cuts.back());
+				Assert::IsTrue(cuts.size() <= threads + 1);
+
+				os << threads << " threads:";
+				for (size_t k = 1; k + 1 < cuts.size(); k++)
+				{
+					size_t cut = cuts[k];
+					Assert::IsTrue(cut > cuts[k - 1]);
+					bool boundary = std::any_of(boundaries.begin(), boundaries.end(), [&](double b) { return u[cut - 1] < b && b <= u[cut]; });
+					size_t even = u.size() * k / threads;
+					Assert::IsTrue(boundary || cut == even);
+					Assert::IsTrue((cut > even ? cut - even : even - cut) <= u.size() / threads / 4);
+					os << " " << cut << (boundary ? " (boundary)" : "");
+				}
+				os << "\n";
+			}
+			Logger::WriteMessage(os.str().c_str());
+
+			// fewer stations than threads, and none
+			Assert::AreEqual((size_t)3, parallel_evaluator(evaluator, 8).partition(u.data(), 2).size());
+			Assert::AreEqual((size_t)1, parallel_evaluator(evaluator, 8).partition(u.data(), 0).size());
+			Assert::IsTrue(parallel_evaluator(evaluator, 8).evaluate(std::vector<double>()).empty());
+		}
+
+		// records loaded without an evaluator throw on generic records, on whichever thread reaches them
+		TEST_METHOD(Errors)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(horizontal);
+			compiled_alignment compiled(evaluator);
+
+			auto records = compiled.horizontal();
+			records.back().kind = segment_kind::generic;
+			compiled_alignment loaded(records, {}, compiled.start(), compiled.end(), compiled.tolerance());
+			auto u = stations(evaluator, 1000);
+			Assert::ExpectException<std::logic_error>([&]() { parallel_evaluator(loaded, 4).evaluate(u); });
+
+			// stations before the generic record do not need an evaluator
+			std::vector<double> head(u.begin(), std::lower_bound(u.begin(), u.end(), records.back().start));
+			Assert::AreEqual((size_t)0, mismatches(parallel_evaluator(loaded, 4).evaluate(head), compiled.evaluate(head)));
+		}
+	};
+}
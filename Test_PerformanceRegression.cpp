@@ -0,0 +1,814 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+#include <ifcgeom/function_item_evaluator.h>
+
+#include "RailRoomTestset.h"
+#include "Benchmark.h"
+#include "AdaptiveTessellation.h"
+#include "PlacementBuilder.h"
+#include "StepWriter.h"
+#include "CompiledAlignment.h"
+#include "AlignmentStore.h"
+#include "PolylineIndex.h"
+#include "ColumnarExport.h"
+#include "ParallelEvaluation.h"
+#include "CompactAttributes.h"
+#include "NestingIndex.h"
+#include "PlacementResolver.h"
+#include "TestModels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace IfcOpenShellUnitTests;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	// Benchmarks of the FHWA, ACCA and RailRoom fixtures, compared against the baselines in Files/benchmark_baselines.csv.
+	// See Benchmark.h for the threshold and for recording new baselines.
+	TEST_CLASS(PerformanceRegression)
+	{
+	public:
+		static constexpr const char* baseline_path = "../../Files/benchmark_baselines.csv";
+
+		static void check(benchmark::regression_gate& gate)
+		{
+			gate.save();
+			Logger::WriteMessage(gate.table().c_str());
+			auto missing = gate.missing();
+			if (!missing.empty())
+			{
+				std::wostringstream os;
+				os << missing.size() << L" metrics without a baseline in " << baseline_path << L", record them with IFCOS_BENCHMARK_UPDATE=1:";
+				for (const auto& metric : missing)
+					os << L" " << metric.c_str();
+				Assert::Fail(os.str().c_str());
+			}
+			for (const auto& r : gate.results())
+			{
+				std::wostringstream os;
+				os << r.metric.c_str() << L" is " << r.ratio() << L" times its baseline (threshold " << gate.threshold() << L")";
+				Assert::IsFalse(r.regressed, os.str().c_str());
+			}
+		}
+
+		// evaluates n evenly spaced stations along fn
+		static void evaluate_stations(const ifcopenshell::geometry::function_item_evaluator& evaluator, double start, double end, int n)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				evaluator.evaluate(start + (end - start) * i / (n - 1));
+			}
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			auto gradient_curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			// placements along the gradient curve, as in FHWA_Bridge_Geometry_Alignment_Example::Vertical_Curve
+			for (int i = 0; i < 100; i++)
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(
+					new Schema::IfcLengthMeasure(50.0 * i),
+					boost::none, boost::none, boost::none,
+					gradient_curve);
+
+				auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+				file.addEntity(lp);
+			}
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping->map(gradient_curve));
+			ifcopenshell::geometry::function_item_evaluator evaluator(settings, fn);
+
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("FHWA/IfcGradientCurve/evaluate", "IfcGradientCurve", [&]() { evaluate_stations(evaluator, fn->start(), fn->end(), 10000); });
+
+			// the tree walk against the compiled records, in station order and in random order
+			alignment_evaluator tree(settings, gradient_curve, fn, mapping->get_length_unit());
+			compiled_alignment compiled(tree);
+			std::vector<double> random_stations;
+			std::mt19937 generator(38);
+			std::uniform_real_distribution<double> station(tree.start(), tree.end());
+			for (int i = 0; i < 10000; i++)
+				random_stations.push_back(station(generator));
+			gate.run("FHWA/IfcGradientCurve/compiled", "IfcGradientCurve", [&]()
+			{
+				for (int i = 0; i < 10000; i++)
+					compiled.evaluate(tree.start() + (tree.end() - tree.start()) * i / 9999);
+			});
+			std::vector<double> ascending;
+			for (int i = 0; i < 10000; i++)
+				ascending.push_back(tree.start() + (tree.end() - tree.start()) * i / 9999);
+			gate.run("FHWA/IfcGradientCurve/compiled_batch", "IfcGradientCurve", [&]() { compiled.evaluate(ascending); });
+			gate.run("FHWA/IfcGradientCurve/evaluate_random", "IfcGradientCurve", [&]() { for (auto u : random_stations) tree.evaluate(u); });
+			gate.run("FHWA/IfcGradientCurve/compiled_random", "IfcGradientCurve", [&]() { for (auto u : random_stations) compiled.evaluate(u); });
+
+			// gradient and vertical curvature from the records against the slope of frames and a difference
+			gate.run("FHWA/IfcGradientCurve/derived", "IfcGradientCurve", [&]() { compiled.derived(ascending); });
+			gate.run("FHWA/IfcGradientCurve/derived_from_frames", "IfcGradientCurve", [&]()
+			{
+				const double h = 1e-3;
+				for (auto u : ascending)
+				{
+					auto m = compiled.evaluate(u);
+					auto a = compiled.evaluate(u - h), b = compiled.evaluate(u + h);
+					volatile double slope = m(2, 0) / std::hypot(m(0, 0), m(1, 0));
+					volatile double curvature = (std::atan(compiled::gradient(b)) - std::atan(compiled::gradient(a))) / (2 * h);
+				}
+			});
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			gate.run("FHWA/IfcLinearPlacement/map", "IfcLinearPlacement", [&]()
+			{
+				for (auto& placement : *placements)
+				{
+					mapping->map(placement);
+				}
+			});
+
+			check(gate);
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcSegmentedReferenceCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto fn = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::function_item>(mapping->map(curve));
+			ifcopenshell::geometry::function_item_evaluator evaluator(settings, fn);
+
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("ACCA/IfcSegmentedReferenceCurve/evaluate", "IfcSegmentedReferenceCurve", [&]() { evaluate_stations(evaluator, fn->start(), fn->end(), 10000); });
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			gate.run("ACCA/IfcLinearPlacement/map", "IfcLinearPlacement", [&]()
+			{
+				for (int i = 0; i < 100; i++)
+				{
+					for (auto& placement : *placements)
+					{
+						mapping->map(placement);
+					}
+				}
+			});
+
+			check(gate);
+		}
+
+		// process startup without and with the alignment_store: parse, map and compile against parse, hash and load
+		TEST_METHOD(FHWA_Startup)
+		{
+			const std::string path = "../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc";
+			alignment_store store((std::filesystem::temp_directory_path() / "IfcOpenShellUnitTests" / "FHWA_Startup").string());
+
+			benchmark::regression_gate gate(baseline_path);
+			auto cold = gate.run("FHWA/startup/cold", "startup", [&]()
+			{
+				IfcParse::IfcFile file(path);
+				auto curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+				ifcopenshell::geometry::Settings settings;
+				alignment_cache cache(file, settings, units::model);
+				compiled_alignment compiled(cache.get(curve));
+				if (!store.contains(alignment_store::key(file, compiled.evaluator())))
+					store.save(alignment_store::key(file, compiled.evaluator()), compiled);
+			}, 3);
+			auto warm = gate.run("FHWA/startup/warm", "startup", [&]()
+			{
+				IfcParse::IfcFile file(path);
+				auto curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+				ifcopenshell::geometry::Settings settings;
+				std::unique_ptr<ifcopenshell::geometry::abstract_mapping> mapping(ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings));
+				auto compiled = store.load(alignment_store::key(file, curve, mapping->get_length_unit(), units::model));
+				Assert::IsNotNull(compiled.get());
+			}, 3);
+
+			std::ostringstream os;
+			os << "cold start " << cold.seconds << " s, warm start " << warm.seconds << " s\n";
+			Logger::WriteMessage(os.str().c_str());
+			check(gate);
+		}
+
+		// adaptive tessellation against uniform tessellation with the same maximum chord deviation
+		TEST_METHOD(FHWA_Tessellation)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			auto gradient_curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(gradient_curve);
+
+			const double tolerance = 0.001;
+			auto step = adaptive_tessellator(evaluator, tolerance).min_step();
+
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("FHWA/tessellation/adaptive", "tessellation", [&]() { adaptive_tessellator(evaluator, tolerance).tessellate(); });
+			gate.run("FHWA/tessellation/uniform", "tessellation", [&]() { tessellate_uniform(evaluator, step); });
+
+			std::ostringstream os;
+			os << "vertices at " << tolerance << " m: adaptive " << adaptive_tessellator(evaluator, tolerance).tessellate().size()
+				<< ", uniform " << tessellate_uniform(evaluator, step).size() << "\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// construction of many sleeper placements, one entity at a time and with linear_placement_builder
+		TEST_METHOD(PlacementConstruction)
+		{
+			const size_t n = 50000;
+			std::vector<double> distance(n), lateral(n, 0.0), vertical(n, 0.0), longitudinal(n, 0.0);
+			for (size_t i = 0; i < n; i++)
+				distance[i] = 0.6 * i;
+
+			auto new_file = [](IfcHierarchyHelper<Schema>& file) -> Schema::IfcCurve*
+			{
+				aggregate_of<Schema::IfcCartesianPoint>::ptr points(new aggregate_of<Schema::IfcCartesianPoint>());
+				points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }));
+				points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 30000.0, 0.0 }));
+				auto curve = new Schema::IfcPolyline(points);
+				file.addEntity(curve);
+				return curve;
+			};
+
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("IfcLinearPlacement/construct/per_entity", "construction", [&]()
+			{
+				IfcHierarchyHelper<Schema> file;
+				auto curve = new_file(file);
+				for (size_t i = 0; i < n; i++)
+				{
+					auto pde = new Schema::IfcPointByDistanceExpression(
+						new Schema::IfcLengthMeasure(distance[i]),
+						lateral[i], vertical[i], longitudinal[i],
+						curve);
+
+					auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+					auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+					file.addEntity(lp);
+				}
+			}, 3);
+			gate.run("IfcLinearPlacement/construct/bulk", "construction", [&]()
+			{
+				IfcHierarchyHelper<Schema> file;
+				auto curve = new_file(file);
+				linear_placement_builder(file).add(curve, distance, lateral, vertical, longitudinal);
+			}, 3);
+
+			check(gate);
+		}
+
+		// serialisation of a generated model with IfcFile's stream operator and with step_writer
+		TEST_METHOD(StepSerialisation)
+		{
+			IfcHierarchyHelper<Schema> file;
+			aggregate_of<Schema::IfcCartesianPoint>::ptr points(new aggregate_of<Schema::IfcCartesianPoint>());
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }));
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 30000.0, 0.0 }));
+			auto curve = new Schema::IfcPolyline(points);
+			file.addEntity(curve);
+
+			std::vector<double> distance(50000), lateral(50000, 1.5);
+			for (size_t i = 0; i < distance.size(); i++)
+				distance[i] = 0.6 * i;
+			linear_placement_builder(file).add(curve, distance, lateral);
+
+			const char* path = "step_serialisation_benchmark.ifc";
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("IfcFile/write/stream_operator", "serialisation", [&]()
+			{
+				std::ofstream ofile(path, std::ios::binary);
+				ofile << file;
+			}, 3);
+			gate.run("IfcFile/write/step_writer", "serialisation", [&]()
+			{
+				std::ofstream ofile(path, std::ios::binary);
+				step_writer(ofile).write(file);
+			}, 3);
+			std::remove(path);
+
+			check(gate);
+		}
+
+		// distance queries on a million-vertex IfcIndexedPolyCurve: building the index, single queries, sorted batches
+		// and the mapping of placements
+		TEST_METHOD(PolylineIndex)
+		{
+			const size_t n = 1000000;
+			std::vector<std::vector<double>> coordinates(n);
+			double x = 0.0;
+			for (size_t i = 0; i < n; i++, x += 1.0 + 0.5 * sin(0.1 * i))
+				coordinates[i] = { x, 50.0 * sin(x / 5000.0), 10.0 * sin(x / 20000.0) };
+
+			IfcHierarchyHelper<Schema> file;
+			auto curve = new Schema::IfcIndexedPolyCurve(new Schema::IfcCartesianPointList3D(coordinates, boost::none), boost::none, boost::none);
+			file.addEntity(curve);
+
+			auto index = polyline_index::from_curve(curve);
+			std::vector<double> u(100000);
+			for (size_t i = 0; i < u.size(); i++)
+				u[i] = index.length() * i / (u.size() - 1);
+
+			benchmark::regression_gate gate(baseline_path);
+			gate.run("IfcIndexedPolyCurve/1M/index_build", "polyline", [&]() { polyline_index::from_curve(curve); }, 3);
+			gate.run("IfcIndexedPolyCurve/1M/index_single", "polyline", [&]() { for (auto v : u) index.frame(v); });
+			auto batch = gate.run("IfcIndexedPolyCurve/1M/index_batch", "polyline", [&]() { index.frames(u); });
+
+			// the mapping interprets the whole curve for every placement, so a few placements suffice
+			for (size_t i = 0; i < 10; i++)
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(new Schema::IfcLengthMeasure(u[i * u.size() / 10]), boost::none, boost::none, boost::none, curve);
+				file.addEntity(new Schema::IfcLinearPlacement(nullptr, new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr), nullptr));
+			}
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = std::unique_ptr<ifcopenshell::geometry::abstract_mapping>(ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings));
+			auto map = gate.run("IfcIndexedPolyCurve/1M/map", "polyline", [&]()
+			{
+				for (auto& placement : *file.instances_by_type<Schema::IfcLinearPlacement>())
+					mapping->map(placement);
+			}, 3);
+
+			std::ostringstream os;
+			os << "per query: mapping " << map.seconds / 10 << " s, batch " << batch.seconds / u.size() << " s\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// columnar export of FHWA and of the RailRoom cant testcases on one and on all hardware threads, against copying
+		// the columns of every frame into rows
+		TEST_METHOD(ColumnarExport)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+			std::vector<double> u;
+			for (int i = 0; i < 100000; i++)
+				u.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / 99999);
+
+			const std::string path = (std::filesystem::temp_directory_path() / "columnar_export_benchmark.frames").string();
+			benchmark::regression_gate gate(baseline_path);
+			auto rows = gate.run("FHWA/export/row_copy", "export", [&]()
+			{
+				std::vector<double> values;
+				values.reserve(u.size() * frame_columns);
+				for (auto s : u)
+				{
+					Eigen::Matrix4d m = evaluator.evaluate(s);
+					values.push_back(s);
+					for (int col : { 3, 0, 1, 2 })
+					{
+						for (int row = 0; row < 3; row++)
+							values.push_back(m(row, col));
+					}
+					values.push_back(std::atan2(m(2, 1), m(2, 2)));
+					values.push_back(m(2, 0) / std::hypot(m(0, 0), m(1, 0)));
+				}
+				std::ofstream os(path, std::ios::binary);
+				os.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+			}, 3);
+			auto single = gate.run("FHWA/export/columnar_1", "export", [&]()
+			{
+				frame_writer writer(path);
+				writer.add("gradient", evaluator, u, 1);
+			}, 3);
+			auto parallel = gate.run("FHWA/export/columnar", "export", [&]()
+			{
+				frame_writer writer(path);
+				writer.add("gradient", evaluator, u);
+			}, 3);
+
+			std::vector<std::unique_ptr<IfcRailRoom::testcase>> testcases;
+			std::vector<std::unique_ptr<alignment_evaluator>> evaluators;
+			std::vector<std::vector<double>> stations;
+			size_t railroom_rows = 0;
+			for (const auto& curve_type : IfcRailRoom::curve_types(IfcRailRoom::Layout::Cant))
+			{
+				for (const auto& test_name : IfcRailRoom::test_names(IfcRailRoom::Layout::Cant))
+				{
+					auto tc = IfcRailRoom::load_testcase(IfcRailRoom::Layout::Cant, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+					evaluators.push_back(std::make_unique<alignment_evaluator>(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit()));
+					testcases.push_back(std::move(tc));
+					stations.emplace_back();
+					for (double s = evaluators.back()->start(); s < evaluators.back()->end(); s += 0.05)
+						stations.back().push_back(s);
+					railroom_rows += stations.back().size();
+				}
+			}
+			auto railroom = gate.run("RailRoom/Cant/export/columnar", "export", [&]()
+			{
+				frame_writer writer(path);
+				for (size_t i = 0; i < evaluators.size(); i++)
+					writer.add(std::to_string(i), *evaluators[i], stations[i]);
+			}, 3);
+			std::remove(path.c_str());
+
+			const double megabytes = frame_columns * sizeof(double) / 1e6;
+			std::ostringstream os;
+			os << "FHWA: " << u.size() << " rows, row copy " << u.size() * megabytes / rows.seconds << " MB/s, columnar "
+				<< u.size() * megabytes / single.seconds << " MB/s on one thread, " << u.size() * megabytes / parallel.seconds << " MB/s on "
+				<< std::thread::hardware_concurrency() << " threads\n"
+				<< "RailRoom cant: " << railroom_rows << " rows, " << railroom_rows * megabytes / railroom.seconds << " MB/s\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// Strong scaling of one batch of stations along the FHWA gradient curve on 1 to 8 threads, through the taxonomy
+		// and through the compiled records. The thread counts are fixed so that the metrics are the same on every
+		// machine, all hardware threads are timed for the log only.
+		TEST_METHOD(ParallelScaling)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+			compiled_alignment compiled(evaluator);
+
+			std::vector<double> tree_stations, compiled_stations;
+			for (int i = 0; i < 100000; i++)
+				tree_stations.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / 99999);
+			for (int i = 0; i < 1000000; i++)
+				compiled_stations.push_back(evaluator.start() + (evaluator.end() - evaluator.start()) * i / 999999);
+
+			benchmark::regression_gate gate(baseline_path);
+			std::ostringstream os;
+			os << std::thread::hardware_concurrency() << " hardware threads\n";
+			double tree_single = 0.0, compiled_single = 0.0;
+			for (size_t threads : { 1, 2, 4, 8 })
+			{
+				parallel_evaluator tree(evaluator, threads), records(compiled, threads);
+				auto t = gate.run("FHWA/parallel/evaluate_" + std::to_string(threads), "parallel", [&]() { tree.evaluate(tree_stations); }, 3);
+				auto c = gate.run("FHWA/parallel/compiled_" + std::to_string(threads), "parallel", [&]() { records.evaluate(compiled_stations); }, 3);
+				if (threads == 1)
+				{
+					tree_single = t.seconds;
+					compiled_single = c.seconds;
+				}
+				os << threads << " threads: evaluate speedup " << tree_single / t.seconds << " (efficiency " << tree_single / t.seconds / threads
+					<< "), compiled speedup " << compiled_single / c.seconds << " (efficiency " << compiled_single / c.seconds / threads << ")\n";
+			}
+			{
+				size_t threads = std::max(1u, std::thread::hardware_concurrency());
+				parallel_evaluator tree(evaluator, threads), records(compiled, threads);
+				auto t = benchmark::median_seconds([&]() { tree.evaluate(tree_stations); }, 3);
+				auto c = benchmark::median_seconds([&]() { records.evaluate(compiled_stations); }, 3);
+				os << threads << " threads (not gated): evaluate speedup " << tree_single / t << ", compiled speedup " << compiled_single / c << "\n";
+			}
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// Loading the ACCA file, copying its numeric instances into compact_attributes, and reading every number of
+		// those instances from the store and through get_attribute_value()
+		TEST_METHOD(CompactAttributes)
+		{
+			const std::string path = "../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc";
+			IfcParse::IfcFile file(path);
+			compact_attributes store(file);
+			auto ids = store.ids();
+
+			benchmark::regression_gate gate(baseline_path);
+			auto load = gate.run("ACCA/attributes/load", "attributes", [&]() { IfcParse::IfcFile loaded(path); }, 3);
+			auto build = gate.run("ACCA/attributes/compact_build", "attributes", [&]() { compact_attributes built(file); });
+
+			double compact_sum = 0.0, file_sum = 0.0;
+			auto compact = gate.run("ACCA/attributes/compact_read", "attributes", [&]()
+			{
+				compact_sum = 0.0;
+				for (auto id : ids)
+				{
+					for (size_t i = 0; i < store.attribute_count(id); i++)
+					{
+						switch (store.type(id, i))
+						{
+						case IfcUtil::Argument_AGGREGATE_OF_INT:
+						case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+							for (auto v : store.integers(id, i))
+								compact_sum += v;
+							break;
+						case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+						case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+							for (auto v : store.reals(id, i))
+								compact_sum += v;
+							break;
+						default:
+							break;
+						}
+					}
+				}
+			});
+			auto generic = gate.run("ACCA/attributes/generic_read", "attributes", [&]()
+			{
+				file_sum = 0.0;
+				for (auto id : ids)
+				{
+					auto inst = file.instance_by_id(id);
+					for (size_t i = 0; i < store.attribute_count(id); i++)
+					{
+						auto value = inst->get_attribute_value(i);
+						switch (value.type())
+						{
+						case IfcUtil::Argument_AGGREGATE_OF_INT:
+							for (auto v : (std::vector<int>)value)
+								file_sum += v;
+							break;
+						case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_INT:
+							for (const auto& row : (std::vector<std::vector<int>>)value)
+								for (auto v : row)
+									file_sum += v;
+							break;
+						case IfcUtil::Argument_AGGREGATE_OF_DOUBLE:
+							for (auto v : (std::vector<double>)value)
+								file_sum += v;
+							break;
+						case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_DOUBLE:
+							for (const auto& row : (std::vector<std::vector<double>>)value)
+								for (auto v : row)
+									file_sum += v;
+							break;
+						default:
+							break;
+						}
+					}
+				}
+			});
+			Assert::AreEqual(file_sum, compact_sum);
+
+			std::ostringstream os;
+			os << ids.size() << " instances in " << store.bytes() << " bytes, build " << build.seconds / load.seconds << " of the load time, read "
+				<< generic.seconds / compact.seconds << " times faster than through the attributes\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// Layouts and segments of 10k synthetic alignments through the inverse attributes and through nesting_index,
+		// and building the index on one and on all hardware threads
+		TEST_METHOD(NestingIndex)
+		{
+			IfcHierarchyHelper<Schema> file;
+			add_nested_alignments(file, 10000, 5, 3, 2);
+			auto alignments = file.instances_by_type<Schema::IfcAlignment>();
+
+			benchmark::regression_gate gate(baseline_path);
+			size_t inverse_segments = 0, index_segments = 0;
+			auto inverse = gate.run("synthetic/10k/nesting/inverse", "nesting", [&]()
+			{
+				inverse_segments = 0;
+				for (auto& alignment : *alignments)
+				{
+					for (auto& rel : *alignment->IsNestedBy())
+					{
+						for (auto& layout : *rel->RelatedObjects())
+						{
+							for (auto& segments : *layout->IsNestedBy())
+								inverse_segments += segments->RelatedObjects()->size();
+						}
+					}
+				}
+			}, 3);
+
+			auto build_single = gate.run("synthetic/10k/nesting/index_build_1", "nesting", [&]() { nesting_index(file, 1); }, 3);
+			auto build = gate.run("synthetic/10k/nesting/index_build", "nesting", [&]() { nesting_index index(file); }, 3);
+			nesting_index index(file);
+			auto walk = gate.run("synthetic/10k/nesting/index_walk", "nesting", [&]()
+			{
+				index_segments = 0;
+				for (auto& alignment : *alignments)
+				{
+					auto layouts = index.layouts(alignment);
+					index_segments += index.segments(layouts.horizontal).size() + index.segments(layouts.vertical).size() + index.segments(layouts.cant).size();
+				}
+			});
+			Assert::AreEqual((size_t)100000, index_segments);
+			Assert::AreEqual(inverse_segments, index_segments);
+
+			std::ostringstream os;
+			os << index.relationships() << " relationships in " << index.bytes() << " bytes; walk " << inverse.seconds / walk.seconds
+				<< " times faster than the inverses, build on " << std::thread::hardware_concurrency() << " threads " << build_single.seconds / build.seconds
+				<< " times faster than on one\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		// 10^5 local placements in chains of 10, mapped one by one and resolved in one batch
+		TEST_METHOD(PlacementResolver)
+		{
+			IfcHierarchyHelper<Schema> file;
+			add_local_placements(file, 100000, 10);
+			auto placements = file.instances_by_type<Schema::IfcLocalPlacement>();
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			benchmark::regression_gate gate(baseline_path);
+			auto map = gate.run("synthetic/100k/placements/map", "placements", [&]()
+			{
+				for (auto& placement : *placements)
+					cache.mapping().map(placement);
+			}, 3);
+			auto batch = gate.run("synthetic/100k/placements/batch", "placements", [&]() { placement_resolver resolver(file, cache); }, 3);
+
+			std::ostringstream os;
+			os << placements->size() << " local placements: batch " << map.seconds / batch.seconds << " times faster than mapping each\n";
+			Logger::WriteMessage(os.str().c_str());
+
+			check(gate);
+		}
+
+		void RailRoom(IfcRailRoom::Layout layout)
+		{
+			benchmark::regression_gate gate(baseline_path);
+
+			// spirals integrated at the tolerance of the layout
+			ifcopenshell::geometry::Settings precision;
+			precision.get<ifcopenshell::geometry::settings::Precision>().value = IfcRailRoom::tolerance(layout);
+
+			for (const auto& curve_type : IfcRailRoom::curve_types(layout))
+			{
+				// evaluate every reference station of every test case of the curve type
+				std::vector<std::unique_ptr<IfcRailRoom::testcase>> testcases;
+				std::vector<std::unique_ptr<ifcopenshell::geometry::function_item_evaluator>> evaluators;
+				std::vector<std::unique_ptr<alignment_evaluator>> trees;
+				std::vector<std::unique_ptr<compiled_alignment>> compiled;
+				std::vector<std::unique_ptr<compiled_alignment>> precise;
+				std::vector<std::vector<double>> stations;
+				for (const auto& test_name : IfcRailRoom::test_names(layout))
+				{
+					auto tc = IfcRailRoom::load_testcase(layout, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+					evaluators.push_back(std::make_unique<ifcopenshell::geometry::function_item_evaluator>(tc->settings, tc->fn));
+					trees.push_back(std::make_unique<alignment_evaluator>(tc->settings, tc->curve, tc->fn, tc->mapping->get_length_unit()));
+					compiled.push_back(std::make_unique<compiled_alignment>(*trees.back()));
+					precise.push_back(std::make_unique<compiled_alignment>(*trees.back(), precision));
+
+					std::vector<double> s;
+					for (const auto& p : IfcRailRoom::read_reference(layout, curve_type, test_name))
+						s.push_back(p.s);
+					stations.push_back(s);
+
+					testcases.push_back(std::move(tc));
+				}
+
+				std::string group = std::string(IfcRailRoom::layout_name(layout)) + "/" + curve_type;
+				gate.run("RailRoom/" + group + "/evaluate", group, [&]()
+				{
+					for (size_t i = 0; i < evaluators.size(); i++)
+					{
+						for (auto s : stations[i])
+						{
+							evaluators[i]->evaluate(s);
+						}
+					}
+				});
+				auto single = gate.run("RailRoom/" + group + "/compiled", group, [&]()
+				{
+					for (size_t i = 0; i < compiled.size(); i++)
+					{
+						for (auto s : stations[i])
+						{
+							compiled[i]->evaluate(s);
+						}
+					}
+				});
+				auto batch = gate.run("RailRoom/" + group + "/compiled_batch", group, [&]()
+				{
+					for (size_t i = 0; i < compiled.size(); i++)
+						compiled[i]->evaluate(stations[i]);
+				});
+				auto at_tolerance = gate.run("RailRoom/" + group + "/compiled_batch_tolerance", group, [&]()
+				{
+					for (size_t i = 0; i < precise.size(); i++)
+						precise[i]->evaluate(stations[i]);
+				});
+
+				size_t records = 0, generic = 0, bytes = 0, cheaper = 0;
+				for (size_t i = 0; i < compiled.size(); i++)
+				{
+					const auto& c = compiled[i];
+					records += c->horizontal().size() + c->vertical().size();
+					generic += c->count(segment_kind::generic);
+					bytes += c->bytes();
+					cheaper += precise[i]->quadrature().points < c->quadrature().points || precise[i]->quadrature().panel_angle > c->quadrature().panel_angle;
+				}
+				std::ostringstream os;
+				os << group << ": " << records << " compiled records (" << generic << " generic), " << bytes << " bytes, batch "
+					<< single.seconds / batch.seconds << " times the speed of single stations; at a precision of " << IfcRailRoom::tolerance(layout)
+					<< " " << cheaper << " of " << precise.size() << " with a cheaper quadrature, " << batch.seconds / at_tolerance.seconds
+					<< " times the speed of the most precise\n";
+				Logger::WriteMessage(os.str().c_str());
+			}
+
+			check(gate);
+		}
+
+		TEST_METHOD(RailRoom_Horizontal)
+		{
+			RailRoom(IfcRailRoom::Layout::Horizontal);
+		}
+
+		TEST_METHOD(RailRoom_Vertical)
+		{
+			RailRoom(IfcRailRoom::Layout::Vertical);
+		}
+
+		TEST_METHOD(RailRoom_Cant)
+		{
+			RailRoom(IfcRailRoom::Layout::Cant);
+		}
+	};
+
+	TEST_CLASS(BenchmarkBaselines)
+	{
+	public:
+		TEST_METHOD(Calibration)
+		{
+			auto c1 = benchmark::calibration_seconds();
+			Assert::IsTrue(c1 > 0.0);
+			Assert::AreEqual(c1, benchmark::calibration_seconds()); // measured once per process
+		}
+
+		TEST_METHOD(Gate)
+		{
+			const char* path = "benchmark_gate_test.csv";
+			{
+				benchmark::baseline_store store(path);
+				store.set("fast", 1e-9);
+				store.set("slow", 1e3);
+				store.save();
+			}
+
+			benchmark::regression_gate gate(path, 1.5, false);
+			auto work = []()
+			{
+				volatile double x = 0.0;
+				for (int i = 0; i < 100000; i++)
+					x = x + sqrt((double)i);
+			};
+			Assert::IsTrue(gate.run("fast", "group", work).regressed);
+			Assert::IsFalse(gate.run("slow", "group", work).regressed);
+			auto added = gate.run("new", "group", work);
+			Assert::IsFalse(added.regressed);
+			Assert::IsTrue(added.missing);
+			Assert::IsTrue(gate.regressed());
+			Assert::IsTrue(gate.failed());
+			Assert::AreEqual((size_t)3, gate.results().size());
+			Assert::AreEqual((size_t)1, gate.missing().size());
+
+			// a missing baseline alone fails the gate
+			benchmark::regression_gate unrecorded(path, 1.5, false);
+			unrecorded.run("new", "group", work);
+			Assert::IsFalse(unrecorded.regressed());
+			Assert::IsTrue(unrecorded.failed());
+
+			// outside update mode neither the regression nor the missing metric is written
+			gate.save();
+			{
+				benchmark::baseline_store store(path);
+				Assert::IsFalse(store.has("new"));
+				Assert::AreEqual(1e-9, store.get("fast"));
+			}
+
+			benchmark::regression_gate update(path, 1.5, true);
+			Assert::IsFalse(update.run("fast", "group", work).regressed);
+			update.run("new", "group", work);
+			Assert::IsTrue(update.missing().empty());
+			Assert::IsFalse(update.failed());
+			update.save();
+			benchmark::baseline_store store(path);
+			Assert::IsTrue(store.has("new"));
+			Assert::IsTrue(store.get("fast") > 1e-9);
+			std::remove(path);
+		}
+	};
+}
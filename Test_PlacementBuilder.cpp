@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "PlacementBuilder.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(PlacementBuilder)
+	{
+	public:
+		// The bulk placements map to the same matrices as placements built one entity at a time
+		TEST_METHOD(FHWA_MatchesPerEntity)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcCompositeCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcCompositeCurve>();
+
+			std::vector<double> distance, lateral, vertical, longitudinal;
+			for (int i = 0; i < 50; i++)
+			{
+				distance.push_back(100.0 * i);
+				lateral.push_back(-20.0 + i);
+				vertical.push_back(0.1 * i);
+				longitudinal.push_back(i % 3);
+			}
+
+			std::vector<Schema::IfcLinearPlacement*> expected;
+			for (size_t i = 0; i < distance.size(); i++)
+			{
+				auto pde = new Schema::IfcPointByDistanceExpression(
+					new Schema::IfcLengthMeasure(distance[i]),
+					lateral[i], vertical[i], longitudinal[i],
+					curve);
+
+				auto pl = new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, pl, nullptr);
+				file.addEntity(lp);
+				expected.push_back(lp);
+			}
+
+			auto max_id = file.getMaxId();
+			linear_placement_builder builder(file);
+			auto placements = builder.add(curve, distance, lateral, vertical, longitudinal);
+			Assert::AreEqual(distance.size(), placements.size());
+
+			// contiguous ids, three entities per placement
+			Assert::AreEqual(max_id + 1, builder.ids().first);
+			Assert::AreEqual(3 * distance.size(), builder.ids().size());
+			for (size_t i = 0; i < placements.size(); i++)
+			{
+				Assert::AreEqual(builder.ids().first + 3 * (unsigned)i + 2, placements[i]->id());
+				Assert::AreEqual(builder.ids().first + 3 * (unsigned)i + 1, placements[i]->RelativePlacement()->id());
+				Assert::AreEqual(builder.ids().first + 3 * (unsigned)i, placements[i]->RelativePlacement()->as<Schema::IfcAxis2PlacementLinear>()->Location()->id());
+			}
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			for (size_t i = 0; i < placements.size(); i++)
+			{
+				auto e = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(expected[i]))->ccomponents();
+				auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placements[i]))->ccomponents();
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(e(row, col), m(row, col), 0.000001);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(OmittedOffsets)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcSegmentedReferenceCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			linear_placement_builder builder(file);
+			auto placements = builder.add(curve, { 425.0, 426.0 }, { 0.0, 0.0 });
+			Assert::AreEqual((size_t)2, placements.size());
+			Assert::AreEqual(4u, file.instances_by_type<Schema::IfcLinearPlacement>()->size());
+
+			auto pde = placements[0]->RelativePlacement()->as<Schema::IfcAxis2PlacementLinear>()->Location()->as<Schema::IfcPointByDistanceExpression>();
+			Assert::IsTrue(pde->OffsetLateral().is_initialized());
+			Assert::IsFalse(pde->OffsetVertical().is_initialized());
+			Assert::IsFalse(pde->OffsetLongitudinal().is_initialized());
+
+			// same stations as the sleepers, see ACCA_Sleepers::LinearPlacement1 and LinearPlacement2
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placements[1]))->ccomponents();
+			Assert::AreEqual(425.99994710799535, m(0, 3), 0.001);
+			Assert::AreEqual(-0.039057725772016598, m(1, 3), 0.001);
+			Assert::AreEqual(0.26000003254615944, m(2, 3), 0.001);
+
+			auto empty = builder.add(curve, {});
+			Assert::IsTrue(empty.empty());
+			Assert::AreEqual((size_t)0, builder.ids().size());
+		}
+
+		TEST_METHOD(ColumnSizeMismatch)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcSegmentedReferenceCurve>();
+			auto curve = (*(curves->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			linear_placement_builder builder(file);
+			Assert::ExpectException<std::invalid_argument>([&]() { builder.add(curve, { 1.0, 2.0 }, { 0.0 }); });
+			Assert::AreEqual(2u, file.instances_by_type<Schema::IfcLinearPlacement>()->size());
+		}
+	};
+}
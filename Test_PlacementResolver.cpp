@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "PlacementResolver.h"
+#include "TestModels.h"
+#include "RailRoomTestset.h"
+
+#include <map>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(PlacementResolver)
+	{
+	public:
+		// every placement of the file against mapping->map(placement), returns the number of placements by type
+		static std::map<std::string, size_t> check(IfcParse::IfcFile& file, ifcopenshell::geometry::Settings& settings)
+		{
+			alignment_cache cache(file, settings);
+			placement_resolver resolver(file, cache);
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+
+			std::map<std::string, size_t> types;
+			size_t mismatches = 0;
+			for (size_t i = 0; i < resolver.size(); i++)
+			{
+				auto placement = resolver.placements()[i];
+				types[placement->declaration().name()]++;
+				Assert::IsTrue(&resolver.matrix(placement) == &resolver.matrices()[i]);
+
+				auto expected = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placement))->ccomponents();
+				if ((expected - resolver.matrices()[i]).cwiseAbs().maxCoeff() > 0.000001)
+				{
+					std::ostringstream os;
+					os << "#" << placement->id() << " " << placement->declaration().name() << "\n" << expected << "\n" << resolver.matrices()[i] << "\n";
+					Logger::WriteMessage(os.str().c_str());
+					mismatches++;
+				}
+			}
+			Assert::AreEqual((size_t)0, mismatches);
+			return types;
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			ifcopenshell::geometry::Settings settings;
+			auto types = check(file, settings);
+			Assert::AreEqual((size_t)file.instances_by_type<Schema::IfcAxis2Placement2D>()->size(), types["IfcAxis2Placement2D"]);
+		}
+
+		TEST_METHOD(ACCA)
+		{
+			for (auto path : { "../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc", "../../Files/ACCA_sleepers-linear-placement-cant-implicit.ifc" })
+			{
+				IfcParse::IfcFile file(path);
+				ifcopenshell::geometry::Settings settings;
+				auto types = check(file, settings);
+				Assert::AreEqual((size_t)file.instances_by_type<Schema::IfcLocalPlacement>()->size(), types["IfcLocalPlacement"]);
+				Assert::AreEqual((size_t)file.instances_by_type<Schema::IfcAxis2Placement3D>()->size(), types["IfcAxis2Placement3D"]);
+			}
+		}
+
+		// segment placements and EndPoint of every RailRoom testcase
+		static void RailRoom(IfcRailRoom::Layout layout)
+		{
+			size_t files = 0;
+			for (const auto& curve_type : IfcRailRoom::curve_types(layout))
+			{
+				for (const auto& test_name : IfcRailRoom::test_names(layout))
+				{
+					auto tc = IfcRailRoom::load_testcase(layout, curve_type, test_name);
+					Assert::IsNotNull(tc.get());
+					check(tc->file, tc->settings);
+
+					alignment_cache cache(tc->file, tc->settings);
+					placement_resolver resolver(tc->file, cache);
+					for (auto& segment : *tc->curve->Segments())
+						resolver.matrix(segment->as<Schema::IfcCurveSegment>()->Placement());
+					if (auto gradient_curve = tc->curve->as<Schema::IfcGradientCurve>())
+						resolver.matrix(gradient_curve->EndPoint());
+					if (auto reference_curve = tc->curve->as<Schema::IfcSegmentedReferenceCurve>())
+						resolver.matrix(reference_curve->EndPoint());
+					files++;
+				}
+			}
+			Assert::IsTrue(files > 0);
+		}
+
+		TEST_METHOD(RailRoom_Horizontal)
+		{
+			RailRoom(IfcRailRoom::Layout::Horizontal);
+		}
+
+		TEST_METHOD(RailRoom_Vertical)
+		{
+			RailRoom(IfcRailRoom::Layout::Vertical);
+		}
+
+		TEST_METHOD(RailRoom_Cant)
+		{
+			RailRoom(IfcRailRoom::Layout::Cant);
+		}
+
+		// chains of local placements, resolved parents first whatever the order of the ids
+		TEST_METHOD(Chains)
+		{
+			IfcHierarchyHelper<Schema> file;
+			add_local_placements(file, 1000, 50);
+			ifcopenshell::geometry::Settings settings;
+			auto types = check(file, settings);
+			Assert::AreEqual((size_t)1000, types["IfcLocalPlacement"]);
+
+			// a placement added later as the parent of the first chain
+			auto first = (*file.instances_by_type<Schema::IfcLocalPlacement>()->begin())->as<Schema::IfcLocalPlacement>();
+			auto root = new Schema::IfcLocalPlacement(nullptr, new Schema::IfcAxis2Placement3D(new Schema::IfcCartesianPoint(std::vector<double>{ 100.0, 200.0, 0.0 }), nullptr, nullptr));
+			file.addEntity(root);
+			first->setPlacementRelTo(root);
+			check(file, settings);
+
+			alignment_cache cache(file, settings);
+			placement_resolver resolver(file, cache);
+			Assert::AreEqual(100.0, resolver.matrix(first)(0, 3) - resolver.matrix(first->RelativePlacement())(0, 3), 1e-12);
+			Assert::ExpectException<std::out_of_range>([&]() { resolver.matrix(first->RelativePlacement()->as<Schema::IfcAxis2Placement3D>()->Location()); });
+
+			// a loop
+			root->setPlacementRelTo(first);
+			Assert::ExpectException<std::runtime_error>([&]() { placement_resolver(file, cache); });
+		}
+
+		// a linear placement relative to a local placement, and a local placement relative to it
+		TEST_METHOD(LinearRelativeTo)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			ifcopenshell::geometry::Settings settings;
+			auto first = (*file.instances_by_type<Schema::IfcLinearPlacement>()->begin())->as<Schema::IfcLinearPlacement>();
+
+			auto root = new Schema::IfcLocalPlacement(nullptr, new Schema::IfcAxis2Placement3D(new Schema::IfcCartesianPoint(std::vector<double>{ 100.0, 200.0, 0.0 }), nullptr, nullptr));
+			auto linear = new Schema::IfcLinearPlacement(root, first->RelativePlacement(), nullptr);
+			auto local = new Schema::IfcLocalPlacement(linear, new Schema::IfcAxis2Placement3D(new Schema::IfcCartesianPoint(std::vector<double>{ 1.0, 0.0, 0.0 }), nullptr, nullptr));
+			file.addEntity(local);
+			file.addEntity(linear);
+			file.addEntity(root);
+
+			alignment_cache cache(file, settings);
+			placement_resolver resolver(file, cache);
+			Eigen::Matrix4d translation = Eigen::Matrix4d::Identity();
+			translation.col(3).head(3) = resolver.matrix(root).col(3).head(3);
+			Assert::AreEqual(0.0, (translation * resolver.matrix(first) - resolver.matrix(linear)).cwiseAbs().maxCoeff(), 1e-9);
+			Assert::AreEqual(0.0, (linear_placement_resolver(cache).resolve(linear) - resolver.matrix(linear)).cwiseAbs().maxCoeff(), 1e-9);
+
+			Eigen::Vector3d expected = resolver.matrix(linear).col(3).head(3) + resolver.matrix(linear).col(0).head(3) * resolver.matrix(local->RelativePlacement())(0, 3);
+			Assert::AreEqual(0.0, (expected - resolver.matrix(local).col(3).head(3)).cwiseAbs().maxCoeff(), 1e-9);
+		}
+	};
+}
@@ -0,0 +1,314 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "SpatialIndex.h"
+
+#include <chrono>
+#include <random>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(SpatialIndex)
+	{
+	public:
+		struct sample
+		{
+			size_t alignment;
+			double u;
+			Eigen::Vector3d p;
+		};
+
+		// points every step along the alignments, the ground truth for the queries
+		static std::vector<sample> sample_alignments(const std::vector<const alignment_evaluator*>& evaluators, double step)
+		{
+			std::vector<sample> samples;
+			for (size_t a = 0; a < evaluators.size(); a++)
+			{
+				const auto& e = *evaluators[a];
+				for (double u = e.start(); u <= e.end(); u += step)
+					samples.push_back({ a, u, e.evaluate(u).col(3).head(3) });
+			}
+			return samples;
+		}
+
+		static bool covered(const std::vector<spatial_index::hit>& hits, const sample& s)
+		{
+			return std::any_of(hits.begin(), hits.end(), [&s](const spatial_index::hit& h) { return h.alignment == s.alignment && h.start <= s.u && s.u <= h.end; });
+		}
+
+		// Every sampled point inside a query volume lies in a returned station range
+		static void check_queries(const spatial_index& index, const std::vector<sample>& samples, size_t queries)
+		{
+			auto bounds = index.bounds();
+			Eigen::Vector3d size = bounds.max - bounds.min;
+
+			std::mt19937 generator(7);
+			std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+			size_t non_empty = 0;
+			for (size_t q = 0; q < queries; q++)
+			{
+				Eigen::Vector3d center = bounds.min + Eigen::Vector3d(unit(generator), unit(generator), unit(generator)).cwiseProduct(size);
+				double half = (0.001 + 0.05 * unit(generator)) * size.head(2).maxCoeff();
+
+				bounding_box box(center - Eigen::Vector3d::Constant(half), center + Eigen::Vector3d::Constant(half));
+				auto box_hits = index.query(box);
+				auto radius_hits = index.query(center, half);
+				non_empty += !box_hits.empty();
+
+				for (const auto& s : samples)
+				{
+					if (box.contains(s.p))
+						Assert::IsTrue(covered(box_hits, s));
+					if ((s.p - center).norm() <= half)
+						Assert::IsTrue(covered(radius_hits, s));
+				}
+			}
+			Assert::IsTrue(non_empty > 0);
+		}
+
+		TEST_METHOD(FHWA)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+
+			auto horizontal = (*(file.instances_by_type<Schema::IfcCompositeCurve>()->begin()))->as<Schema::IfcCompositeCurve>();
+			auto gradient = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+			std::vector<const alignment_evaluator*> evaluators = { &cache.get(horizontal), &cache.get(gradient) };
+
+			spatial_index index(0.5);
+			for (auto e : evaluators)
+				index.add(*e);
+			index.build();
+			Assert::AreEqual((size_t)2, index.alignment_count());
+
+			auto samples = sample_alignments(evaluators, 1.0);
+
+			// leaf boxes are conservative
+			for (const auto& s : samples)
+			{
+				Assert::IsTrue(std::any_of(index.leaves().begin(), index.leaves().end(), [&s](const spatial_index::leaf& l)
+				{
+					return l.alignment == s.alignment && l.start <= s.u && s.u <= l.end && l.box.contains(s.p);
+				}));
+			}
+
+			check_queries(index, samples, 200);
+
+			// a box around the PC of the first curve (Example 5.3 station) finds the line and the arc it joins
+			const auto& h = *evaluators[0];
+			auto pc = h.layers().front()[1].start;
+			Eigen::Vector3d p = h.evaluate(pc).col(3).head(3);
+			auto hits = index.query(bounding_box(p - Eigen::Vector3d::Constant(1.0), p + Eigen::Vector3d::Constant(1.0)));
+			Assert::IsTrue(std::any_of(hits.begin(), hits.end(), [](const spatial_index::hit& x) { return x.alignment == 0 && x.segment == 0; }));
+			Assert::IsTrue(std::any_of(hits.begin(), hits.end(), [](const spatial_index::hit& x) { return x.alignment == 0 && x.segment == 1; }));
+			for (const auto& x : hits)
+			{
+				if (x.alignment == 0 && x.segment == 1)
+					Assert::IsTrue(x.end - x.start < 100.0); // only the neighbourhood of the point on the arc
+			}
+
+			// far away
+			Assert::IsTrue(index.query(Eigen::Vector3d(1e7, 1e7, 0.0), 10.0).empty());
+		}
+
+		// adds an alignment of lines and circular arcs starting at (x, y) with heading theta, model units are millimetres
+		static Schema::IfcCompositeCurve* add_alignment(IfcHierarchyHelper<Schema>& file, double x, double y, double theta, std::mt19937& generator)
+		{
+			const double mm = 1000.0;
+			std::uniform_real_distribution<double> length(50.0, 400.0);
+			std::uniform_real_distribution<double> radius(300.0, 2000.0);
+
+			aggregate_of<Schema::IfcSegment>::ptr segments(new aggregate_of<Schema::IfcSegment>());
+			for (int i = 0; i < 20; i++)
+			{
+				double l = length(generator);
+				auto placement = new Schema::IfcAxis2Placement2D(
+					new Schema::IfcCartesianPoint(std::vector<double>{ x * mm, y * mm }),
+					new Schema::IfcDirection(std::vector<double>{ cos(theta), sin(theta) }));
+
+				if (i % 2 == 0)
+				{
+					auto line = new Schema::IfcLine(
+						new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }),
+						new Schema::IfcVector(new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 }), 1.0));
+					segments->push(new Schema::IfcCurveSegment(Schema::IfcTransitionCode::IfcTransitionCode_CONTSAMEGRADIENT, placement,
+						new Schema::IfcLengthMeasure(0.0), new Schema::IfcLengthMeasure(l * mm), line));
+					x += l * cos(theta);
+					y += l * sin(theta);
+				}
+				else
+				{
+					// left turn for a positive length, as in FHWA
+					double r = radius(generator);
+					double sign = generator() % 2 ? 1.0 : -1.0;
+					auto circle = new Schema::IfcCircle(
+						new Schema::IfcAxis2Placement2D(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }), new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 })),
+						r * mm);
+					segments->push(new Schema::IfcCurveSegment(Schema::IfcTransitionCode::IfcTransitionCode_CONTSAMEGRADIENT, placement,
+						new Schema::IfcLengthMeasure(0.0), new Schema::IfcLengthMeasure(sign * l * mm), circle));
+					double cx = x - sign * r * sin(theta);
+					double cy = y + sign * r * cos(theta);
+					theta += sign * l / r;
+					x = cx + sign * r * sin(theta);
+					y = cy - sign * r * cos(theta);
+				}
+			}
+
+			auto curve = new Schema::IfcCompositeCurve(segments, false);
+			file.addEntity(curve);
+			return curve;
+		}
+
+		// a composite curve of 100 m segments of the given parent curves, model units are millimetres
+		static Schema::IfcCompositeCurve* add_segments(IfcHierarchyHelper<Schema>& file, const std::vector<Schema::IfcCurve*>& parents)
+		{
+			const double mm = 1000.0;
+			aggregate_of<Schema::IfcSegment>::ptr segments(new aggregate_of<Schema::IfcSegment>());
+			for (size_t i = 0; i < parents.size(); i++)
+			{
+				auto placement = new Schema::IfcAxis2Placement2D(
+					new Schema::IfcCartesianPoint(std::vector<double>{ 120.0 * i * mm, 0.0 }),
+					new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 }));
+				segments->push(new Schema::IfcCurveSegment(Schema::IfcTransitionCode::IfcTransitionCode_DISCONTINUOUS, placement,
+					new Schema::IfcLengthMeasure(0.0), new Schema::IfcLengthMeasure(100.0 * mm), parents[i]));
+			}
+			auto curve = new Schema::IfcCompositeCurve(segments, false);
+			file.addEntity(curve);
+			return curve;
+		}
+
+		static Schema::IfcAxis2Placement2D* origin()
+		{
+			return new Schema::IfcAxis2Placement2D(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }), new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 }));
+		}
+
+		// Spirals have closed form bounds and are parameterized by arc length. A polynomial curve with CoefficientsX (0, 1)
+		// has a closed form bound but is parameterized by x, so its boxes are not clipped to the ellipsoid. With other
+		// CoefficientsX, M2 is estimated and the leaves are not conservative, the curve is still expected in their boxes.
+		TEST_METHOD(SpiralsAndPolynomials)
+		{
+			IfcHierarchyHelper<Schema> file;
+			file.addProject();
+
+			const double mm = 1000.0;
+			auto spirals = add_segments(file, {
+				new Schema::IfcCosineSpiral(origin(), 300.0 * mm, 1000.0 * mm),
+				new Schema::IfcSineSpiral(origin(), 400.0 * mm, 200.0 * mm, 800.0 * mm),
+				new Schema::IfcThirdOrderPolynomialSpiral(origin(), 150.0 * mm, boost::none, 300.0 * mm, boost::none),
+				new Schema::IfcSeventhOrderPolynomialSpiral(origin(), 120.0 * mm, boost::none, boost::none, boost::none, 160.0 * mm, boost::none, boost::none, 500.0 * mm) });
+			auto cubic = add_segments(file, {
+				new Schema::IfcPolynomialCurve(origin(), std::vector<double>{ 0.0, 1.0 }, std::vector<double>{ 0.0, 0.0, 0.0, 1.0 / (6.0 * 300.0 * 100.0 * mm * mm) }, boost::none) });
+			auto estimated = add_segments(file, {
+				new Schema::IfcPolynomialCurve(origin(), std::vector<double>{ 0.0, 1.0, 0.5 / (100.0 * mm) }, std::vector<double>{ 0.0, 0.0, 1.0 / (2.0 * 500.0 * mm) }, boost::none) });
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			std::vector<const alignment_evaluator*> evaluators = { &cache.get(spirals), &cache.get(cubic), &cache.get(estimated) };
+
+			spatial_index index(0.01);
+			for (auto e : evaluators)
+				index.add(*e);
+			index.build();
+
+			for (const auto& l : index.leaves())
+				Assert::AreEqual(l.alignment != 2, l.conservative);
+
+			auto samples = sample_alignments(evaluators, 0.25);
+			for (const auto& s : samples)
+			{
+				Assert::IsTrue(std::any_of(index.leaves().begin(), index.leaves().end(), [&s](const spatial_index::leaf& l)
+				{
+					return l.alignment == s.alignment && l.start <= s.u && s.u <= l.end && l.box.contains(s.p);
+				}));
+			}
+			check_queries(index, samples, 100);
+		}
+
+		TEST_METHOD(SyntheticNetwork)
+		{
+			IfcHierarchyHelper<Schema> file;
+			file.addProject();
+
+			std::mt19937 generator(2024);
+			std::uniform_real_distribution<double> origin(0.0, 20000.0);
+			std::uniform_real_distribution<double> heading(0.0, 6.283185307179586);
+
+			const size_t n = 100;
+			std::vector<Schema::IfcCompositeCurve*> curves;
+			for (size_t i = 0; i < n; i++)
+				curves.push_back(add_alignment(file, origin(generator), origin(generator), heading(generator), generator));
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			std::vector<const alignment_evaluator*> evaluators;
+			for (auto curve : curves)
+				evaluators.push_back(&cache.get(curve));
+
+			spatial_index index(1.0);
+			for (auto e : evaluators)
+				index.add(*e);
+			index.build();
+			Assert::AreEqual(n, index.alignment_count());
+
+			// correctness on every tenth alignment to keep the brute force affordable
+			std::vector<const alignment_evaluator*> checked;
+			for (size_t i = 0; i < n; i += 10)
+				checked.push_back(evaluators[i]);
+			auto checked_samples = sample_alignments(checked, 2.0);
+			for (auto& s : checked_samples)
+				s.alignment *= 10;
+			check_queries(index, checked_samples, 100);
+
+			// throughput against scanning evaluated points of every segment
+			auto samples = sample_alignments(evaluators, 2.0);
+			auto bounds = index.bounds();
+			std::uniform_real_distribution<double> unit(0.0, 1.0);
+			std::vector<bounding_box> boxes;
+			for (int q = 0; q < 1000; q++)
+			{
+				Eigen::Vector3d c = bounds.min + Eigen::Vector3d(unit(generator), unit(generator), 0.5).cwiseProduct(bounds.max - bounds.min);
+				boxes.emplace_back(c - Eigen::Vector3d(100.0, 100.0, 100.0), c + Eigen::Vector3d(100.0, 100.0, 100.0));
+			}
+
+			size_t hits = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			for (const auto& box : boxes)
+				hits += index.query(box).size();
+			auto t1 = std::chrono::steady_clock::now();
+
+			const size_t brute_force_queries = 20;
+			size_t inside = 0;
+			for (size_t q = 0; q < brute_force_queries; q++)
+			{
+				for (const auto& s : samples)
+					inside += boxes[q].contains(s.p);
+			}
+			auto t2 = std::chrono::steady_clock::now();
+
+			double index_per_query = std::chrono::duration<double>(t1 - t0).count() / boxes.size();
+			double brute_force_per_query = std::chrono::duration<double>(t2 - t1).count() / brute_force_queries;
+			Assert::IsTrue(index_per_query < brute_force_per_query);
+
+			std::ostringstream os;
+			os << index.leaves().size() << " leaves, " << samples.size() << " sampled points\n"
+				<< "index: " << 1.0 / index_per_query << " queries/s, " << hits << " hits\n"
+				<< "scan of sampled points: " << 1.0 / brute_force_per_query << " queries/s (" << inside << " points)\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
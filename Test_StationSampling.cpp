@@ -0,0 +1,251 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "StationSampling.h"
+#include "ProcessMemory.h"
+
+#include <chrono>
+#include <limits>
+#include <set>
+#include <span>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(StationSampling)
+	{
+	public:
+		static void check_sample(const alignment_evaluator& evaluator, const station_sample& sample)
+		{
+			Eigen::Matrix4d m = evaluator.evaluate(sample.station);
+			for (int col = 0; col < 4; col++)
+			{
+				for (int row = 0; row < 4; row++)
+				{
+					Assert::AreEqual(m(row, col), sample.frame(row, col));
+				}
+			}
+			if (!evaluator.layers().empty())
+				Assert::AreEqual(evaluator.layers().front().find(sample.station), sample.segment);
+		}
+
+		TEST_METHOD(FHWA_FixedStep)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+
+			const double step = 100.0; // feet
+			size_t n = 0;
+			double last = -1.0;
+			for (const auto& sample : sample_fixed_step(evaluator, step))
+			{
+				if (sample.station < evaluator.end())
+					Assert::AreEqual(evaluator.start() + step * n, sample.station);
+				Assert::IsTrue(sample.station > last);
+				check_sample(evaluator, sample);
+				last = sample.station;
+				n++;
+			}
+			Assert::AreEqual(evaluator.end(), last);
+			Assert::AreEqual((size_t)std::ceil((evaluator.end() - evaluator.start()) / step) + 1, n);
+
+			// stopping early leaves the rest unevaluated
+			n = 0;
+			for (const auto& sample : sample_fixed_step(evaluator, step))
+			{
+				if (++n == 3)
+				{
+					Assert::AreEqual(evaluator.start() + 2 * step, sample.station);
+					break;
+				}
+			}
+		}
+
+		// a step that never reaches the end is rejected when the generator is created
+		TEST_METHOD(FHWA_InvalidStep)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+
+			for (double step : { 0.0, -100.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() })
+				Assert::ExpectException<std::invalid_argument>([&]() { sample_fixed_step(evaluator, step); });
+
+			// a step beyond the length gives the start and the end
+			size_t n = 0;
+			for (const auto& sample : sample_fixed_step(evaluator, 2.0 * (evaluator.end() - evaluator.start())))
+			{
+				check_sample(evaluator, sample);
+				n++;
+			}
+			Assert::AreEqual((size_t)2, n);
+		}
+
+		TEST_METHOD(FHWA_Breakpoints)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings, units::model);
+			const auto& evaluator = cache.get(gradient_curve);
+			Assert::AreEqual((size_t)2, evaluator.layers().size());
+
+			// segment starts of the vertical and horizontal layers
+			std::set<double> expected = { evaluator.start(), evaluator.end() };
+			for (const auto& layer : evaluator.layers())
+			{
+				for (const auto& r : layer.segments())
+				{
+					if (r.start > evaluator.start() && r.start < evaluator.end())
+						expected.insert(r.start);
+				}
+			}
+
+			std::vector<double> stations;
+			for (const auto& sample : sample_breakpoints(evaluator))
+			{
+				check_sample(evaluator, sample);
+				stations.push_back(sample.station);
+			}
+			Assert::AreEqual(expected.size(), stations.size());
+			Assert::IsTrue(std::equal(expected.begin(), expected.end(), stations.begin()));
+
+			// the PVC of vertical curve 1 at 1200 ft, Table 3.2
+			Assert::IsTrue(expected.count(1200.0) == 1);
+		}
+
+		TEST_METHOD(ACCA_Stations)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			auto curve = (*(file.instances_by_type<Schema::IfcSegmentedReferenceCurve>()->begin()))->as<Schema::IfcSegmentedReferenceCurve>();
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+
+			// ascending, then backwards into an earlier segment and forward again
+			std::vector<double> stations;
+			for (double f : { 0.0, 0.05, 0.3, 0.6, 0.9, 0.02, 0.4, 1.0 })
+				stations.push_back(evaluator.start() + f * (evaluator.end() - evaluator.start()));
+			size_t i = 0;
+			for (const auto& sample : sample_stations(evaluator, std::span<const double>(stations)))
+			{
+				Assert::AreEqual(stations[i++], sample.station);
+				check_sample(evaluator, sample);
+			}
+			Assert::AreEqual(stations.size(), i);
+
+			// a lazily computed sequence
+			const double step = (evaluator.end() - evaluator.start()) / 49;
+			auto station = [&evaluator, step](int k) { return evaluator.start() + step * k; };
+			i = 0;
+			for (const auto& sample : sample_stations(evaluator, std::views::iota(0, 50) | std::views::transform(station)))
+			{
+				Assert::AreEqual(station((int)i++), sample.station);
+				check_sample(evaluator, sample);
+			}
+			Assert::AreEqual((size_t)50, i);
+		}
+
+		// a 1,000 km alignment of 900 m lines and 100 m arcs, model units are millimetres
+		static Schema::IfcCompositeCurve* add_long_alignment(IfcHierarchyHelper<Schema>& file)
+		{
+			const double mm = 1000.0;
+			const double line_length = 900.0, arc_length = 100.0, radius = 2000.0;
+
+			double x = 0.0, y = 0.0, theta = 0.0;
+			aggregate_of<Schema::IfcSegment>::ptr segments(new aggregate_of<Schema::IfcSegment>());
+			for (int i = 0; i < 1000; i++)
+			{
+				auto line = new Schema::IfcLine(
+					new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }),
+					new Schema::IfcVector(new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 }), 1.0));
+				segments->push(new Schema::IfcCurveSegment(Schema::IfcTransitionCode::IfcTransitionCode_CONTSAMEGRADIENT,
+					new Schema::IfcAxis2Placement2D(new Schema::IfcCartesianPoint(std::vector<double>{ x * mm, y * mm }), new Schema::IfcDirection(std::vector<double>{ cos(theta), sin(theta) })),
+					new Schema::IfcLengthMeasure(0.0), new Schema::IfcLengthMeasure(line_length * mm), line));
+				x += line_length * cos(theta);
+				y += line_length * sin(theta);
+
+				// alternating left and right turns, a positive length turns left as in FHWA
+				double sign = i % 2 ? -1.0 : 1.0;
+				auto circle = new Schema::IfcCircle(
+					new Schema::IfcAxis2Placement2D(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }), new Schema::IfcDirection(std::vector<double>{ 1.0, 0.0 })),
+					radius * mm);
+				segments->push(new Schema::IfcCurveSegment(Schema::IfcTransitionCode::IfcTransitionCode_CONTSAMEGRADIENT,
+					new Schema::IfcAxis2Placement2D(new Schema::IfcCartesianPoint(std::vector<double>{ x * mm, y * mm }), new Schema::IfcDirection(std::vector<double>{ cos(theta), sin(theta) })),
+					new Schema::IfcLengthMeasure(0.0), new Schema::IfcLengthMeasure(sign * arc_length * mm), circle));
+				double cx = x - sign * radius * sin(theta);
+				double cy = y + sign * radius * cos(theta);
+				theta += sign * arc_length / radius;
+				x = cx + sign * radius * sin(theta);
+				y = cy - sign * radius * cos(theta);
+			}
+
+			auto curve = new Schema::IfcCompositeCurve(segments, false);
+			file.addEntity(curve);
+			return curve;
+		}
+
+		TEST_METHOD(SyntheticAlignment_MemoryFlat)
+		{
+			IfcHierarchyHelper<Schema> file;
+			file.addProject();
+			auto curve = add_long_alignment(file);
+
+			ifcopenshell::geometry::Settings settings;
+			alignment_cache cache(file, settings);
+			const auto& evaluator = cache.get(curve);
+			Assert::AreEqual(1.0e6, evaluator.end() - evaluator.start(), 1e-3);
+			Assert::AreEqual((size_t)2000, evaluator.layers().front().size());
+
+			const double step = 5.0;
+			size_t n = 0, baseline = 0, peak = 0;
+			double last = 0.0;
+			auto t0 = std::chrono::steady_clock::now();
+			for (const auto& sample : sample_fixed_step(evaluator, step))
+			{
+				// the first samples warm up the evaluator and the allocator
+				if (n == 1000)
+					baseline = peak = current_process_memory().private_bytes;
+				else if (n > 1000 && n % 10000 == 0)
+					peak = std::max(peak, current_process_memory().private_bytes);
+
+				Assert::IsTrue(sample.station > last || n == 0);
+				last = sample.station;
+				n++;
+			}
+			auto t1 = std::chrono::steady_clock::now();
+			Assert::AreEqual(evaluator.end(), last);
+			Assert::AreEqual((size_t)std::ceil((evaluator.end() - evaluator.start()) / step) + 1, n);
+
+			// materialising the samples would take n * sizeof(station_sample), about 30 MB
+			size_t materialised = n * sizeof(station_sample);
+			size_t growth = peak - baseline;
+			Assert::IsTrue(growth < materialised / 10);
+
+			std::ostringstream os;
+			os << n << " samples over 1000 km in " << std::chrono::duration<double>(t1 - t0).count() << " s, private bytes grew by "
+				<< growth << " (materialised: " << materialised << ")\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
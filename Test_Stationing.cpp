@@ -0,0 +1,248 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "Stationing.h"
+
+#include <chrono>
+#include <random>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(Stationing)
+	{
+	public:
+		// Adds a station referent at distance along basis_curve, nested under alignment with its Pset_Stationing
+		static Schema::IfcReferent* add_referent(IfcParse::IfcFile& file, Schema::IfcAlignment* alignment, Schema::IfcCurve* basis_curve,
+			double distance, double station, boost::optional<double> incoming_station = boost::none, boost::optional<bool> increasing = boost::none)
+		{
+			auto pde = new Schema::IfcPointByDistanceExpression(new Schema::IfcLengthMeasure(distance), boost::none, boost::none, boost::none, basis_curve);
+			auto placement = new Schema::IfcLinearPlacement(nullptr, new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr), nullptr);
+			auto referent = new Schema::IfcReferent(IfcParse::IfcGlobalId(), nullptr, std::string("Station"), boost::none, boost::none, placement, nullptr, Schema::IfcReferentTypeEnum::IfcReferentType_STATION);
+			file.addEntity(referent);
+
+			aggregate_of<Schema::IfcProperty>::ptr properties(new aggregate_of<Schema::IfcProperty>());
+			properties->push(new Schema::IfcPropertySingleValue(std::string("Station"), boost::none, new Schema::IfcLengthMeasure(station), nullptr));
+			if (incoming_station)
+				properties->push(new Schema::IfcPropertySingleValue(std::string("IncomingStation"), boost::none, new Schema::IfcLengthMeasure(*incoming_station), nullptr));
+			if (increasing)
+				properties->push(new Schema::IfcPropertySingleValue(std::string("HasIncreasingStation"), boost::none, new Schema::IfcBoolean(*increasing), nullptr));
+			auto pset = new Schema::IfcPropertySet(IfcParse::IfcGlobalId(), nullptr, std::string("Pset_Stationing"), boost::none, properties);
+
+			aggregate_of<Schema::IfcObjectDefinition>::ptr objects(new aggregate_of<Schema::IfcObjectDefinition>());
+			objects->push(referent);
+			file.addEntity(new Schema::IfcRelDefinesByProperties(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, objects, pset));
+			file.addEntity(new Schema::IfcRelNests(IfcParse::IfcGlobalId(), nullptr, boost::none, boost::none, alignment, objects));
+			return referent;
+		}
+
+		// Bridge 1 of the FHWA example with stationing from a referent instead of dist = station - start_station,
+		// see FHWA_Bridge_Geometry_Alignment_Example::Bridge1
+		TEST_METHOD(FHWA_Bridge1)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto alignment = (*(file.instances_by_type<Schema::IfcAlignment>()->begin()))->as<Schema::IfcAlignment>();
+			auto gradient_curve = (*(file.instances_by_type<Schema::IfcGradientCurve>()->begin()))->as<Schema::IfcGradientCurve>();
+
+			Assert::AreEqual((size_t)0, stationing_service(file).size());
+			Assert::AreEqual(1234.5, stationing_service(file).get(alignment).station(1234.5));
+
+			add_referent(file, alignment, gradient_curve, 0.0, 10000.0);
+
+			stationing_service service(file);
+			Assert::AreEqual((size_t)1, service.size());
+			const auto& stationing = service.get(alignment);
+			Assert::AreEqual((size_t)1, stationing.size());
+			Assert::AreEqual(10000.0, stationing.station(0.0));
+			Assert::AreEqual(11070.0, stationing.station(1070.0));
+
+			// Station, X, Y, Elev from Table 6.2 and Table 6.5
+			std::vector<std::tuple<double, double, double, double>> expected_values{
+				{ 11070, 1398.00, 1918.20, 118.73 }, // Abut 1
+				{ 11200, 1507.10, 1847.51, 121.00 }, // Pier 2
+				{ 11330, 1616.21, 1776.82, 123.13 }, // Pier 3
+				{ 11460, 1725.31, 1706.14, 124.97 }, // Pier 4
+				{ 11590, 1834.41, 1635.45, 126.52 }, // Pier 5
+				{ 11720, 1943.51, 1564.76, 127.78 }, // Pier 6
+				{ 11850, 2052.62, 1494.08, 128.74 }  // Abut 7
+			};
+
+			std::vector<double> stations;
+			for (const auto& ev : expected_values)
+				stations.push_back(std::get<0>(ev));
+			auto distances = stationing.distances(stations);
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			for (size_t i = 0; i < distances.size(); i++)
+			{
+				Assert::AreEqual(stations[i] - 10000.0, distances[i], 1e-9);
+
+				auto pde = new Schema::IfcPointByDistanceExpression(new Schema::IfcLengthMeasure(distances[i]), boost::none, boost::none, boost::none, gradient_curve);
+				auto lp = new Schema::IfcLinearPlacement(nullptr, new Schema::IfcAxis2PlacementLinear(pde, nullptr, nullptr), nullptr);
+				file.addEntity(lp);
+
+				auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(lp));
+				Eigen::Vector3d p = m->ccomponents().col(3).head(3) / mapping->get_length_unit();
+				Assert::AreEqual(std::get<1>(expected_values[i]), p(0), 0.01);
+				Assert::AreEqual(std::get<2>(expected_values[i]), p(1), 0.01);
+				Assert::AreEqual(std::get<3>(expected_values[i]), p(2), 0.01);
+			}
+		}
+
+		// linear reference implementation of the stationing rules
+		struct reference_stationing
+		{
+			std::vector<station_equation> equations; // sorted by distance
+
+			size_t region(double d) const
+			{
+				size_t i = 0;
+				for (size_t j = 0; j < equations.size(); j++)
+				{
+					if (equations[j].distance <= d)
+						i = j;
+				}
+				return i;
+			}
+
+			double station(double d) const
+			{
+				const auto& e = equations[region(d)];
+				return e.increasing ? e.station + (d - e.distance) : e.station - (d - e.distance);
+			}
+
+			// true if any region between referents reaches station s, the first region extends backwards without limit
+			bool has_station(double s) const
+			{
+				for (size_t i = 0; i < equations.size(); i++)
+				{
+					const auto& e = equations[i];
+					double end = i + 1 < equations.size() ? equations[i + 1].distance : std::numeric_limits<double>::infinity();
+					double s1 = e.increasing ? e.station + (end - e.distance) : e.station - (end - e.distance);
+					double low = i == 0 ? (e.increasing ? -std::numeric_limits<double>::infinity() : s1) : std::min(e.station, s1);
+					double high = i == 0 && !e.increasing ? std::numeric_limits<double>::infinity() : std::max(e.station, s1);
+					if (low <= s && s <= high)
+						return true;
+				}
+				return false;
+			}
+		};
+
+		TEST_METHOD(SyntheticEquations)
+		{
+			IfcHierarchyHelper<Schema> file;
+			file.addProject();
+
+			aggregate_of<Schema::IfcCartesianPoint>::ptr points(new aggregate_of<Schema::IfcCartesianPoint>());
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }));
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 100000.0, 0.0 }));
+			auto curve = new Schema::IfcPolyline(points);
+			file.addEntity(curve);
+
+			auto alignment = new Schema::IfcAlignment(IfcParse::IfcGlobalId(), nullptr, std::string("Synthetic"), boost::none, boost::none, nullptr, nullptr, boost::none);
+			file.addEntity(alignment);
+
+			// 200 equations, ahead (gaps) and back (overlapping stations), one region with decreasing stationing
+			std::mt19937 generator(34);
+			std::uniform_real_distribution<double> spacing(50.0, 500.0);
+			std::uniform_real_distribution<double> jump(-40.0, 60.0);
+
+			reference_stationing reference;
+			double distance = 0.0, station = 5000.0;
+			for (int i = 0; i < 200; i++)
+			{
+				boost::optional<bool> increasing;
+				if (i == 100)
+					increasing = false;
+				else if (i == 101)
+					increasing = true;
+
+				double incoming = i == 0 ? station : reference.station(distance);
+				add_referent(file, alignment, curve, distance, station, incoming, increasing);
+
+				station_equation e;
+				e.distance = distance;
+				e.station = station;
+				e.increasing = increasing.get_value_or(true);
+				reference.equations.push_back(e);
+
+				distance += spacing(generator);
+				station = reference.station(distance) + jump(generator);
+			}
+
+			stationing_service service(file);
+			const auto& stationing = service.get(alignment);
+			Assert::AreEqual((size_t)200, stationing.size());
+			Assert::IsFalse(stationing.equations()[100].increasing);
+			Assert::IsFalse(std::isnan(stationing.equations()[0].incoming_station));
+
+			// station from distance
+			std::uniform_real_distribution<double> distances(-100.0, distance + 100.0);
+			std::vector<double> samples;
+			for (int i = 0; i < 10000; i++)
+				samples.push_back(distances(generator));
+			for (auto d : samples)
+				Assert::AreEqual(reference.station(d), stationing.station(d), 1e-9);
+
+			// batches, sorted and unsorted
+			auto unsorted = stationing.stations(samples);
+			std::sort(samples.begin(), samples.end());
+			auto sorted = stationing.stations(samples);
+			for (size_t i = 0; i < samples.size(); i++)
+				Assert::AreEqual(reference.station(samples[i]), sorted[i], 1e-9);
+			Assert::AreEqual(samples.size(), unsorted.size());
+
+			// distance from station is the smallest distance with that station
+			for (auto d : samples)
+			{
+				double s = reference.station(d);
+				double found = stationing.distance(s);
+				Assert::AreEqual(s, reference.station(found), 1e-6);
+				Assert::IsTrue(found <= d + 1e-6);
+			}
+
+			// a station in the gap of an ahead equation
+			for (size_t i = 1; i < reference.equations.size(); i++)
+			{
+				const auto& e = reference.equations[i];
+				const auto& previous = reference.equations[i - 1];
+				double incoming = reference.station(e.distance - 1e-9);
+				if (e.increasing && previous.increasing && e.station - incoming > 1.0 && i + 1 < reference.equations.size())
+				{
+					double s = incoming + 0.5 * (e.station - incoming);
+					if (!reference.has_station(s))
+					{
+						Assert::ExpectException<std::out_of_range>([&]() { stationing.distance(s); });
+						break;
+					}
+				}
+			}
+
+			// throughput
+			auto t0 = std::chrono::steady_clock::now();
+			double sum = 0.0;
+			for (int k = 0; k < 100; k++)
+			{
+				for (auto d : samples)
+					sum += stationing.station(d);
+			}
+			auto t1 = std::chrono::steady_clock::now();
+			std::ostringstream os;
+			os << "1000000 station lookups over 200 equations: " << std::chrono::duration<double>(t1 - t0).count() << " s (" << sum << ")\n";
+			Logger::WriteMessage(os.str().c_str());
+		}
+	};
+}
@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+// Disable warnings coming from IfcOpenShell
+#pragma warning(disable:4018 4267 4250 4984 4985)
+
+#include <ifcparse/IfcHierarchyHelper.h>
+#include <ifcparse/Ifc4x3_add2.h>
+#include <ifcgeom/abstract_mapping.h>
+
+#include "StepWriter.h"
+#include "PlacementBuilder.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define Schema Ifc4x3_add2
+
+namespace IfcOpenShellUnitTests
+{
+	TEST_CLASS(StepWriter)
+	{
+	public:
+		// Writes file, parses it back and compares the mapped linear placements, which must be bit-identical
+		static void round_trip(IfcParse::IfcFile& file, const char* path)
+		{
+			{
+				std::ofstream ofile(path, std::ios::binary);
+				step_writer writer(ofile, 4096);
+				writer.write(file, path);
+				Assert::IsTrue(writer.sink().written() > writer.sink().capacity());
+			}
+
+			IfcParse::IfcFile reread(path);
+			Assert::IsTrue(reread.good());
+
+			auto placements = file.instances_by_type<Schema::IfcLinearPlacement>();
+			auto reread_placements = reread.instances_by_type<Schema::IfcLinearPlacement>();
+			Assert::AreEqual(placements->size(), reread_placements->size());
+			Assert::AreEqual(file.getMaxId(), reread.getMaxId());
+
+			ifcopenshell::geometry::Settings settings;
+			auto mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&file, settings);
+			auto reread_mapping = ifcopenshell::geometry::impl::mapping_implementations().construct(&reread, settings);
+
+			for (auto& placement : *placements)
+			{
+				auto reread_placement = reread.instance_by_id(placement->id());
+				Assert::IsNotNull(reread_placement);
+
+				auto e = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(mapping->map(placement))->ccomponents();
+				auto m = ifcopenshell::geometry::taxonomy::cast<ifcopenshell::geometry::taxonomy::matrix4>(reread_mapping->map(reread_placement))->ccomponents();
+				for (int col = 0; col < 4; col++)
+				{
+					for (int row = 0; row < 4; row++)
+					{
+						Assert::AreEqual(e(row, col), m(row, col));
+					}
+				}
+			}
+
+			std::remove(path);
+		}
+
+		TEST_METHOD(FormatReal)
+		{
+			Assert::AreEqual(std::string("1."), step::format_real(1.0));
+			Assert::AreEqual(std::string("0."), step::format_real(0.0));
+			Assert::AreEqual(std::string("0.5"), step::format_real(0.5));
+			Assert::AreEqual(std::string("-273.861278752584"), step::format_real(-273.861278752584));
+			Assert::AreEqual(std::string("1.E-05"), step::format_real(1e-05));
+			Assert::AreEqual(std::string("-8.59375E-06"), step::format_real(-8.59375E-06));
+			Assert::ExpectException<std::runtime_error>([]() { step::format_real(std::numeric_limits<double>::quiet_NaN()); });
+
+			// shortest round trip
+			std::mt19937_64 generator(42);
+			std::uniform_real_distribution<double> distribution(-1e6, 1e6);
+			for (int i = 0; i < 10000; i++)
+			{
+				double v = distribution(generator) * std::pow(10.0, (int)(generator() % 20) - 10);
+				Assert::AreEqual(v, std::stod(step::format_real(v)));
+			}
+		}
+
+		TEST_METHOD(FormatString)
+		{
+			Assert::AreEqual(std::string("'Sleeper_01'"), step::format_string("Sleeper_01"));
+			Assert::AreEqual(std::string("'it''s'"), step::format_string("it's"));
+			Assert::AreEqual(std::string("'a\\\\b'"), step::format_string("a\\b"));
+			Assert::AreEqual(std::string("'Traversa \\X2\\00E8\\X0\\ ok'"), step::format_string("Traversa \xC3\xA8 ok"));
+			Assert::AreEqual(std::string("'\\X2\\00E800E9\\X0\\'"), step::format_string("\xC3\xA8\xC3\xA9"));
+		}
+
+		TEST_METHOD(BufferedSink)
+		{
+			std::ostringstream os;
+			{
+				buffered_sink sink(os, 8);
+				sink.write("0123");
+				Assert::AreEqual((size_t)0, sink.written());
+				sink.write("456789");
+				Assert::AreEqual((size_t)4, sink.written());
+				sink.write("a string longer than the buffer");
+				sink.put('!');
+			}
+			Assert::AreEqual(std::string("0123456789a string longer than the buffer!"), os.str());
+		}
+
+		TEST_METHOD(ACCA_RoundTrip)
+		{
+			IfcParse::IfcFile file("../../Files/ACCA_sleepers-linear-placement-cant-explicit.ifc");
+			round_trip(file, "step_writer_acca.ifc");
+		}
+
+		TEST_METHOD(FHWA_RoundTrip)
+		{
+			IfcParse::IfcFile file("../../Files/FHWA_Bridge_Geometry_Alignment_Example.ifc");
+
+			auto curves = file.instances_by_type<Schema::IfcGradientCurve>();
+			auto gradient_curve = (*(curves->begin()))->as<Schema::IfcGradientCurve>();
+
+			std::vector<double> distance, lateral;
+			for (int i = 0; i < 100; i++)
+			{
+				distance.push_back(50.0 * i + 0.1);
+				lateral.push_back(-10.0 + 0.2 * i);
+			}
+			linear_placement_builder(file).add(gradient_curve, distance, lateral);
+
+			round_trip(file, "step_writer_fhwa.ifc");
+		}
+
+		// a generated model with many placements, see IfcLinearPlacement::Test2D for the helper pattern
+		TEST_METHOD(GeneratedModel_RoundTrip)
+		{
+			IfcHierarchyHelper<Schema> file;
+			auto project = file.addProject();
+			project->setName(std::string("StepWriter"));
+
+			aggregate_of<Schema::IfcCartesianPoint>::ptr points(new aggregate_of<Schema::IfcCartesianPoint>());
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 0.0, 0.0 }));
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 10000.0, 0.0 }));
+			points->push(new Schema::IfcCartesianPoint(std::vector<double>{ 20000.0, 10000.0 }));
+			auto curve = new Schema::IfcPolyline(points);
+			file.addEntity(curve);
+
+			std::vector<double> distance;
+			for (int i = 0; i < 20000; i++)
+				distance.push_back(0.6 * i + 1.0 / 3.0);
+			linear_placement_builder(file).add(curve, distance);
+
+			round_trip(file, "step_writer_generated.ifc");
+		}
+	};
+}